@@ -0,0 +1,317 @@
+/*
+ * ijkbench.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Headless decode-and-present benchmark of the player core: software
+ * decoding through ffpipeline_ffplay, the dummy vout and aout, frames
+ * presented as soon as they are decoded. Samples the player while it runs
+ * and writes one JSON report:
+ *
+ *   ijkbench [-o report.json] [-t seconds] [-p|-f|-c name=value]... <url>
+ *
+ *   -o   report file, stdout by default (the player logs there too)
+ *   -t   stop after this many seconds instead of at the end of the input
+ *   -i   sampling interval in milliseconds, 10 by default
+ *   -p   player option, e.g. -p overlay-format=fcc-rv32 -p video-convert-threads=4
+ *   -f   format option
+ *   -c   codec option
+ *   -v   keep the player's log level at info
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "ijkplayer/ff_ffplay.h"
+#include "ijkplayer/pipeline/ffpipeline_ffplay.h"
+#include "ijksdl/dummy/ijksdl_dummy.h"
+
+typedef struct BenchSample {
+    int64_t count;
+    int64_t sum;
+    int64_t max;
+} BenchSample;
+
+typedef struct BenchReport {
+    const char *url;
+    const char *result;
+    int         error;
+    double      elapsed;
+
+    int64_t     video_decoded_frames;
+    int64_t     video_dropped_frames;
+    int64_t     video_packet_wait_us;
+    int64_t     audio_decoded_frames;
+    int64_t     audio_packet_wait_us;
+
+    int64_t     convert_frames;
+    int64_t     convert_total_us;
+    int64_t     convert_max_us;
+
+    BenchSample frame_queue;
+    BenchSample video_cached_bytes;
+    BenchSample audio_cached_bytes;
+    BenchSample video_cached_packets;
+
+    long        max_rss_kb;
+} BenchReport;
+
+/* glibc before 2.38 has no strlcpy, which ijksdl uses */
+__attribute__((weak)) size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (size) {
+        size_t n = len < size ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+static void sample_add(BenchSample *s, int64_t value)
+{
+    s->count++;
+    s->sum += value;
+    if (value > s->max)
+        s->max = value;
+}
+
+static void sample_sample(FFPlayer *ffp, BenchReport *r)
+{
+    sample_add(&r->frame_queue,          ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_FRAME_QUEUE_FRAMES, 0));
+    sample_add(&r->video_cached_bytes,   ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_CACHED_BYTES, 0));
+    sample_add(&r->audio_cached_bytes,   ffp_get_property_int64(ffp, FFP_PROP_INT64_AUDIO_CACHED_BYTES, 0));
+    sample_add(&r->video_cached_packets, ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_CACHED_PACKETS, 0));
+}
+
+/* counters of the decoders, before the stream is closed */
+static void sample_totals(FFPlayer *ffp, BenchReport *r)
+{
+    r->video_decoded_frames = ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_DECODED_FRAMES, 0);
+    r->video_dropped_frames = ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_DROPPED_FRAMES, 0);
+    r->video_packet_wait_us = ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_PACKET_WAIT_US, 0);
+    r->audio_decoded_frames = ffp_get_property_int64(ffp, FFP_PROP_INT64_AUDIO_DECODED_FRAMES, 0);
+    r->audio_packet_wait_us = ffp_get_property_int64(ffp, FFP_PROP_INT64_AUDIO_PACKET_WAIT_US, 0);
+    r->convert_frames       = ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_CONVERTED_FRAMES, 0);
+    r->convert_total_us     = ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_CONVERT_TOTAL_TIME_US, 0);
+    r->convert_max_us       = ffp_get_property_int64(ffp, FFP_PROP_INT64_VIDEO_MAX_CONVERT_TIME_US, 0);
+}
+
+static double ratio(double num, double den)
+{
+    return den > 0 ? num / den : 0;
+}
+
+static void json_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(out, "\\u%04x", *str);
+        else
+            fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+static void json_sample(FILE *out, const char *name, const BenchSample *s, int last)
+{
+    fprintf(out, "    \"%s\": { \"avg\": %.2f, \"max\": %"PRId64" }%s\n",
+            name, ratio(s->sum, s->count), s->max, last ? "" : ",");
+}
+
+static void write_report(FILE *out, const BenchReport *r)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"url\": ");
+    json_string(out, r->url);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"result\": \"%s\",\n", r->result);
+    fprintf(out, "  \"error\": %d,\n", r->error);
+    fprintf(out, "  \"elapsed_s\": %.3f,\n", r->elapsed);
+    fprintf(out, "  \"video\": {\n");
+    fprintf(out, "    \"decoded_frames\": %"PRId64",\n", r->video_decoded_frames);
+    fprintf(out, "    \"decode_fps\": %.2f,\n", ratio(r->video_decoded_frames, r->elapsed));
+    fprintf(out, "    \"dropped_frames\": %"PRId64",\n", r->video_dropped_frames);
+    fprintf(out, "    \"packet_wait_ms\": %.3f,\n", r->video_packet_wait_us / 1000.0);
+    fprintf(out, "    \"packet_wait_us_per_frame\": %.2f,\n", ratio(r->video_packet_wait_us, r->video_decoded_frames));
+    fprintf(out, "    \"converted_frames\": %"PRId64",\n", r->convert_frames);
+    fprintf(out, "    \"convert_us_avg\": %.2f,\n", ratio(r->convert_total_us, r->convert_frames));
+    fprintf(out, "    \"convert_us_max\": %"PRId64",\n", r->convert_max_us);
+    json_sample(out, "frame_queue_frames", &r->frame_queue, 0);
+    json_sample(out, "cached_bytes", &r->video_cached_bytes, 0);
+    json_sample(out, "cached_packets", &r->video_cached_packets, 1);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"audio\": {\n");
+    fprintf(out, "    \"decoded_frames\": %"PRId64",\n", r->audio_decoded_frames);
+    fprintf(out, "    \"packet_wait_ms\": %.3f,\n", r->audio_packet_wait_us / 1000.0);
+    json_sample(out, "cached_bytes", &r->audio_cached_bytes, 1);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"memory\": {\n");
+    fprintf(out, "    \"max_rss_kb\": %ld\n", r->max_rss_kb);
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
+
+static int set_option(FFPlayer *ffp, int category, char *arg)
+{
+    char *value = strchr(arg, '=');
+
+    if (!value)
+        return -1;
+    *value++ = '\0';
+    ffp_set_option(ffp, category, arg, value);
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-o report.json] [-t seconds] [-i interval_ms] [-v] [-p|-f|-c name=value]... <url>\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    BenchReport  report = { 0 };
+    FFPlayer    *ffp;
+    FILE        *out = stdout;
+    const char  *out_path = NULL;
+    double       duration = 0;
+    int          interval_ms = 10;
+    int          verbose = 0;
+    int64_t      start;
+    int          opt;
+
+    ffp_global_init();
+    ffp = ffp_create();
+    if (!ffp)
+        return 1;
+
+    /* unthrottled, and no frame counted late against an audio clock that runs as fast */
+    ffp_set_option_int(ffp, FFP_OPT_CATEGORY_PLAYER, "present-unthrottled", 1);
+    ffp_set_option_int(ffp, FFP_OPT_CATEGORY_PLAYER, "framedrop", 0);
+    ffp_set_option_int(ffp, FFP_OPT_CATEGORY_PLAYER, "packet-buffering", 0);
+    ffp_set_option_int(ffp, FFP_OPT_CATEGORY_PLAYER, "start-on-prepared", 1);
+
+    while ((opt = getopt(argc, argv, "o:t:i:p:f:c:v")) != -1) {
+        switch (opt) {
+            case 'o': out_path = optarg; break;
+            case 't': duration = atof(optarg); break;
+            case 'i': interval_ms = atoi(optarg) > 0 ? atoi(optarg) : 10; break;
+            case 'v': verbose = 1; break;
+            case 'p':
+            case 'f':
+            case 'c':
+                if (set_option(ffp, opt == 'p' ? FFP_OPT_CATEGORY_PLAYER :
+                                    opt == 'f' ? FFP_OPT_CATEGORY_FORMAT : FFP_OPT_CATEGORY_CODEC, optarg) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    report.url    = argv[optind];
+    report.result = "error";
+
+    if (!verbose)
+        ffp_global_set_log_level(AV_LOG_ERROR);
+
+    ffp->vout     = SDL_VoutDummy_Create();
+    ffp->pipeline = ffpipeline_create_from_ffplay(ffp);
+    if (!ffp->vout || !ffp->pipeline)
+        return 1;
+
+    start = av_gettime_relative();
+    msg_queue_start(&ffp->msg_queue);
+    if (ffp_prepare_async_l(ffp, report.url) < 0) {
+        report.error = -1;
+        goto end;
+    }
+
+    for (;;) {
+        AVMessage msg;
+        int       done = 0;
+        int       ret;
+
+        while ((ret = msg_queue_get(&ffp->msg_queue, &msg, 0)) > 0) {
+            switch (msg.what) {
+                case FFP_MSG_COMPLETED:
+                    report.result = "completed";
+                    done = 1;
+                    break;
+                case FFP_MSG_ERROR:
+                    report.error = msg.arg1;
+                    done = 1;
+                    break;
+                default:
+                    break;
+            }
+            msg_free_res(&msg);
+        }
+        if (ret < 0 || done)
+            break;
+
+        sample_sample(ffp, &report);
+        if (duration > 0 && av_gettime_relative() - start >= duration * 1000000) {
+            report.result = "timeout";
+            break;
+        }
+        av_usleep(interval_ms * 1000);
+    }
+
+end:
+    report.elapsed = (av_gettime_relative() - start) / 1000000.0;
+    sample_totals(ffp, &report);
+
+    ffp_stop_l(ffp);
+    ffp_wait_stop_l(ffp);
+    ffp_destroy_p(&ffp);
+    ffp_global_uninit();
+
+    {
+        struct rusage usage;
+        if (!getrusage(RUSAGE_SELF, &usage))
+            report.max_rss_kb = usage.ru_maxrss;
+    }
+
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+    write_report(out, &report);
+    if (out != stdout)
+        fclose(out);
+
+    return strcmp(report.result, "error") ? 0 : 1;
+}
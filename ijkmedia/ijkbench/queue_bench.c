@@ -0,0 +1,148 @@
+/*
+ * queue_bench.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Packet queue microbenchmark: one producer, one consumer, the locked list
+ * against the spsc ring ("packet-queue-spsc"), with and without batched
+ * wakeups. Prints ops/s and the put to get latency percentiles.
+ *
+ *   make queue_bench && ./queue_bench [packets]
+ *
+ * The queue is static in ff_ffplay.c, which is built into this file the
+ * way ffmpeg's tests build the source they test.
+ */
+
+#include "ijkplayer/ff_ffplay.c"
+
+#define BENCH_PACKETS_DEFAULT   (1000 * 1000)
+
+typedef struct BenchContext {
+    PacketQueue q;
+    int64_t    *latency;
+    int         nb_latency;
+    int         nb_packets;
+} BenchContext;
+
+static uint8_t bench_payload[64];
+
+/* glibc before 2.38 has no strlcpy, which ijksdl uses */
+__attribute__((weak)) size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+
+    if (size) {
+        size_t n = len < size ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+static int bench_consumer(void *arg)
+{
+    BenchContext *c = arg;
+    AVPacket      pkt;
+    int           serial;
+
+    while (c->nb_latency < c->nb_packets) {
+        if (packet_queue_get(&c->q, &pkt, 1, &serial) < 0)
+            break;
+        if (pkt.data == flush_pkt.data)
+            continue;
+        /* eof marker */
+        if (!pkt.data)
+            break;
+        c->latency[c->nb_latency++] = av_gettime_relative() - pkt.pts;
+    }
+    return 0;
+}
+
+static int bench_cmp_int64(const void *a, const void *b)
+{
+    return FFDIFFSIGN(*(const int64_t *)a, *(const int64_t *)b);
+}
+
+/* wakeup_batch < 0 for the locked list */
+static void bench_run(const char *name, int nb_packets, int wakeup_batch)
+{
+    BenchContext c = {0};
+    SDL_Thread   consumer;
+    AVPacket     pkt;
+    int64_t      start, elapsed;
+    int          i;
+
+    c.nb_packets = nb_packets;
+    c.latency    = av_malloc_array(nb_packets, sizeof(int64_t));
+    if (!c.latency)
+        return;
+    if (wakeup_batch > 0)
+        packet_queue_init_spsc(&c.q, PACKET_QUEUE_SPSC_SIZE_DEFAULT, wakeup_batch);
+    else
+        packet_queue_init(&c.q);
+    packet_queue_start(&c.q);
+
+    SDL_CreateThreadEx(&consumer, bench_consumer, &c, "bench_consumer");
+    start = av_gettime_relative();
+    for (i = 0; i < nb_packets; i++) {
+        av_init_packet(&pkt);
+        pkt.data = bench_payload;
+        pkt.size = sizeof(bench_payload);
+        pkt.pts  = av_gettime_relative();
+        packet_queue_put(&c.q, &pkt);
+    }
+    /* releases a batch that is not full, as read_thread does when idle */
+    packet_queue_put_nullpacket(&c.q, 0);
+    SDL_WaitThread(&consumer, NULL);
+    elapsed = av_gettime_relative() - start;
+
+    if (c.nb_latency > 0) {
+        qsort(c.latency, c.nb_latency, sizeof(int64_t), bench_cmp_int64);
+        printf("%-8s: %9.0f ops/s, latency(us) p50=%"PRId64" p99=%"PRId64" p999=%"PRId64" max=%"PRId64"\n",
+               name, c.nb_latency * 1000000.0 / FFMAX(elapsed, 1),
+               c.latency[c.nb_latency / 2],
+               c.latency[(int64_t)c.nb_latency * 99 / 100],
+               c.latency[(int64_t)c.nb_latency * 999 / 1000],
+               c.latency[c.nb_latency - 1]);
+    }
+
+    packet_queue_abort(&c.q);
+    packet_queue_destroy(&c.q);
+    av_free(c.latency);
+}
+
+int main(int argc, char **argv)
+{
+    int nb_packets = argc > 1 ? atoi(argv[1]) : BENCH_PACKETS_DEFAULT;
+
+    if (nb_packets <= 0) {
+        fprintf(stderr, "usage: %s [packets]\n", argv[0]);
+        return 1;
+    }
+
+    ffp_global_init();
+    ffp_global_set_log_level(AV_LOG_QUIET);
+
+    bench_run("list", nb_packets, -1);
+    bench_run("spsc", nb_packets, 1);
+    bench_run("spsc-b4", nb_packets, PACKET_QUEUE_WAKEUP_BATCH_DEFAULT);
+
+    ffp_global_uninit();
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * record_stub.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Audio capture of AudioUnitRecordController.m for hosts without AudioUnit.
+ * Nothing is ever captured: an intercom started from ijkbench connects and
+ * sends no audio.
+ */
+
+#include "libavutil/time.h"
+#include "AudioUnitRecordController.h"
+
+void startRecord()
+{
+}
+
+void stopRecord()
+{
+}
+
+int getRecordFrameData(char *pcmData)
+{
+    return 0;
+}
+
+int getRecordFrameDataTimeout(char *pcmData, unsigned long long *ts, int timeout_ms)
+{
+    av_usleep(timeout_ms * 1000);
+    return 0;
+}
+
+int getRecordQueuedFrames(void)
+{
+    return 0;
+}
+
+unsigned long long getRecordClockUs(void)
+{
+    return av_gettime_relative();
+}
@@ -37,6 +37,10 @@ LOCAL_SRC_FILES += ff_cmdutils.c
 LOCAL_SRC_FILES += ff_ffplay.c
 LOCAL_SRC_FILES += ff_ffpipeline.c
 LOCAL_SRC_FILES += ff_ffpipenode.c
+LOCAL_SRC_FILES += ff_ffprobe_cache.c
+LOCAL_SRC_FILES += ff_ffbandwidth.c
+LOCAL_SRC_FILES += ff_ffrecorder.c
+LOCAL_SRC_FILES += ff_ffintercom.c
 LOCAL_SRC_FILES += ijkmeta.c
 LOCAL_SRC_FILES += ijkplayer.c
 
@@ -55,9 +59,12 @@ LOCAL_SRC_FILES += ijkavformat/ijklivehook.c
 LOCAL_SRC_FILES += ijkavformat/ijkmediadatasource.c
 
 LOCAL_SRC_FILES  += ijkavformat/ijkasync.c
+LOCAL_SRC_FILES  += ijkavformat/ijkdiskcache.c
+LOCAL_SRC_FILES  += ijkavformat/ijkconnpool.c
 LOCAL_SRC_FILES  += ijkavformat/ijkurlhook.c
 LOCAL_SRC_FILES  += ijkavformat/ijklongurl.c
 LOCAL_SRC_FILES  += ijkavformat/ijksegment.c
+LOCAL_SRC_FILES  += ijkavformat/ijkmmap.c
 
 LOCAL_SHARED_LIBRARIES := ijkffmpeg ijksdl
 LOCAL_STATIC_LIBRARIES := android-ndk-profiler
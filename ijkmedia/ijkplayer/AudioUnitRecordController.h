@@ -13,6 +13,21 @@ void startRecord();
 
 int getRecordFrameData(char *pcmData);
 
+/* 16kHz mono s16 in 10ms frames */
+#define RECORD_SAMPLE_RATE      16000
+#define RECORD_FRAME_BYTES      320
+
+/*
+ * Wait up to timeout_ms for a captured frame, return its length or 0 on timeout.
+ * ts is the capture time of its first sample, in microseconds of getRecordClockUs().
+ */
+int getRecordFrameDataTimeout(char *pcmData, unsigned long long *ts, int timeout_ms);
+
+/* frames captured but not read yet */
+int getRecordQueuedFrames(void);
+
+unsigned long long getRecordClockUs(void);
+
 void stopRecord();
 
 #endif /* AudioUnitRecordController_h */
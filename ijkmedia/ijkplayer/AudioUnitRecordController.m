@@ -8,6 +8,7 @@
 #import "AudioUnitRecordController.h"
 #import <AudioToolbox/AudioToolbox.h>
 #import <UIKit/UIKit.h>
+#include <sys/time.h>
 #include "ring_buffer.h"
 #define VQE_READY_ITEM_NUM      30
 
@@ -24,7 +25,24 @@
 #define kOutputBus 0
 #define kInputBus 1
 
-static pcm_ring_buffer *rbuf_vqe_ready;
+// 环形缓冲里每帧前面的头
+typedef struct {
+    USC_Time_t ts;
+    uint32_t   length;
+    uint32_t   reserved;
+} record_header;
+
+typedef struct {
+    record_header header;
+    char          pcm[RECORD_FRAME_BYTES];
+} record_item;
+
+// 采集回调写、读线程读，无锁；只在采集停止、读线程退出后 init/deinit
+static pcm_ring_buffer rbuf_vqe_ready;
+// 每写入一帧 signal 一次，读线程用它做超时等待
+static dispatch_semaphore_t rbuf_sem;
+// 增益在 startRecord 里算好，回调里不调 ObjC
+static int record_gain_shift;
 
 @interface AudioUnitRecordController :NSObject{
     AudioComponentInstance audioUnit;
@@ -51,12 +69,17 @@ void checkStatus(int status){
 
 #define TMP_MAX_BUF_LEN 1024
 
-#define MAX_BUF_LEN 2048
+// 回调一次最多的采样数，锁屏时是 4096
+#define MAX_RENDER_FRAMES 4096
+
+#define MAX_BUF_LEN (RECORD_FRAME_BYTES + MAX_RENDER_FRAMES * 2)
 
 static char tmp_buffer[TMP_MAX_BUF_LEN];
 
+// 直接渲染到不满一帧的剩余数据后面，回调里不分配内存
 static char audio_buffer[MAX_BUF_LEN];
 static int buffer_pos = 0;
+static record_item record_stage;
 /**
  This callback is called when new audio data from the microphone is
  available.
@@ -73,11 +96,14 @@ static OSStatus recordingCallback(void *inRefCon,
     // Samples are 16 bits = 2 bytes.
     // 1 frame includes only 1 sample
     
+    if (inNumberFrames * 2 > MAX_BUF_LEN - buffer_pos)
+        return noErr;
+
     AudioBuffer buffer;
     
     buffer.mNumberChannels = 1;
     buffer.mDataByteSize = inNumberFrames * 2;
-    buffer.mData = malloc( inNumberFrames * 2 );
+    buffer.mData = audio_buffer + buffer_pos;
     
     // Put buffer in a AudioBufferList
     AudioBufferList bufferList;
@@ -96,25 +122,25 @@ static OSStatus recordingCallback(void *inRefCon,
                              inNumberFrames,
                              &bufferList);
     checkStatus(status);
+    if (status)
+        return status;
+
+    // 本次回调第一个采样的采集时间
+    USC_Time_t host_us = (inTimeStamp->mFlags & kAudioTimeStampHostTimeValid) ?
+                         AudioConvertHostTimeToNanos(inTimeStamp->mHostTime) / 1000 :
+                         getRecordClockUs();
+    int first_pos = buffer_pos;
     
     // Now, we have the samples we just read sitting in buffers in bufferList
     // Process the new data
     //NSLog(@"record =============");
     //[iosAudio processAudio:&bufferList];
     
-//    for(int index = 0; index < inNumberFrames; index++)
-//    {
-//        //        if(last_dropped){
-//        audio_buffer[buffer_pos++] = tmp_buffer[index];
-//        //        }
-//        //        last_dropped = !last_dropped;
-//    }
-    memcpy(audio_buffer + buffer_pos, buffer.mData, buffer.mDataByteSize);
-    buffer_pos+=buffer.mDataByteSize;
+    buffer_pos += bufferList.mBuffers[0].mDataByteSize;
     
     int oldPos = 0;
     
-    while(buffer_pos >= 320){
+    while(buffer_pos >= RECORD_FRAME_BYTES){
         
         //        NSString * docsdir = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex:0];
         //        NSString *dataFilePath = [docsdir stringByAppendingPathComponent:@"rec.pcm"]; // 在指定目录下创建 文件夹
@@ -126,35 +152,36 @@ static OSStatus recordingCallback(void *inRefCon,
         //        }
 //        if(rec_cb != NULL)
 //            rec_cb(buffer + oldPos, dev->_period * 2);
-        if([[[UIDevice currentDevice] systemVersion] floatValue] >= 11.0){
-            short *tmpShort = (short *)(audio_buffer + oldPos);
+        short *src = (short *)(audio_buffer + oldPos);
+        short *dst = (short *)record_stage.pcm;
+        if (record_gain_shift) {
             int32_t tmp32;
-            for(int i = 0; i<160; i++){
-                tmp32 = ((int32_t)*tmpShort) << 3;
+            for(int i = 0; i < RECORD_FRAME_BYTES / 2; i++){
+                tmp32 = ((int32_t)src[i]) << record_gain_shift;
                 if (tmp32 > 32767) {
-                    *tmpShort = 32767;
+                    dst[i] = 32767;
                 } else if(tmp32 < -32768){
-                    *tmpShort = -32768;
+                    dst[i] = -32768;
                 }
                 else{
-                    *tmpShort = tmp32;
+                    dst[i] = tmp32;
                 }
-                tmpShort++;
             }
+        } else {
+            memcpy(dst, src, RECORD_FRAME_BYTES);
         }
-        ring_buffer_push(rbuf_vqe_ready, audio_buffer + oldPos, 320, 0);
+        record_stage.header.ts = host_us + (long long)(oldPos - first_pos) / 2 * 1000000 / RECORD_SAMPLE_RATE;
+        record_stage.header.length = RECORD_FRAME_BYTES;
+        // 满了就丢掉这一帧
+        if (ring_buffer_push(&rbuf_vqe_ready, &record_stage, sizeof(record_stage)) == RB_ERR_OK)
+            dispatch_semaphore_signal(rbuf_sem);
         
-        oldPos += 320;
-        buffer_pos -= 320;
+        oldPos += RECORD_FRAME_BYTES;
+        buffer_pos -= RECORD_FRAME_BYTES;
     }
     
     if(buffer_pos > 0)
         memmove(audio_buffer, audio_buffer+oldPos, buffer_pos);
-   // ring_buffer_push(rbuf_vqe_ready, bufferList.mBuffers[0].mData, bufferList.mBuffers[0].mDataByteSize, 0);
-
-    
-    // release the malloc'ed data in the buffer we created earlier
-    free(bufferList.mBuffers[0].mData);
     
     return noErr;
 }
@@ -366,9 +393,6 @@ static OSStatus playbackCallback(void *inRefCon,
     
     // copy incoming audio data to temporary buffer
     memcpy(tempBuffer.mData, bufferList->mBuffers[0].mData, bufferList->mBuffers[0].mDataByteSize);
-    NSLog(@"rbuf_vqe_ready = %p, tempBuffer.mDataByteSize = %d", rbuf_vqe_ready, (unsigned int)tempBuffer.mDataByteSize);
-    
-     //ring_buffer_push(rbuf_vqe_ready, tempBuffer.mData, tempBuffer.mDataByteSize, 0);
 }
 
 /**
@@ -383,8 +407,16 @@ static OSStatus playbackCallback(void *inRefCon,
 @end
 
 void startRecord(){
-    rbuf_vqe_ready = (pcm_ring_buffer *)malloc(sizeof(pcm_ring_buffer));
-    ring_buffer_init(rbuf_vqe_ready, VQE_READY_ITEM_NUM);
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        rbuf_sem = dispatch_semaphore_create(0);
+    });
+    // 上次没读完的计数
+    while (dispatch_semaphore_wait(rbuf_sem, DISPATCH_TIME_NOW) == 0)
+        ;
+    ring_buffer_init(&rbuf_vqe_ready, VQE_READY_ITEM_NUM * sizeof(record_item));
+    buffer_pos = 0;
+    record_gain_shift = [[[UIDevice currentDevice] systemVersion] floatValue] >= 11.0 ? 3 : 0;
     iosAudio = [[AudioUnitRecordController alloc] init];
     [iosAudio start];
 }
@@ -395,19 +427,47 @@ int getRecordFrameData(char *pcmData){
         return -1;
     }
     
-    item_data *item = ring_buffer_peek(rbuf_vqe_ready);
-    if(item != NULL) {
-        memcpy(pcmData , item->buffer, item->length);
-        ring_buffer_pop(rbuf_vqe_ready);
-        return item->length;
-    }
-    return 0;
+    return getRecordFrameDataTimeout(pcmData, NULL, 0);
 }
 
+int getRecordFrameDataTimeout(char *pcmData, unsigned long long *ts, int timeout_ms){
+    record_header header;
+    ring_buffer_span span;
+
+    if(pcmData == NULL)
+        return -1;
+    if (!rbuf_vqe_ready.buffer)
+        return 0;
+
+    // 一次 signal 对应一帧，等到了就一定能读到
+    if (dispatch_semaphore_wait(rbuf_sem, timeout_ms > 0 ?
+                                dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeout_ms * NSEC_PER_MSEC) :
+                                DISPATCH_TIME_NOW) != 0)
+        return 0;
+    if (ring_buffer_peek(&rbuf_vqe_ready, &header, sizeof(header)) != RB_ERR_OK)
+        return 0;
+
+    ring_buffer_read_commit(&rbuf_vqe_ready, sizeof(header));
+    ring_buffer_read_reserve(&rbuf_vqe_ready, sizeof(record_item) - sizeof(header), &span);
+    memcpy(pcmData, span.data[0], min(span.length[0], header.length));
+    if (span.length[0] < header.length)
+        memcpy(pcmData + span.length[0], span.data[1], header.length - span.length[0]);
+    ring_buffer_read_commit(&rbuf_vqe_ready, sizeof(record_item) - sizeof(header));
+    if (ts)
+        *ts = header.ts;
+    return header.length;
+}
+
+int getRecordQueuedFrames(void){
+    return (int)(ring_buffer_available(&rbuf_vqe_ready) / sizeof(record_item));
+}
+
+unsigned long long getRecordClockUs(void){
+    return AudioConvertHostTimeToNanos(AudioGetCurrentHostTime()) / 1000;
+}
+
+// AudioOutputUnitStop 返回后回调不会再进来，调用方要先停掉读线程
 void stopRecord(){
     [iosAudio stop];
-    ring_buffer_deinit(rbuf_vqe_ready);
-    free(rbuf_vqe_ready);
-    rbuf_vqe_ready = NULL;
+    ring_buffer_deinit(&rbuf_vqe_ready);
 }
-
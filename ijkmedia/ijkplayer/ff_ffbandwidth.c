@@ -0,0 +1,84 @@
+/*
+ * ff_ffbandwidth.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "ff_ffbandwidth.h"
+#include <math.h>
+#include <string.h>
+
+void ffp_bandwidth_init(FFBandwidthEstimator *bw)
+{
+    memset(bw, 0, sizeof(*bw));
+    bw->mutex = SDL_CreateMutex();
+}
+
+void ffp_bandwidth_destroy(FFBandwidthEstimator *bw)
+{
+    SDL_DestroyMutexP(&bw->mutex);
+}
+
+void ffp_bandwidth_reset(FFBandwidthEstimator *bw)
+{
+    SDL_LockMutex(bw->mutex);
+    bw->mean       = 0;
+    bw->variance   = 0;
+    bw->nb_samples = 0;
+    SDL_UnlockMutex(bw->mutex);
+}
+
+void ffp_bandwidth_add_sample(FFBandwidthEstimator *bw, int64_t bytes, int64_t elapsed_ms, int is_full_speed)
+{
+    double speed;
+    double alpha;
+    double delta;
+
+    if (bytes <= 0 || elapsed_ms <= 0)
+        return;
+
+    speed = bytes * 1000.0 / elapsed_ms;
+    alpha = 1.0 - exp2(-elapsed_ms / (FFP_BANDWIDTH_HALF_LIFE * 1000.0));
+
+    SDL_LockMutex(bw->mutex);
+    if (bw->nb_samples == 0) {
+        /* a lower bound alone says nothing about the variance */
+        bw->mean       = speed;
+        bw->variance   = 0;
+        bw->nb_samples = is_full_speed ? 1 : 0;
+    } else if (is_full_speed || speed > bw->mean) {
+        delta          = speed - bw->mean;
+        bw->mean      += alpha * delta;
+        bw->variance   = (1.0 - alpha) * (bw->variance + alpha * delta * delta);
+        bw->nb_samples++;
+    }
+    SDL_UnlockMutex(bw->mutex);
+}
+
+int ffp_bandwidth_get(FFBandwidthEstimator *bw, int64_t *mean, int64_t *deviation)
+{
+    int nb_samples;
+
+    SDL_LockMutex(bw->mutex);
+    nb_samples = bw->nb_samples;
+    if (mean)
+        *mean = (int64_t)bw->mean;
+    if (deviation)
+        *deviation = (int64_t)sqrt(bw->variance);
+    SDL_UnlockMutex(bw->mutex);
+    return nb_samples;
+}
@@ -0,0 +1,58 @@
+/*
+ * ff_ffbandwidth.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFPLAY__FF_FFBANDWIDTH_H
+#define FFPLAY__FF_FFBANDWIDTH_H
+
+#include <stdint.h>
+#include "ijksdl/ijksdl_mutex.h"
+
+/* seconds of samples after which the weight of older ones is halved */
+#define FFP_BANDWIDTH_HALF_LIFE         (4.0)
+/* samples needed before the estimate is used */
+#define FFP_BANDWIDTH_MIN_SAMPLES       (3)
+
+/*
+ * Network throughput, as an exponentially weighted mean and variance of
+ * speed samples. Each sample weighs by its duration, so one long transfer
+ * counts as much as the short ones it is made of.
+ *
+ * A sample taken while the reader was throttled by a full buffer only says
+ * the network is at least that fast: it raises the mean, never lowers it.
+ * Samples come from io threads, the estimate is read by the read thread.
+ */
+typedef struct FFBandwidthEstimator {
+    SDL_mutex *mutex;
+
+    double     mean;            /* bytes per second */
+    double     variance;
+    int        nb_samples;
+} FFBandwidthEstimator;
+
+void ffp_bandwidth_init(FFBandwidthEstimator *bw);
+void ffp_bandwidth_destroy(FFBandwidthEstimator *bw);
+void ffp_bandwidth_reset(FFBandwidthEstimator *bw);
+
+void ffp_bandwidth_add_sample(FFBandwidthEstimator *bw, int64_t bytes, int64_t elapsed_ms, int is_full_speed);
+
+/* return the number of samples, mean and standard deviation in bytes per second */
+int  ffp_bandwidth_get(FFBandwidthEstimator *bw, int64_t *mean, int64_t *deviation);
+
+#endif
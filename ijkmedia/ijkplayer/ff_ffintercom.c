@@ -0,0 +1,554 @@
+/*
+ * ff_ffintercom.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "ff_ffintercom.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "libavcodec/avcodec.h"
+#include "libavutil/channel_layout.h"
+#include "ijksdl/ijksdl_mutex.h"
+#include "ijksdl/ijksdl_thread.h"
+#include "AudioUnitRecordController.h"
+
+#define INTERCOM_HEADER_SIZE        8       /* int32 audio type, int32 payload size */
+#define INTERCOM_WAIT_MS            20
+#define INTERCOM_CONNECT_TIMEOUT_MS 5000
+#define INTERCOM_SEND_TIMEOUT_MS    5000
+#define INTERCOM_PCM_FRAME_SAMPLES  (RECORD_FRAME_BYTES / 2)
+
+/* never block in send(), the fd may be the app's and stay blocking */
+#ifdef MSG_NOSIGNAL
+#define INTERCOM_SEND_FLAGS         (MSG_NOSIGNAL | MSG_DONTWAIT)
+#else
+#define INTERCOM_SEND_FLAGS         MSG_DONTWAIT
+#endif
+
+struct FFIntercom {
+    char               *addr;
+    int                 port;
+    int                 fd;
+    int                 own_fd;
+    int                 codec;
+    int                 bit_rate;
+    int64_t             batch_duration;     /* microseconds */
+
+    SDL_Thread         *tid;
+    SDL_Thread          _tid;
+    int                 abort_request;
+    int                 capture_stopped;
+    void              (*on_error)(void *opaque, int error);
+    void               *opaque;
+
+    SDL_mutex          *mutex;
+    FFIntercomStat      stat;               /* guarded by mutex */
+
+    /* intercom thread only */
+    AVCodecContext     *avctx;              /* NULL for pcm */
+    AVFrame            *frame;
+    int                 frame_samples;
+    int                 frame_fill;
+    int64_t             frame_ts;           /* capture time of the first sample in frame */
+    int64_t             last_pts;
+    uint8_t            *batch;
+    int                 batch_size;
+    int                 batch_capacity;
+    int                 batch_frames;
+    int64_t             batch_samples;
+    int64_t             batch_ts;           /* capture time of the oldest sample in batch */
+    int64_t             socket_queued;
+};
+
+/* the capture buffer is a singleton */
+static int intercom_capturing;
+
+static int64_t socket_queued_bytes(int fd)
+{
+    int n = 0;
+#if defined(SO_NWRITE)
+    socklen_t len = sizeof(n);
+    if (getsockopt(fd, SOL_SOCKET, SO_NWRITE, &n, &len) < 0)
+        return 0;
+#elif defined(__linux__) && defined(TIOCOUTQ)
+    if (ioctl(fd, TIOCOUTQ, &n) < 0)
+        return 0;
+#endif
+    return n;
+}
+
+/*
+ * wait for events on fd in INTERCOM_WAIT_MS steps, so that an abort is seen
+ * return > 0 when ready, AVERROR(ETIMEDOUT) past timeout_ms, AVERROR_EXIT on abort
+ */
+static int intercom_poll(FFIntercom *ic, int fd, short events, int timeout_ms)
+{
+    struct pollfd pfd = { fd, events, 0 };
+    int           waited, ret;
+
+    for (waited = 0; waited < timeout_ms; waited += INTERCOM_WAIT_MS) {
+        if (__atomic_load_n(&ic->abort_request, __ATOMIC_ACQUIRE))
+            return AVERROR_EXIT;
+        ret = poll(&pfd, 1, INTERCOM_WAIT_MS);
+        if (ret > 0)
+            return ret;
+        if (ret < 0 && errno != EINTR)
+            return AVERROR(errno);
+    }
+    return AVERROR(ETIMEDOUT);
+}
+
+static int intercom_connect(FFIntercom *ic)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(int);
+    int fd, ret, flags, error = 0;
+    int on = 1;
+
+    if (ic->fd >= 0)
+        return 0;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return AVERROR(errno);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(ic->port);
+    addr.sin_addr.s_addr = inet_addr(ic->addr);
+
+    /* connect without blocking, ffp_intercom_freep() must not wait for it */
+    flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ret = errno == EINPROGRESS ? intercom_poll(ic, fd, POLLOUT, INTERCOM_CONNECT_TIMEOUT_MS) : AVERROR(errno);
+        if (ret > 0)
+            ret = getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 ? AVERROR(errno) : AVERROR(error);
+        if (ret < 0) {
+            close(fd);
+            return ret;
+        }
+    }
+    fcntl(fd, F_SETFL, flags);
+
+    /* frames are coalesced here already */
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    SDL_LockMutex(ic->mutex);
+    ic->fd     = fd;
+    ic->own_fd = 1;
+    SDL_UnlockMutex(ic->mutex);
+    return 0;
+}
+
+static enum AVSampleFormat pick_sample_fmt(const AVCodec *codec)
+{
+    static const enum AVSampleFormat preferred[] = { AV_SAMPLE_FMT_S16, AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_FLT };
+    const enum AVSampleFormat *p;
+    int i;
+
+    if (!codec->sample_fmts)
+        return AV_SAMPLE_FMT_S16;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(preferred); i++) {
+        for (p = codec->sample_fmts; *p != AV_SAMPLE_FMT_NONE; p++) {
+            if (*p == preferred[i])
+                return *p;
+        }
+    }
+    return AV_SAMPLE_FMT_NONE;
+}
+
+static int intercom_open_encoder(FFIntercom *ic)
+{
+    AVCodec *codec = NULL;
+    int ret;
+
+    if (ic->codec == FFP_INTERCOM_CODEC_PCM) {
+        ic->frame_samples = INTERCOM_PCM_FRAME_SAMPLES;
+    } else {
+        if (ic->codec == FFP_INTERCOM_CODEC_OPUS) {
+            codec = avcodec_find_encoder_by_name("libopus");
+            if (!codec)
+                codec = avcodec_find_encoder(AV_CODEC_ID_OPUS);
+        } else {
+            codec = avcodec_find_encoder_by_name("libfdk_aac");
+            if (!codec)
+                codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+        }
+        if (!codec)
+            return AVERROR_ENCODER_NOT_FOUND;
+
+        ic->avctx = avcodec_alloc_context3(codec);
+        if (!ic->avctx)
+            return AVERROR(ENOMEM);
+
+        ic->avctx->sample_fmt     = pick_sample_fmt(codec);
+        ic->avctx->sample_rate    = RECORD_SAMPLE_RATE;
+        ic->avctx->channel_layout = AV_CH_LAYOUT_MONO;
+        ic->avctx->channels       = 1;
+        ic->avctx->bit_rate       = ic->bit_rate;
+        ic->avctx->time_base      = (AVRational){1, RECORD_SAMPLE_RATE};
+        if (ic->avctx->sample_fmt == AV_SAMPLE_FMT_NONE)
+            return AVERROR(ENOSYS);
+
+        ret = avcodec_open2(ic->avctx, codec, NULL);
+        if (ret < 0)
+            return ret;
+        ic->frame_samples = ic->avctx->frame_size > 0 ? ic->avctx->frame_size : INTERCOM_PCM_FRAME_SAMPLES * 2;
+    }
+
+    ic->frame = av_frame_alloc();
+    if (!ic->frame)
+        return AVERROR(ENOMEM);
+    ic->frame->nb_samples     = ic->frame_samples;
+    ic->frame->format         = ic->avctx ? ic->avctx->sample_fmt : AV_SAMPLE_FMT_S16;
+    ic->frame->channel_layout = AV_CH_LAYOUT_MONO;
+    ic->frame->sample_rate    = RECORD_SAMPLE_RATE;
+    return av_frame_get_buffer(ic->frame, 0);
+}
+
+static int intercom_flush(FFIntercom *ic)
+{
+    int64_t latency;
+    int     sent = 0;
+
+    while (sent < ic->batch_size) {
+        ssize_t n = send(ic->fd, ic->batch + sent, ic->batch_size - sent, INTERCOM_SEND_FLAGS);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return AVERROR(errno);
+            /* a peer not reading for INTERCOM_SEND_TIMEOUT_MS is gone */
+            n = intercom_poll(ic, ic->fd, POLLOUT, INTERCOM_SEND_TIMEOUT_MS);
+            if (n < 0)
+                return (int)n;
+            continue;
+        }
+        sent += n;
+    }
+
+    latency = (int64_t)getRecordClockUs() - ic->batch_ts;
+    ic->socket_queued = socket_queued_bytes(ic->fd);
+
+    SDL_LockMutex(ic->mutex);
+    ic->stat.last_latency_us  = latency;
+    ic->stat.max_latency_us   = FFMAX(ic->stat.max_latency_us, latency);
+    ic->stat.send_queue_bytes = ic->socket_queued;
+    ic->stat.sent_frames     += ic->batch_frames;
+    ic->stat.sent_bytes      += ic->batch_size;
+    ic->stat.send_calls++;
+    SDL_UnlockMutex(ic->mutex);
+
+    ic->batch_size    = 0;
+    ic->batch_frames  = 0;
+    ic->batch_samples = 0;
+    ic->batch_ts      = AV_NOPTS_VALUE;
+    return 0;
+}
+
+static int intercom_append(FFIntercom *ic, const uint8_t *data, int size, int64_t ts, int64_t nb_samples)
+{
+    int32_t header[2] = { ic->codec, size };
+    int     needed    = ic->batch_size + INTERCOM_HEADER_SIZE + size;
+    int     ret;
+
+    if (needed > ic->batch_capacity) {
+        ret = av_reallocp(&ic->batch, needed * 2);
+        if (ret < 0)
+            return ret;
+        ic->batch_capacity = needed * 2;
+    }
+
+    memcpy(ic->batch + ic->batch_size, header, INTERCOM_HEADER_SIZE);
+    memcpy(ic->batch + ic->batch_size + INTERCOM_HEADER_SIZE, data, size);
+    if (!ic->batch_size)
+        ic->batch_ts = ts;
+    ic->batch_size    = needed;
+    ic->batch_frames++;
+    ic->batch_samples += nb_samples;
+
+    if (ic->batch_samples * 1000000 / RECORD_SAMPLE_RATE >= ic->batch_duration)
+        return intercom_flush(ic);
+
+    SDL_LockMutex(ic->mutex);
+    ic->stat.send_queue_bytes = ic->batch_size + ic->socket_queued;
+    SDL_UnlockMutex(ic->mutex);
+    return 0;
+}
+
+/* frame is NULL to drain the encoder */
+static int intercom_encode(FFIntercom *ic, AVFrame *frame)
+{
+    AVPacket pkt;
+    int ret;
+
+    if (!ic->avctx) {
+        if (!frame)
+            return 0;
+        return intercom_append(ic, frame->data[0], ic->frame_samples * 2, ic->frame_ts, ic->frame_samples);
+    }
+
+    if (frame) {
+        /* keep capture timestamps, but never let clock jitter reorder frames */
+        int64_t pts = av_rescale(ic->frame_ts, RECORD_SAMPLE_RATE, 1000000);
+        if (ic->last_pts != AV_NOPTS_VALUE)
+            pts = FFMAX(pts, ic->last_pts + frame->nb_samples);
+        frame->pts   = pts;
+        ic->last_pts = pts;
+    }
+
+    ret = avcodec_send_frame(ic->avctx, frame);
+    if (ret < 0)
+        return ret;
+
+    for (;;) {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+
+        ret = avcodec_receive_packet(ic->avctx, &pkt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return 0;
+        if (ret < 0)
+            return ret;
+
+        ret = intercom_append(ic, pkt.data, pkt.size,
+                              pkt.pts != AV_NOPTS_VALUE ? av_rescale(pkt.pts, 1000000, RECORD_SAMPLE_RATE) : ic->frame_ts,
+                              pkt.duration > 0 ? pkt.duration : ic->frame_samples);
+        av_packet_unref(&pkt);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+static void write_samples(AVFrame *frame, int offset, const int16_t *src, int nb_samples)
+{
+    int i;
+
+    if (frame->format == AV_SAMPLE_FMT_S16) {
+        memcpy((int16_t *)frame->data[0] + offset, src, nb_samples * sizeof(int16_t));
+    } else {
+        /* mono, planar and packed float are the same */
+        float *dst = (float *)frame->data[0] + offset;
+        for (i = 0; i < nb_samples; i++)
+            dst[i] = src[i] * (1.0f / 32768.0f);
+    }
+}
+
+static int intercom_feed(FFIntercom *ic, const uint8_t *data, int size, int64_t ts)
+{
+    const int16_t *src        = (const int16_t *)data;
+    int            nb_samples = size / 2;
+    int            ret;
+
+    while (nb_samples > 0) {
+        int n = FFMIN(nb_samples, ic->frame_samples - ic->frame_fill);
+
+        if (!ic->frame_fill) {
+            /* the encoder may still hold the previous frame */
+            ret = av_frame_make_writable(ic->frame);
+            if (ret < 0)
+                return ret;
+            ic->frame_ts = ts;
+        }
+
+        write_samples(ic->frame, ic->frame_fill, src, n);
+        ic->frame_fill += n;
+        src            += n;
+        nb_samples     -= n;
+        ts             += (int64_t)n * 1000000 / RECORD_SAMPLE_RATE;
+
+        if (ic->frame_fill == ic->frame_samples) {
+            ic->frame_fill = 0;
+            ret = intercom_encode(ic, ic->frame);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    return 0;
+}
+
+/* by the intercom thread once it stops reading, else by ffp_intercom_freep() */
+static void intercom_stop_capture(FFIntercom *ic)
+{
+    if (!__atomic_exchange_n(&ic->capture_stopped, 1, __ATOMIC_ACQ_REL))
+        stopRecord();
+}
+
+static int intercom_fail(FFIntercom *ic, int error)
+{
+    intercom_stop_capture(ic);
+    /* failed because ffp_intercom_freep() ended it, nothing to report */
+    if (__atomic_load_n(&ic->abort_request, __ATOMIC_ACQUIRE))
+        return 0;
+    if (ic->on_error)
+        ic->on_error(ic->opaque, error);
+    return 0;
+}
+
+static int intercom_thread(void *arg)
+{
+    FFIntercom        *ic = arg;
+    char               pcm[RECORD_FRAME_BYTES];
+    unsigned long long ts;
+    int                len, ret;
+
+    ret = intercom_connect(ic);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "intercom: failed to connect %s:%d: %s\n", ic->addr, ic->port, av_err2str(ret));
+        return intercom_fail(ic, ret);
+    }
+
+    ret = intercom_open_encoder(ic);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "intercom: failed to open encoder %d: %s\n", ic->codec, av_err2str(ret));
+        return intercom_fail(ic, ret);
+    }
+
+    while (!__atomic_load_n(&ic->abort_request, __ATOMIC_ACQUIRE)) {
+        len = getRecordFrameDataTimeout(pcm, &ts, INTERCOM_WAIT_MS);
+
+        SDL_LockMutex(ic->mutex);
+        ic->stat.capture_queued_frames = getRecordQueuedFrames();
+        SDL_UnlockMutex(ic->mutex);
+
+        if (len <= 0)
+            continue;
+
+        ret = intercom_feed(ic, (const uint8_t *)pcm, len, ts);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "intercom: %s\n", av_err2str(ret));
+            return intercom_fail(ic, ret);
+        }
+    }
+
+    /* send what the encoder still holds, a partial frame is dropped */
+    if (intercom_encode(ic, NULL) >= 0 && ic->batch_size)
+        intercom_flush(ic);
+    return 0;
+}
+
+FFIntercom *ffp_intercom_create(const FFIntercomConfig *config)
+{
+    FFIntercom *ic;
+
+    if (!config || (config->fd < 0 && !config->addr))
+        return NULL;
+
+    if (__atomic_exchange_n(&intercom_capturing, 1, __ATOMIC_ACQ_REL)) {
+        av_log(NULL, AV_LOG_WARNING, "intercom: already running\n");
+        return NULL;
+    }
+
+    ic = av_mallocz(sizeof(FFIntercom));
+    if (!ic)
+        goto fail;
+
+    ic->fd             = config->fd;
+    ic->port           = config->port;
+    ic->codec          = config->codec;
+    ic->bit_rate       = config->bit_rate > 0 ? config->bit_rate : FFP_INTERCOM_BIT_RATE_DEFAULT;
+    ic->batch_duration = av_clip(config->batch_ms, 0, FFP_INTERCOM_BATCH_MS_MAX) * 1000;
+    ic->last_pts       = AV_NOPTS_VALUE;
+    ic->batch_ts       = AV_NOPTS_VALUE;
+    ic->on_error       = config->on_error;
+    ic->opaque         = config->opaque;
+    if (ic->codec != FFP_INTERCOM_CODEC_PCM && ic->codec != FFP_INTERCOM_CODEC_OPUS)
+        ic->codec = FFP_INTERCOM_CODEC_AAC;
+
+    ic->mutex = SDL_CreateMutex();
+    if (!ic->mutex)
+        goto fail;
+    if (config->fd < 0) {
+        ic->addr = av_strdup(config->addr);
+        if (!ic->addr)
+            goto fail;
+    }
+
+    startRecord();
+    ic->tid = SDL_CreateThreadEx(&ic->_tid, intercom_thread, ic, "ff_intercom");
+    if (!ic->tid) {
+        stopRecord();
+        goto fail;
+    }
+
+    return ic;
+fail:
+    if (ic) {
+        SDL_DestroyMutexP(&ic->mutex);
+        av_freep(&ic->addr);
+        av_free(ic);
+    }
+    __atomic_store_n(&intercom_capturing, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void ffp_intercom_freep(FFIntercom **pic)
+{
+    FFIntercom *ic;
+
+    if (!pic || !*pic)
+        return;
+
+    ic = *pic;
+    __atomic_store_n(&ic->abort_request, 1, __ATOMIC_RELEASE);
+    /* a connection of our own is not needed past this point, end it at once */
+    SDL_LockMutex(ic->mutex);
+    if (ic->own_fd)
+        shutdown(ic->fd, SHUT_RDWR);
+    SDL_UnlockMutex(ic->mutex);
+    SDL_WaitThread(ic->tid, NULL);
+    intercom_stop_capture(ic);
+    __atomic_store_n(&intercom_capturing, 0, __ATOMIC_RELEASE);
+
+    if (ic->own_fd)
+        close(ic->fd);
+    avcodec_free_context(&ic->avctx);
+    av_frame_free(&ic->frame);
+    av_freep(&ic->batch);
+    av_freep(&ic->addr);
+    SDL_DestroyMutexP(&ic->mutex);
+    av_freep(pic);
+}
+
+void ffp_intercom_get_stat(FFIntercom *ic, FFIntercomStat *stat)
+{
+    if (!ic) {
+        memset(stat, 0, sizeof(FFIntercomStat));
+        return;
+    }
+
+    SDL_LockMutex(ic->mutex);
+    *stat = ic->stat;
+    SDL_UnlockMutex(ic->mutex);
+}
@@ -0,0 +1,76 @@
+/*
+ * ff_ffintercom.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFPLAY__FF_FFINTERCOM_H
+#define FFPLAY__FF_FFINTERCOM_H
+
+#include <stdint.h>
+
+/* also the audio type in the header of each frame sent */
+#define FFP_INTERCOM_CODEC_PCM          1   /* s16le, 16kHz mono */
+#define FFP_INTERCOM_CODEC_AAC          2   /* libfdk_aac, or the native encoder */
+#define FFP_INTERCOM_CODEC_OPUS         3
+
+#define FFP_INTERCOM_BIT_RATE_DEFAULT   64000
+#define FFP_INTERCOM_BATCH_MS_DEFAULT   40
+#define FFP_INTERCOM_BATCH_MS_MAX       500
+
+typedef struct FFIntercomConfig {
+    const char *addr;               /* connect to addr:port if fd < 0 */
+    int         port;
+    int         fd;                 /* connected socket, left open */
+    int         codec;              /* FFP_INTERCOM_CODEC_* */
+    int         bit_rate;
+    int         batch_ms;           /* audio coalesced into one send(), 0 sends each frame */
+
+    /*
+     * called on the intercom thread when it gives up on an error, once
+     * capture is stopped, ffp_intercom_freep() is still needed
+     */
+    void      (*on_error)(void *opaque, int error);
+    void       *opaque;
+} FFIntercomConfig;
+
+typedef struct FFIntercomStat {
+    int64_t last_latency_us;        /* capture of the oldest sample to send() */
+    int64_t max_latency_us;
+    int64_t capture_queued_frames;  /* captured, not encoded yet */
+    int64_t send_queue_bytes;       /* batched, plus unsent in the socket where known */
+    int64_t sent_frames;
+    int64_t sent_bytes;
+    int64_t send_calls;
+} FFIntercomStat;
+
+typedef struct FFIntercom FFIntercom;
+
+/*
+ * Start capturing, encoding and sending on one thread.
+ * The thread blocks on the capture buffer while there is nothing to encode.
+ */
+FFIntercom *ffp_intercom_create(const FFIntercomConfig *config);
+
+/*
+ * Send what is left, stop capturing and join the thread.
+ */
+void ffp_intercom_freep(FFIntercom **pic);
+
+void ffp_intercom_get_stat(FFIntercom *ic, FFIntercomStat *stat);
+
+#endif
@@ -43,6 +43,8 @@
 #define FFP_MSG_TIMED_TEXT                  800
 
 #define FFP_MSG_VIDEO_DECODER_OPEN          10001
+#define FFP_MSG_CACHED_PACKETS_DROPPED      10002   /* arg1 = dropped duration in milliseconds, arg2 = dropped packets */
+#define FFP_MSG_INTERCOM_ERROR              10003   /* arg1 = error, capture is stopped */
 
 #define FFP_REQ_START                       20001
 #define FFP_REQ_PAUSE                       20002
@@ -80,4 +82,31 @@
 #define FFP_PROP_INT64_ASYNC_STATISTIC_BUF_CAPACITY     20203
 
 #define FFP_PROP_INT64_LATEST_SEEK_LOAD_DURATION               20300
+
+#define FFP_PROP_INT64_PACKET_NODE_ALLOC_COUNT          20400
+#define FFP_PROP_INT64_PACKET_NODE_RECYCLE_COUNT        20401
+
+#define FFP_PROP_INT64_RECORD_QUEUED_BYTES              20410
+#define FFP_PROP_INT64_RECORD_WRITE_LATENCY_US          20411
+#define FFP_PROP_INT64_RECORD_MAX_WRITE_LATENCY_US      20412
+#define FFP_PROP_INT64_RECORD_DROPPED_GOPS              20413
+#define FFP_PROP_INT64_RECORD_SEGMENTS                  20414
+#define FFP_PROP_INT64_RECORD_SEGMENTS_BYTES            20415
+
+#define FFP_PROP_INT64_INTERCOM_LATENCY_US              20420
+#define FFP_PROP_INT64_INTERCOM_MAX_LATENCY_US          20421
+#define FFP_PROP_INT64_INTERCOM_CAPTURE_QUEUED_FRAMES   20422
+#define FFP_PROP_INT64_INTERCOM_SEND_QUEUE_BYTES        20423
+
+#define FFP_PROP_INT64_VIDEO_CONVERT_TIME_US            20430
+#define FFP_PROP_INT64_VIDEO_MAX_CONVERT_TIME_US        20431
+
+#define FFP_PROP_INT64_VIDEO_DECODED_FRAMES             20440
+#define FFP_PROP_INT64_VIDEO_DROPPED_FRAMES             20441
+#define FFP_PROP_INT64_VIDEO_FRAME_QUEUE_FRAMES         20442
+#define FFP_PROP_INT64_VIDEO_PACKET_WAIT_US             20443
+#define FFP_PROP_INT64_AUDIO_DECODED_FRAMES             20444
+#define FFP_PROP_INT64_AUDIO_PACKET_WAIT_US             20445
+#define FFP_PROP_INT64_VIDEO_CONVERT_TOTAL_TIME_US      20446
+#define FFP_PROP_INT64_VIDEO_CONVERTED_FRAMES           20447
 #endif
@@ -46,6 +46,7 @@
 #include "libavutil/samplefmt.h"
 #include "libavutil/avassert.h"
 #include "libavutil/time.h"
+#include "libavutil/cpu.h"
 #include "libavformat/avformat.h"
 #if CONFIG_AVDEVICE
 #include "libavdevice/avdevice.h"
@@ -64,6 +65,7 @@
 
 #include "ijksdl/ijksdl_log.h"
 #include "ijkavformat/ijkavformat.h"
+#include "ijkavformat/ijksegment.h"
 #include "ff_cmdutils.h"
 #include "ff_fferror.h"
 #include "ff_ffpipeline.h"
@@ -76,9 +78,6 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include "AudioUnitRecordController.h"
-
-static int audio_record_start = 0;
 
 #ifndef AV_CODEC_FLAG2_FAST
 #define AV_CODEC_FLAG2_FAST CODEC_FLAG2_FAST
@@ -105,24 +104,10 @@ static int audio_record_start = 0;
 
 #define FFP_BUF_MSG_PERIOD (3)
 
-#define MAX_RECORD_CACHE 250
-
 // static const AVOption ffp_context_options[] = ...
 #include "ff_ffplay_options.h"
 
 static AVPacket flush_pkt;
-typedef struct RECORD_PACKET{
-    AVPacket *recordPkt;
-}RECORD_PACKET;
-
-typedef struct RECORD_CACHE_QUEUE{
-    RECORD_PACKET rePkt[MAX_RECORD_CACHE];
-    int readIndex;
-    int writeIndex;
-    int max_size;
-}RECORD_CACHE_QUEUE;
-
-static RECORD_CACHE_QUEUE recorQueue;
 
 #if CONFIG_AVFILTER
 // FFP_MERGE: opt_add_vfilter
@@ -156,6 +141,103 @@ int64_t get_valid_channel_layout(int64_t channel_layout, int channels)
 
 static void free_picture(Frame *vp);
 
+static int packet_queue_grow_slab(PacketQueue *q)
+{
+    MyAVPacketSlab *slab = av_malloc(sizeof(MyAVPacketSlab));
+    int i;
+
+    if (!slab)
+        return AVERROR(ENOMEM);
+
+    q->alloc_count++;
+    slab->next = q->slab_list;
+    q->slab_list = slab;
+    for (i = PACKET_QUEUE_SLAB_NODES - 1; i >= 0; i--) {
+        slab->nodes[i].next = q->recycle_pkt;
+        q->recycle_pkt = &slab->nodes[i];
+    }
+    return 0;
+}
+
+static int packet_queue_in_slab(PacketQueue *q, MyAVPacketList *pkt)
+{
+    MyAVPacketSlab *slab;
+
+    for (slab = q->slab_list; slab; slab = slab->next) {
+        if (pkt >= slab->nodes && pkt < slab->nodes + PACKET_QUEUE_SLAB_NODES)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * keyframe index
+ *
+ * put records sparse keyframes along with the totals put before them, so
+ * packet_queue_trim_to_pts() can cut the queue at a keyframe without walking it.
+ * only the producer side (read_thread) touches the index in ring mode,
+ * in linked list mode it is guarded by q->mutex.
+ */
+static void packet_queue_index_packet(PacketQueue *q, AVPacket *pkt, unsigned int seq, MyAVPacketList *prev)
+{
+    PacketQueueKeyIndex *key;
+
+    if (pkt == &flush_pkt) {
+        q->flush_seq = seq;
+        return;
+    }
+    if (pkt->pts == AV_NOPTS_VALUE)
+        return;
+    /* atomic, check_live_catchup_speed() reads it on the video refresh thread */
+    __atomic_store_n(&q->last_pts, pkt->pts, __ATOMIC_RELAXED);
+    if (!(pkt->flags & AV_PKT_FLAG_KEY))
+        return;
+
+    if (q->key_index_count > 0) {
+        key = &q->key_index[(q->key_index_head + q->key_index_count - 1) % PACKET_QUEUE_KEY_INDEX_SIZE];
+        if (pkt->pts >= key->pts && pkt->pts - key->pts < q->key_index_min_gap)
+            return;
+    }
+    if (q->key_index_count == PACKET_QUEUE_KEY_INDEX_SIZE) {
+        q->key_index_head = (q->key_index_head + 1) % PACKET_QUEUE_KEY_INDEX_SIZE;
+        q->key_index_count--;
+    }
+
+    key = &q->key_index[(q->key_index_head + q->key_index_count) % PACKET_QUEUE_KEY_INDEX_SIZE];
+    key->seq          = seq;
+    key->pts          = pkt->pts;
+    key->put_size     = q->put_total_size;
+    key->put_duration = q->put_total_duration;
+    key->prev         = prev;
+    q->key_index_count++;
+}
+
+static void packet_queue_reset_index(PacketQueue *q)
+{
+    q->key_index_head  = 0;
+    q->key_index_count = 0;
+    __atomic_store_n(&q->last_pts, AV_NOPTS_VALUE, __ATOMIC_RELAXED);
+}
+
+/* first indexed keyframe at or after target_pts which is still queued, get_seq is the head of queue */
+static PacketQueueKeyIndex *packet_queue_find_key(PacketQueue *q, unsigned int get_seq, int64_t target_pts)
+{
+    PacketQueueKeyIndex *key;
+    int i;
+
+    while (q->key_index_count > 0 && (int)(q->key_index[q->key_index_head].seq - get_seq) < 0) {
+        q->key_index_head = (q->key_index_head + 1) % PACKET_QUEUE_KEY_INDEX_SIZE;
+        q->key_index_count--;
+    }
+
+    for (i = 0; i < q->key_index_count; i++) {
+        key = &q->key_index[(q->key_index_head + i) % PACKET_QUEUE_KEY_INDEX_SIZE];
+        if (key->pts >= target_pts)
+            return key;
+    }
+    return NULL;
+}
+
 static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
 {
     MyAVPacketList *pkt1;
@@ -166,6 +248,8 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
 #ifdef FFP_MERGE
     pkt1 = av_malloc(sizeof(MyAVPacketList));
 #else
+    if (!q->recycle_pkt && q->slab_list)
+        packet_queue_grow_slab(q);
     pkt1 = q->recycle_pkt;
     if (pkt1) {
         q->recycle_pkt = pkt1->next;
@@ -189,6 +273,10 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
         q->serial++;
     pkt1->serial = q->serial;
 
+    packet_queue_index_packet(q, pkt, q->put_seq++, q->last_pkt);
+    q->put_total_size += pkt1->pkt.size + sizeof(*pkt1);
+    q->put_total_duration += pkt1->pkt.duration;
+
     if (!q->last_pkt)
         q->first_pkt = pkt1;
     else
@@ -202,13 +290,163 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
     return 0;
 }
 
-static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+/*
+ * single producer/single consumer mode
+ *
+ * read_thread is the only producer and one decoder the only consumer,
+ * put/get only advance ring_write/ring_read. mutex and cond are only used
+ * to park a side on an empty/full ring.
+ * read_thread may drop packets too (flush, cached duration control),
+ * so a slot is always claimed with a CAS on ring_read.
+ */
+/* both sides share cond, wake whichever waits */
+static void packet_queue_wakeup_spsc(PacketQueue *q)
 {
-    int ret;
+    SDL_LockMutex(q->mutex);
+    SDL_CondBroadcast(q->cond);
+    SDL_UnlockMutex(q->mutex);
+}
+
+/*
+ * A side sets its own waiting flag before it rechecks the indexes, the other
+ * side moves an index before it tests that flag, so one of them sees the
+ * other. The signal is sent under the mutex, it can not fall between the
+ * recheck and SDL_CondWait(). Only the owner clears its flag.
+ */
+static void packet_queue_wait_spsc(PacketQueue *q, int for_space)
+{
+    int         *waiting = for_space ? &q->producer_waiting : &q->consumer_waiting;
+    unsigned int nb_packets;
 
     SDL_LockMutex(q->mutex);
-    ret = packet_queue_put_private(q, pkt);
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    while (!q->abort_request) {
+        nb_packets = __atomic_load_n(&q->ring_write, __ATOMIC_SEQ_CST) - __atomic_load_n(&q->ring_read, __ATOMIC_SEQ_CST);
+        if (for_space ? nb_packets <= q->ring_mask : nb_packets > 0)
+            break;
+        SDL_CondWait(q->cond, q->mutex);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
     SDL_UnlockMutex(q->mutex);
+}
+
+/*
+ * Wake a decoder held back by wakeup batching. read_thread calls it whenever
+ * it may block or idle, see decode_interrupt_cb(), so a batch that never
+ * fills up is released all the same.
+ */
+static void packet_queue_wakeup_pending(PacketQueue *q)
+{
+    if (q->ring &&
+        __atomic_load_n(&q->consumer_waiting, __ATOMIC_SEQ_CST) &&
+        __atomic_load_n(&q->ring_write, __ATOMIC_SEQ_CST) != __atomic_load_n(&q->ring_read, __ATOMIC_SEQ_CST))
+        packet_queue_wakeup_spsc(q);
+}
+
+static int packet_queue_put_spsc(PacketQueue *q, AVPacket *pkt)
+{
+    MyAVPacketList *pkt1;
+    unsigned int w = q->ring_write;
+    unsigned int nb_packets;
+
+    for (;;) {
+        if (__atomic_load_n(&q->abort_request, __ATOMIC_ACQUIRE))
+            return -1;
+        nb_packets = w - __atomic_load_n(&q->ring_read, __ATOMIC_ACQUIRE);
+        if (nb_packets <= q->ring_mask)
+            break;
+        packet_queue_wait_spsc(q, 1);
+    }
+
+    pkt1 = &q->ring[w & q->ring_mask];
+    pkt1->pkt = *pkt;
+    pkt1->next = NULL;
+    if (pkt == &flush_pkt)
+        __atomic_add_fetch(&q->serial, 1, __ATOMIC_SEQ_CST);
+    pkt1->serial = q->serial;
+
+    packet_queue_index_packet(q, pkt, w, NULL);
+    q->put_total_size += pkt1->pkt.size + sizeof(*pkt1);
+    q->put_total_duration += pkt1->pkt.duration;
+
+    __atomic_add_fetch(&q->nb_packets, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&q->size, pkt1->pkt.size + (int)sizeof(*pkt1), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&q->duration, pkt1->pkt.duration, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->ring_write, w + 1, __ATOMIC_SEQ_CST);
+
+    /* batch wakeups, but never hold back a flush or an eof marker */
+    if (__atomic_load_n(&q->consumer_waiting, __ATOMIC_SEQ_CST) &&
+        (nb_packets + 1 >= q->wakeup_batch || pkt == &flush_pkt || !pkt->data))
+        packet_queue_wakeup_spsc(q);
+    return 0;
+}
+
+/* claim slot r, fails if the other side took it first */
+static int packet_queue_take_spsc(PacketQueue *q, unsigned int r, AVPacket *pkt, int *serial)
+{
+    MyAVPacketList pkt1 = q->ring[r & q->ring_mask];
+
+    if (!__atomic_compare_exchange_n(&q->ring_read, &r, r + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        return 0;
+
+    __atomic_sub_fetch(&q->nb_packets, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&q->size, pkt1.pkt.size + (int)sizeof(pkt1), __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&q->duration, pkt1.pkt.duration, __ATOMIC_RELAXED);
+    *pkt = pkt1.pkt;
+    if (serial)
+        *serial = pkt1.serial;
+
+    if (__atomic_load_n(&q->producer_waiting, __ATOMIC_SEQ_CST))
+        packet_queue_wakeup_spsc(q);
+    return 1;
+}
+
+static int packet_queue_pop_spsc(PacketQueue *q, AVPacket *pkt, int *serial)
+{
+    unsigned int r;
+
+    for (;;) {
+        r = __atomic_load_n(&q->ring_read, __ATOMIC_SEQ_CST);
+        if (r == __atomic_load_n(&q->ring_write, __ATOMIC_SEQ_CST))
+            return 0;
+        if (packet_queue_take_spsc(q, r, pkt, serial))
+            return 1;
+    }
+}
+
+static int packet_queue_get_spsc(PacketQueue *q, AVPacket *pkt, int block, int *serial)
+{
+    for (;;) {
+        if (__atomic_load_n(&q->abort_request, __ATOMIC_ACQUIRE))
+            return -1;
+        if (packet_queue_pop_spsc(q, pkt, serial))
+            return 1;
+        if (!block)
+            return 0;
+        packet_queue_wait_spsc(q, 0);
+    }
+}
+
+static void packet_queue_flush_spsc(PacketQueue *q)
+{
+    AVPacket pkt;
+
+    while (packet_queue_pop_spsc(q, &pkt, NULL))
+        av_packet_unref(&pkt);
+    packet_queue_reset_index(q);
+}
+
+static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+{
+    int ret;
+
+    if (q->ring) {
+        ret = packet_queue_put_spsc(q, pkt);
+    } else {
+        SDL_LockMutex(q->mutex);
+        ret = packet_queue_put_private(q, pkt);
+        SDL_UnlockMutex(q->mutex);
+    }
 
     if (pkt != &flush_pkt && ret < 0)
         av_packet_unref(pkt);
@@ -241,6 +479,37 @@ static int packet_queue_init(PacketQueue *q)
         return AVERROR(ENOMEM);
     }
     q->abort_request = 1;
+    q->last_pts = AV_NOPTS_VALUE;
+    return 0;
+}
+
+/*
+ * nodes of a slab queue are never freed one by one, only with their slab,
+ * but for those taken from the heap when the slab could not grow
+ */
+static int packet_queue_init_slab(PacketQueue *q)
+{
+    int ret = packet_queue_init(q);
+    if (ret < 0)
+        return ret;
+
+    return packet_queue_grow_slab(q);
+}
+
+static int packet_queue_init_spsc(PacketQueue *q, int max_packets, int wakeup_batch)
+{
+    unsigned int nb_entries = 1;
+    int ret = packet_queue_init(q);
+    if (ret < 0)
+        return ret;
+
+    while (nb_entries < max_packets)
+        nb_entries <<= 1;
+    q->ring = av_mallocz_array(nb_entries, sizeof(MyAVPacketList));
+    if (!q->ring)
+        return AVERROR(ENOMEM);
+    q->ring_mask    = nb_entries - 1;
+    q->wakeup_batch = av_clip(wakeup_batch, 1, nb_entries);
     return 0;
 }
 
@@ -248,6 +517,11 @@ static void packet_queue_flush(PacketQueue *q)
 {
     MyAVPacketList *pkt, *pkt1;
 
+    if (q->ring) {
+        packet_queue_flush_spsc(q);
+        return;
+    }
+
     SDL_LockMutex(q->mutex);
     for (pkt = q->first_pkt; pkt; pkt = pkt1) {
         pkt1 = pkt->next;
@@ -264,6 +538,8 @@ static void packet_queue_flush(PacketQueue *q)
     q->nb_packets = 0;
     q->size = 0;
     q->duration = 0;
+    q->get_seq = q->put_seq;
+    packet_queue_reset_index(q);
     SDL_UnlockMutex(q->mutex);
 }
 
@@ -276,9 +552,17 @@ static void packet_queue_destroy(PacketQueue *q)
         MyAVPacketList *pkt = q->recycle_pkt;
         if (pkt)
             q->recycle_pkt = pkt->next;
-        av_freep(&pkt);
+        /* taken from the heap when a slab could not be grown */
+        if (!packet_queue_in_slab(q, pkt))
+            av_freep(&pkt);
+    }
+    while (q->slab_list) {
+        MyAVPacketSlab *slab = q->slab_list;
+        q->slab_list = slab->next;
+        av_free(slab);
     }
     SDL_UnlockMutex(q->mutex);
+    av_freep(&q->ring);
 
     SDL_DestroyMutex(q->mutex);
     SDL_DestroyCond(q->cond);
@@ -299,8 +583,12 @@ static void packet_queue_start(PacketQueue *q)
 {
     SDL_LockMutex(q->mutex);
     q->abort_request = 0;
-    packet_queue_put_private(q, &flush_pkt);
+    if (!q->ring)
+        packet_queue_put_private(q, &flush_pkt);
     SDL_UnlockMutex(q->mutex);
+
+    if (q->ring)
+        packet_queue_put_spsc(q, &flush_pkt);
 }
 
 /* return < 0 if aborted, 0 if no packet and > 0 if packet.  */
@@ -309,6 +597,9 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *seria
     MyAVPacketList *pkt1;
     int ret;
 
+    if (q->ring)
+        return packet_queue_get_spsc(q, pkt, block, serial);
+
     SDL_LockMutex(q->mutex);
 
     for (;;) {
@@ -325,6 +616,7 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *seria
             q->nb_packets--;
             q->size -= pkt1->pkt.size + sizeof(*pkt1);
             q->duration -= pkt1->pkt.duration;
+            q->get_seq++;
             *pkt = pkt1->pkt;
             if (serial)
                 *serial = pkt1->serial;
@@ -347,6 +639,94 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *seria
     return ret;
 }
 
+static int packet_queue_trim_list(PacketQueue *q, int64_t target_pts, int64_t *cut_pts)
+{
+    PacketQueueKeyIndex *key;
+    MyAVPacketList *pkt1, *first, *last;
+    int nb_packets;
+
+    SDL_LockMutex(q->mutex);
+    key = packet_queue_find_key(q, q->get_seq, target_pts);
+    /* never cut away a queued flush_pkt, the decoder must see it */
+    if (!key || key->seq == q->get_seq || (int)(q->flush_seq - q->get_seq) >= 0) {
+        SDL_UnlockMutex(q->mutex);
+        return 0;
+    }
+
+    first = q->first_pkt;
+    last  = key->prev;
+    q->first_pkt = last->next;
+    last->next   = NULL;
+
+    nb_packets    = key->seq - q->get_seq;
+    q->nb_packets = q->put_seq - key->seq;
+    q->size       = (int)(q->put_total_size - key->put_size);
+    q->duration   = q->put_total_duration - key->put_duration;
+    q->get_seq    = key->seq;
+    *cut_pts      = key->pts;
+    SDL_UnlockMutex(q->mutex);
+
+    for (pkt1 = first; pkt1; pkt1 = pkt1->next)
+        av_packet_unref(&pkt1->pkt);
+
+    SDL_LockMutex(q->mutex);
+    last->next = q->recycle_pkt;
+    q->recycle_pkt = first;
+    SDL_UnlockMutex(q->mutex);
+    return nb_packets;
+}
+
+/* must be called from the producer, as the only other writer of ring_read is the consumer */
+static int packet_queue_trim_spsc(PacketQueue *q, int64_t target_pts, int64_t *cut_pts)
+{
+    PacketQueueKeyIndex *key;
+    MyAVPacketList *pkt1;
+    unsigned int r, i;
+    int size = 0;
+    int64_t duration = 0;
+
+    for (;;) {
+        r = __atomic_load_n(&q->ring_read, __ATOMIC_SEQ_CST);
+        key = packet_queue_find_key(q, r, target_pts);
+        if (!key || key->seq == r || (int)(q->flush_seq - r) >= 0)
+            return 0;
+        /* retry if the consumer took the head meanwhile */
+        if (__atomic_compare_exchange_n(&q->ring_read, &r, key->seq, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            break;
+    }
+
+    for (i = r; i != key->seq; i++) {
+        pkt1 = &q->ring[i & q->ring_mask];
+        size += pkt1->pkt.size + (int)sizeof(*pkt1);
+        duration += pkt1->pkt.duration;
+        av_packet_unref(&pkt1->pkt);
+    }
+
+    __atomic_sub_fetch(&q->nb_packets, (int)(key->seq - r), __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&q->size, size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&q->duration, duration, __ATOMIC_RELAXED);
+    *cut_pts = key->pts;
+    return key->seq - r;
+}
+
+/*
+ * drop queued packets before the first indexed keyframe at or after target_pts.
+ * return the number of dropped packets, cut_pts is set to the pts of the new head if any.
+ */
+static int packet_queue_trim_to_pts(PacketQueue *q, int64_t target_pts, int64_t *cut_pts)
+{
+    if (q->ring)
+        return packet_queue_trim_spsc(q, target_pts, cut_pts);
+    return packet_queue_trim_list(q, target_pts, cut_pts);
+}
+
+static void packet_queue_set_time_base(PacketQueue *q, AVRational time_base)
+{
+    if (time_base.num <= 0 || time_base.den <= 0)
+        return;
+    q->key_index_min_gap = av_rescale_q(PACKET_QUEUE_KEY_INDEX_MIN_GAP_MS, (AVRational){1, 1000}, time_base);
+}
+
 static int packet_queue_get_or_buffering(FFPlayer *ffp, PacketQueue *q, AVPacket *pkt, int *serial, int *finished)
 {
     assert(finished);
@@ -390,89 +770,106 @@ static void decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue,
 }
 
 static int decoder_decode_frame(FFPlayer *ffp, Decoder *d, AVFrame *frame, AVSubtitle *sub) {
-    int got_frame = 0;
-
-    do {
-        int ret = -1;
+    int ret = AVERROR(EAGAIN);
 
-        if (d->queue->abort_request)
-            return -1;
+    for (;;) {
+        AVPacket pkt;
 
-        if (!d->packet_pending || d->queue->serial != d->pkt_serial) {
-            AVPacket pkt;
+        /* drain every frame the decoder has ready before feeding it again */
+        if (d->queue->serial == d->pkt_serial) {
             do {
-                if (d->queue->nb_packets == 0)
-                    SDL_CondSignal(d->empty_queue_cond);
-                if (packet_queue_get_or_buffering(ffp, d->queue, &pkt, &d->pkt_serial, &d->finished) < 0)
+                if (d->queue->abort_request)
                     return -1;
-                if (pkt.data == flush_pkt.data) {
-                    avcodec_flush_buffers(d->avctx);
-                    d->finished = 0;
-                    d->next_pts = d->start_pts;
-                    d->next_pts_tb = d->start_pts_tb;
-                }
-            } while (pkt.data == flush_pkt.data || d->queue->serial != d->pkt_serial);
-            av_packet_unref(&d->pkt);
-            d->pkt_temp = d->pkt = pkt;
-            d->packet_pending = 1;
-        }
 
-        switch (d->avctx->codec_type) {
-            case AVMEDIA_TYPE_VIDEO: {
-                ret = avcodec_decode_video2(d->avctx, frame, &got_frame, &d->pkt_temp);
-                if (got_frame) {
-                    ffp->stat.vdps = SDL_SpeedSamplerAdd(&ffp->vdps_sampler, FFP_SHOW_VDPS_AVCODEC, "vdps[avcodec]");
-                    if (ffp->decoder_reorder_pts == -1) {
-                        frame->pts = av_frame_get_best_effort_timestamp(frame);
-                    } else if (!ffp->decoder_reorder_pts) {
-                        frame->pts = frame->pkt_dts;
-                    }
+                switch (d->avctx->codec_type) {
+                    case AVMEDIA_TYPE_VIDEO:
+                        ret = avcodec_receive_frame(d->avctx, frame);
+                        if (ret >= 0) {
+                            ffp->stat.vdps = SDL_SpeedSamplerAdd(&ffp->vdps_sampler, FFP_SHOW_VDPS_AVCODEC, "vdps[avcodec]");
+                            if (ffp->decoder_reorder_pts == -1) {
+                                frame->pts = av_frame_get_best_effort_timestamp(frame);
+                            } else if (!ffp->decoder_reorder_pts) {
+                                frame->pts = frame->pkt_dts;
+                            }
+                        }
+                        break;
+                    case AVMEDIA_TYPE_AUDIO:
+                        ret = avcodec_receive_frame(d->avctx, frame);
+                        if (ret >= 0) {
+                            AVRational tb = (AVRational){1, frame->sample_rate};
+                            if (frame->pts != AV_NOPTS_VALUE)
+                                frame->pts = av_rescale_q(frame->pts, av_codec_get_pkt_timebase(d->avctx), tb);
+                            else if (d->next_pts != AV_NOPTS_VALUE)
+                                frame->pts = av_rescale_q(d->next_pts, d->next_pts_tb, tb);
+                            if (frame->pts != AV_NOPTS_VALUE) {
+                                d->next_pts = frame->pts + frame->nb_samples;
+                                d->next_pts_tb = tb;
+                            }
+                        }
+                        break;
+                    default:
+                        /* subtitles are decoded below, ret tells the outcome */
+                        break;
                 }
+                if (ret == AVERROR_EOF) {
+                    d->finished = d->pkt_serial;
+                    avcodec_flush_buffers(d->avctx);
+                    return 0;
                 }
-                break;
-            case AVMEDIA_TYPE_AUDIO:
-                ret = avcodec_decode_audio4(d->avctx, frame, &got_frame, &d->pkt_temp);
-                if (got_frame) {
-                    AVRational tb = (AVRational){1, frame->sample_rate};
-                    if (frame->pts != AV_NOPTS_VALUE)
-                        frame->pts = av_rescale_q(frame->pts, av_codec_get_pkt_timebase(d->avctx), tb);
-                    else if (d->next_pts != AV_NOPTS_VALUE)
-                        frame->pts = av_rescale_q(d->next_pts, d->next_pts_tb, tb);
-                    if (frame->pts != AV_NOPTS_VALUE) {
-                        d->next_pts = frame->pts + frame->nb_samples;
-                        d->next_pts_tb = tb;
-                    }
+                if (ret >= 0) {
+                    d->decoded_frames++;
+                    return 1;
                 }
+            } while (ret != AVERROR(EAGAIN));
+        }
+
+        for (;;) {
+            if (d->queue->nb_packets == 0)
+                SDL_CondSignal(d->empty_queue_cond);
+            if (d->packet_pending) {
+                av_packet_move_ref(&pkt, &d->pkt);
+                d->packet_pending = 0;
+            } else {
+                int64_t wait_start = av_gettime_relative();
+                if (packet_queue_get_or_buffering(ffp, d->queue, &pkt, &d->pkt_serial, &d->finished) < 0)
+                    return -1;
+                d->packet_wait_us += av_gettime_relative() - wait_start;
+            }
+            if (d->queue->serial == d->pkt_serial)
                 break;
-            case AVMEDIA_TYPE_SUBTITLE:
-                ret = avcodec_decode_subtitle2(d->avctx, sub, &got_frame, &d->pkt_temp);
-                break;
-            default:
-                break;
+            /* stale since a flush, nothing else releases it */
+            av_packet_unref(&pkt);
         }
 
-        if (ret < 0) {
-            d->packet_pending = 0;
+        if (pkt.data == flush_pkt.data) {
+            avcodec_flush_buffers(d->avctx);
+            d->finished = 0;
+            d->next_pts = d->start_pts;
+            d->next_pts_tb = d->start_pts_tb;
         } else {
-            d->pkt_temp.dts =
-            d->pkt_temp.pts = AV_NOPTS_VALUE;
-            if (d->pkt_temp.data) {
-                if (d->avctx->codec_type != AVMEDIA_TYPE_AUDIO)
-                    ret = d->pkt_temp.size;
-                d->pkt_temp.data += ret;
-                d->pkt_temp.size -= ret;
-                if (d->pkt_temp.size <= 0)
-                    d->packet_pending = 0;
+            if (d->avctx->codec_type == AVMEDIA_TYPE_SUBTITLE) {
+                int got_frame = 0;
+                ret = avcodec_decode_subtitle2(d->avctx, sub, &got_frame, &pkt);
+                if (ret < 0) {
+                    ret = AVERROR(EAGAIN);
+                } else {
+                    /* a drain packet may hold more subtitles */
+                    if (got_frame && !pkt.data) {
+                        d->packet_pending = 1;
+                        av_packet_move_ref(&d->pkt, &pkt);
+                    }
+                    ret = got_frame ? 0 : (pkt.data ? AVERROR(EAGAIN) : AVERROR_EOF);
+                }
             } else {
-                if (!got_frame) {
-                    d->packet_pending = 0;
-                    d->finished = d->pkt_serial;
+                if (avcodec_send_packet(d->avctx, &pkt) == AVERROR(EAGAIN)) {
+                    av_log(d->avctx, AV_LOG_ERROR, "Receive_frame and send_packet both returned EAGAIN, which is an API violation.\n");
+                    d->packet_pending = 1;
+                    av_packet_move_ref(&d->pkt, &pkt);
                 }
             }
+            av_packet_unref(&pkt);
         }
-    } while (!got_frame && !d->finished);
-
-    return got_frame;
+    }
 }
 
 static void decoder_destroy(Decoder *d) {
@@ -876,19 +1273,6 @@ static void stream_component_close(FFPlayer *ffp, int stream_index)
     }
 }
 
-static void record_queue_init(){
-    for(int i = 0; i<MAX_RECORD_CACHE; i++){
-        recorQueue.rePkt[i].recordPkt = av_packet_alloc();
-    }
-}
-
-static void record_queue_destroy(){
-    for(int i = 0; i<MAX_RECORD_CACHE; i++){
-        AVPacket *recPkt = recorQueue.rePkt[i].recordPkt;
-        av_free_packet(recPkt);
-    }
-}
-
 static void stream_close(FFPlayer *ffp)
 {
     VideoState *is = ffp->is;
@@ -899,10 +1283,11 @@ static void stream_close(FFPlayer *ffp)
     av_log(NULL, AV_LOG_DEBUG, "wait for read_tid\n");
     SDL_WaitThread(is->read_tid, NULL);
     
-    record_queue_destroy();
-    if(is->ofmt_ctx){
-        mw_closeOutPutStream(ffp);
-    }
+    SDL_LockMutex(ffp->record_mutex);
+    ffp_recorder_freep(&is->recorder);
+    ffp_recorder_reap(&is->closing_recorders, 1);
+    SDL_UnlockMutex(ffp->record_mutex);
+    ffp_recorder_preroll_freep(&is->record_preroll);
     /* close each stream */
     if (is->audio_stream >= 0)
         stream_component_close(ffp, is->audio_stream);
@@ -912,6 +1297,8 @@ static void stream_close(FFPlayer *ffp)
         stream_component_close(ffp, is->subtitle_stream);
 
     avformat_close_input(&is->ic);
+    ijkmmap_avio_closep(&is->mmap_pb);
+    ijksegment_preload_drop(ffp->app_ctx);
 
     av_log(NULL, AV_LOG_DEBUG, "wait for video_refresh_tid\n");
     SDL_WaitThread(is->video_refresh_tid, NULL);
@@ -1047,6 +1434,72 @@ static void check_external_clock_speed(VideoState *is) {
    }
 }
 
+/* written on the video refresh thread, read by the audio callback too */
+static double get_live_catchup_speed(VideoState *is)
+{
+    double speed;
+
+    __atomic_load(&is->catchup_speed, &speed, __ATOMIC_RELAXED);
+    return speed;
+}
+
+/*
+ * A multiplier on top of the playback rate the user chose, which is left
+ * as it is: the audio output plays at pf_playback_rate * catchup_speed.
+ */
+static void set_live_catchup_speed(FFPlayer *ffp, VideoState *is, double speed)
+{
+    av_log(ffp, AV_LOG_DEBUG, "live catchup speed %.2f -> %.2f\n", get_live_catchup_speed(is), speed);
+    __atomic_store(&is->catchup_speed, &speed, __ATOMIC_RELAXED);
+    set_clock_speed(&is->audclk, speed);
+    set_clock_speed(&is->vidclk, speed);
+    set_clock_speed(&is->extclk, speed);
+    __atomic_store_n(&ffp->pf_playback_rate_changed, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * live latency is the pts of the last packet read minus the master clock.
+ * speed up in steps once it exceeds target + band, and slow down to 1.0x
+ * once it is back at target.
+ */
+static void check_live_catchup_speed(FFPlayer *ffp, VideoState *is)
+{
+    PacketQueue *q;
+    AVStream *st;
+    int64_t last_pts;
+    double clock, latency, speed;
+    double time = av_gettime_relative() / 1000000.0;
+
+    if (time < is->catchup_check_time + LIVE_CATCHUP_CHECK_INTERVAL)
+        return;
+    is->catchup_check_time = time;
+
+    if (get_master_sync_type(is) == AV_SYNC_AUDIO_MASTER || !is->video_st) {
+        q  = &is->audioq;
+        st = is->audio_st;
+    } else {
+        q  = &is->videoq;
+        st = is->video_st;
+    }
+    if (!st)
+        return;
+
+    last_pts = __atomic_load_n(&q->last_pts, __ATOMIC_RELAXED);
+    clock    = get_master_clock(is);
+    if (last_pts == AV_NOPTS_VALUE || isnan(clock))
+        return;
+
+    latency = last_pts * av_q2d(st->time_base) - clock;
+    speed   = get_live_catchup_speed(is);
+    if (latency * 1000 > ffp->live_catchup_target_ms + ffp->live_catchup_band_ms)
+        speed = FFMIN(ffp->live_catchup_max_speed, speed + LIVE_CATCHUP_SPEED_STEP);
+    else if (latency * 1000 <= ffp->live_catchup_target_ms)
+        speed = FFMAX(1.0, speed - LIVE_CATCHUP_SPEED_STEP);
+
+    if (speed != get_live_catchup_speed(is))
+        set_live_catchup_speed(ffp, is, speed);
+}
+
 /* seek in the stream */
 static void stream_seek(VideoState *is, int64_t pos, int64_t rel, int seek_by_bytes)
 {
@@ -1061,6 +1514,35 @@ static void stream_seek(VideoState *is, int64_t pos, int64_t rel, int seek_by_by
     }
 }
 
+/*
+ * Tell the async: protocol where each stream resumes after the seek, so the
+ * one the demuxer does not read first is fetched in parallel.
+ * Index entries may grow while demuxing, read thread only.
+ */
+static void stream_seek_prefetch_hint(VideoState *is, int64_t seek_target)
+{
+    AVFormatContext *ic = is->ic;
+    int              stream_index[2] = {is->video_stream, is->audio_stream};
+    char             hint[64] = "";
+    AVStream        *st;
+    int              i, idx;
+
+    if (!ic->pb || (is->seek_flags & AVSEEK_FLAG_BYTE))
+        return;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(stream_index); i++) {
+        if (stream_index[i] < 0)
+            continue;
+        st  = ic->streams[stream_index[i]];
+        idx = av_index_search_timestamp(st, av_rescale_q(seek_target, AV_TIME_BASE_Q, st->time_base), AVSEEK_FLAG_BACKWARD);
+        if (idx >= 0)
+            av_strlcatf(hint, sizeof(hint), "%s%"PRId64, *hint ? "," : "", st->index_entries[idx].pos);
+    }
+
+    if (*hint)
+        av_opt_set(ic->pb, "async-prefetch-hint", hint, AV_OPT_SEARCH_CHILDREN);
+}
+
 /* pause or resume the video */
 static void stream_toggle_pause_l(FFPlayer *ffp, int pause_on)
 {
@@ -1184,7 +1666,9 @@ static void video_refresh(FFPlayer *opaque, double *remaining_time)
 
     Frame *sp, *sp2;
 
-    if (!is->paused && get_master_sync_type(is) == AV_SYNC_EXTERNAL_CLOCK && is->realtime)
+    if (!is->paused && ffp->live_catchup)
+        check_live_catchup_speed(ffp, is);
+    else if (!is->paused && get_master_sync_type(is) == AV_SYNC_EXTERNAL_CLOCK && is->realtime)
         check_external_clock_speed(is);
 
     if (!ffp->display_disable && is->show_mode != SHOW_MODE_VIDEO && is->audio_st) {
@@ -1221,7 +1705,11 @@ retry:
 
             /* compute nominal last_duration */
             last_duration = vp_duration(is, lastvp, vp);
+            if (ffp->live_catchup && get_live_catchup_speed(is) > 1.0)
+                last_duration /= get_live_catchup_speed(is);
             delay = compute_target_delay(ffp, last_duration, is);
+            if (ffp->present_unthrottled)
+                delay = 0;
 
             time= av_gettime_relative()/1000000.0;
             if (isnan(is->frame_timer) || time < is->frame_timer)
@@ -1243,7 +1731,8 @@ retry:
             if (frame_queue_nb_remaining(&is->pictq) > 1) {
                 Frame *nextvp = frame_queue_peek_next(&is->pictq);
                 duration = vp_duration(is, vp, nextvp);
-                if(!is->step && (ffp->framedrop > 0 || (ffp->framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) && time > is->frame_timer + duration) {
+                if(!is->step && !ffp->present_unthrottled && (ffp->framedrop > 0 || (ffp->framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) && time > is->frame_timer + duration) {
+                    is->frame_drops_late++;
                     frame_queue_next(&is->pictq);
                     goto retry;
                 }
@@ -1437,10 +1926,15 @@ static int queue_picture(FFPlayer *ffp, AVFrame *src_frame, double pts, double d
 #endif
 #endif
         // FIXME: set swscale options
+        int64_t convert_start = av_gettime_relative();
         if (SDL_VoutFillFrameYUVOverlay(vp->bmp, src_frame) < 0) {
             av_log(NULL, AV_LOG_FATAL, "Cannot initialize the conversion context\n");
             exit(1);
         }
+        ffp->stat.vconvert_us     = av_gettime_relative() - convert_start;
+        ffp->stat.vconvert_max_us = FFMAX(ffp->stat.vconvert_max_us, ffp->stat.vconvert_us);
+        ffp->stat.vconvert_total_us += ffp->stat.vconvert_us;
+        ffp->stat.vconvert_frames++;
         /* update the bitmap content */
         SDL_VoutUnlockYUVOverlay(vp->bmp);
 
@@ -2254,10 +2748,8 @@ static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
 
     ffp->audio_callback_time = av_gettime_relative();
 
-    if (ffp->pf_playback_rate_changed) {
-        ffp->pf_playback_rate_changed = 0;
-        SDL_AoutSetPlaybackRate(ffp->aout, ffp->pf_playback_rate);
-    }
+    if (__atomic_exchange_n(&ffp->pf_playback_rate_changed, 0, __ATOMIC_ACQUIRE))
+        SDL_AoutSetPlaybackRate(ffp->aout, ffp->pf_playback_rate * get_live_catchup_speed(is));
     if (ffp->pf_playback_volume_changed) {
         ffp->pf_playback_volume_changed = 0;
         SDL_AoutSetPlaybackVolume(ffp->aout, ffp->pf_playback_volume);
@@ -2390,6 +2882,21 @@ static int audio_open(FFPlayer *opaque, int64_t wanted_channel_layout, int wante
     return spec.size;
 }
 
+/*
+ * Frame threads add a frame of latency each, worth it only when one core
+ * can't keep up: all the cores above 1080p, up to 4 below.
+ */
+static int ffp_video_thread_count(FFPlayer *ffp, VideoState *is)
+{
+    int cpu_count = av_cpu_count();
+
+    if (ffp->video_threads > 0)
+        return ffp->video_threads;
+    if (is->is_video_high_res)
+        return FFMIN(cpu_count + 1, VIDEO_THREADS_MAX);
+    return FFMIN(cpu_count, 4);
+}
+
 /* open a given stream. Return 0 if OK */
 static int stream_component_open(FFPlayer *ffp, int stream_index)
 {
@@ -2454,6 +2961,13 @@ static int stream_component_open(FFPlayer *ffp, int stream_index)
 #endif
 
     opts = filter_codec_opts(ffp->codec_opts, avctx->codec_id, ic, ic->streams[stream_index], codec);
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        is->is_video_high_res = avctx->width * avctx->height > 1920 * 1080;
+        if (!av_dict_get(opts, "threads", NULL, 0))
+            av_dict_set_int(&opts, "threads", ffp_video_thread_count(ffp, is), 0);
+        if (ffp->video_thread_type && !av_dict_get(opts, "thread_type", NULL, 0))
+            avctx->thread_type = ffp->video_thread_type;
+    }
     if (!av_dict_get(opts, "threads", NULL, 0))
         av_dict_set(&opts, "threads", "auto", 0);
     if (stream_lowres)
@@ -2521,6 +3035,7 @@ static int stream_component_open(FFPlayer *ffp, int stream_index)
         is->audio_st = ic->streams[stream_index];
 
         decoder_init(&is->auddec, avctx, &is->audioq, is->continue_read_thread);
+        packet_queue_set_time_base(&is->audioq, is->audio_st->time_base);
         if ((is->ic->iformat->flags & (AVFMT_NOBINSEARCH | AVFMT_NOGENSEARCH | AVFMT_NO_BYTE_SEEK)) && !is->ic->iformat->read_seek) {
             is->auddec.start_pts = is->audio_st->start_time;
             is->auddec.start_pts_tb = is->audio_st->time_base;
@@ -2534,6 +3049,7 @@ static int stream_component_open(FFPlayer *ffp, int stream_index)
         is->video_st = ic->streams[stream_index];
 
         decoder_init(&is->viddec, avctx, &is->videoq, is->continue_read_thread);
+        packet_queue_set_time_base(&is->videoq, is->video_st->time_base);
         ffp->node_vdec = ffpipeline_open_video_decoder(ffp->pipeline, ffp);
         if (!ffp->node_vdec)
             goto fail;
@@ -2595,9 +3111,18 @@ out:
     return ret;
 }
 
+static void stream_wakeup_decoders(VideoState *is)
+{
+    packet_queue_wakeup_pending(&is->videoq);
+    packet_queue_wakeup_pending(&is->audioq);
+    packet_queue_wakeup_pending(&is->subtitleq);
+}
+
 static int decode_interrupt_cb(void *ctx)
 {
     VideoState *is = ctx;
+    /* polled while io blocks */
+    stream_wakeup_decoders(is);
     return is->abort_request;
 }
 
@@ -2627,364 +3152,125 @@ static int is_realtime(AVFormatContext *s)
     return 0;
 }
     
-    //初始化输出流
-static AVStream* add_output_stream(AVFormatContext* output_format_context, AVStream* input_stream)
-{
-    AVCodecContext* input_codec_context = NULL;
-    AVCodecContext* output_codec_context = NULL;
-        
-    AVStream* output_stream = NULL;
-    output_stream = avformat_new_stream(output_format_context, NULL);
-    if (!output_stream)
-    {
-        return NULL;
-    }
-        
-    input_codec_context = input_stream->codec;
-    output_codec_context = output_stream->codec;
-        
-    output_codec_context->codec_id = input_codec_context->codec_id;
-    output_codec_context->codec_type = input_codec_context->codec_type;
-    output_codec_context->codec_tag = input_codec_context->codec_tag;
-    output_codec_context->bit_rate = input_codec_context->bit_rate;
-    output_codec_context->extradata = input_codec_context->extradata;
-    output_codec_context->extradata_size = input_codec_context->extradata_size;
-        
-    if (av_q2d(input_codec_context->time_base) * input_codec_context->ticks_per_frame > av_q2d(input_stream->time_base) && av_q2d(input_stream->time_base) < 1.0 / 1000)
-    {
-        output_codec_context->time_base = input_codec_context->time_base;
-        output_codec_context->time_base.num *= input_codec_context->ticks_per_frame;
-    }
-    else
-    {
-        output_codec_context->time_base = input_stream->time_base;
-    }
-    switch (input_codec_context->codec_type)
-    {
-        case AVMEDIA_TYPE_AUDIO:
-            output_codec_context->channel_layout = input_codec_context->channel_layout;
-            output_codec_context->sample_rate = input_codec_context->sample_rate;
-            output_codec_context->channels = input_codec_context->channels;
-            output_codec_context->frame_size = input_codec_context->frame_size;
-            if ((input_codec_context->block_align == 1 && input_codec_context->codec_id == AV_CODEC_ID_MP3) ||
-                input_codec_context->codec_id == AV_CODEC_ID_AC3 || input_codec_context->codec_id == AV_CODEC_ID_AAC)
-            {
-                output_codec_context->block_align = 0;
-            }
-            else
-            {
-                output_codec_context->block_align = input_codec_context->block_align;
-            }
-            break;
-        case AVMEDIA_TYPE_VIDEO:
-            output_codec_context->pix_fmt = input_codec_context->pix_fmt;
-            output_codec_context->width = input_codec_context->width;
-            output_codec_context->height = input_codec_context->height;
-            output_codec_context->has_b_frames = input_codec_context->has_b_frames;
-            if (output_format_context->oformat->flags & AVFMT_GLOBALHEADER)
-            {
-                output_codec_context->flags |= CODEC_FLAG_GLOBAL_HEADER;
-            }
-            break;
-        default:
-            break;
-}
-        
-        return output_stream;
-    }
-
-    
-static int init_record_file(FFPlayer *ffp)
-{
-    int ret;
-    int i;
-    VideoState *is = ffp->is;
-    if(is->m_oformat_ctx)
-        return 1;
-    if(is->video_stream == -1 || is->video_st->codec->codec_id != AV_CODEC_ID_H264)
-        return 0;
-    if (is->audio_stream != -1)
-    {
-        if ( is->audio_st->codec->codec_id == AV_CODEC_ID_MP3 ||
-            is->audio_st->codec->codec_id == AV_CODEC_ID_AC3 ||
-            is->audio_st->codec->codec_id == AV_CODEC_ID_AAC)
-        {
-            /* allocate the output media context */
-            avformat_alloc_output_context2(&is->m_oformat_ctx, NULL, NULL, ffp->mwRecFile);
-            if(is->m_oformat_ctx)
-            {
-                is->m_output_fmt = is->m_oformat_ctx->oformat;
-                if (is->video_stream != -1)
-                {
-                    is->m_out_video_st = add_output_stream(is->m_oformat_ctx, is->video_st);
-                }
-                if (is->audio_stream != -1)
-                    is->m_out_audio_st = add_output_stream(is->m_oformat_ctx, is->audio_st);
-                if (avio_open(&is->m_oformat_ctx->pb, ffp->mwRecFile, AVIO_FLAG_WRITE) >= 0)
-                {
-                    if(avformat_write_header(is->m_oformat_ctx, NULL) >= 0)//写入文件头
-                    {
-                        ret = 1;
-                    }else
-                    {
-                        if (is->m_oformat_ctx)
-                        {
-                                
-                            for(i = 0; i < is->m_oformat_ctx->nb_streams; i++)
-                            {
-                                av_freep(&is->m_oformat_ctx->streams[i]->codec);
-                                av_freep(&is->m_oformat_ctx->streams[i]);
-                            }
-                                
-                            if (!(is->m_output_fmt->flags & AVFMT_NOFILE))
-                                avio_close(is->m_oformat_ctx->pb);
-                            av_free(is->m_oformat_ctx);
-                                
-                            if(is->m_key_pkt)
-                                av_free_packet(is->m_key_pkt);
-                                
-                            is->m_output_fmt = NULL;
-                            is->m_oformat_ctx = NULL;
-                            is->m_out_video_st = NULL;
-                            is->m_out_audio_st = NULL;
-                            is->m_key_pkt = NULL;
-                            ffp->m_bRecorder = 0;
-                        }
-                    }
-                }else{
-                    if (is->m_oformat_ctx)
-                    {
-                        for(i = 0; i < is->m_oformat_ctx->nb_streams; i++)
-                        {
-                            av_freep(&is->m_oformat_ctx->streams[i]->codec);
-                            av_freep(&is->m_oformat_ctx->streams[i]);
-                        }
-                            
-                        av_free(is->m_oformat_ctx);
-                            
-                        if(is->m_key_pkt)
-                            av_free_packet(is->m_key_pkt);
-                            
-                        is->m_output_fmt = NULL;
-                        is->m_oformat_ctx = NULL;
-                        is->m_out_video_st = NULL;
-                        is->m_out_audio_st = NULL;
-                        is->m_key_pkt = NULL;
-                        ffp->m_bRecorder = 0;
-                    }
-                }
-            }
-        }
-    }
-    return ret;
-}
-    
-    //关闭录像文件
-static void close_record_file(FFPlayer *ffp)
-{
-    int i;
-    VideoState *is = ffp->is;
-        
-    if (is->m_oformat_ctx)
-    {
-        av_write_trailer(is->m_oformat_ctx);
-            
-        for(i = 0; i < is->m_oformat_ctx->nb_streams; i++)
-        {
-            av_freep(&is->m_oformat_ctx->streams[i]->codec);
-            av_freep(&is->m_oformat_ctx->streams[i]);
-        }
-            
-        if (!(is->m_output_fmt->flags & AVFMT_NOFILE))
-            avio_close(is->m_oformat_ctx->pb);
-        av_free(is->m_oformat_ctx);
-            
-        if(is->m_key_pkt)
-            av_free_packet(is->m_key_pkt);
-            
-        is->m_output_fmt = NULL;
-        is->m_oformat_ctx = NULL;
-        is->m_out_video_st = NULL;
-        is->m_out_audio_st = NULL;
-        is->m_key_pkt = NULL;
-        ffp->m_bRecorder = 0;
-    }
-}
-    
-    static void drop_queue_until_pts(PacketQueue *q, int64_t drop_to_pts) {
-        MyAVPacketList *pkt1 = NULL;
-        int del_nb_packets = 0;
-        for (;;) {
-            pkt1 = q->first_pkt;
-            if (!pkt1) {
-                break;
-            }
-            // video need key frame? 这里如果不判断是否是关键帧会导致视频画面花屏。但是这样会导致全部清空的可能也会出现花屏
-            // 所以这里推流端设置好 GOP 的大小，如果 max_cached_duration > 2 * GOP，可以尽可能规避全部清空
-            // 也可以在调用control_queue_duration之前判断新进来的视频pkt是否是关键帧，这样即使全部清空了也不会花屏
-            if ((pkt1->pkt.flags & AV_PKT_FLAG_KEY) && pkt1->pkt.pts >= drop_to_pts) {
-                //        if (pkt1->pkt.pts >= drop_to_pts) {
-                break;
-            }
-            q->first_pkt = pkt1->next;
-            if (!q->first_pkt)
-                q->last_pkt = NULL;
-            q->nb_packets--;
-            ++del_nb_packets;
-            q->size -= pkt1->pkt.size + sizeof(*pkt1);
-            if (pkt1->pkt.duration > 0)
-                q->duration -= pkt1->pkt.duration;
-            av_free_packet(&pkt1->pkt);
-#ifdef FFP_MERGE
-            av_free(pkt1);
-#else
-            pkt1->next = q->recycle_pkt;
-            q->recycle_pkt = pkt1;
-#endif
-        }
-        av_log(NULL, AV_LOG_INFO, "233 del_nb_packets = %d.\n", del_nb_packets);
-    }
-    
-    static void control_video_queue_duration(FFPlayer *ffp, VideoState *is) {
-        int time_base_valid = 0;
-        int64_t cached_duration = -1;
-        int nb_packets = 0;
-        int64_t duration = 0;
-        int64_t drop_to_pts = 0;
-        
-        //Lock
-        SDL_LockMutex(is->videoq.mutex);
-        
-        time_base_valid = is->video_st->time_base.den > 0 && is->video_st->time_base.num > 0;
-        nb_packets = is->videoq.nb_packets;
-        
-        // TOFIX: if time_base_valid false, calc duration with nb_packets and framerate
-        // 为什么不用 videoq.duration？因为遇到过videoq.duration 一直为0，audioq也一样
-        if (time_base_valid) {
-            if (is->videoq.first_pkt && is->videoq.last_pkt) {
-                duration = is->videoq.last_pkt->pkt.pts - is->videoq.first_pkt->pkt.pts;
-                cached_duration = duration * av_q2d(is->video_st->time_base) * 1000;
+    // spsc模式下只能在read_thread调用
+    static int packet_queue_pts_span(PacketQueue *q, int64_t *first_pts, int64_t *last_pts) {
+        unsigned int r;
+        int ret = 0;
+        if (q->ring) {
+            r = __atomic_load_n(&q->ring_read, __ATOMIC_SEQ_CST);
+            if (r != q->ring_write) {
+                *first_pts = q->ring[r & q->ring_mask].pkt.pts;
+                *last_pts  = q->last_pts;
+                ret = 1;
             }
-        }
-        
-        if (cached_duration > is->max_cached_duration) {
-            // drop
-            av_log(NULL, AV_LOG_INFO, "233 video cached_duration = %lld, nb_packets = %d.\n", cached_duration, nb_packets);
-            drop_to_pts = is->videoq.last_pkt->pkt.pts - is->max_cached_duration;  // 这里删掉一半，你也可以自己修改，依据设置进来的max_cached_duration大小
-            drop_queue_until_pts(&is->videoq, drop_to_pts);
-        }
-        
-        //Unlock
-        SDL_UnlockMutex(is->videoq.mutex);
-    }
-    
-    static void control_audio_queue_duration(FFPlayer *ffp, VideoState *is) {
-        int time_base_valid = 0;
-        int64_t cached_duration = -1;
-        int nb_packets = 0;
-        int64_t duration = 0;
-        int64_t drop_to_pts = 0;
-        
-        //Lock
-        SDL_LockMutex(is->audioq.mutex);
-        
-        time_base_valid = is->audio_st->time_base.den > 0 && is->audio_st->time_base.num > 0;
-        nb_packets = is->audioq.nb_packets;
-        
-        // TOFIX: if time_base_valid false, calc duration with nb_packets and samplerate
-        if (time_base_valid) {
-            if (is->audioq.first_pkt && is->audioq.last_pkt) {
-                duration = is->audioq.last_pkt->pkt.pts - is->audioq.first_pkt->pkt.pts;
-                cached_duration = duration * av_q2d(is->audio_st->time_base) * 1000;
+        } else {
+            SDL_LockMutex(q->mutex);
+            if (q->first_pkt) {
+                *first_pts = q->first_pkt->pkt.pts;
+                *last_pts  = q->last_pts;
+                ret = 1;
             }
+            SDL_UnlockMutex(q->mutex);
         }
-        
-        if (cached_duration > is->max_cached_duration) {
-            // drop
-            av_log(NULL, AV_LOG_INFO, "233 audio cached_duration = %lld, nb_packets = %d.\n", cached_duration, nb_packets);
-            drop_to_pts = is->audioq.last_pkt->pkt.pts - is->max_cached_duration;
-            drop_queue_until_pts(&is->audioq, drop_to_pts);
-        }
-        
-        //Unlock
-        SDL_UnlockMutex(is->audioq.mutex);
+        return ret && *first_pts != AV_NOPTS_VALUE && *last_pts != AV_NOPTS_VALUE;
     }
-    
+
+    // 以视频队列为准（没有视频时用音频）裁剪到关键帧，音频裁剪到同一时间点，保持音画同步
+    // 推流端的 GOP 需小于 max_cached_duration，否则找不到可以裁剪的关键帧
     static void control_queue_duration(FFPlayer *ffp, VideoState *is) {
+        PacketQueue *q = NULL;
+        AVRational tb;
+        int64_t first_pts = 0;
+        int64_t last_pts = 0;
+        int64_t cut_pts = 0;
+        int64_t audio_cut_pts = 0;
+        int64_t cached_duration = 0;
+        int64_t dropped_duration = 0;
+        int nb_packets = 0;
+
         if (is->max_cached_duration <= 0) {
             return;
         }
-        
-        if (is->audio_st) {
-            return control_audio_queue_duration(ffp, is);
-        }
-        if (is->video_st) {
-            return control_video_queue_duration(ffp, is);
-        }
-        
-}
-
-static void save_record_data(FFPlayer *ffp, AVPacket *pkt, int64_t *first_rec_pts, int64_t *first_rec_dts, int64_t *first_audio_rec_pts, int64_t *first_audio_rec_dts){
-        //write record
-        VideoState *is = ffp->is;
-        AVStream *in_stream, *out_stream;
-        int out_index;
-        in_stream = is->ic->streams[pkt->stream_index];
-        // out_stream = is->ofmt_ctx->streams[pkt->stream_index];
-        AVPacket *repkt = av_malloc(sizeof(AVPacket));
-        av_init_packet(repkt);
-        repkt->data = NULL;
-        repkt->size = 0;
-        av_new_packet(repkt, pkt->size);
-        memcpy(repkt->data, pkt->data, pkt->size);
-        repkt->size = pkt->size;
-        
-        if (pkt->stream_index == is->video_stream){
-            out_index = is->video_out_stream_index;
-            out_stream = is->ofmt_ctx->streams[is->video_out_stream_index];
-            if (*first_rec_pts == 0){
-                *first_rec_pts = pkt->pts;
-            }
-            
-            if (*first_rec_dts == 0){
-                *first_rec_dts = pkt->dts;
-            }
-            
-        }
-        
-        if (pkt->stream_index == is->audio_stream){
-            out_index = is->audio_out_stream_index;
-            out_stream = is->ofmt_ctx->streams[is->audio_out_stream_index];
-            //av_log(NULL, AV_LOG_DEBUG,"%s:%d\n", __func__, __LINE__);
-            if (*first_audio_rec_pts == 0){
-                *first_audio_rec_pts = pkt->pts;
-            }
-            
-            if (*first_audio_rec_dts == 0){
-                *first_audio_rec_dts = pkt->dts;
-            }
-            
-        }
-        
-        repkt->pts = pkt->pts - (pkt->stream_index == is->video_stream ? *first_rec_pts : *first_audio_rec_pts);
-        repkt->dts = pkt->dts - (pkt->stream_index == is->video_stream ? *first_rec_dts : *first_audio_rec_dts);
-        //repkt->pts = pkt->pts;
-        //repkt->dts = pkt->dts;
-        repkt->stream_index = out_index;
-        repkt->flags = pkt->flags;
-        //repkt->duration = pkt->duration;
-        repkt->pts = av_rescale_q_rnd(repkt->pts, in_stream->time_base, out_stream->time_base, AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-        repkt->dts = av_rescale_q_rnd(repkt->dts, in_stream->time_base, out_stream->time_base, AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-        repkt->duration = av_rescale_q(repkt->duration, in_stream->time_base, out_stream->time_base);
-        repkt->pos = -1;
-        if (is->ic->streams[pkt->stream_index]->codec->codec_id == AV_CODEC_ID_AAC){
-            av_bitstream_filter_filter(is->aacbsfc, is->ic->streams[pkt->stream_index]->codec, NULL, &repkt->data, &repkt->size, repkt->data, repkt->size, 0);
+
+        if (is->video_st && !(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+            q  = &is->videoq;
+            tb = is->video_st->time_base;
+        } else if (is->audio_st) {
+            q  = &is->audioq;
+            tb = is->audio_st->time_base;
+        } else {
+            return;
         }
-        
-        av_interleaved_write_frame(is->ofmt_ctx, repkt);
-        av_free_packet(repkt);
+
+        // TOFIX: if time_base invalid, calc duration with nb_packets and framerate
+        // 为什么不用 videoq.duration？因为遇到过videoq.duration 一直为0，audioq也一样
+        if (tb.num <= 0 || tb.den <= 0 || !packet_queue_pts_span(q, &first_pts, &last_pts))
+            return;
+
+        cached_duration = av_rescale_q(last_pts - first_pts, tb, (AVRational){1, 1000});
+        if (cached_duration <= is->max_cached_duration)
+            return;
+
+        nb_packets = packet_queue_trim_to_pts(q, last_pts - av_rescale_q(is->max_cached_duration, (AVRational){1, 1000}, tb), &cut_pts);
+        if (nb_packets <= 0)
+            return;
+        dropped_duration = av_rescale_q(cut_pts - first_pts, tb, (AVRational){1, 1000});
+
+        if (q == &is->videoq && is->audio_st && is->audio_st->time_base.num > 0 && is->audio_st->time_base.den > 0)
+            nb_packets += packet_queue_trim_to_pts(&is->audioq, av_rescale_q(cut_pts, tb, is->audio_st->time_base), &audio_cut_pts);
+
+        av_log(ffp, AV_LOG_INFO, "cached_duration = %"PRId64"ms, dropped %"PRId64"ms, %d packets\n",
+               cached_duration, dropped_duration, nb_packets);
+        ffp_notify_msg3(ffp, FFP_MSG_CACHED_PACKETS_DROPPED, (int)dropped_duration, nb_packets);
+    }
+
+static FFRecorder *open_recorder(FFPlayer *ffp, const char *filename, AVStream **streams, int nb_streams)
+{
+    FFRecorderConfig config = {0};
+    FFRecorder *rec;
+
+    config.format_name         = ffp->record_format;
+    config.max_queue_bytes     = ffp->record_queue_bytes;
+    config.overflow            = ffp->record_overflow;
+    config.segment_duration_ms = ffp->record_segment_ms;
+    config.segment_bytes       = ffp->record_segment_bytes;
+    config.retention_bytes     = ffp->record_retention_bytes;
+
+    rec = ffp_recorder_create(filename, streams, nb_streams, &config);
+    if (!rec)
+        av_log(ffp, AV_LOG_ERROR, "failed to start recording to %s\n", filename);
+    return rec;
 }
 
+// 替换录像实例，旧的录像在自己的线程里写完文件尾，之后的替换或 stream_close 里回收
+static void set_recorder(FFPlayer *ffp, VideoState *is, FFRecorder *rec)
+{
+    SDL_LockMutex(ffp->record_mutex);
+    ffp_recorder_close_async(&is->recorder, &is->closing_recorders);
+    is->recorder = rec;
+    SDL_UnlockMutex(ffp->record_mutex);
+}
+
+// 处理 ffp_start_record/ffp_stop_record 的请求，预录缓存先写入新录像
+static void apply_record_request(FFPlayer *ffp, VideoState *is)
+{
+    AVStream   *streams[2] = {is->video_st, is->audio_st};
+    FFRecorder *rec        = NULL;
+    char       *filename   = NULL;
+
+    SDL_LockMutex(ffp->record_mutex);
+    is->record_serial = ffp->record_serial;
+    if (ffp->record_filename)
+        filename = av_strdup(ffp->record_filename);
+    SDL_UnlockMutex(ffp->record_mutex);
+
+    if (filename) {
+        rec = open_recorder(ffp, filename, streams, 2);
+        ffp_recorder_preroll_flush(is->record_preroll, rec);
+        av_free(filename);
+    }
+    set_recorder(ffp, is, rec);
+}
 
 /* this thread gets the stream from the disk or the network */
 static int read_thread(void *arg)
@@ -3007,15 +3293,13 @@ static int read_thread(void *arg)
     int last_error = 0;
     int64_t prev_io_tick_counter = 0;
     int64_t io_tick_counter = 0;
-    int initRecordFile = 0;
-    AVPacket *repkt = NULL;
-    int iFirstWrite = 1;
-    int can_be_write = 0;
     int can_be_put_vid_packet = 0;
-	int64_t first_rec_pts=0, first_rec_dts=0;
-	int64_t first_audio_rec_pts = 0, first_audio_rec_dts = 0;
+    const char *probe_key = NULL;
+    FFProbeEntry *probe_snapshot = NULL;
+    AVDictionary *probe_format_opts = NULL;
+    int probe_restored = 0;
+    int probe_full = 0;
     
-    record_queue_init();
     if (!wait_mutex) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
         ret = AVERROR(ENOMEM);
@@ -3028,6 +3312,13 @@ static int read_thread(void *arg)
     is->last_subtitle_stream = is->subtitle_stream = -1;
     is->eof = 0;
 
+    /* the options are consumed by the open, kept for a second one */
+    if (ffp->probe_cache) {
+        probe_key = ffp->probe_cache_key && *ffp->probe_cache_key ? ffp->probe_cache_key : is->filename;
+        av_dict_copy(&probe_format_opts, ffp->format_opts, 0);
+    }
+
+probe_reopen:
     ic = avformat_alloc_context();
     if (!ic) {
         av_log(NULL, AV_LOG_FATAL, "Could not allocate context.\n");
@@ -3046,6 +3337,17 @@ static int read_thread(void *arg)
         av_log(ffp, AV_LOG_WARNING, "remove 'timeout' option for rtmp.\n");
         av_dict_set(&ffp->format_opts, "timeout", NULL, 0);
     }
+    if (ffp->mmap_local_files && !is->mmap_pb) {
+        err = ijkmmap_avio_open(&is->mmap_pb, is->filename, ffp->mmap_readahead);
+        if (err < 0)
+            av_log(ffp, AV_LOG_WARNING, "mmap %s: %s, reading it as usual\n", is->filename, av_err2str(err));
+    }
+    if (is->mmap_pb) {
+        /* a probe reopen reads the mapping again from the start */
+        avio_seek(is->mmap_pb, 0, SEEK_SET);
+        ic->pb     = is->mmap_pb;
+        ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
     if (ffp->iformat_name)
         is->iformat = av_find_input_format(ffp->iformat_name);
     err = avformat_open_input(&ic, is->filename, is->iformat, &ffp->format_opts);
@@ -3071,6 +3373,17 @@ static int read_thread(void *arg)
 
     av_format_inject_global_side_data(ic);
 
+    if (probe_key) {
+        probe_snapshot = ffp_probe_cache_snapshot(ic);
+        if (!probe_full)
+            probe_restored = ffp_probe_cache_restore(probe_key, ffp->probe_cache_dir, probe_snapshot, ic);
+        if (probe_restored) {
+            /* parameters are known, only the first packet of each stream is read */
+            av_log(ffp, AV_LOG_INFO, "probe cache: hit %s\n", probe_key);
+            ic->fps_probe_size = 0;
+        }
+    }
+
     opts = setup_find_stream_info_opts(ic, ffp->codec_opts);
     orig_nb_streams = ic->nb_streams;
 
@@ -3080,6 +3393,23 @@ static int read_thread(void *arg)
         av_dict_free(&opts[i]);
     av_freep(&opts);
 
+    if (probe_restored && (err < 0 || ffp_probe_cache_validate(probe_key, ic) < 0)) {
+        av_log(ffp, AV_LOG_WARNING, "probe cache: first packets disagree with %s, full probe\n", probe_key);
+        ffp_probe_cache_invalidate(probe_key, ffp->probe_cache_dir);
+        ffp_probe_entry_freep(&probe_snapshot);
+        is->ic = NULL;
+        avformat_close_input(&ic);
+        av_dict_free(&ffp->format_opts);
+        av_dict_copy(&ffp->format_opts, probe_format_opts, 0);
+        probe_restored = 0;
+        probe_full     = 1;
+        goto probe_reopen;
+    } else if (!probe_restored && err >= 0 && probe_snapshot) {
+        ffp_probe_cache_store(probe_key, ffp->probe_cache_dir, &probe_snapshot, ic);
+    }
+    ffp_probe_entry_freep(&probe_snapshot);
+    av_dict_free(&probe_format_opts);
+
     if (err < 0) {
         av_log(NULL, AV_LOG_WARNING,
                "%s: could not find codec parameters\n", is->filename);
@@ -3289,6 +3619,7 @@ static int read_thread(void *arg)
 
             ffp_toggle_buffering(ffp, 1);
             ffp_notify_msg3(ffp, FFP_MSG_BUFFERING_UPDATE, 0, 0);
+            stream_seek_prefetch_hint(is, seek_target);
             ret = avformat_seek_file(is->ic, -1, seek_min, seek_target, seek_max, is->seek_flags);
             if (ret < 0) {
                 av_log(NULL, AV_LOG_ERROR,
@@ -3309,6 +3640,7 @@ static int read_thread(void *arg)
                     packet_queue_flush(&is->videoq);
                     packet_queue_put(&is->videoq, &flush_pkt);
                 }
+                ffp_recorder_preroll_reset(is->record_preroll);
                 if (is->seek_flags & AVSEEK_FLAG_BYTE) {
                    set_clock(&is->extclk, NAN, 0);
                 } else {
@@ -3357,7 +3689,7 @@ static int read_thread(void *arg)
 #ifdef FFP_MERGE
               (is->audioq.size + is->videoq.size + is->subtitleq.size > MAX_QUEUE_SIZE
 #else
-              (is->audioq.size + is->videoq.size + is->subtitleq.size > ffp->dcc.max_buffer_size
+              (is->audioq.size + is->videoq.size + is->subtitleq.size > (ffp->dcc.autotune_max_buffer_size > 0 ? ffp->dcc.autotune_max_buffer_size : ffp->dcc.max_buffer_size)
 #endif
             || (   stream_has_enough_packets(is->audio_st, is->audio_stream, &is->audioq, MIN_FRAMES)
                 && stream_has_enough_packets(is->video_st, is->video_stream, &is->videoq, MIN_FRAMES)
@@ -3365,6 +3697,7 @@ static int read_thread(void *arg)
             if (!is->eof) {
                 ffp_toggle_buffering(ffp, 0);
             }
+            stream_wakeup_decoders(is);
             /* wait 10 ms */
             SDL_LockMutex(wait_mutex);
             SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
@@ -3408,26 +3741,9 @@ static int read_thread(void *arg)
             }
         }
         pkt->flags = 0;
-            //本地录像初始化文件输出格式
-        if(ffp->m_bRecorder && !initRecordFile)
-        {
-            initRecordFile = init_record_file(ffp);
-                
-            if(!initRecordFile)
-            {
-                //PostMessage(play->m_hWnd,WM_Wireless_INFO,INFO_DEBUG_INIT_RECORD_ERR,0);//初始化录像文件失败
-                av_log(NULL, AV_LOG_DEBUG, "init recorder file failed");
-                ffp->m_bRecorder = 0;
-            }
-            
-        }
-            
-            //停止录像
-        if(!ffp->m_bRecorder && initRecordFile)
-        {
-            close_record_file(ffp);
-            initRecordFile = 0;
-        }
+        //开始/停止录像
+        if (is->record_serial != __atomic_load_n(&ffp->record_serial, __ATOMIC_ACQUIRE))
+            apply_record_request(ffp, is);
         ret = av_read_frame(ic, pkt);
         av_log(ffp, AV_LOG_DEBUG, "new stream_index == %d\n", pkt->stream_index);
         if (ret < 0) {
@@ -3441,8 +3757,8 @@ static int read_thread(void *arg)
                 pb_eof = 1;
                 pb_error = ic->pb->error;
                 //关闭录像
-                if(ffp->m_bRecorder)
-                    close_record_file(ffp);
+                if (is->recorder)
+                    set_recorder(ffp, is, NULL);
             }
             if (ret == AVERROR_EXIT) {
                 pb_eof = 1;
@@ -3481,6 +3797,7 @@ static int read_thread(void *arg)
                 ffp_toggle_buffering(ffp, 0);
                 SDL_Delay(100);
             }
+            stream_wakeup_decoders(is);
             SDL_LockMutex(wait_mutex);
             SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
             SDL_UnlockMutex(wait_mutex);
@@ -3497,165 +3814,38 @@ static int read_thread(void *arg)
             if (is->subtitle_stream >= 0) {
                 packet_queue_put(&is->subtitleq, &flush_pkt);
             }
-            if (is->video_stream >= 0) {
-                packet_queue_put(&is->videoq, &flush_pkt);
-            }
-        }
-
-        /* check if packet is in play range specified by user, then queue, otherwise discard */
-        stream_start_time = ic->streams[pkt->stream_index]->start_time;
-        pkt_ts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
-        pkt_in_play_range = ffp->duration == AV_NOPTS_VALUE ||
-                (pkt_ts - (stream_start_time != AV_NOPTS_VALUE ? stream_start_time : 0)) *
-                av_q2d(ic->streams[pkt->stream_index]->time_base) -
-                (double)(ffp->start_time != AV_NOPTS_VALUE ? ffp->start_time : 0) / 1000000
-                <= ((double)ffp->duration / 1000000);
-            //本地录像
-            if(ffp->m_bRecorder == 1 && initRecordFile == 1)
-            {
-                repkt = av_malloc(sizeof(AVPacket));
-                av_init_packet(repkt);
-                repkt->data = NULL;
-                repkt->size = 0;
-                av_new_packet(repkt, pkt->size);
-                memcpy( repkt->data, pkt->data, pkt->size);
-                repkt->pts = pkt->pts;
-                repkt->dts = pkt->dts;
-                repkt->stream_index = pkt->stream_index;
-                repkt->flags = pkt->flags;
-                repkt->duration = pkt->duration;
-                repkt->pos = pkt->pos;
-                
-                //第一次写文件， 则是必须等到视频关键帧再写文件
-                if(iFirstWrite == 1)
-                {
-                    if (pkt->stream_index == is->video_stream)//视频帧
-                    {
-                        if ((pkt->flags & AV_PKT_FLAG_KEY) == AV_PKT_FLAG_KEY)//关键帧
-                        {
-                            
-                            if(is->m_oformat_ctx)//MP4文件
-                            {
-                                repkt->stream_index = 0;
-                                if(repkt->pts!=AV_NOPTS_VALUE);
-                                repkt->pts = av_rescale_q(repkt->pts,is->ic->streams[is->video_stream]->time_base,
-                                                          is->m_oformat_ctx->streams[is->video_stream]->time_base);
-                                if(repkt->dts!=AV_NOPTS_VALUE);
-                                repkt->dts = av_rescale_q(repkt->dts,is->ic->streams[is->video_stream]->time_base,
-                                                          is->m_oformat_ctx->streams[is->video_stream]->time_base);
-                                av_interleaved_write_frame(is->m_oformat_ctx, repkt);
-                            }
-                            iFirstWrite = 0;
-                        }
-                    }
-                }
-                else
-                {
-                    if(is->m_oformat_ctx)//MP4文件
-                    {
-                        int packetindex = 0;
-                        if (repkt->stream_index == is->video_stream)
-                            packetindex = 0;
-                        if (repkt->stream_index == is->audio_stream)
-                            packetindex = 1;
-                        if(repkt->pts!=AV_NOPTS_VALUE);
-                        repkt->pts = av_rescale_q(repkt->pts,is->ic->streams[repkt->stream_index]->time_base,
-                                                  is->m_oformat_ctx->streams[packetindex]->time_base);
-                        if(repkt->dts!=AV_NOPTS_VALUE);
-                        repkt->dts = av_rescale_q(repkt->dts,is->ic->streams[repkt->stream_index]->time_base,
-                                                  is->m_oformat_ctx->streams[packetindex]->time_base);
-                        repkt->stream_index = packetindex;
-                        av_interleaved_write_frame(is->m_oformat_ctx, repkt);
-                        
-                    }
-                    
-                }
-                av_free_packet(repkt);
-                av_freep(&repkt);
-                //pkt = NULL;	
-            }
-            else
-            iFirstWrite = 0;
-            
-            //local file record start
-            AVDictionaryEntry *e = av_dict_get(ffp->player_opts, "local_record_start", NULL, 0);
-            if (e) {
-                int local_record_start = atoi(e->value);
-                if (local_record_start <= 0) {
-                    is->local_record_start = 0;
-                } else {
-                    is->local_record_start = local_record_start;
-                    AVDictionaryEntry *e = av_dict_get(ffp->player_opts, "local_record_filename", NULL, 0);
-                    
-                    if (e) {
-                        is->local_record_filename = e->value;
-                    }else{
-                        is->local_record_filename = "";
-                    }
-                }
-            } else {
-                is->local_record_start = 0;
+            if (is->video_stream >= 0) {
+                packet_queue_put(&is->videoq, &flush_pkt);
             }
-            
-            if((pkt->flags & AV_PKT_FLAG_KEY) == AV_PKT_FLAG_KEY&&pkt->stream_index == is->video_stream){//±£¥Ê…œ“ª∏ˆIFrame
-                //*keyPkt = *pkt;
-                //av_log(NULL, AV_LOG_ERROR, "%s:%d, recorQueue.max_size = %d\n", __func__, __LINE__, recorQueue.max_size);
-                recorQueue.writeIndex = 0;
-                recorQueue.readIndex = 0;
-                recorQueue.max_size = 0;
-                AVPacket *tmpPkt= recorQueue.rePkt[recorQueue.writeIndex].recordPkt;
-                av_copy_packet(tmpPkt, pkt);
-                recorQueue.writeIndex++;
-                recorQueue.max_size++;
-                
-            }else if(recorQueue.writeIndex > 0){
-                if(recorQueue.writeIndex == MAX_RECORD_CACHE){
-                    //av_log(NULL, AV_LOG_ERROR, "%s:%d, recorQueue.max_size = %d\n", __func__, __LINE__, recorQueue.max_size);
-                    recorQueue.writeIndex = 0;
-                    recorQueue.max_size = 0;
-                    av_log(NULL, AV_LOG_ERROR, "There is dangerous that first frame not a I frame\n");
-                }
-                AVPacket *tmpPkt= recorQueue.rePkt[recorQueue.writeIndex].recordPkt;
-                av_copy_packet(tmpPkt, pkt);
-                recorQueue.writeIndex++;
-                recorQueue.max_size++;
+        }
+
+        /* check if packet is in play range specified by user, then queue, otherwise discard */
+        stream_start_time = ic->streams[pkt->stream_index]->start_time;
+        pkt_ts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        pkt_in_play_range = ffp->duration == AV_NOPTS_VALUE ||
+                (pkt_ts - (stream_start_time != AV_NOPTS_VALUE ? stream_start_time : 0)) *
+                av_q2d(ic->streams[pkt->stream_index]->time_base) -
+                (double)(ffp->start_time != AV_NOPTS_VALUE ? ffp->start_time : 0) / 1000000
+                <= ((double)ffp->duration / 1000000);
+
+        //预录缓存和录像
+        if (pkt_in_play_range &&
+            (pkt->stream_index == is->audio_stream || pkt->stream_index == is->video_stream)) {
+            if (is->record_preroll) {
+                int gop_start = is->video_stream < 0 ||
+                                (pkt->stream_index == is->video_stream && (pkt->flags & AV_PKT_FLAG_KEY));
+                ffp_recorder_preroll_put(is->record_preroll, pkt, ic->streams[pkt->stream_index]->time_base, gop_start);
             }
-            if(is->local_record_start){
-                
-                if (!can_be_write)
-                {
-                    if (!is->ofmt_ctx)
-                        mw_initOutPutStream(ffp, is->local_record_filename);
-                    
-                    if (is->ofmt_ctx)
-                    {
-                        can_be_write = 1;
-                        for(int rIndex = 0; rIndex < recorQueue.max_size-1; rIndex++){
-                            AVPacket *mRecPacket = recorQueue.rePkt[rIndex].recordPkt;
-                            save_record_data(ffp, mRecPacket, &first_rec_pts, &first_rec_dts, &first_audio_rec_pts, &first_audio_rec_dts);
-                        }
-                        //save_record_data(ffp, keyPkt, &first_rec_pts, &first_rec_dts, &first_audio_rec_pts, &first_audio_rec_dts);
-                    }
-                }
-                
-                if (can_be_write)
-                {
-                    save_record_data(ffp, pkt, &first_rec_pts, &first_rec_dts, &first_audio_rec_pts, &first_audio_rec_dts);
-                }
-            }else if(!is->local_record_start&&is->ofmt_ctx){
-                can_be_write = 0;
-                first_rec_pts=0;
-                first_rec_dts=0;
-                first_audio_rec_pts = 0;
-                first_audio_rec_dts = 0;
-                mw_closeOutPutStream(ffp);
+            if (is->recorder && ffp_recorder_write(is->recorder, pkt) < 0)
+                set_recorder(ffp, is, NULL);
         }
         // 每次读取一个pkt，都去判断处理
         // TODO:优化，不用每次都调用
         if (is->max_cached_duration > 0) {
             control_queue_duration(ffp, is);
         }
-        
+
+
         if (pkt->stream_index == is->audio_stream && pkt_in_play_range) {
             packet_queue_put(&is->audioq, pkt);
         } else if (pkt->stream_index == is->video_stream && pkt_in_play_range
@@ -3733,6 +3923,8 @@ static int read_thread(void *arg)
  fail:
     if (ic && !is->ic)
         avformat_close_input(&ic);
+    ffp_probe_entry_freep(&probe_snapshot);
+    av_dict_free(&probe_format_opts);
 
     if (!ffp->prepared || !is->abort_request) {
         ffp->last_error = last_error;
@@ -3766,10 +3958,28 @@ static VideoState *stream_open(FFPlayer *ffp, const char *filename, AVInputForma
     if (frame_queue_init(&is->sampq, &is->audioq, SAMPLE_QUEUE_SIZE, 1) < 0)
         goto fail;
 
-    if (packet_queue_init(&is->videoq) < 0 ||
-        packet_queue_init(&is->audioq) < 0 ||
-        packet_queue_init(&is->subtitleq) < 0)
-        goto fail;
+    if (ffp->packet_queue_spsc) {
+        if (packet_queue_init_spsc(&is->videoq, ffp->packet_queue_spsc_size, ffp->packet_queue_wakeup_batch) < 0 ||
+            packet_queue_init_spsc(&is->audioq, ffp->packet_queue_spsc_size, ffp->packet_queue_wakeup_batch) < 0 ||
+            packet_queue_init_spsc(&is->subtitleq, ffp->packet_queue_spsc_size, ffp->packet_queue_wakeup_batch) < 0)
+            goto fail;
+    } else if (ffp->packet_pool) {
+        if (packet_queue_init_slab(&is->videoq) < 0 ||
+            packet_queue_init_slab(&is->audioq) < 0 ||
+            packet_queue_init_slab(&is->subtitleq) < 0)
+            goto fail;
+    } else {
+        if (packet_queue_init(&is->videoq) < 0 ||
+            packet_queue_init(&is->audioq) < 0 ||
+            packet_queue_init(&is->subtitleq) < 0)
+            goto fail;
+    }
+
+    if (ffp->record_preroll_ms > 0) {
+        is->record_preroll = ffp_recorder_preroll_create(ffp->record_preroll_ms, ffp->record_queue_bytes);
+        if (!is->record_preroll)
+            goto fail;
+    }
 
     if (!(is->continue_read_thread = SDL_CreateCond())) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateCond(): %s\n", SDL_GetError());
@@ -3779,6 +3989,9 @@ static VideoState *stream_open(FFPlayer *ffp, const char *filename, AVInputForma
     init_clock(&is->vidclk, &is->videoq.serial);
     init_clock(&is->audclk, &is->audioq.serial);
     init_clock(&is->extclk, &is->extclk.serial);
+    is->catchup_speed = 1.0;
+    /* back to the user's rate if the last stream ended catching up */
+    ffp->pf_playback_rate_changed = 1;
     is->audio_clock_serial = -1;
     is->audio_volume = SDL_MIX_MAXVOLUME;
     is->muted = 0;
@@ -3838,6 +4051,9 @@ static int video_refresh_thread(void *arg)
         remaining_time = REFRESH_RATE;
         if (is->show_mode != SHOW_MODE_NONE && (!is->paused || is->force_refresh))
             video_refresh(ffp, &remaining_time);
+        /* keep up with the decoder instead of the timestamps */
+        if (ffp->present_unthrottled && !is->paused)
+            remaining_time = frame_queue_nb_remaining(&is->pictq) > 0 ? 0.0 : FFMIN(remaining_time, 0.001);
     }
 
     return 0;
@@ -4058,6 +4274,8 @@ FFPlayer *ffp_create()
     msg_queue_init(&ffp->msg_queue);
     ffp->af_mutex = SDL_CreateMutex();
     ffp->vf_mutex = SDL_CreateMutex();
+    ffp->record_mutex = SDL_CreateMutex();
+    ffp_bandwidth_init(&ffp->bandwidth);
 
     ffp_reset_internal(ffp);
     ffp->av_class = &ffp_context_class;
@@ -4079,6 +4297,7 @@ void ffp_destroy(FFPlayer *ffp)
         ffp->is = NULL;
     }
 
+    ffp_intercom_freep(&ffp->intercom);
     SDL_VoutFreeP(&ffp->vout);
     SDL_AoutFreeP(&ffp->aout);
     ffpipenode_free_p(&ffp->node_vdec);
@@ -4088,6 +4307,8 @@ void ffp_destroy(FFPlayer *ffp)
 
     SDL_DestroyMutexP(&ffp->af_mutex);
     SDL_DestroyMutexP(&ffp->vf_mutex);
+    SDL_DestroyMutexP(&ffp->record_mutex);
+    ffp_bandwidth_destroy(&ffp->bandwidth);
 
     msg_queue_destroy(&ffp->msg_queue);
 
@@ -4120,6 +4341,35 @@ static AVDictionary **ffp_get_opt_dict(FFPlayer *ffp, int opt_category)
     }
 }
 
+/*
+ * Feed the bandwidth estimator from the tcp read sampler, once per half
+ * sample range. Reads only run at network speed while buffering, else the
+ * demuxer paces them and the speed is a lower bound.
+ * The same bytes come with the async read speed when async is used, which
+ * is the better source then: after its first sample, this one is skipped.
+ * Called from every io thread, under af_mutex.
+ */
+static void ffp_sample_tcp_read_speed_l(FFPlayer *ffp, int64_t bytes)
+{
+    int64_t now     = (int64_t)SDL_GetTickHR();
+    int64_t elapsed = now - ffp->bandwidth_sample_tick;
+    int64_t speed;
+
+    SDL_SpeedSampler2Add(&ffp->stat.tcp_read_sampler, (int)bytes);
+    if (ffp->bandwidth_from_async)
+        return;
+    if (ffp->bandwidth_sample_tick == 0) {
+        ffp->bandwidth_sample_tick = now;
+        return;
+    }
+    if (elapsed < FFP_TCP_READ_SAMPLE_RANGE / 2)
+        return;
+
+    ffp->bandwidth_sample_tick = now;
+    speed = SDL_SpeedSampler2GetSpeed(&ffp->stat.tcp_read_sampler);
+    ffp_bandwidth_add_sample(&ffp->bandwidth, speed * elapsed / 1000, elapsed, ffp->is && ffp->is->buffering_on);
+}
+
 static int app_func_event(AVApplicationContext *h, int message ,void *data, size_t size)
 {
     if (!h || !h->opaque || !data)
@@ -4130,8 +4380,17 @@ static int app_func_event(AVApplicationContext *h, int message ,void *data, size
         return 0;
     if (message == AVAPP_EVENT_IO_TRAFFIC && sizeof(AVAppIOTraffic) == size) {
         AVAppIOTraffic *event = (AVAppIOTraffic *)(intptr_t)data;
-        if (event->bytes > 0)
-            SDL_SpeedSampler2Add(&ffp->stat.tcp_read_sampler, event->bytes);
+        if (event->bytes > 0) {
+            SDL_LockMutex(ffp->af_mutex);
+            ffp_sample_tcp_read_speed_l(ffp, event->bytes);
+            SDL_UnlockMutex(ffp->af_mutex);
+        }
+    } else if (message == AVAPP_EVENT_ASYNC_READ_SPEED && sizeof(AVAppAsyncReadSpeed) == size) {
+        AVAppAsyncReadSpeed *speed = (AVAppAsyncReadSpeed *)(intptr_t)data;
+        SDL_LockMutex(ffp->af_mutex);
+        ffp->bandwidth_from_async = 1;
+        SDL_UnlockMutex(ffp->af_mutex);
+        ffp_bandwidth_add_sample(&ffp->bandwidth, speed->io_bytes, speed->elapsed_milli, speed->is_full_speed);
     } else if (message == AVAPP_EVENT_ASYNC_STATISTIC && sizeof(AVAppAsyncStatistic) == size) {
         AVAppAsyncStatistic *statistic =  (AVAppAsyncStatistic *) (intptr_t)data;
         ffp->stat.buf_backwards = statistic->buf_backwards;
@@ -4287,6 +4546,8 @@ int ffp_prepare_async_l(FFPlayer *ffp, const char *file_name)
     av_log(NULL, AV_LOG_INFO, "===================\n");
 
     av_opt_set_dict(ffp, &ffp->player_opts);
+    if (SDL_VoutSetConvertThreads(ffp->vout, ffp->video_convert_threads, ffp->video_convert_slice_threshold) < 0)
+        av_log(ffp, AV_LOG_WARNING, "video-convert-threads: the vout's convert pool is running, keeping its threads\n");
     if (!ffp->aout) {
         ffp->aout = ffpipeline_open_audio_output(ffp->pipeline, ffp);
         if (!ffp->aout)
@@ -4606,6 +4867,54 @@ void ffp_statistic_l(FFPlayer *ffp)
     ffp_video_statistic_l(ffp);
 }
 
+/*
+ * Buffer just enough for the measured network: the slower it is against the
+ * media bitrate and the less steady, the higher the water mark to resume at
+ * and the more to read ahead. Plans for a network one deviation below the
+ * mean.
+ */
+static void ffp_autotune_buffering_l(FFPlayer *ffp)
+{
+    int64_t bandwidth    = 0;
+    int64_t deviation    = 0;
+    int64_t byte_rate    = ffp->stat.bit_rate / 8;
+    int64_t cached_ms    = FFMAX(ffp->stat.audio_cache.duration, ffp->stat.video_cache.duration);
+    int64_t cached_bytes = ffp->stat.audio_cache.bytes + ffp->stat.video_cache.bytes;
+    double  ratio;
+    double  cv;
+    double  hwm_in_ms;
+    double  buffer_ms;
+
+    if (ffp_bandwidth_get(&ffp->bandwidth, &bandwidth, &deviation) < FFP_BANDWIDTH_MIN_SAMPLES || bandwidth <= 0)
+        return;
+
+    /* live streams often tell no bitrate, measure the queued packets */
+    if (byte_rate <= 0 && cached_ms >= 500)
+        byte_rate = cached_bytes * 1000 / cached_ms;
+    if (byte_rate <= 0)
+        return;
+
+    ratio = (double)byte_rate / FFMAX(bandwidth - deviation, bandwidth / 8);
+    cv    = (double)deviation / bandwidth;
+
+    if (ratio < 1.0)
+        hwm_in_ms = ffp->dcc.next_high_water_mark_in_ms * (ratio + cv);
+    else
+        hwm_in_ms = ffp->dcc.next_high_water_mark_in_ms * ratio * (1.0 + cv);
+    hwm_in_ms = av_clipd(hwm_in_ms, ffp->dcc.first_high_water_mark_in_ms, ffp->dcc.last_high_water_mark_in_ms);
+
+    buffer_ms = FFMAX(hwm_in_ms * 4, ffp->dcc.last_high_water_mark_in_ms * 2) * (1.0 + cv);
+
+    if ((int)hwm_in_ms != ffp->dcc.autotune_high_water_mark_in_ms) {
+        av_log(ffp, AV_LOG_DEBUG, "autotune: bandwidth %"PRId64"+-%"PRId64" B/s, media %"PRId64" B/s, hwm %d ms\n",
+               bandwidth, deviation, byte_rate, (int)hwm_in_ms);
+    }
+    ffp->dcc.autotune_high_water_mark_in_ms = (int)hwm_in_ms;
+    ffp->dcc.autotune_max_buffer_size       = (int)av_clip64((int64_t)(byte_rate * buffer_ms / 1000),
+                                                             ffp->dcc.high_water_mark_in_bytes,
+                                                             ffp->dcc.max_buffer_size);
+}
+
 void ffp_check_buffering_l(FFPlayer *ffp)
 {
     VideoState *is            = ffp->is;
@@ -4618,6 +4927,9 @@ void ffp_check_buffering_l(FFPlayer *ffp)
     int video_time_base_valid = 0;
     int64_t buf_time_position = -1;
 
+    if (ffp->dcc.autotune)
+        ffp_autotune_buffering_l(ffp);
+
     if(is->audio_st)
         audio_time_base_valid = is->audio_st->time_base.den > 0 && is->audio_st->time_base.num > 0;
     if(is->video_st)
@@ -4706,7 +5018,10 @@ void ffp_check_buffering_l(FFPlayer *ffp)
     }
 
     if (need_start_buffering) {
-        if (hwm_in_ms < ffp->dcc.next_high_water_mark_in_ms) {
+        if (ffp->dcc.autotune_high_water_mark_in_ms > 0) {
+            /* the measured network decides, not the doubling ramp */
+            hwm_in_ms = ffp->dcc.autotune_high_water_mark_in_ms;
+        } else if (hwm_in_ms < ffp->dcc.next_high_water_mark_in_ms) {
             hwm_in_ms = ffp->dcc.next_high_water_mark_in_ms;
         } else {
             hwm_in_ms *= 2;
@@ -4758,7 +5073,7 @@ void ffp_set_playback_rate(FFPlayer *ffp, float rate)
         return;
 
     ffp->pf_playback_rate = rate;
-    ffp->pf_playback_rate_changed = 1;
+    __atomic_store_n(&ffp->pf_playback_rate_changed, 1, __ATOMIC_RELEASE);
 }
 
 void ffp_set_playback_volume(FFPlayer *ffp, float volume)
@@ -4951,6 +5266,90 @@ int64_t ffp_get_property_int64(FFPlayer *ffp, int id, int64_t default_value)
             return ffp->stat.buf_capacity;
         case FFP_PROP_INT64_LATEST_SEEK_LOAD_DURATION:
             return ffp ? ffp->stat.latest_seek_load_duration : default_value;
+        case FFP_PROP_INT64_PACKET_NODE_ALLOC_COUNT:
+            if (!ffp || !ffp->is)
+                return default_value;
+            return ffp->is->videoq.alloc_count + ffp->is->audioq.alloc_count + ffp->is->subtitleq.alloc_count;
+        case FFP_PROP_INT64_PACKET_NODE_RECYCLE_COUNT:
+            if (!ffp || !ffp->is)
+                return default_value;
+            return ffp->is->videoq.recycle_count + ffp->is->audioq.recycle_count + ffp->is->subtitleq.recycle_count;
+        case FFP_PROP_INT64_RECORD_QUEUED_BYTES:
+        case FFP_PROP_INT64_RECORD_WRITE_LATENCY_US:
+        case FFP_PROP_INT64_RECORD_MAX_WRITE_LATENCY_US:
+        case FFP_PROP_INT64_RECORD_DROPPED_GOPS:
+        case FFP_PROP_INT64_RECORD_SEGMENTS:
+        case FFP_PROP_INT64_RECORD_SEGMENTS_BYTES: {
+            FFRecorderStat record_stat;
+            if (!ffp || !ffp->is)
+                return default_value;
+            SDL_LockMutex(ffp->record_mutex);
+            ffp_recorder_get_stat(ffp->is->recorder, &record_stat);
+            SDL_UnlockMutex(ffp->record_mutex);
+            switch (id) {
+                case FFP_PROP_INT64_RECORD_QUEUED_BYTES:            return record_stat.queued_bytes;
+                case FFP_PROP_INT64_RECORD_WRITE_LATENCY_US:        return record_stat.last_write_latency_us;
+                case FFP_PROP_INT64_RECORD_MAX_WRITE_LATENCY_US:    return record_stat.max_write_latency_us;
+                case FFP_PROP_INT64_RECORD_SEGMENTS:                return record_stat.segments;
+                case FFP_PROP_INT64_RECORD_SEGMENTS_BYTES:          return record_stat.segments_bytes;
+                default:                                            return record_stat.dropped_gops;
+            }
+        }
+        case FFP_PROP_INT64_INTERCOM_LATENCY_US:
+        case FFP_PROP_INT64_INTERCOM_MAX_LATENCY_US:
+        case FFP_PROP_INT64_INTERCOM_CAPTURE_QUEUED_FRAMES:
+        case FFP_PROP_INT64_INTERCOM_SEND_QUEUE_BYTES: {
+            FFIntercomStat intercom_stat;
+            if (!ffp)
+                return default_value;
+            ffp_intercom_get_stat(ffp->intercom, &intercom_stat);
+            switch (id) {
+                case FFP_PROP_INT64_INTERCOM_LATENCY_US:            return intercom_stat.last_latency_us;
+                case FFP_PROP_INT64_INTERCOM_MAX_LATENCY_US:        return intercom_stat.max_latency_us;
+                case FFP_PROP_INT64_INTERCOM_CAPTURE_QUEUED_FRAMES: return intercom_stat.capture_queued_frames;
+                default:                                            return intercom_stat.send_queue_bytes;
+            }
+        }
+        case FFP_PROP_INT64_VIDEO_CONVERT_TIME_US:
+            if (!ffp)
+                return default_value;
+            return ffp->stat.vconvert_us;
+        case FFP_PROP_INT64_VIDEO_MAX_CONVERT_TIME_US:
+            if (!ffp)
+                return default_value;
+            return ffp->stat.vconvert_max_us;
+        case FFP_PROP_INT64_VIDEO_CONVERT_TOTAL_TIME_US:
+            if (!ffp)
+                return default_value;
+            return ffp->stat.vconvert_total_us;
+        case FFP_PROP_INT64_VIDEO_CONVERTED_FRAMES:
+            if (!ffp)
+                return default_value;
+            return ffp->stat.vconvert_frames;
+        case FFP_PROP_INT64_VIDEO_DECODED_FRAMES:
+            if (!ffp || !ffp->is)
+                return default_value;
+            return ffp->is->viddec.decoded_frames;
+        case FFP_PROP_INT64_VIDEO_DROPPED_FRAMES:
+            if (!ffp || !ffp->is)
+                return default_value;
+            return ffp->is->frame_drops_early + ffp->is->frame_drops_late;
+        case FFP_PROP_INT64_VIDEO_FRAME_QUEUE_FRAMES:
+            if (!ffp || !ffp->is)
+                return default_value;
+            return frame_queue_nb_remaining(&ffp->is->pictq);
+        case FFP_PROP_INT64_VIDEO_PACKET_WAIT_US:
+            if (!ffp || !ffp->is)
+                return default_value;
+            return ffp->is->viddec.packet_wait_us;
+        case FFP_PROP_INT64_AUDIO_DECODED_FRAMES:
+            if (!ffp || !ffp->is)
+                return default_value;
+            return ffp->is->auddec.decoded_frames;
+        case FFP_PROP_INT64_AUDIO_PACKET_WAIT_US:
+            if (!ffp || !ffp->is)
+                return default_value;
+            return ffp->is->auddec.packet_wait_us;
         default:
             return default_value;
     }
@@ -4974,11 +5373,53 @@ IjkMediaMeta *ffp_get_meta_l(FFPlayer *ffp)
     return ffp->meta;
 }
             
+static const char *record_extension(const char *format_name)
+{
+    if (!format_name || !*format_name)
+        return "mp4";
+    if (!strcmp(format_name, "matroska"))
+        return "mkv";
+    if (!strcmp(format_name, "mpegts"))
+        return "ts";
+    return format_name;
+}
+
+int ffp_start_record(FFPlayer *ffp, const char *filename)
+{
+    char *dup;
+
+    if (!ffp || !filename || !*filename)
+        return AVERROR(EINVAL);
+
+    dup = av_strdup(filename);
+    if (!dup)
+        return AVERROR(ENOMEM);
+
+    SDL_LockMutex(ffp->record_mutex);
+    av_free(ffp->record_filename);
+    ffp->record_filename = dup;
+    __atomic_add_fetch(&ffp->record_serial, 1, __ATOMIC_RELEASE);
+    SDL_UnlockMutex(ffp->record_mutex);
+    return 0;
+}
+
+void ffp_stop_record(FFPlayer *ffp)
+{
+    if (!ffp)
+        return;
+
+    SDL_LockMutex(ffp->record_mutex);
+    av_freep(&ffp->record_filename);
+    __atomic_add_fetch(&ffp->record_serial, 1, __ATOMIC_RELEASE);
+    SDL_UnlockMutex(ffp->record_mutex);
+}
+
 void mw_start_record(FFPlayer *ffp, const char *recRootPath)
 {
     av_log(NULL, AV_LOG_DEBUG, "mw_start_record, start");
             
     struct timeval tv;
+    char filename[1024];
             
     if(access(recRootPath, F_OK) == 0)
     {
@@ -4993,204 +5434,52 @@ void mw_start_record(FFPlayer *ffp, const char *recRootPath)
             
     gettimeofday(&tv,NULL);
     long currrntTime = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-    sprintf(ffp->mwRecFile ,"%s/%ld.mp4", recRootPath, currrntTime);
-            
-    ffp->m_bRecorder = 1;
+    snprintf(filename, sizeof(filename), "%s/%ld.%s", recRootPath, currrntTime, record_extension(ffp->record_format));
             
-            
-    }
+    ffp_start_record(ffp, filename);
+}
             
 void mw_stop_record(FFPlayer *ffp)
 {
     av_log(NULL, AV_LOG_DEBUG, "mw_stop_record");
-    ffp->m_bRecorder = 0;
+    ffp_stop_record(ffp);
 }
 
-#define AUDIO_BUF_SIZE 1024*64
+static void on_intercom_error(void *opaque, int error)
+{
+    ffp_notify_msg2((FFPlayer *)opaque, FFP_MSG_INTERCOM_ERROR, error);
+}
 
-#define CAT_AUDIO_BUF_SIZE 4096 * 2
-            
-#define AUDIO_SEND_BUF_SIZE 1024 * 64
-            
-typedef struct{
-    char addr[512];
-    int port;
-    int client_fd;
-}Cmd_Addr;
-            
-void *read_record_audio_thread(void *arg){
-    AVCodec *pCodec;
-    AVCodecContext *pCodecCtx= NULL;
-    int i, ret, got_output;
-    int autioType = 2;
-    
-    AVFrame *pFrame;
-    uint8_t* frame_buf;
-    int size=0;
-    
-    AVPacket pkt;
-    int framecnt=0;
-    int total_cpy_len = 0, excpect_cpy_len = 0;
-    
-    
-    enum AVCodecID codec_id=AV_CODEC_ID_AAC;
-    
-    char audioFrame[AUDIO_BUF_SIZE];
-    uint8_t sendbuf[AUDIO_BUF_SIZE];
-    int length = 0;
-    
-    Cmd_Addr *cmd_addr = (Cmd_Addr *)arg;
-    
-    int clientSocket;
-    //ÃèÊö·þÎñÆ÷µÄsocket
-    struct sockaddr_in serverAddr;
-    
-    if((clientSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-    {
-        av_log(NULL, AV_LOG_ERROR,"create socket error\n");
-        return 1;
-    }
-    
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(cmd_addr->port);
-    
-    serverAddr.sin_addr.s_addr = inet_addr(cmd_addr->addr);
-    if(connect(clientSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0)
-    {
-        av_log(NULL, AV_LOG_ERROR,"client connect failed");
-        return 1;
-    }
-    
-    //avcodec_register_all();
-    
-    pCodec = avcodec_find_encoder_by_name("libfdk_aac");//avcodec_find_encoder(codec_id);
-    if (!pCodec) {
-        printf("Codec not found\n");
-        return -1;
-    }
-    pCodecCtx = avcodec_alloc_context3(pCodec);
-    if (!pCodecCtx) {
-        printf("Could not allocate video codec context\n");
-        return -1;
-    }
-    av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    
-    pCodecCtx->codec_id = codec_id;
-    pCodecCtx->codec_type = AVMEDIA_TYPE_AUDIO;
-    pCodecCtx->sample_fmt = AV_SAMPLE_FMT_S16;
-    pCodecCtx->sample_rate= 16000;
-    pCodecCtx->channel_layout= AV_CH_LAYOUT_MONO;
-    pCodecCtx->channels = 1;
-    pCodecCtx->bit_rate = 64000;
-    
-    //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    if (avcodec_open2(pCodecCtx, pCodec, NULL) < 0) {
-        //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-        printf("Could not open codec\n");
-        return -1;
-    }
-    //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    
-    pFrame = av_frame_alloc();
-    pFrame->nb_samples= pCodecCtx->frame_size;
-    pFrame->format= pCodecCtx->sample_fmt;
-    size = av_samples_get_buffer_size(NULL, pCodecCtx->channels,pCodecCtx->frame_size,pCodecCtx->sample_fmt, 1);
-    frame_buf = (uint8_t *)av_malloc(size);
-    avcodec_fill_audio_frame(pFrame, pCodecCtx->channels, pCodecCtx->sample_fmt,(const uint8_t*)frame_buf, size, 1);
-    
-    //Input raw data
-    //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    /*fp_in = fopen(filename_in, "rb");
-     if (!fp_in) {
-     printf("Could not open %s\n", filename_in);
-     return -1;
-     }*/
-    //Output bitstream
-    /*fp_out = fopen(filename_out, "wb");
-     if (!fp_out) {
-     printf("Could not open %s\n", filename_out);
-     return -1;
-     }*/
-    
-    //Encode
-    while(audio_record_start) {
-        av_init_packet(&pkt);
-        pkt.data = NULL;    // packet data will be allocated by the encoder
-        pkt.size = 0;
-        //Read raw data
-        length    = getRecordFrameData(audioFrame);
-        if(length <= 0)
-            continue;
-        excpect_cpy_len = (size -total_cpy_len) < length ? size -total_cpy_len : length;
-        memcpy(frame_buf+total_cpy_len, audioFrame, excpect_cpy_len);
-        total_cpy_len += excpect_cpy_len;
-        if(total_cpy_len == size ){
-            pFrame->pts = 0;
-            ret = avcodec_encode_audio2(pCodecCtx, &pkt, pFrame, &got_output);
-            if (ret < 0) {
-                printf("Error encoding frame\n");
-                return -1;
-            }
-            if (got_output) {
-                printf("Succeed to encode frame: %5d\tsize:%5d\n",framecnt,pkt.size);
-                framecnt++;
-                //fwrite(pkt.data, 1, pkt.size, fp_out);
-                memcpy(sendbuf, &autioType, 4);
-                memcpy(sendbuf+4, &(pkt.size), 4);
-                memcpy(sendbuf+8, pkt.data, pkt.size);
-                
-                int totalSend = send(clientSocket, sendbuf, pkt.size+8, 0);
-                av_log(NULL, AV_LOG_ERROR, "%s:%d, totalSend = %d\n", __func__, __LINE__, totalSend);
-                av_free_packet(&pkt);
-            }
-            total_cpy_len = 0;
-            memcpy(frame_buf+total_cpy_len, audioFrame + excpect_cpy_len, length - excpect_cpy_len);
-            total_cpy_len += length - excpect_cpy_len;
-        }
-    }
-    //Flush Encoder
-    for (got_output = 1; got_output; i++) {
-        ret = avcodec_encode_audio2(pCodecCtx, &pkt, NULL, &got_output);
-        if (ret < 0) {
-            printf("Error encoding frame\n");
-            return -1;
-        }
-        if (got_output) {
-            printf("Flush Encoder: Succeed to encode 1 frame!\tsize:%5d\n",pkt.size);
-            //fwrite(pkt.data, 1, pkt.size, fp_out);
-            av_free_packet(&pkt);
-        }
-    }
-    
-    // fclose(fp_out);
-    avcodec_close(pCodecCtx);
-    av_free(pCodecCtx);
-    av_freep(&pFrame->data[0]);
-    av_frame_free(&pFrame);
-    close(clientSocket);
-    free(cmd_addr);
+static FFIntercom *open_intercom(FFPlayer *ffp, const char *addr, int port, int fd)
+{
+    FFIntercomConfig config = {0};
+    FFIntercom *ic;
 
-    return 0;
+    config.addr     = addr;
+    config.port     = port;
+    config.fd       = fd;
+    config.codec    = ffp->intercom_codec;
+    config.bit_rate = ffp->intercom_bit_rate;
+    config.batch_ms = ffp->intercom_batch_ms;
+    config.on_error = on_intercom_error;
+    config.opaque   = ffp;
+
+    ic = ffp_intercom_create(&config);
+    if (!ic)
+        av_log(ffp, AV_LOG_ERROR, "failed to start intercom\n");
+    return ic;
 }
 
 void mw_start_p2p_intercom(FFPlayer *ffp, const char * urlStr, const char * ipStr, int port)
 {
-    pthread_t record_tid ;
-    startRecord();
-    audio_record_start = 1;
-    Cmd_Addr* cmd_addr= (Cmd_Addr*)malloc(sizeof(Cmd_Addr));
-    int length = strlen(ipStr);
-    memcpy(cmd_addr->addr, ipStr, length);
-    cmd_addr->addr[length] = '\0';
-    cmd_addr->port = port;
-
-    pthread_create(&record_tid, NULL, read_record_audio_thread,  cmd_addr);
+    if (ffp->intercom)
+        return;
+    ffp->intercom = open_intercom(ffp, ipStr, port, -1);
 }
 
 void mw_stop_p2p_intercom(FFPlayer *ffp)
 {
-    audio_record_start = 0;
-    stopRecord();
+    ffp_intercom_freep(&ffp->intercom);
 }
             
 void mp_screenshot(FFPlayer *ffp, const char *screenshotRootPath)
@@ -5215,495 +5504,20 @@ void mp_screenshot_with_name(FFPlayer *ffp, const char *screenshotRootPath, cons
     ffp->m_screenShot = 1;
 }
 
-void mw_initOutPutStream(FFPlayer *ffp, const char *out_filename){
-                
-    int ret;
-	VideoState *is = ffp->is;
-	
-	//AVOutputFormat *ofmt = NULL;
-	//AVFormatContext *ofmt_ctx = NULL;
-	avformat_alloc_output_context2(&is->ofmt_ctx, NULL, NULL, out_filename);
-    if (!is->ofmt_ctx) {
-        fprintf(stderr, "Could not create output context\n");
-        ret = AVERROR_UNKNOWN;
-        mw_closeOutPutStream(ffp);
-		return ;
-    }
-
-	 is->ofmt = is->ofmt_ctx->oformat;
-	  for (int i = 0; i < is->ic->nb_streams; i++) {
-        AVStream *in_stream = is->ic->streams[i];
-        AVStream *out_stream = avformat_new_stream(is->ofmt_ctx, NULL);
-        if (!out_stream) {
-            fprintf(stderr, "Failed allocating output stream\n");
-            ret = AVERROR_UNKNOWN;
-            mw_closeOutPutStream(ffp);
-			return ;
-        }
-        /*ret = avcodec_copy_context(out_stream->codec, in_stream->codec);
-        if (ret < 0) {
-            fprintf(stderr, "Failed to copy context from input to output stream codec context\n");
-            mw_closeOutPutStream(ffp);
-			return ;
-        }*/
-        out_stream->codec->codec_tag = 0;
-		out_stream->codec->codec_type = in_stream->codec->codec_type;
-
-		//av_log(NULL, AV_LOG_DEBUG, "%s:%d, codec_type = %d\n", __func__, __LINE__, out_stream->codec->codec_type);
-		AVCodecParameters *par = NULL;
-		AVCodecContext *dec_ctx, *enc_ctx;
-		switch(out_stream->codec->codec_type){
-			case AVMEDIA_TYPE_AUDIO:
-				is->audio_out_stream_index = out_stream->index;
-				dec_ctx = is->auddec.avctx;
-				enc_ctx = out_stream->codec;
-				enc_ctx->codec_id   = dec_ctx->codec_id;
-            	enc_ctx->codec_type = dec_ctx->codec_type;
-				enc_ctx->channel_layout     = dec_ctx->channel_layout;
-                enc_ctx->sample_rate        = dec_ctx->sample_rate;
-                enc_ctx->channels           = dec_ctx->channels;
-                enc_ctx->frame_size         = dec_ctx->frame_size;
-                enc_ctx->audio_service_type = dec_ctx->audio_service_type;
-                enc_ctx->block_align        = dec_ctx->block_align;
-                enc_ctx->initial_padding    = dec_ctx->delay;
-				par = out_stream->codecpar;
-				par->codec_type = AVMEDIA_TYPE_AUDIO;
-				par->sample_rate = dec_ctx->sample_rate;
-				par->codec_id = dec_ctx->codec_id;
-				//av_log(NULL, AV_LOG_DEBUG, "%s:%d, width=%d, height=%d, codec_id2 = %s\n", __func__, __LINE__, par->width, par->height, avcodec_get_name(dec_ctx->codec_id));
-				break;
-			case AVMEDIA_TYPE_VIDEO:
-				//par = out_stream->codecpar;
-				//par->width = in_stream->codec->width;
-				//par->height = in_stream->codec->height;
-				is->video_out_stream_index = out_stream->index;
-				dec_ctx = is->viddec.avctx;
-				enc_ctx = out_stream->codec;
-				enc_ctx->codec_id   = dec_ctx->codec_id;
-            	enc_ctx->codec_type = dec_ctx->codec_type;
-				enc_ctx->pix_fmt            = dec_ctx->pix_fmt;
-                enc_ctx->width              = dec_ctx->width;
-                enc_ctx->height             = dec_ctx->height;
-				par = out_stream->codecpar;
-				par->width = dec_ctx->width;
-				par->height = dec_ctx->height;
-				par->codec_type = AVMEDIA_TYPE_VIDEO;
-				par->codec_id = dec_ctx->codec_id;
-				//av_log(NULL, AV_LOG_DEBUG, "%s:%d, width=%d, height=%d, codec_id2 = %s\n", __func__, __LINE__, par->width, par->height, avcodec_get_name(dec_ctx->codec_id));
-				break;
-		}
-
-		if (par && in_stream->codec->extradata)
-		{
-			par->extradata = av_mallocz(in_stream->codec->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
-			if (par->extradata)
-			{
-				memcpy(par->extradata, in_stream->codec->extradata, in_stream->codec->extradata_size);
-				par->extradata_size = in_stream->codec->extradata_size;
-			}
-			else
-			{
-				//return AVERROR(ENOMEM);
-			}
-		}
-        
-		/*AVCodecContext *enc_ctx;
-		AVCodecContext *dec_ctx = NULL;
-		enc_ctx = out_stream->codec;
-		dec_ctx = in_stream->codec;
-		out_stream->disposition          = in_stream->disposition;
-        enc_ctx->bits_per_raw_sample    = dec_ctx->bits_per_raw_sample;
-        enc_ctx->chroma_sample_location = dec_ctx->chroma_sample_location;
-
-		AVRational sar;
-		uint64_t extra_size;
-		 
-		extra_size = (uint64_t)dec_ctx->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE;
-		 
-		if (extra_size > INT_MAX) {
-			return AVERROR(EINVAL);
-		}
-
-		 if (!enc_ctx->codec_tag) {
-                unsigned int codec_tag;
-                if (!is->ofmt_ctx->oformat->codec_tag ||
-                     av_codec_get_id (is->ofmt_ctx->oformat->codec_tag, dec_ctx->codec_tag) == enc_ctx->codec_id ||
-                     !av_codec_get_tag2(is->ofmt_ctx->oformat->codec_tag, dec_ctx->codec_id, &codec_tag))
-                    enc_ctx->codec_tag = dec_ctx->codec_tag;
-            }
-
-            enc_ctx->bit_rate       = dec_ctx->bit_rate;
-            enc_ctx->rc_max_rate    = dec_ctx->rc_max_rate;
-            enc_ctx->rc_buffer_size = dec_ctx->rc_buffer_size;
-            enc_ctx->field_order    = dec_ctx->field_order;
-            if (dec_ctx->extradata_size) {
-                enc_ctx->extradata      = av_mallocz(extra_size);
-                if (!enc_ctx->extradata) {
-                    return AVERROR(ENOMEM);
-                }
-                memcpy(enc_ctx->extradata, dec_ctx->extradata, dec_ctx->extradata_size);
-            }
-            enc_ctx->extradata_size= dec_ctx->extradata_size;
-            enc_ctx->bits_per_coded_sample  = dec_ctx->bits_per_coded_sample;
-
-            enc_ctx->time_base = in_stream->time_base;
-
-			  /*
-             * Avi is a special case here because it supports variable fps but
-             * having the fps and timebase differe significantly adds quite some
-             * overhead
-             */
-           /*  int copy_tb = -1;
-          if(!strcmp(is->ofmt_ctx->oformat->name, "avi")) {
-                if ( copy_tb<0 && av_q2d(in_stream->r_frame_rate) >= av_q2d(in_stream->avg_frame_rate)
-                               && 0.5/av_q2d(in_stream->r_frame_rate) > av_q2d(in_stream->time_base)
-                               && 0.5/av_q2d(in_stream->r_frame_rate) > av_q2d(dec_ctx->time_base)
-                               && av_q2d(in_stream->time_base) < 1.0/500 && av_q2d(dec_ctx->time_base) < 1.0/500
-                     || copy_tb==2){
-                    enc_ctx->time_base.num = in_stream->r_frame_rate.den;
-                    enc_ctx->time_base.den = 2*in_stream->r_frame_rate.num;
-                    enc_ctx->ticks_per_frame = 2;
-                } else if (   copy_tb<0 && av_q2d(dec_ctx->time_base)*dec_ctx->ticks_per_frame > 2*av_q2d(in_stream->time_base)
-                                 && av_q2d(in_stream->time_base) < 1.0/500
-                    || copy_tb==0){
-                    enc_ctx->time_base = dec_ctx->time_base;
-                    enc_ctx->time_base.num *= dec_ctx->ticks_per_frame;
-                    enc_ctx->time_base.den *= 2;
-                    enc_ctx->ticks_per_frame = 2;
-                }
-            } else if(!(is->ofmt_ctx->oformat->flags & AVFMT_VARIABLE_FPS)
-                      && strcmp(is->ofmt_ctx->oformat->name, "mov") && strcmp(is->ofmt_ctx->oformat->name, "mp4") && strcmp(is->ofmt_ctx->oformat->name, "3gp")
-                      && strcmp(is->ofmt_ctx->oformat->name, "3g2") && strcmp(is->ofmt_ctx->oformat->name, "psp") && strcmp(is->ofmt_ctx->oformat->name, "ipod")
-                      && strcmp(is->ofmt_ctx->oformat->name, "f4v")
-            ) {
-                if(   copy_tb<0 && dec_ctx->time_base.den
-                                && av_q2d(dec_ctx->time_base)*dec_ctx->ticks_per_frame > av_q2d(in_stream->time_base)
-                                && av_q2d(in_stream->time_base) < 1.0/500
-                   || copy_tb==0){
-                    enc_ctx->time_base = dec_ctx->time_base;
-                    enc_ctx->time_base.num *= dec_ctx->ticks_per_frame;
-                }
-            }*/
-           /* if (   enc_ctx->codec_tag == AV_RL32("tmcd")
-                && dec_ctx->time_base.num < dec_ctx->time_base.den
-                && dec_ctx->time_base.num > 0
-                && 121LL*dec_ctx->time_base.num > dec_ctx->time_base.den) {
-                enc_ctx->time_base = dec_ctx->time_base;
-            }*/
-
-            /*if (ist && !ost->frame_rate.num)
-                ost->frame_rate = ist->framerate;
-            if(ost->frame_rate.num)
-                enc_ctx->time_base = av_inv_q(ost->frame_rate);*/
-
-           // av_reduce(&enc_ctx->time_base.num, &enc_ctx->time_base.den,
-           //             enc_ctx->time_base.num, enc_ctx->time_base.den, INT_MAX);
-
-           /* if (in_stream->nb_side_data) {
-                out_stream->side_data = av_realloc_array(NULL, in_stream->nb_side_data,
-                                                      sizeof(*in_stream->side_data));
-                if (!ost->st->side_data)
-                    return AVERROR(ENOMEM);
-
-                ost->st->nb_side_data = 0;
-                for (j = 0; j < in_stream->nb_side_data; j++) {
-                    const AVPacketSideData *sd_src = &in_stream->side_data[j];
-                    AVPacketSideData *sd_dst = &out_stream->side_data[out_stream->nb_side_data];
-
-                    if (ost->rotate_overridden && sd_src->type == AV_PKT_DATA_DISPLAYMATRIX)
-                        continue;
-
-                    sd_dst->data = av_malloc(sd_src->size);
-                    if (!sd_dst->data)
-                        return AVERROR(ENOMEM);
-                    memcpy(sd_dst->data, sd_src->data, sd_src->size);
-                    sd_dst->size = sd_src->size;
-                    sd_dst->type = sd_src->type;
-                    out_stream->nb_side_data++;
-                }
-            }*/
-
-           /* out_stream->parser = av_parser_init(enc_ctx->codec_id);
-			  AVCodecParameters *par;
-
-            switch (enc_ctx->codec_type) {
-            case AVMEDIA_TYPE_AUDIO:
-                
-                enc_ctx->channel_layout     = dec_ctx->channel_layout;
-                enc_ctx->sample_rate        = dec_ctx->sample_rate;
-                enc_ctx->channels           = dec_ctx->channels;
-                enc_ctx->frame_size         = dec_ctx->frame_size;
-                enc_ctx->audio_service_type = dec_ctx->audio_service_type;
-                enc_ctx->block_align        = dec_ctx->block_align;
-                enc_ctx->initial_padding    = dec_ctx->delay;
-#if FF_API_AUDIOENC_DELAY
-                enc_ctx->delay              = dec_ctx->delay;
-#endif
-                if((enc_ctx->block_align == 1 || enc_ctx->block_align == 1152 || enc_ctx->block_align == 576) && enc_ctx->codec_id == AV_CODEC_ID_MP3)
-                    enc_ctx->block_align= 0;
-                if(enc_ctx->codec_id == AV_CODEC_ID_AC3)
-                    enc_ctx->block_align= 0;
-				par = out_stream->codecpar;
-				par->codec_type = AVMEDIA_TYPE_AUDIO;
-                break;
-            case AVMEDIA_TYPE_VIDEO:
-                enc_ctx->pix_fmt            = dec_ctx->pix_fmt;
-                enc_ctx->width              = dec_ctx->width;
-                enc_ctx->height             = dec_ctx->height;
-                enc_ctx->has_b_frames       = dec_ctx->has_b_frames;
-        		par = out_stream->codecpar;
-				par->width = dec_ctx->width;
-				par->height = dec_ctx->height;
-				par->codec_type = AVMEDIA_TYPE_VIDEO;
-                /*if (out_stream->frame_aspect_ratio.num) { // overridden by the -aspect cli option
-                    sar =
-                        av_mul_q(out_stream->frame_aspect_ratio,
-                                 getAVRational(enc_ctx->height, enc_ctx->width ));
-                    av_log(NULL, AV_LOG_WARNING, "Overriding aspect ratio "
-                           "with stream copy may produce invalid files\n");
-                }
-                else*/ if (in_stream->sample_aspect_ratio.num)
-                /*    sar = in_stream->sample_aspect_ratio;
-                else
-                    sar = dec_ctx->sample_aspect_ratio;
-                out_stream->sample_aspect_ratio = enc_ctx->sample_aspect_ratio = sar;
-                out_stream->avg_frame_rate = in_stream->avg_frame_rate;
-                out_stream->r_frame_rate = in_stream->r_frame_rate;
-                break;
-            }*/
-			
-        if (is->ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
-            out_stream->codec->flags |= CODEC_FLAG_GLOBAL_HEADER;
-    }
-    av_dump_format(is->ofmt_ctx, 0, out_filename, 1);
-    if (!(is->ofmt->flags & AVFMT_NOFILE)) {
-        //ret = avio_open(&is->ofmt_ctx->pb, out_filename, AVIO_FLAG_WRITE);
-        ret = avio_open2(&is->ofmt_ctx->pb, out_filename, AVIO_FLAG_WRITE, NULL, NULL);
-        if (ret < 0) {
-            fprintf(stderr, "Could not open output file '%s'", out_filename);
-            mw_closeOutPutStream(ffp);
-			return ;
-        }
-    }
-    ret = avformat_write_header(is->ofmt_ctx, NULL);
-    if (ret < 0) {
-        fprintf(stderr, "Error occurred when opening output file\n");
-        mw_closeOutPutStream(ffp);
-		return ;
-    }
-	//is->hevcbsfc = av_bitstream_filter_init("hevc_mp4toannexb");
-	is->aacbsfc = av_bitstream_filter_init("aac_adtstoasc");   
- }
-            
-void mw_closeOutPutStream(FFPlayer *ffp){
-   //	int ret;
-	VideoState *is = ffp->is;
-	if(is->ofmt_ctx){
-		av_write_trailer(is->ofmt_ctx);
-	}
-    /* close output */
-    if (is->ofmt_ctx && !(is->ofmt->flags & AVFMT_NOFILE)){
-        avio_close(is->ofmt_ctx->pb);
-    }
-    avformat_free_context(is->ofmt_ctx);
-/*
-    if (ret < 0 && ret != AVERROR_EOF) {
-        fprintf(stderr, "Error occurred: %s\n", av_err2str(ret));
-       // return 1;
-    }
-*/
-	is->ofmt_ctx = NULL;
-	//av_bitstream_filter_close(is->hevcbsfc);
-	av_bitstream_filter_close(is->aacbsfc);
-	//is->hevcbsfc = NULL;
-	is->aacbsfc = NULL;
-}
-
-void *wechat_send_audio_thread(void *arg){
-    av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    AVCodec *pCodec;
-    AVCodecContext *pCodecCtx= NULL;
-    int i, ret, got_output;
-    int autioType = 2;
-    FILE *fp_in;
-    FILE *fp_out;
-    
-    AVFrame *pFrame;
-    uint8_t* frame_buf;
-    int size=0;
-    
-    AVPacket pkt;
-    int y_size;
-    int framecnt=0;
-    int total_cpy_len = 0, excpect_cpy_len = 0;
-    
-    char filename_in[]="/sdcard/play16k.pcm";
-    
-    enum AVCodecID codec_id=AV_CODEC_ID_AAC;
-    char filename_out[]="/sdcard/play16k.aac";
-    
-    int framenum=1000;
-    char audioFrame[AUDIO_BUF_SIZE];
-    uint8_t sendbuf[AUDIO_BUF_SIZE];
-    
-    Cmd_Addr *cmd_addr = (Cmd_Addr *)arg;
-    
-    int clientSocket = cmd_addr->client_fd;
-    av_log(NULL, AV_LOG_ERROR, "%s:%d, clientSocket = %d\n", __func__, __LINE__, clientSocket);
-    //√Ë ˆ∑˛ŒÒ∆˜µƒsocket
-    /*struct sockaddr_in serverAddr;
-     
-     if((clientSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-     {
-     av_log(NULL, AV_LOG_ERROR,"create socket error\n");
-     return 1;
-     }
-     
-     serverAddr.sin_family = AF_INET;
-     serverAddr.sin_port = htons(cmd_addr->port);
-     
-     serverAddr.sin_addr.s_addr = inet_addr(cmd_addr->addr);
-     if(connect(clientSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0)
-     {
-     av_log(NULL, AV_LOG_ERROR,"client connect failed");
-     return 1;
-     }*/
-    
-    //avcodec_register_all();
-    
-    pCodec = avcodec_find_encoder_by_name("libfdk_aac");//avcodec_find_encoder(codec_id);
-    if (!pCodec) {
-        printf("Codec not found\n");
-        return NULL;
-    }
-    pCodecCtx = avcodec_alloc_context3(pCodec);
-    if (!pCodecCtx) {
-        printf("Could not allocate video codec context\n");
-        return NULL;
-    }
-    //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    
-    pCodecCtx->codec_id = codec_id;
-    pCodecCtx->codec_type = AVMEDIA_TYPE_AUDIO;
-    pCodecCtx->sample_fmt = AV_SAMPLE_FMT_S16;
-    pCodecCtx->sample_rate= 16000;
-    pCodecCtx->channel_layout= AV_CH_LAYOUT_MONO;
-    pCodecCtx->channels = 1;
-    pCodecCtx->bit_rate = 64000;
-    
-    //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    if (avcodec_open2(pCodecCtx, pCodec, NULL) < 0) {
-        //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-        printf("Could not open codec\n");
-        return NULL;
-    }
-    //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    
-    pFrame = av_frame_alloc();
-    pFrame->nb_samples= pCodecCtx->frame_size;
-    pFrame->format= pCodecCtx->sample_fmt;
-    size = av_samples_get_buffer_size(NULL, pCodecCtx->channels,pCodecCtx->frame_size,pCodecCtx->sample_fmt, 1);
-    frame_buf = (uint8_t *)av_malloc(size);
-    avcodec_fill_audio_frame(pFrame, pCodecCtx->channels, pCodecCtx->sample_fmt,(const uint8_t*)frame_buf, size, 1);
-    
-    //Input raw data
-    //av_log(NULL, AV_LOG_ERROR, "%s:%d", __func__, __LINE__);
-    /*fp_in = fopen(filename_in, "rb");
-     if (!fp_in) {
-     printf("Could not open %s\n", filename_in);
-     return -1;
-     }*/
-    //Output bitstream
-    /*fp_out = fopen(filename_out, "wb");
-     if (!fp_out) {
-     printf("Could not open %s\n", filename_out);
-     return -1;
-     }*/
-    
-    //Encode
-    while(audio_record_start) {
-        av_init_packet(&pkt);
-        pkt.data = NULL;    // packet data will be allocated by the encoder
-        pkt.size = 0;
-        //Read raw data
-        int length  = getRecordFrameData(audioFrame);
-        if(length <= 0)
-            continue;
-        excpect_cpy_len = (size -total_cpy_len) < length ? size -total_cpy_len : length;
-        memcpy(frame_buf+total_cpy_len, audioFrame, excpect_cpy_len);
-        total_cpy_len += excpect_cpy_len;
-        if(total_cpy_len == size ){
-            pFrame->pts = 0;
-            ret = avcodec_encode_audio2(pCodecCtx, &pkt, pFrame, &got_output);
-            if (ret < 0) {
-                printf("Error encoding frame\n");
-                return NULL;
-            }
-            if (got_output) {
-                printf("Succeed to encode frame: %5d\tsize:%5d\n",framecnt,pkt.size);
-                framecnt++;
-                //fwrite(pkt.data, 1, pkt.size, fp_out);
-                memcpy(sendbuf, &autioType, 4);
-                memcpy(sendbuf+4, &(pkt.size), 4);
-                memcpy(sendbuf+8, pkt.data, pkt.size);
-                
-                int totalSend = send(clientSocket, sendbuf, pkt.size+8, 0);
-                av_log(NULL, AV_LOG_ERROR, "%s:%d, totalSend = %d, clientSocket=%d, length = %d\n", __func__, __LINE__, totalSend, clientSocket, length);
-                av_free_packet(&pkt);
-            }
-            total_cpy_len = 0;
-            memcpy(frame_buf+total_cpy_len, audioFrame + excpect_cpy_len, length - excpect_cpy_len);
-            total_cpy_len += length - excpect_cpy_len;
-        }
-    }
-    //Flush Encoder
-    for (got_output = 1; got_output; i++) {
-        ret = avcodec_encode_audio2(pCodecCtx, &pkt, NULL, &got_output);
-        if (ret < 0) {
-            printf("Error encoding frame\n");
-            return NULL;
-        }
-        if (got_output) {
-            printf("Flush Encoder: Succeed to encode 1 frame!\tsize:%5d\n",pkt.size);
-            //fwrite(pkt.data, 1, pkt.size, fp_out);
-            av_free_packet(&pkt);
-        }
-    }
-    
-    // fclose(fp_out);
-    avcodec_close(pCodecCtx);
-    av_free(pCodecCtx);
-    av_freep(&pFrame->data[0]);
-    av_frame_free(&pFrame);
-    free(cmd_addr);
-    cmd_addr = NULL;
-    //close(clientSocket);
-    
-    return NULL;
-}
-
 void mw_start_wechat_intercom2(FFPlayer *ffp, int clientSocket){
     
-    if(audio_record_start){
+    if(ffp->intercom){
         return;
     }
-   pthread_t wechat_send_tid;
-   startRecord();
-   audio_record_start = 1;
-   Cmd_Addr* cmd_addr= (Cmd_Addr*)malloc(sizeof(Cmd_Addr));
-   cmd_addr->addr[0] = '\0';
-   cmd_addr->port = 0;
-   cmd_addr->client_fd = clientSocket;
-   pthread_create(&wechat_send_tid, NULL, wechat_send_audio_thread, cmd_addr);
+    ffp->intercom = open_intercom(ffp, NULL, 0, clientSocket);
 }
             
 void mw_stop_wechat_intercom2(FFPlayer *ffp, const char *user_id, const char *user_name, const char bemaster, int client_fd){
-    if(!audio_record_start){
+    if(!ffp->intercom){
         return;
-    }   
-    audio_record_start = 0;
-    
-    stopRecord();
+    }
+    // 先发完剩余音频再发离开消息
+    ffp_intercom_freep(&ffp->intercom);
     MwCmdPacket cmdPkt;
     cmdPkt.packet.header.cmd_type = CMD_HEARTBEAT;
     cmdPkt.packet.header.data_len = sizeof(cmdPkt.packet.content);//strlen(pClt->user_id);
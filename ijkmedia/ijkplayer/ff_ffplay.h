@@ -115,6 +115,10 @@ void      ffp_set_property_int64(FFPlayer *ffp, int id, int64_t value);
 // must be freed with free();
 struct IjkMediaMeta *ffp_get_meta_l(FFPlayer *ffp);
 
+/* take effect in the read thread, a new start replaces the running recording */
+int       ffp_start_record(FFPlayer *ffp, const char *filename);
+void      ffp_stop_record(FFPlayer *ffp);
+
 void mw_start_record(FFPlayer *ffp, const char *recRootPath);
 
 void mw_stop_record(FFPlayer *ffp);
@@ -128,10 +132,6 @@ void   mp_screenshot(FFPlayer *ffp, const char *screenshotRootPath);
 
 void    mp_screenshot_with_name(FFPlayer *ffp, const char *screenshotRootPath, const char *picName);
 
-void mw_initOutPutStream(FFPlayer *ffp, const char *out_filename);
-
-void mw_closeOutPutStream(FFPlayer *ffp);
-
 void mw_start_wechat_intercom2(FFPlayer *ffp, int clientSocket);
 
 void mw_stop_wechat_intercom2(FFPlayer *ffp, const char *user_id, const char *user_name, const char bemaster, int client_fd);
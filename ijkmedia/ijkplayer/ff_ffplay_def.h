@@ -60,6 +60,11 @@
 #include <stdbool.h>
 #include "ff_ffinc.h"
 #include "ff_ffmsg_queue.h"
+#include "ff_ffprobe_cache.h"
+#include "ff_ffbandwidth.h"
+#include "ff_ffrecorder.h"
+#include "ijkavformat/ijkmmap.h"
+#include "ff_ffintercom.h"
 #include "ff_ffpipenode.h"
 #include "ijkmeta.h"
 #include "ijkplayer.h"
@@ -114,6 +119,13 @@
 #define EXTERNAL_CLOCK_SPEED_MAX  1.010
 #define EXTERNAL_CLOCK_SPEED_STEP 0.001
 
+/* live catch-up speed control, see check_live_catchup_speed() */
+#define LIVE_CATCHUP_TARGET_MS_DEFAULT      (500)
+#define LIVE_CATCHUP_BAND_MS_DEFAULT        (200)
+#define LIVE_CATCHUP_MAX_SPEED_DEFAULT      (1.25)
+#define LIVE_CATCHUP_SPEED_STEP             (0.05)
+#define LIVE_CATCHUP_CHECK_INTERVAL         (0.2)
+
 /* we use about AUDIO_DIFF_AVG_NB A-V differences to make the average */
 #define AUDIO_DIFF_AVG_NB   20
 
@@ -138,6 +150,36 @@ typedef struct MyAVPacketList {
     int serial;
 } MyAVPacketList;
 
+/* nodes carved from one allocation when packet-pool is enabled */
+#define PACKET_QUEUE_SLAB_NODES 256
+
+typedef struct MyAVPacketSlab {
+    struct MyAVPacketSlab *next;
+    MyAVPacketList nodes[PACKET_QUEUE_SLAB_NODES];
+} MyAVPacketSlab;
+
+/* single producer/single consumer ring, see packet_queue_init_spsc() */
+#define PACKET_QUEUE_SPSC_SIZE_DEFAULT      (4096)
+#define PACKET_QUEUE_SPSC_SIZE_MIN          (256)
+#define PACKET_QUEUE_SPSC_SIZE_MAX          (64 * 1024)
+#define PACKET_QUEUE_WAKEUP_BATCH_DEFAULT   (4)
+#define PACKET_QUEUE_WAKEUP_BATCH_MAX       (256)
+
+/* keyframes a queue remembers for cached duration control, see packet_queue_trim_to_pts() */
+#define PACKET_QUEUE_KEY_INDEX_SIZE         (256)
+/* audio packets are all keyframes, index them sparsely */
+#define PACKET_QUEUE_KEY_INDEX_MIN_GAP_MS   (40)
+
+typedef struct PacketQueueKeyIndex {
+    unsigned int seq;
+    int64_t pts;
+    /* totals put before this keyframe */
+    int64_t put_size;
+    int64_t put_duration;
+    /* node before this keyframe, linked list mode only */
+    MyAVPacketList *prev;
+} PacketQueueKeyIndex;
+
 typedef struct PacketQueue {
     MyAVPacketList *first_pkt, *last_pkt;
     int nb_packets;
@@ -150,6 +192,27 @@ typedef struct PacketQueue {
     MyAVPacketList *recycle_pkt;
     int recycle_count;
     int alloc_count;
+    MyAVPacketSlab *slab_list;
+
+    MyAVPacketList *ring;
+    unsigned int ring_mask;
+    unsigned int ring_read;
+    unsigned int ring_write;
+    int producer_waiting;
+    int consumer_waiting;
+    int wakeup_batch;
+
+    /* sequence numbers of put/removed packets, ring mode uses ring_write/ring_read */
+    unsigned int put_seq;
+    unsigned int get_seq;
+    int64_t put_total_size;
+    int64_t put_total_duration;
+    unsigned int flush_seq;
+    int64_t last_pts;
+    int64_t key_index_min_gap;
+    PacketQueueKeyIndex key_index[PACKET_QUEUE_KEY_INDEX_SIZE];
+    int key_index_head;
+    int key_index_count;
 
     int is_buffer_indicator;
 } PacketQueue;
@@ -162,6 +225,12 @@ typedef struct PacketQueue {
 #define SAMPLE_QUEUE_SIZE 9
 #define FRAME_QUEUE_SIZE FFMAX(SAMPLE_QUEUE_SIZE, FFMAX(VIDEO_PICTURE_QUEUE_SIZE_MAX, SUBPICTURE_QUEUE_SIZE))
 
+/* libavcodec refuses more frame threads */
+#define VIDEO_THREADS_MAX       (16)
+
+/* above 1440p, where one converting thread starts to cost frames */
+#define VIDEO_CONVERT_SLICE_THRESHOLD_DEFAULT   (2560 * 1440 + 1)
+
 #define VIDEO_MAX_FPS_DEFAULT 30
 
 typedef struct AudioParams {
@@ -245,6 +314,10 @@ typedef struct Decoder {
     SDL_Profiler decode_profiler;
     Uint64 first_frame_decoded_time;
     int    first_frame_decoded;
+
+    /* for benchmarks, written by the decoder thread only */
+    int64_t decoded_frames;
+    int64_t packet_wait_us;
 } Decoder;
 
 typedef struct VideoState {
@@ -377,19 +450,15 @@ typedef struct VideoState {
 
     volatile int latest_seek_load_serial;
     volatile int64_t latest_seek_load_start_at;
-    
-    AVFormatContext *m_oformat_ctx;//输出文件指针
-    AVOutputFormat  *m_output_fmt;//文件输出格式
-    AVStream        *m_out_video_st;//输出视频AVStream
-    AVStream        *m_out_audio_st;//输出音频AVStream
-    AVPacket        *m_key_pkt;//关键帧
+
+    FFRecorder      *recorder;//替换时持有 ffp->record_mutex
+    FFRecorder      *closing_recorders;//还在写文件尾的旧录像，同样由 ffp->record_mutex 保护
+    FFRecorderPreroll *record_preroll;
+    AVIOContext     *mmap_pb;//mmap-local-files 时的 ic->pb，ic 关闭后释放
+    int record_serial;
     int max_cached_duration;
-    AVFormatContext *ofmt_ctx;
-	int audio_out_stream_index, video_out_stream_index;
-    AVOutputFormat *ofmt;
-    int local_record_start ;
-    const char *local_record_filename ;
-    AVBitStreamFilterContext* aacbsfc;
+    double catchup_speed;
+    double catchup_check_time;
 } VideoState;
 
 /* options specified by the user */
@@ -478,6 +547,12 @@ typedef struct FFStatistic
     int64_t buf_capacity;
     SDL_SpeedSampler2 tcp_read_sampler;
     int64_t latest_seek_load_duration;
+
+    /* filling the overlay, converting it unless the frame is linked */
+    int64_t vconvert_us;
+    int64_t vconvert_max_us;
+    int64_t vconvert_total_us;
+    int64_t vconvert_frames;
 } FFStatistic;
 
 #define FFP_TCP_READ_SAMPLE_RANGE 2000
@@ -497,6 +572,11 @@ typedef struct FFDemuxCacheControl
     int next_high_water_mark_in_ms;
     int last_high_water_mark_in_ms;
     int current_high_water_mark_in_ms;
+
+    /* derived from the measured bandwidth, 0 until there is an estimate */
+    int autotune;
+    int autotune_high_water_mark_in_ms;
+    int autotune_max_buffer_size;
 } FFDemuxCacheControl;
 
 inline static void ffp_reset_demux_cache_control(FFDemuxCacheControl *dcc)
@@ -509,6 +589,10 @@ inline static void ffp_reset_demux_cache_control(FFDemuxCacheControl *dcc)
     dcc->next_high_water_mark_in_ms     = DEFAULT_NEXT_HIGH_WATER_MARK_IN_MS;
     dcc->last_high_water_mark_in_ms     = DEFAULT_LAST_HIGH_WATER_MARK_IN_MS;
     dcc->current_high_water_mark_in_ms  = DEFAULT_FIRST_HIGH_WATER_MARK_IN_MS;
+
+    dcc->autotune                       = 0;
+    dcc->autotune_high_water_mark_in_ms = 0;
+    dcc->autotune_max_buffer_size       = 0;
 }
 
 /* ffplayer */
@@ -613,6 +697,7 @@ typedef struct FFPlayer {
     int error;
     int error_count;
     int start_on_prepared;
+    int present_unthrottled;
     int first_video_frame_rendered;
     int first_audio_frame_rendered;
     int sync_av_start;
@@ -624,6 +709,28 @@ typedef struct FFPlayer {
     int packet_buffering;
     int pictq_size;
     int max_fps;
+    int video_threads;
+    int video_thread_type;
+    int video_convert_threads;
+    int video_convert_slice_threshold;
+    int packet_pool;
+    int packet_queue_spsc;
+    int packet_queue_spsc_size;
+    int packet_queue_wakeup_batch;
+    int live_catchup;
+    int live_catchup_target_ms;
+    int live_catchup_band_ms;
+    double live_catchup_max_speed;
+    int record_preroll_ms;
+    char *record_format;
+    int record_queue_bytes;
+    int record_overflow;
+    int record_segment_ms;
+    int64_t record_segment_bytes;
+    int64_t record_retention_bytes;
+    int intercom_codec;
+    int intercom_bit_rate;
+    int intercom_batch_ms;
 
     int videotoolbox;
     int vtb_max_frame_width;
@@ -642,6 +749,11 @@ typedef struct FFPlayer {
     int opensles;
 
     char *iformat_name;
+    int probe_cache;
+    char *probe_cache_key;
+    char *probe_cache_dir;
+    int mmap_local_files;
+    int mmap_readahead;
 
     int no_time_adjust;
     double preset_5_1_center_mix_level;
@@ -664,13 +776,18 @@ typedef struct FFPlayer {
     void               *inject_opaque;
     FFStatistic         stat;
     FFDemuxCacheControl dcc;
+    FFBandwidthEstimator bandwidth;
+    int64_t             bandwidth_sample_tick;
+    int                 bandwidth_from_async;
 
     AVApplicationContext *app_ctx;
     
-    /*本地录像标志*/
-    int m_bRecorder;
-    /*本地录像文件*/
-    char mwRecFile[255];
+    /*本地录像，ffp_start_record/ffp_stop_record 修改*/
+    SDL_mutex *record_mutex;
+    char *record_filename;
+    int record_serial;
+    /*对讲上行*/
+    FFIntercom *intercom;
     int m_screenShot;
     char screenShotFile[256];
     
@@ -799,6 +916,30 @@ inline static void ffp_reset_internal(FFPlayer *ffp)
     ffp->packet_buffering               = 1;
     ffp->pictq_size                     = VIDEO_PICTURE_QUEUE_SIZE_DEFAULT; // option
     ffp->max_fps                        = 31; // option
+    ffp->video_threads                  = 0; // option
+    ffp->video_thread_type              = 0; // option
+    ffp->video_convert_threads          = 0; // option
+    ffp->video_convert_slice_threshold  = VIDEO_CONVERT_SLICE_THRESHOLD_DEFAULT; // option
+    ffp->present_unthrottled            = 0; // option
+    ffp->packet_pool                    = 0; // option
+    ffp->packet_queue_spsc              = 0; // option
+    ffp->packet_queue_spsc_size         = PACKET_QUEUE_SPSC_SIZE_DEFAULT; // option
+    ffp->packet_queue_wakeup_batch      = PACKET_QUEUE_WAKEUP_BATCH_DEFAULT; // option
+    ffp->live_catchup                   = 0; // option
+    ffp->live_catchup_target_ms         = LIVE_CATCHUP_TARGET_MS_DEFAULT; // option
+    ffp->live_catchup_band_ms           = LIVE_CATCHUP_BAND_MS_DEFAULT; // option
+    ffp->live_catchup_max_speed         = LIVE_CATCHUP_MAX_SPEED_DEFAULT; // option
+    ffp->record_preroll_ms              = 0; // option
+    av_freep(&ffp->record_format); // option, av_opt_free() above has normally released it
+    av_freep(&ffp->record_filename);
+    ffp->record_queue_bytes             = FFP_RECORDER_QUEUE_BYTES_DEFAULT; // option
+    ffp->record_overflow                = FFP_RECORDER_OVERFLOW_DROP_GOP; // option
+    ffp->record_segment_ms              = 0; // option
+    ffp->record_segment_bytes           = 0; // option
+    ffp->record_retention_bytes         = 0; // option
+    ffp->intercom_codec                 = FFP_INTERCOM_CODEC_AAC; // option
+    ffp->intercom_bit_rate              = FFP_INTERCOM_BIT_RATE_DEFAULT; // option
+    ffp->intercom_batch_ms              = FFP_INTERCOM_BATCH_MS_DEFAULT; // option
 
     ffp->videotoolbox                   = 0; // option
     ffp->vtb_max_frame_width            = 0; // option
@@ -816,6 +957,11 @@ inline static void ffp_reset_internal(FFPlayer *ffp)
     ffp->opensles                       = 0; // option
 
     ffp->iformat_name                   = NULL; // option
+    ffp->probe_cache                    = 0; // option
+    ffp->probe_cache_key                = NULL; // option
+    ffp->probe_cache_dir                = NULL; // option
+    ffp->mmap_local_files               = 0; // option
+    ffp->mmap_readahead                 = IJKMMAP_READAHEAD_DEFAULT; // option
 
     ffp->no_time_adjust                 = 0; // option
 
@@ -839,6 +985,9 @@ inline static void ffp_reset_internal(FFPlayer *ffp)
     ffp->inject_opaque = NULL;
     ffp_reset_statistic(&ffp->stat);
     ffp_reset_demux_cache_control(&ffp->dcc);
+    ffp_bandwidth_reset(&ffp->bandwidth);
+    ffp->bandwidth_sample_tick = 0;
+    ffp->bandwidth_from_async  = 0;
 }
 
 inline static void ffp_notify_msg1(FFPlayer *ffp, int what) {
@@ -109,11 +109,21 @@ static const AVOption ffp_context_options[] = {
 
     { "start-on-prepared",                  "automatically start playing on prepared",
         OPTION_OFFSET(start_on_prepared),   OPTION_INT(1, 0, 1) },
+    { "present-unthrottled",                "present every frame as soon as it is decoded, for benchmarks",
+        OPTION_OFFSET(present_unthrottled), OPTION_INT(0, 0, 1) },
 
     { "video-pictq-size",                   "max picture queue frame count",
         OPTION_OFFSET(pictq_size),          OPTION_INT(VIDEO_PICTURE_QUEUE_SIZE_DEFAULT,
                                                        VIDEO_PICTURE_QUEUE_SIZE_MIN,
                                                        VIDEO_PICTURE_QUEUE_SIZE_MAX) },
+    { "video-threads",                      "software video decoder threads, 0 for core count and resolution based",
+        OPTION_OFFSET(video_threads),       OPTION_INT(0, 0, VIDEO_THREADS_MAX) },
+    { "video-thread-type",                  "software video decoder threading, 1 frame, 2 slice, 3 both, 0 for the codec default",
+        OPTION_OFFSET(video_thread_type),   OPTION_INT(0, 0, FF_THREAD_FRAME | FF_THREAD_SLICE) },
+    { "video-convert-threads",              "threads converting large frames to the overlay format in slices, 0 for core count, 1 for none",
+        OPTION_OFFSET(video_convert_threads),           OPTION_INT(0, 0, IJK_IMAGE_CONVERT_THREADS_MAX + 1) },
+    { "video-convert-slice-threshold",      "min frame pixels to convert in slices, 0 to never",
+        OPTION_OFFSET(video_convert_slice_threshold),   OPTION_INT(VIDEO_CONVERT_SLICE_THRESHOLD_DEFAULT, 0, INT_MAX) },
 
     { "max-buffer-size",                    "max buffer size should be pre-read",
         OPTION_OFFSET(dcc.max_buffer_size), OPTION_INT(MAX_QUEUE_SIZE, 0, MAX_QUEUE_SIZE) },
@@ -134,13 +144,77 @@ static const AVOption ffp_context_options[] = {
         OPTION_INT(DEFAULT_LAST_HIGH_WATER_MARK_IN_MS,
                    DEFAULT_FIRST_HIGH_WATER_MARK_IN_MS,
                    DEFAULT_LAST_HIGH_WATER_MARK_IN_MS) },
+    { "buffering-autotune",                 "derive high water marks and max buffer size from the measured bandwidth",
+        OPTION_OFFSET(dcc.autotune),        OPTION_INT(0, 0, 1) },
 
+    { "packet-pool",                        "preallocate packet queue nodes",
+        OPTION_OFFSET(packet_pool),         OPTION_INT(0, 0, 1) },
+    { "packet-queue-spsc",                  "use lock-free single producer/single consumer packet queues",
+        OPTION_OFFSET(packet_queue_spsc),   OPTION_INT(0, 0, 1) },
+    { "packet-queue-spsc-size",             "max packets of a single producer/single consumer packet queue",
+        OPTION_OFFSET(packet_queue_spsc_size),
+        OPTION_INT(PACKET_QUEUE_SPSC_SIZE_DEFAULT,
+                   PACKET_QUEUE_SPSC_SIZE_MIN,
+                   PACKET_QUEUE_SPSC_SIZE_MAX) },
+    { "packet-queue-wakeup-batch",          "packets to queue before waking up a waiting decoder",
+        OPTION_OFFSET(packet_queue_wakeup_batch),
+        OPTION_INT(PACKET_QUEUE_WAKEUP_BATCH_DEFAULT, 1, PACKET_QUEUE_WAKEUP_BATCH_MAX) },
+    { "live-catchup",                       "play faster when live latency exceeds live-catchup-target-ms",
+        OPTION_OFFSET(live_catchup),        OPTION_INT(0, 0, 1) },
+    { "live-catchup-target-ms",             "live latency to return to normal speed at",
+        OPTION_OFFSET(live_catchup_target_ms),
+        OPTION_INT(LIVE_CATCHUP_TARGET_MS_DEFAULT, 0, 60000) },
+    { "live-catchup-band-ms",               "live latency above target to start catching up at",
+        OPTION_OFFSET(live_catchup_band_ms),
+        OPTION_INT(LIVE_CATCHUP_BAND_MS_DEFAULT, 0, 60000) },
+    { "live-catchup-max-speed",             "max playback speed while catching up",
+        OPTION_OFFSET(live_catchup_max_speed),
+        OPTION_DOUBLE(LIVE_CATCHUP_MAX_SPEED_DEFAULT, 1.0, 2.0) },
+    { "record-preroll-ms",                  "keep whole GOPs covering this duration to start recording with",
+        OPTION_OFFSET(record_preroll_ms),   OPTION_INT(0, 0, 60000) },
+    { "record-format",                      "recording container: mp4, mkv, ts, or guess from the file name",
+        OPTION_OFFSET(record_format),       OPTION_STR(NULL) },
+    { "record-queue-bytes",                 "max bytes queued for the recording writer thread",
+        OPTION_OFFSET(record_queue_bytes),
+        OPTION_INT(FFP_RECORDER_QUEUE_BYTES_DEFAULT,
+                   FFP_RECORDER_QUEUE_BYTES_MIN,
+                   FFP_RECORDER_QUEUE_BYTES_MAX) },
+    { "record-overflow",                    "when the recording queue is full, 0: drop until next keyframe, 1: block",
+        OPTION_OFFSET(record_overflow),
+        OPTION_INT(FFP_RECORDER_OVERFLOW_DROP_GOP, FFP_RECORDER_OVERFLOW_DROP_GOP, FFP_RECORDER_OVERFLOW_BLOCK) },
+    { "record-segment-ms",                  "start a new recording file at the next keyframe after this duration, 0: one file",
+        OPTION_OFFSET(record_segment_ms),   OPTION_INT(0, 0, INT_MAX) },
+    { "record-segment-bytes",               "start a new recording file at the next keyframe after this size, 0: one file",
+        OPTION_OFFSET(record_segment_bytes),
+        OPTION_INT64(0, 0, INT64_MAX) },
+    { "record-retention-bytes",             "delete the oldest recording segments beyond this size, 0: keep all",
+        OPTION_OFFSET(record_retention_bytes),
+        OPTION_INT64(0, 0, INT64_MAX) },
+    { "intercom-codec",                     "intercom uplink codec, 1: pcm, 2: aac, 3: opus",
+        OPTION_OFFSET(intercom_codec),
+        OPTION_INT(FFP_INTERCOM_CODEC_AAC, FFP_INTERCOM_CODEC_PCM, FFP_INTERCOM_CODEC_OPUS) },
+    { "intercom-bit-rate",                  "intercom uplink encoder bit rate",
+        OPTION_OFFSET(intercom_bit_rate),
+        OPTION_INT(FFP_INTERCOM_BIT_RATE_DEFAULT, 8000, 256000) },
+    { "intercom-batch-ms",                  "intercom uplink audio coalesced into one send, 0: send each frame",
+        OPTION_OFFSET(intercom_batch_ms),
+        OPTION_INT(FFP_INTERCOM_BATCH_MS_DEFAULT, 0, FFP_INTERCOM_BATCH_MS_MAX) },
     { "packet-buffering",                   "pause output until enough packets have been read after stalling",
         OPTION_OFFSET(packet_buffering),    OPTION_INT(1, 0, 1) },
     { "sync-av-start",                      "synchronise a/v start time",
         OPTION_OFFSET(sync_av_start),       OPTION_INT(1, 0, 1) },
     { "iformat",                            "force format",
         OPTION_OFFSET(iformat_name),        OPTION_STR(NULL) },
+    { "probe-cache",                        "reuse the stream info probed by an earlier open of the same key",
+        OPTION_OFFSET(probe_cache),         OPTION_INT(0, 0, 1) },
+    { "probe-cache-key",                    "probe cache key, the url if not set",
+        OPTION_OFFSET(probe_cache_key),     OPTION_STR(NULL) },
+    { "probe-cache-dir",                    "directory to persist the probe cache in, memory only if not set",
+        OPTION_OFFSET(probe_cache_dir),     OPTION_STR(NULL) },
+    { "mmap-local-files",                   "read local files through a memory mapping",
+        OPTION_OFFSET(mmap_local_files),    OPTION_INT(0, 0, 1) },
+    { "mmap-readahead",                     "bytes the kernel is asked to read ahead of the position in mapped files",
+        OPTION_OFFSET(mmap_readahead),      OPTION_INT(IJKMMAP_READAHEAD_DEFAULT, 0, 64 * 1024 * 1024) },
     { "no-time-adjust",                     "return player's real time from the media stream instead of the adjusted time",
         OPTION_OFFSET(no_time_adjust),      OPTION_INT(0, 0, 1) },
     { "preset-5-1-center-mix-level",        "preset center-mix-level for 5.1 channel",
@@ -0,0 +1,471 @@
+/*
+ * ff_ffprobe_cache.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "ff_ffprobe_cache.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "libavutil/avstring.h"
+#include "libavutil/common.h"
+#include "libavutil/crc.h"
+#include "libavutil/mem.h"
+#include "ijkavutil/hash.h"
+
+#define PROBE_FILE_MAGIC        "ffprobecache 1\n"
+#define PROBE_FILE_SUFFIX       ".probe"
+#define PROBE_KEY_MAX           4096
+#define PROBE_STREAMS_MAX       64
+#define PROBE_EXTRADATA_MAX     (1024 * 1024)
+
+/* what avformat_open_input tells about a stream, before any probing */
+typedef struct ProbeKey {
+    int64_t codec_type;
+    int64_t codec_id;
+    int64_t width;
+    int64_t height;
+    int64_t extradata_size;
+    int64_t extradata_crc;
+} ProbeKey;
+
+typedef struct ProbeStream {
+    ProbeKey           key;
+    AVCodecParameters *par;
+    AVRational         r_frame_rate;
+    AVRational         avg_frame_rate;
+    AVRational         sample_aspect_ratio;
+} ProbeStream;
+
+struct FFProbeEntry {
+    char        *key;
+    char         format[32];
+    int          nb_streams;
+    ProbeStream *streams;
+    int64_t      last_used;
+};
+
+/* every field of AVCodecParameters but extradata, persisted as int64 */
+#define PROBE_PAR_FIELDS(X)                                                 \
+    X(codec_type) X(codec_id) X(codec_tag) X(format) X(bit_rate)            \
+    X(bits_per_coded_sample) X(bits_per_raw_sample) X(profile) X(level)     \
+    X(width) X(height) X(sample_aspect_ratio.num) X(sample_aspect_ratio.den)\
+    X(field_order) X(color_range) X(color_primaries) X(color_trc)           \
+    X(color_space) X(chroma_location) X(video_delay) X(channel_layout)      \
+    X(channels) X(sample_rate) X(block_align) X(frame_size)                 \
+    X(initial_padding) X(trailing_padding) X(seek_preroll)
+
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FFProbeEntry   *g_entries[FFP_PROBE_CACHE_MAX_ENTRIES];
+static int64_t         g_clock;
+
+static void probe_key_init(ProbeKey *key, const AVCodecParameters *par)
+{
+    memset(key, 0, sizeof(*key));
+    key->codec_type     = par->codec_type;
+    key->codec_id       = par->codec_id;
+    key->width          = par->width;
+    key->height         = par->height;
+    key->extradata_size = par->extradata_size;
+    if (par->extradata && par->extradata_size > 0)
+        key->extradata_crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, par->extradata, par->extradata_size);
+}
+
+static FFProbeEntry *entry_alloc(const char *key, const char *format, int nb_streams)
+{
+    FFProbeEntry *entry = av_mallocz(sizeof(FFProbeEntry));
+
+    if (!entry)
+        return NULL;
+    entry->streams = av_mallocz_array(nb_streams, sizeof(ProbeStream));
+    entry->key     = av_strdup(key ? key : "");
+    if (!entry->streams || !entry->key) {
+        ffp_probe_entry_freep(&entry);
+        return NULL;
+    }
+    av_strlcpy(entry->format, format, sizeof(entry->format));
+    entry->nb_streams = nb_streams;
+    return entry;
+}
+
+void ffp_probe_entry_freep(FFProbeEntry **pentry)
+{
+    FFProbeEntry *entry = *pentry;
+    int           i;
+
+    if (!entry)
+        return;
+    for (i = 0; i < entry->nb_streams && entry->streams; i++)
+        avcodec_parameters_free(&entry->streams[i].par);
+    av_freep(&entry->streams);
+    av_freep(&entry->key);
+    av_freep(pentry);
+}
+
+FFProbeEntry *ffp_probe_cache_snapshot(AVFormatContext *ic)
+{
+    FFProbeEntry *entry;
+    int           i;
+
+    if (!ic || !ic->iformat || ic->nb_streams <= 0 || ic->nb_streams > PROBE_STREAMS_MAX)
+        return NULL;
+
+    entry = entry_alloc(NULL, ic->iformat->name, ic->nb_streams);
+    if (!entry)
+        return NULL;
+    for (i = 0; i < ic->nb_streams; i++)
+        probe_key_init(&entry->streams[i].key, ic->streams[i]->codecpar);
+    return entry;
+}
+
+static int entry_match(const FFProbeEntry *entry, const FFProbeEntry *snapshot)
+{
+    int i;
+
+    if (strcmp(entry->format, snapshot->format) || entry->nb_streams != snapshot->nb_streams)
+        return 0;
+    for (i = 0; i < entry->nb_streams; i++) {
+        if (memcmp(&entry->streams[i].key, &snapshot->streams[i].key, sizeof(ProbeKey)))
+            return 0;
+    }
+    return 1;
+}
+
+/* caller holds g_mutex */
+static int entry_find(const char *key)
+{
+    int i;
+
+    for (i = 0; i < FFP_PROBE_CACHE_MAX_ENTRIES; i++) {
+        if (g_entries[i] && !strcmp(g_entries[i]->key, key))
+            return i;
+    }
+    return -1;
+}
+
+/* caller holds g_mutex, takes entry */
+static void entry_insert(FFProbeEntry *entry)
+{
+    int slot = entry_find(entry->key);
+    int i;
+
+    if (slot < 0) {
+        for (i = 0; i < FFP_PROBE_CACHE_MAX_ENTRIES; i++) {
+            if (!g_entries[i]) {
+                slot = i;
+                break;
+            }
+            if (slot < 0 || g_entries[i]->last_used < g_entries[slot]->last_used)
+                slot = i;
+        }
+    }
+    ffp_probe_entry_freep(&g_entries[slot]);
+    entry->last_used = ++g_clock;
+    g_entries[slot]  = entry;
+}
+
+static char *probe_file_path(const char *dir, const char *key)
+{
+    return av_asprintf("%s/%016"PRIx64 PROBE_FILE_SUFFIX, dir, ijk_hash_fnv1a64(key));
+}
+
+static int write_int(FILE *fp, int64_t value)
+{
+    return fwrite(&value, sizeof(value), 1, fp) == 1 ? 0 : -1;
+}
+
+static int write_bytes(FILE *fp, const void *data, int64_t size)
+{
+    if (write_int(fp, size) < 0)
+        return -1;
+    return size <= 0 || fwrite(data, size, 1, fp) == 1 ? 0 : -1;
+}
+
+static int read_int(FILE *fp, int64_t *value)
+{
+    return fread(value, sizeof(*value), 1, fp) == 1 ? 0 : -1;
+}
+
+/* into a new buffer padded for the decoders, *size 0 leaves *data NULL */
+static int read_bytes(FILE *fp, uint8_t **data, int *size, int max_size)
+{
+    int64_t length;
+
+    *data = NULL;
+    *size = 0;
+    if (read_int(fp, &length) < 0 || length < 0 || length > max_size)
+        return -1;
+    if (length == 0)
+        return 0;
+    *data = av_mallocz(length + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!*data || fread(*data, length, 1, fp) != 1) {
+        av_freep(data);
+        return -1;
+    }
+    *size = (int)length;
+    return 0;
+}
+
+static void entry_save(const FFProbeEntry *entry, const char *dir)
+{
+    char *path     = probe_file_path(dir, entry->key);
+    char *tmp_path = av_asprintf("%s.tmp", path ? path : "");
+    FILE *fp       = NULL;
+    int   ret      = 0;
+    int   i;
+
+    if (!path || !tmp_path || !(fp = fopen(tmp_path, "wb")))
+        goto end;
+
+    ret |= fwrite(PROBE_FILE_MAGIC, strlen(PROBE_FILE_MAGIC), 1, fp) == 1 ? 0 : -1;
+    ret |= write_bytes(fp, entry->key, strlen(entry->key));
+    ret |= write_bytes(fp, entry->format, strlen(entry->format));
+    ret |= write_int(fp, entry->nb_streams);
+    for (i = 0; i < entry->nb_streams; i++) {
+        const ProbeStream       *st  = &entry->streams[i];
+        const AVCodecParameters *par = st->par;
+
+        ret |= fwrite(&st->key, sizeof(st->key), 1, fp) == 1 ? 0 : -1;
+#define X(field) ret |= write_int(fp, (int64_t)par->field);
+        PROBE_PAR_FIELDS(X)
+#undef X
+        ret |= write_bytes(fp, par->extradata, par->extradata_size);
+        ret |= write_int(fp, st->r_frame_rate.num);
+        ret |= write_int(fp, st->r_frame_rate.den);
+        ret |= write_int(fp, st->avg_frame_rate.num);
+        ret |= write_int(fp, st->avg_frame_rate.den);
+        ret |= write_int(fp, st->sample_aspect_ratio.num);
+        ret |= write_int(fp, st->sample_aspect_ratio.den);
+    }
+    /* synced before the rename, a crash never leaves a truncated entry under path */
+    if (ret == 0 && (fflush(fp) || fsync(fileno(fp))))
+        ret = -1;
+    if (fclose(fp) || ret < 0 || rename(tmp_path, path))
+        unlink(tmp_path);
+
+end:
+    av_free(tmp_path);
+    av_free(path);
+}
+
+static FFProbeEntry *entry_load(const char *dir, const char *key)
+{
+    FFProbeEntry *entry = NULL;
+    char         *path  = probe_file_path(dir, key);
+    FILE         *fp    = path ? fopen(path, "rb") : NULL;
+    char          magic[sizeof(PROBE_FILE_MAGIC) - 1];
+    uint8_t      *bytes = NULL;
+    char          format[sizeof(entry->format)];
+    int64_t       value;
+    int64_t       nb_streams;
+    int           size;
+    int           ret = 0;
+    int           i;
+
+    if (!fp)
+        goto end;
+    if (fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, PROBE_FILE_MAGIC, sizeof(magic)))
+        goto end;
+
+    /* a hash collision is not our key */
+    if (read_bytes(fp, &bytes, &size, PROBE_KEY_MAX) < 0 || size != strlen(key) || memcmp(bytes, key, size))
+        goto end;
+    av_freep(&bytes);
+    if (read_bytes(fp, &bytes, &size, sizeof(format) - 1) < 0)
+        goto end;
+    memcpy(format, bytes ? (char *)bytes : "", size);
+    format[size] = 0;
+    av_freep(&bytes);
+    if (read_int(fp, &nb_streams) < 0 || nb_streams <= 0 || nb_streams > PROBE_STREAMS_MAX)
+        goto end;
+
+    entry = entry_alloc(key, format, (int)nb_streams);
+    if (!entry)
+        goto end;
+    for (i = 0; i < entry->nb_streams && ret == 0; i++) {
+        ProbeStream       *st  = &entry->streams[i];
+        AVCodecParameters *par = avcodec_parameters_alloc();
+
+        if (!par || fread(&st->key, sizeof(st->key), 1, fp) != 1) {
+            avcodec_parameters_free(&par);
+            ret = -1;
+            break;
+        }
+        st->par = par;
+#define X(field) ret |= read_int(fp, &value); par->field = value;
+        PROBE_PAR_FIELDS(X)
+#undef X
+        ret |= read_bytes(fp, &par->extradata, &par->extradata_size, PROBE_EXTRADATA_MAX);
+        ret |= read_int(fp, &value); st->r_frame_rate.num        = (int)value;
+        ret |= read_int(fp, &value); st->r_frame_rate.den        = (int)value;
+        ret |= read_int(fp, &value); st->avg_frame_rate.num      = (int)value;
+        ret |= read_int(fp, &value); st->avg_frame_rate.den      = (int)value;
+        ret |= read_int(fp, &value); st->sample_aspect_ratio.num = (int)value;
+        ret |= read_int(fp, &value); st->sample_aspect_ratio.den = (int)value;
+    }
+    if (ret < 0)
+        ffp_probe_entry_freep(&entry);
+
+end:
+    if (fp)
+        fclose(fp);
+    av_free(bytes);
+    av_free(path);
+    return entry;
+}
+
+int ffp_probe_cache_restore(const char *key, const char *dir, const FFProbeEntry *snapshot, AVFormatContext *ic)
+{
+    FFProbeEntry *entry = NULL;
+    AVStream     *st;
+    int           slot;
+    int           ret = 0;
+    int           i;
+
+    if (!key || !snapshot)
+        return 0;
+
+    pthread_mutex_lock(&g_mutex);
+    slot = entry_find(key);
+    if (slot < 0 && dir && *dir) {
+        entry = entry_load(dir, key);
+        if (entry)
+            entry_insert(entry);
+        slot = entry_find(key);
+    }
+    if (slot < 0 || !entry_match(g_entries[slot], snapshot))
+        goto end;
+
+    entry = g_entries[slot];
+    entry->last_used = ++g_clock;
+    for (i = 0; i < ic->nb_streams; i++) {
+        st  = ic->streams[i];
+        ret = avcodec_parameters_copy(st->codecpar, entry->streams[i].par);
+        if (ret < 0)
+            goto end;
+        if (entry->streams[i].r_frame_rate.num > 0)
+            st->r_frame_rate = entry->streams[i].r_frame_rate;
+        if (entry->streams[i].avg_frame_rate.num > 0)
+            st->avg_frame_rate = entry->streams[i].avg_frame_rate;
+        if (entry->streams[i].sample_aspect_ratio.num > 0)
+            st->sample_aspect_ratio = entry->streams[i].sample_aspect_ratio;
+    }
+    ret = 1;
+
+end:
+    pthread_mutex_unlock(&g_mutex);
+    return ret;
+}
+
+int ffp_probe_cache_validate(const char *key, AVFormatContext *ic)
+{
+    const AVCodecParameters *cached;
+    const AVCodecParameters *par;
+    ProbeKey                 cached_key;
+    ProbeKey                 probed_key;
+    int                      slot;
+    int                      ret = 0;
+    int                      i;
+
+    pthread_mutex_lock(&g_mutex);
+    slot = entry_find(key);
+    if (slot < 0 || g_entries[slot]->nb_streams != ic->nb_streams) {
+        ret = -1;
+        goto end;
+    }
+    for (i = 0; i < ic->nb_streams && ret == 0; i++) {
+        cached = g_entries[slot]->streams[i].par;
+        par    = ic->streams[i]->codecpar;
+        probe_key_init(&cached_key, cached);
+        probe_key_init(&probed_key, par);
+
+        /* what the first packets could tell, absent values do not count */
+        if (par->codec_type != cached->codec_type || par->codec_id != cached->codec_id)
+            ret = -1;
+        else if (par->width && (par->width != cached->width || par->height != cached->height))
+            ret = -1;
+        else if (par->sample_rate && par->sample_rate != cached->sample_rate)
+            ret = -1;
+        else if (par->channels && par->channels != cached->channels)
+            ret = -1;
+        else if (par->extradata_size && probed_key.extradata_crc != cached_key.extradata_crc)
+            ret = -1;
+    }
+
+end:
+    pthread_mutex_unlock(&g_mutex);
+    return ret;
+}
+
+void ffp_probe_cache_store(const char *key, const char *dir, FFProbeEntry **psnapshot, AVFormatContext *ic)
+{
+    FFProbeEntry *entry = *psnapshot;
+    int           i;
+
+    *psnapshot = NULL;
+    if (!key || !entry || !ic || entry->nb_streams != ic->nb_streams)
+        goto fail;
+
+    av_freep(&entry->key);
+    entry->key = av_strdup(key);
+    if (!entry->key)
+        goto fail;
+    for (i = 0; i < entry->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+
+        entry->streams[i].par = avcodec_parameters_alloc();
+        if (!entry->streams[i].par || avcodec_parameters_copy(entry->streams[i].par, st->codecpar) < 0)
+            goto fail;
+        entry->streams[i].r_frame_rate        = st->r_frame_rate;
+        entry->streams[i].avg_frame_rate      = st->avg_frame_rate;
+        entry->streams[i].sample_aspect_ratio = st->sample_aspect_ratio;
+    }
+
+    pthread_mutex_lock(&g_mutex);
+    if (dir && *dir)
+        entry_save(entry, dir);
+    entry_insert(entry);
+    pthread_mutex_unlock(&g_mutex);
+    return;
+
+fail:
+    ffp_probe_entry_freep(&entry);
+}
+
+void ffp_probe_cache_invalidate(const char *key, const char *dir)
+{
+    char *path;
+    int   slot;
+
+    if (!key)
+        return;
+
+    pthread_mutex_lock(&g_mutex);
+    slot = entry_find(key);
+    if (slot >= 0)
+        ffp_probe_entry_freep(&g_entries[slot]);
+    if (dir && *dir) {
+        path = probe_file_path(dir, key);
+        if (path)
+            unlink(path);
+        av_free(path);
+    }
+    pthread_mutex_unlock(&g_mutex);
+}
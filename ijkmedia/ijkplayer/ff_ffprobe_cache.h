@@ -0,0 +1,59 @@
+/*
+ * ff_ffprobe_cache.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef FFPLAY__FF_FFPROBE_CACHE_H
+#define FFPLAY__FF_FFPROBE_CACHE_H
+
+#include "libavformat/avformat.h"
+
+/* entries kept in memory by the process, least recently used go first */
+#define FFP_PROBE_CACHE_MAX_ENTRIES 512
+
+/*
+ * Probe results keyed by url or a user key, shared by every player in the
+ * process and optionally persisted, one file per key, in a directory.
+ *
+ * An entry is used only when the streams found by avformat_open_input have
+ * the codec ids, dimensions and extradata they had before the probe that
+ * filled it. The probed parameters are then copied into the streams, and
+ * avformat_find_stream_info only reads the first packet of each stream.
+ */
+typedef struct FFProbeEntry FFProbeEntry;
+
+/* the streams of ic right after avformat_open_input, NULL if there is none */
+FFProbeEntry *ffp_probe_cache_snapshot(AVFormatContext *ic);
+void ffp_probe_entry_freep(FFProbeEntry **pentry);
+
+/* return 1 if a matching entry was copied into the streams of ic, else 0 */
+int ffp_probe_cache_restore(const char *key, const char *dir, const FFProbeEntry *snapshot, AVFormatContext *ic);
+
+/*
+ * After a restored probe, the parameters found in the first packets must
+ * agree with the entry. return 0 if they do, < 0 if not.
+ */
+int ffp_probe_cache_validate(const char *key, AVFormatContext *ic);
+
+/* complete the snapshot with the probe result of ic and keep it */
+void ffp_probe_cache_store(const char *key, const char *dir, FFProbeEntry **psnapshot, AVFormatContext *ic);
+
+void ffp_probe_cache_invalidate(const char *key, const char *dir);
+
+#endif
@@ -0,0 +1,878 @@
+/*
+ * ff_ffrecorder.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "ff_ffrecorder.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "libavcodec/avcodec.h"
+#include "libavutil/avstring.h"
+#include "libavutil/fifo.h"
+#include "libavutil/time.h"
+#include "ijksdl/ijksdl_mutex.h"
+#include "ijksdl/ijksdl_thread.h"
+
+#define FFP_RECORDER_MAX_STREAMS 4
+
+typedef struct FFRecorderStream {
+    int                 in_index;
+    AVCodecParameters  *codecpar;
+    AVRational          time_base;
+    AVBSFContext       *bsf;
+    AVStream           *out_st;
+    int64_t             last_dts;
+} FFRecorderStream;
+
+typedef struct FFRecorderSegment {
+    char               *filename;
+    int64_t             start_pts;      /* input timeline, AV_TIME_BASE */
+    int64_t             duration;       /* AV_TIME_BASE */
+    int64_t             size;
+} FFRecorderSegment;
+
+struct FFRecorder {
+    char               *filename;
+    char               *format_name;
+    FFRecorderStream    streams[FFP_RECORDER_MAX_STREAMS];
+    int                 nb_streams;
+    int                 video_index;
+
+    SDL_mutex          *mutex;
+    SDL_cond           *cond;
+    SDL_Thread         *write_tid;
+    SDL_Thread          _write_tid;
+    FFRecorder         *next_closing;
+
+    /* guarded by mutex */
+    AVFifoBuffer       *queue;
+    int64_t             max_queue_bytes;
+    int                 overflow;
+    int                 started;
+    int                 dropping;
+    int                 closing;
+    int                 finished;
+    int                 error;
+    FFRecorderStat      stat;
+
+    /* writer thread only */
+    AVFormatContext    *oc;
+    int                 header_written;
+    int64_t             start_time;     /* of the current file, input timeline */
+    int64_t             end_time;
+
+    /* segmented recording, filename is a pattern then */
+    int                 segmented;
+    int64_t             segment_duration;
+    int64_t             segment_bytes;
+    int64_t             retention_bytes;
+    char               *index_filename;
+    char               *segment_filename;
+    int                 segment_number;
+    FFRecorderSegment  *segments;
+    int                 nb_segments;
+    int64_t             segments_bytes;
+};
+
+static FFRecorderStream *find_stream(FFRecorder *rec, int in_index)
+{
+    int i;
+
+    for (i = 0; i < rec->nb_streams; i++) {
+        if (rec->streams[i].in_index == in_index)
+            return &rec->streams[i];
+    }
+
+    return NULL;
+}
+
+static int init_aac_bsf(FFRecorderStream *s)
+{
+    const AVBitStreamFilter *filter = av_bsf_get_by_name("aac_adtstoasc");
+    int ret;
+
+    if (!filter)
+        return 0;
+
+    ret = av_bsf_alloc(filter, &s->bsf);
+    if (ret < 0)
+        return ret;
+
+    ret = avcodec_parameters_copy(s->bsf->par_in, s->codecpar);
+    if (ret < 0)
+        return ret;
+    s->bsf->time_base_in = s->time_base;
+
+    return av_bsf_init(s->bsf);
+}
+
+static int recorder_open(FFRecorder *rec, const char *filename)
+{
+    AVFormatContext *oc = NULL;
+    int nb_out_streams = 0;
+    int i, ret;
+
+    ret = avformat_alloc_output_context2(&oc, NULL, rec->format_name, filename);
+    if (!oc)
+        return ret < 0 ? ret : AVERROR_UNKNOWN;
+    rec->oc = oc;
+
+    for (i = 0; i < rec->nb_streams; i++) {
+        FFRecorderStream *s = &rec->streams[i];
+
+        /* e.g. g711 in mp4, keep recording the other streams; < 0 means unknown */
+        s->out_st = NULL;
+        if (avformat_query_codec(oc->oformat, s->codecpar->codec_id, FF_COMPLIANCE_NORMAL) == 0) {
+            av_log(NULL, AV_LOG_WARNING, "recorder: %s can not hold %s, stream %d skipped\n",
+                   oc->oformat->name, avcodec_get_name(s->codecpar->codec_id), s->in_index);
+            continue;
+        }
+
+        /* mpegts carries adts as is, segments share the filter */
+        if (!s->bsf && s->codecpar->codec_id == AV_CODEC_ID_AAC && strcmp(oc->oformat->name, "mpegts")) {
+            ret = init_aac_bsf(s);
+            if (ret < 0)
+                return ret;
+        }
+
+        s->out_st = avformat_new_stream(oc, NULL);
+        if (!s->out_st)
+            return AVERROR(ENOMEM);
+
+        ret = avcodec_parameters_copy(s->out_st->codecpar, s->bsf ? s->bsf->par_out : s->codecpar);
+        if (ret < 0)
+            return ret;
+        s->out_st->codecpar->codec_tag = 0;
+        s->out_st->time_base = s->time_base;
+        nb_out_streams++;
+    }
+    if (!nb_out_streams)
+        return AVERROR(EINVAL);
+
+    if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&oc->pb, filename, AVIO_FLAG_WRITE);
+        if (ret < 0)
+            return ret;
+    }
+
+    ret = avformat_write_header(oc, NULL);
+    if (ret < 0)
+        return ret;
+
+    rec->header_written = 1;
+    return 0;
+}
+
+/* return the size of the file */
+static int64_t recorder_close(FFRecorder *rec)
+{
+    int64_t size = 0;
+    int     i;
+
+    if (!rec->oc)
+        return 0;
+
+    for (i = 0; i < rec->nb_streams; i++)
+        rec->streams[i].out_st = NULL;
+
+    if (rec->header_written)
+        av_write_trailer(rec->oc);
+    rec->header_written = 0;
+    if (rec->oc->pb) {
+        size = avio_size(rec->oc->pb);
+        if (size < 0)
+            size = avio_tell(rec->oc->pb);
+    }
+    if (!(rec->oc->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&rec->oc->pb);
+    avformat_free_context(rec->oc);
+    rec->oc = NULL;
+    return size;
+}
+
+static void write_segment_index(FFRecorder *rec)
+{
+    char  tmp[1024];
+    FILE *fp;
+    int   i;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", rec->index_filename);
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        av_log(NULL, AV_LOG_WARNING, "recorder: failed to write %s\n", tmp);
+        return;
+    }
+
+    for (i = 0; i < rec->nb_segments; i++) {
+        FFRecorderSegment *seg = &rec->segments[i];
+        fprintf(fp, "%s %"PRId64" %"PRId64" %"PRId64"\n", av_basename(seg->filename),
+                seg->start_pts / 1000, seg->duration / 1000, seg->size);
+    }
+    fclose(fp);
+
+    /* readers never see a partial index */
+    if (rename(tmp, rec->index_filename))
+        unlink(tmp);
+}
+
+static void apply_segment_retention(FFRecorder *rec)
+{
+    int deleted = 0;
+
+    if (rec->retention_bytes <= 0)
+        return;
+
+    /* keep the latest segment whatever its size */
+    while (rec->nb_segments - deleted > 1 && rec->segments_bytes > rec->retention_bytes) {
+        FFRecorderSegment *seg = &rec->segments[deleted++];
+
+        if (unlink(seg->filename))
+            av_log(NULL, AV_LOG_WARNING, "recorder: failed to delete %s\n", seg->filename);
+        rec->segments_bytes -= seg->size;
+        av_freep(&seg->filename);
+    }
+    if (!deleted)
+        return;
+
+    rec->nb_segments -= deleted;
+    memmove(rec->segments, rec->segments + deleted, rec->nb_segments * sizeof(FFRecorderSegment));
+
+    SDL_LockMutex(rec->mutex);
+    rec->stat.deleted_segments += deleted;
+    SDL_UnlockMutex(rec->mutex);
+}
+
+static int recorder_open_segment(FFRecorder *rec)
+{
+    char filename[1024];
+
+    if (!rec->segmented)
+        return recorder_open(rec, rec->filename);
+
+    if (av_get_frame_filename(filename, sizeof(filename), rec->filename, rec->segment_number) < 0)
+        return AVERROR(EINVAL);
+    rec->segment_number++;
+
+    av_freep(&rec->segment_filename);
+    rec->segment_filename = av_strdup(filename);
+    if (!rec->segment_filename)
+        return AVERROR(ENOMEM);
+
+    return recorder_open(rec, filename);
+}
+
+static void recorder_close_segment(FFRecorder *rec)
+{
+    FFRecorderSegment *seg;
+    int64_t            size;
+    int                empty = rec->start_time == AV_NOPTS_VALUE;
+
+    if (!rec->oc)
+        return;
+
+    size = recorder_close(rec);
+    if (!rec->segmented)
+        return;
+
+    if (empty) {
+        unlink(rec->segment_filename);
+        return;
+    }
+
+    seg = av_dynarray2_add((void **)&rec->segments, &rec->nb_segments, sizeof(FFRecorderSegment), NULL);
+    if (!seg)
+        return;
+    seg->filename  = rec->segment_filename;
+    seg->start_pts = rec->start_time;
+    seg->duration  = FFMAX(rec->end_time - rec->start_time, 0);
+    seg->size      = size;
+    rec->segment_filename = NULL;
+    rec->segments_bytes  += size;
+
+    apply_segment_retention(rec);
+    write_segment_index(rec);
+
+    SDL_LockMutex(rec->mutex);
+    rec->stat.segments       = rec->nb_segments;
+    rec->stat.segments_bytes = rec->segments_bytes;
+    SDL_UnlockMutex(rec->mutex);
+}
+
+/* cut at a keyframe so every segment plays on its own */
+static int need_new_segment(FFRecorder *rec, AVPacket *pkt, int64_t ts)
+{
+    if (!rec->segmented || !rec->oc || rec->start_time == AV_NOPTS_VALUE || ts == AV_NOPTS_VALUE)
+        return 0;
+    if (rec->video_index >= 0 &&
+        (pkt->stream_index != rec->video_index || !(pkt->flags & AV_PKT_FLAG_KEY)))
+        return 0;
+
+    if (rec->segment_duration > 0 && ts - rec->start_time >= rec->segment_duration)
+        return 1;
+    if (rec->segment_bytes > 0 && rec->oc->pb && avio_tell(rec->oc->pb) >= rec->segment_bytes)
+        return 1;
+    return 0;
+}
+
+static int recorder_next_segment(FFRecorder *rec)
+{
+    int i;
+
+    recorder_close_segment(rec);
+
+    for (i = 0; i < rec->nb_streams; i++)
+        rec->streams[i].last_dts = AV_NOPTS_VALUE;
+    rec->start_time = AV_NOPTS_VALUE;
+    rec->end_time   = AV_NOPTS_VALUE;
+
+    return recorder_open_segment(rec);
+}
+
+static int recorder_write_packet(FFRecorder *rec, AVPacket *pkt)
+{
+    FFRecorderStream *s = find_stream(rec, pkt->stream_index);
+    int64_t offset = 0;
+    int64_t ts     = AV_NOPTS_VALUE;
+    int64_t end    = AV_NOPTS_VALUE;
+    int64_t start, latency;
+    int size, ret;
+
+    if (!s->out_st)
+        return 0;
+
+    start = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (start != AV_NOPTS_VALUE)
+        ts = av_rescale_q(start, s->time_base, AV_TIME_BASE_Q);
+    if (pkt->pts != AV_NOPTS_VALUE)
+        end = av_rescale_q(pkt->pts + FFMAX(pkt->duration, 0), s->time_base, AV_TIME_BASE_Q);
+
+    if (need_new_segment(rec, pkt, ts)) {
+        ret = recorder_next_segment(rec);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (rec->start_time == AV_NOPTS_VALUE)
+        rec->start_time = ts;
+    if (rec->start_time != AV_NOPTS_VALUE)
+        offset = av_rescale_q(rec->start_time, AV_TIME_BASE_Q, s->time_base);
+
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts -= offset;
+    if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts -= offset;
+
+    /* packets queued before the first video keyframe of the file, or out of order */
+    if ((pkt->dts != AV_NOPTS_VALUE && pkt->dts < 0) ||
+        (pkt->dts != AV_NOPTS_VALUE && s->last_dts != AV_NOPTS_VALUE && pkt->dts <= s->last_dts))
+        return 0;
+    if (end != AV_NOPTS_VALUE && (rec->end_time == AV_NOPTS_VALUE || end > rec->end_time))
+        rec->end_time = end;
+
+    if (s->bsf) {
+        ret = av_bsf_send_packet(s->bsf, pkt);
+        if (ret < 0)
+            return 0;
+        ret = av_bsf_receive_packet(s->bsf, pkt);
+        if (ret < 0)
+            return 0;
+    }
+
+    if (pkt->dts != AV_NOPTS_VALUE)
+        s->last_dts = pkt->dts;
+    av_packet_rescale_ts(pkt, s->time_base, s->out_st->time_base);
+    pkt->stream_index = s->out_st->index;
+    pkt->pos          = -1;
+    size              = pkt->size;
+
+    start   = av_gettime_relative();
+    ret     = av_interleaved_write_frame(rec->oc, pkt);
+    latency = av_gettime_relative() - start;
+
+    SDL_LockMutex(rec->mutex);
+    rec->stat.last_write_latency_us = latency;
+    rec->stat.max_write_latency_us  = FFMAX(rec->stat.max_write_latency_us, latency);
+    if (ret >= 0) {
+        rec->stat.written_packets++;
+        rec->stat.written_bytes += size;
+    }
+    SDL_UnlockMutex(rec->mutex);
+
+    /* a rejected packet is skipped, io errors stop the recorder */
+    if (ret < 0 && rec->oc->pb && rec->oc->pb->error)
+        return rec->oc->pb->error;
+    return 0;
+}
+
+static int recorder_thread(void *arg)
+{
+    FFRecorder *rec = arg;
+    AVPacket    pkt;
+    int         error;
+    int         ret = recorder_open_segment(rec);
+
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "recorder: failed to open %s: %s\n", rec->filename, av_err2str(ret));
+        SDL_LockMutex(rec->mutex);
+        rec->error = ret;
+        SDL_CondBroadcast(rec->cond);
+        SDL_UnlockMutex(rec->mutex);
+    }
+
+    for (;;) {
+        SDL_LockMutex(rec->mutex);
+        while (!av_fifo_size(rec->queue) && !rec->closing)
+            SDL_CondWait(rec->cond, rec->mutex);
+        if (!av_fifo_size(rec->queue)) {
+            SDL_UnlockMutex(rec->mutex);
+            break;
+        }
+        av_fifo_generic_read(rec->queue, &pkt, sizeof(pkt), NULL);
+        rec->stat.queued_bytes -= pkt.size;
+        rec->stat.queued_packets--;
+        error = rec->error;
+        SDL_CondBroadcast(rec->cond);
+        SDL_UnlockMutex(rec->mutex);
+
+        if (!error) {
+            ret = recorder_write_packet(rec, &pkt);
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "recorder: failed to write %s: %s\n", rec->filename, av_err2str(ret));
+                SDL_LockMutex(rec->mutex);
+                rec->error = ret;
+                SDL_CondBroadcast(rec->cond);
+                SDL_UnlockMutex(rec->mutex);
+            }
+        }
+        av_packet_unref(&pkt);
+    }
+
+    recorder_close_segment(rec);
+
+    SDL_LockMutex(rec->mutex);
+    rec->finished = 1;
+    SDL_UnlockMutex(rec->mutex);
+    return 0;
+}
+
+static void recorder_free(FFRecorder *rec)
+{
+    AVPacket pkt;
+    int      i;
+
+    if (rec->queue) {
+        while (av_fifo_size(rec->queue) >= sizeof(pkt)) {
+            av_fifo_generic_read(rec->queue, &pkt, sizeof(pkt), NULL);
+            av_packet_unref(&pkt);
+        }
+        av_fifo_freep(&rec->queue);
+    }
+
+    for (i = 0; i < rec->nb_streams; i++) {
+        avcodec_parameters_free(&rec->streams[i].codecpar);
+        av_bsf_free(&rec->streams[i].bsf);
+    }
+
+    for (i = 0; i < rec->nb_segments; i++)
+        av_freep(&rec->segments[i].filename);
+    av_freep(&rec->segments);
+
+    SDL_DestroyCondP(&rec->cond);
+    SDL_DestroyMutexP(&rec->mutex);
+    av_freep(&rec->segment_filename);
+    av_freep(&rec->index_filename);
+    av_freep(&rec->format_name);
+    av_freep(&rec->filename);
+    av_free(rec);
+}
+
+/* "/sdcard/rec.mp4" -> "/sdcard/rec-%05d.mp4", index "/sdcard/rec-index.txt" */
+static int init_segment_names(FFRecorder *rec, const char *filename)
+{
+    char        buf[1024];
+    const char *base = av_basename(filename);
+    const char *ext  = strrchr(base, '.');
+    const char *pattern;
+
+    if (av_get_frame_filename(buf, sizeof(buf), filename, 0) < 0) {
+        if (!ext)
+            ext = base + strlen(base);
+        rec->filename = av_asprintf("%.*s-%%05d%s", (int)(ext - filename), filename, ext);
+    } else {
+        rec->filename = av_strdup(filename);
+    }
+    if (!rec->filename)
+        return AVERROR(ENOMEM);
+
+    pattern = strchr(rec->filename, '%');
+    rec->index_filename = av_asprintf("%.*sindex.txt", (int)(pattern - rec->filename), rec->filename);
+    if (!rec->index_filename)
+        return AVERROR(ENOMEM);
+    return 0;
+}
+
+FFRecorder *ffp_recorder_create(const char *filename, AVStream **streams, int nb_streams,
+                                const FFRecorderConfig *config)
+{
+    FFRecorder *rec;
+    int         i;
+
+    if (!filename || !*filename || !config)
+        return NULL;
+
+    rec = av_mallocz(sizeof(FFRecorder));
+    if (!rec)
+        return NULL;
+
+    rec->mutex            = SDL_CreateMutex();
+    rec->cond             = SDL_CreateCond();
+    rec->queue            = av_fifo_alloc(64 * sizeof(AVPacket));
+    rec->max_queue_bytes  = av_clip64(config->max_queue_bytes, FFP_RECORDER_QUEUE_BYTES_MIN, FFP_RECORDER_QUEUE_BYTES_MAX);
+    rec->overflow         = config->overflow;
+    rec->segment_duration = FFMAX(config->segment_duration_ms, 0) * 1000;
+    rec->segment_bytes    = FFMAX(config->segment_bytes, 0);
+    rec->retention_bytes  = FFMAX(config->retention_bytes, 0);
+    rec->segmented        = rec->segment_duration > 0 || rec->segment_bytes > 0;
+    rec->video_index      = -1;
+    rec->start_time       = AV_NOPTS_VALUE;
+    rec->end_time         = AV_NOPTS_VALUE;
+    if (!rec->mutex || !rec->cond || !rec->queue)
+        goto fail;
+
+    if (config->format_name && *config->format_name) {
+        const char *name = config->format_name;
+        if (!strcmp(name, "mkv"))
+            name = "matroska";
+        else if (!strcmp(name, "ts"))
+            name = "mpegts";
+        rec->format_name = av_strdup(name);
+        if (!rec->format_name)
+            goto fail;
+    }
+
+    if (rec->segmented) {
+        if (init_segment_names(rec, filename) < 0)
+            goto fail;
+    } else {
+        rec->filename = av_strdup(filename);
+        if (!rec->filename)
+            goto fail;
+    }
+
+    for (i = 0; i < nb_streams && rec->nb_streams < FFP_RECORDER_MAX_STREAMS; i++) {
+        FFRecorderStream *s;
+        enum AVMediaType  type;
+
+        if (!streams[i])
+            continue;
+        type = streams[i]->codecpar->codec_type;
+        if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO)
+            continue;
+
+        s = &rec->streams[rec->nb_streams];
+        s->codecpar = avcodec_parameters_alloc();
+        if (!s->codecpar || avcodec_parameters_copy(s->codecpar, streams[i]->codecpar) < 0)
+            goto fail;
+        s->in_index  = streams[i]->index;
+        s->time_base = streams[i]->time_base;
+        s->last_dts  = AV_NOPTS_VALUE;
+        rec->nb_streams++;
+
+        if (type == AVMEDIA_TYPE_VIDEO && rec->video_index < 0)
+            rec->video_index = streams[i]->index;
+    }
+    if (!rec->nb_streams)
+        goto fail;
+
+    rec->write_tid = SDL_CreateThreadEx(&rec->_write_tid, recorder_thread, rec, "ff_recorder");
+    if (!rec->write_tid)
+        goto fail;
+
+    return rec;
+fail:
+    for (i = 0; i < FFP_RECORDER_MAX_STREAMS; i++)
+        avcodec_parameters_free(&rec->streams[i].codecpar);
+    rec->nb_streams = 0;
+    recorder_free(rec);
+    return NULL;
+}
+
+void ffp_recorder_freep(FFRecorder **prec)
+{
+    FFRecorder *rec;
+
+    if (!prec || !*prec)
+        return;
+
+    rec = *prec;
+    *prec = NULL;
+
+    SDL_LockMutex(rec->mutex);
+    rec->closing = 1;
+    SDL_CondBroadcast(rec->cond);
+    SDL_UnlockMutex(rec->mutex);
+
+    SDL_WaitThread(rec->write_tid, NULL);
+    recorder_free(rec);
+}
+
+void ffp_recorder_close_async(FFRecorder **prec, FFRecorder **closing)
+{
+    FFRecorder *rec;
+
+    ffp_recorder_reap(closing, 0);
+    if (!prec || !*prec)
+        return;
+
+    rec = *prec;
+    *prec = NULL;
+
+    SDL_LockMutex(rec->mutex);
+    rec->closing = 1;
+    SDL_CondBroadcast(rec->cond);
+    SDL_UnlockMutex(rec->mutex);
+
+    rec->next_closing = *closing;
+    *closing = rec;
+}
+
+void ffp_recorder_reap(FFRecorder **closing, int wait)
+{
+    FFRecorder **link = closing;
+    FFRecorder  *rec;
+    int          finished;
+
+    while ((rec = *link)) {
+        SDL_LockMutex(rec->mutex);
+        finished = rec->finished;
+        SDL_UnlockMutex(rec->mutex);
+        if (!finished && !wait) {
+            link = &rec->next_closing;
+            continue;
+        }
+
+        *link = rec->next_closing;
+        SDL_WaitThread(rec->write_tid, NULL);
+        recorder_free(rec);
+    }
+}
+
+int ffp_recorder_write(FFRecorder *rec, AVPacket *pkt)
+{
+    AVPacket pkt1;
+    int      is_key;
+    int      ret = 0;
+
+    if (!rec || !pkt || !pkt->data || !find_stream(rec, pkt->stream_index))
+        return 0;
+
+    is_key = rec->video_index < 0 ||
+             (pkt->stream_index == rec->video_index && (pkt->flags & AV_PKT_FLAG_KEY));
+
+    SDL_LockMutex(rec->mutex);
+    if (rec->error) {
+        ret = rec->error;
+        goto end;
+    }
+
+    if (!rec->started) {
+        if (!is_key)
+            goto end;
+        rec->started = 1;
+    }
+
+    if (rec->dropping) {
+        if (!is_key) {
+            rec->stat.dropped_packets++;
+            goto end;
+        }
+        rec->dropping = 0;
+    }
+
+    while (rec->stat.queued_packets > 0 && rec->stat.queued_bytes + pkt->size > rec->max_queue_bytes) {
+        if (rec->overflow != FFP_RECORDER_OVERFLOW_BLOCK) {
+            rec->dropping = 1;
+            rec->stat.dropped_gops++;
+            rec->stat.dropped_packets++;
+            goto end;
+        }
+        if (rec->error) {
+            ret = rec->error;
+            goto end;
+        }
+        SDL_CondWait(rec->cond, rec->mutex);
+    }
+
+    if (av_fifo_space(rec->queue) < sizeof(pkt1)) {
+        ret = av_fifo_grow(rec->queue, av_fifo_size(rec->queue));
+        if (ret < 0)
+            goto end;
+    }
+
+    ret = av_packet_ref(&pkt1, pkt);
+    if (ret < 0)
+        goto end;
+
+    av_fifo_generic_write(rec->queue, &pkt1, sizeof(pkt1), NULL);
+    rec->stat.queued_bytes += pkt1.size;
+    rec->stat.queued_packets++;
+    SDL_CondBroadcast(rec->cond);
+
+end:
+    SDL_UnlockMutex(rec->mutex);
+    return ret;
+}
+
+void ffp_recorder_get_stat(FFRecorder *rec, FFRecorderStat *stat)
+{
+    if (!rec) {
+        memset(stat, 0, sizeof(FFRecorderStat));
+        return;
+    }
+
+    SDL_LockMutex(rec->mutex);
+    *stat = rec->stat;
+    SDL_UnlockMutex(rec->mutex);
+}
+
+typedef struct FFRecorderPrerollPacket {
+    AVPacket                        pkt;
+    int64_t                         gop_time;   /* AV_TIME_BASE, first packet of a gop only */
+    struct FFRecorderPrerollPacket *next;
+    struct FFRecorderPrerollPacket *next_gop;   /* first packet of the next gop */
+} FFRecorderPrerollPacket;
+
+struct FFRecorderPreroll {
+    FFRecorderPrerollPacket *first;             /* always starts a gop */
+    FFRecorderPrerollPacket *last;
+    FFRecorderPrerollPacket *last_gop;
+    int                      nb_gops;
+    int64_t                  bytes;
+    int64_t                  duration;
+    int64_t                  max_bytes;
+};
+
+FFRecorderPreroll *ffp_recorder_preroll_create(int64_t duration_ms, int64_t max_bytes)
+{
+    FFRecorderPreroll *p = av_mallocz(sizeof(FFRecorderPreroll));
+    if (!p)
+        return NULL;
+
+    p->duration  = FFMAX(duration_ms, 0) * 1000;
+    p->max_bytes = max_bytes > 0 ? max_bytes : INT64_MAX;
+    return p;
+}
+
+static void preroll_pop(FFRecorderPreroll *p)
+{
+    FFRecorderPrerollPacket *node = p->first;
+
+    p->first = node->next;
+    if (!p->first)
+        p->last = NULL;
+    if (p->last_gop == node)
+        p->last_gop = NULL;
+    p->bytes -= node->pkt.size;
+    av_packet_unref(&node->pkt);
+    av_free(node);
+}
+
+void ffp_recorder_preroll_reset(FFRecorderPreroll *p)
+{
+    if (!p)
+        return;
+
+    while (p->first)
+        preroll_pop(p);
+    p->nb_gops = 0;
+}
+
+void ffp_recorder_preroll_freep(FFRecorderPreroll **pp)
+{
+    if (!pp || !*pp)
+        return;
+
+    ffp_recorder_preroll_reset(*pp);
+    av_freep(pp);
+}
+
+int ffp_recorder_preroll_put(FFRecorderPreroll *p, AVPacket *pkt, AVRational time_base, int gop_start)
+{
+    FFRecorderPrerollPacket *node;
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    int ret;
+
+    if (!p || !pkt->data || (!gop_start && !p->first))
+        return 0;
+
+    node = av_mallocz(sizeof(FFRecorderPrerollPacket));
+    if (!node)
+        return AVERROR(ENOMEM);
+    ret = av_packet_ref(&node->pkt, pkt);
+    if (ret < 0) {
+        av_free(node);
+        return ret;
+    }
+
+    if (ts != AV_NOPTS_VALUE)
+        ts = av_rescale_q(ts, time_base, AV_TIME_BASE_Q);
+    node->gop_time = gop_start ? ts : AV_NOPTS_VALUE;
+
+    if (p->last)
+        p->last->next = node;
+    else
+        p->first = node;
+    p->last   = node;
+    p->bytes += pkt->size;
+
+    if (gop_start) {
+        if (p->last_gop)
+            p->last_gop->next_gop = node;
+        p->last_gop = node;
+        p->nb_gops++;
+    }
+
+    /* drop whole gops, the remaining ones still cover the duration */
+    while (p->nb_gops > 1) {
+        FFRecorderPrerollPacket *next_gop = p->first->next_gop;
+
+        if (p->bytes <= p->max_bytes &&
+            (ts == AV_NOPTS_VALUE || next_gop->gop_time == AV_NOPTS_VALUE || ts - next_gop->gop_time < p->duration))
+            break;
+
+        while (p->first != next_gop)
+            preroll_pop(p);
+        p->nb_gops--;
+    }
+
+    return 0;
+}
+
+void ffp_recorder_preroll_flush(FFRecorderPreroll *p, FFRecorder *rec)
+{
+    FFRecorderPrerollPacket *node;
+
+    if (!p || !rec)
+        return;
+
+    for (node = p->first; node; node = node->next) {
+        if (ffp_recorder_write(rec, &node->pkt) < 0)
+            break;
+    }
+}
@@ -0,0 +1,124 @@
+/*
+ * ff_ffrecorder.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFPLAY__FF_FFRECORDER_H
+#define FFPLAY__FF_FFRECORDER_H
+
+#include <stdint.h>
+#include "libavformat/avformat.h"
+
+/* what ffp_recorder_write() does when the queue is full */
+#define FFP_RECORDER_OVERFLOW_DROP_GOP      0   /* drop until the next video keyframe */
+#define FFP_RECORDER_OVERFLOW_BLOCK         1   /* wait for the writer thread */
+
+#define FFP_RECORDER_QUEUE_BYTES_DEFAULT    (8 * 1024 * 1024)
+#define FFP_RECORDER_QUEUE_BYTES_MIN        (256 * 1024)
+#define FFP_RECORDER_QUEUE_BYTES_MAX        (256 * 1024 * 1024)
+
+typedef struct FFRecorderStat {
+    int64_t queued_bytes;           /* payload waiting for the writer thread */
+    int64_t queued_packets;
+    int64_t written_packets;
+    int64_t written_bytes;
+    int64_t last_write_latency_us;  /* time spent in the last av_interleaved_write_frame() */
+    int64_t max_write_latency_us;
+    int64_t dropped_gops;           /* times the queue overflowed with FFP_RECORDER_OVERFLOW_DROP_GOP */
+    int64_t dropped_packets;
+    int64_t segments;               /* finished segments still on disk */
+    int64_t segments_bytes;
+    int64_t deleted_segments;       /* removed to stay within retention_bytes */
+} FFRecorderStat;
+
+typedef struct FFRecorderConfig {
+    const char *format_name;        /* "mp4", "mkv", "ts" or any muxer name, NULL guesses from filename */
+    int64_t max_queue_bytes;
+    int     overflow;               /* FFP_RECORDER_OVERFLOW_* */
+    /*
+     * Start a new file at the first video keyframe past either limit, 0 disables it.
+     * filename is then a pattern as for av_get_frame_filename(), "-%05d" is inserted
+     * before the extension if it has none. Each finished segment is listed as
+     * "<name> <start pts ms> <duration ms> <bytes>" in "<pattern prefix>index.txt".
+     */
+    int64_t segment_duration_ms;
+    int64_t segment_bytes;
+    int64_t retention_bytes;        /* delete the oldest finished segments beyond this, 0 keeps all */
+} FFRecorderConfig;
+
+typedef struct FFRecorder FFRecorder;
+
+/*
+ * Record packets of streams into filename on a dedicated writer thread.
+ * Codec parameters and time bases of streams are copied, streams may be
+ * closed before the recorder. Packets of other streams, and of streams the
+ * container can not hold, are ignored.
+ * Recording starts at the first video keyframe if a video stream is recorded.
+ */
+FFRecorder *ffp_recorder_create(const char *filename, AVStream **streams, int nb_streams,
+                                const FFRecorderConfig *config);
+
+/*
+ * Flush queued packets, write the trailer and join the writer thread.
+ */
+void ffp_recorder_freep(FFRecorder **prec);
+
+/*
+ * Same as ffp_recorder_freep(), but return at once.
+ * The recorder is put on the *closing list while its writer thread
+ * finishes the file, recorders on the list already done are released.
+ */
+void ffp_recorder_close_async(FFRecorder **prec, FFRecorder **closing);
+
+/*
+ * Join and release the recorders of the *closing list that are done,
+ * or all of them with wait.
+ */
+void ffp_recorder_reap(FFRecorder **closing, int wait);
+
+/*
+ * Queue a new reference to pkt, the payload is never copied.
+ * pkt->stream_index is the index of the input stream.
+ * return 0 if queued or dropped, < 0 if the recorder failed.
+ */
+int ffp_recorder_write(FFRecorder *rec, AVPacket *pkt);
+
+void ffp_recorder_get_stat(FFRecorder *rec, FFRecorderStat *stat);
+
+/*
+ * Packets kept to start a recording with, in whole GOPs: the oldest GOP is
+ * dropped once the following ones cover duration_ms or it exceeds max_bytes.
+ */
+typedef struct FFRecorderPreroll FFRecorderPreroll;
+
+FFRecorderPreroll *ffp_recorder_preroll_create(int64_t duration_ms, int64_t max_bytes);
+void ffp_recorder_preroll_freep(FFRecorderPreroll **pp);
+void ffp_recorder_preroll_reset(FFRecorderPreroll *p);
+
+/*
+ * Keep a new reference to pkt. gop_start is set for video keyframes, or for
+ * every packet without video. Packets before the first GOP are ignored.
+ */
+int ffp_recorder_preroll_put(FFRecorderPreroll *p, AVPacket *pkt, AVRational time_base, int gop_start);
+
+/*
+ * Queue all kept packets to rec, they stay in the preroll.
+ */
+void ffp_recorder_preroll_flush(FFRecorderPreroll *p, FFRecorder *rec);
+
+#endif
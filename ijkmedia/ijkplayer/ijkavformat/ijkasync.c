@@ -30,7 +30,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/error.h"
-#include "libavutil/fifo.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/log.h"
 #include "libavutil/opt.h"
 #include "libavutil/thread.h"
@@ -39,6 +39,7 @@
 #include <stdint.h>
 
 #include "libavutil/application.h"
+#include "ijkdiskcache.h"
 
 #if HAVE_UNISTD_H
 #include <unistd.h>
@@ -46,12 +47,49 @@
 
 #define SHORT_SEEK_THRESHOLD    (256 * 1024)
 
+#define CHUNK_SIZE_DEFAULT      (64 * 1024)
+
+#define PREFETCH_WINDOWS_MAX    8
+#define PREFETCH_SIZE_DEFAULT   (512 * 1024)
+
+enum {
+    PREFETCH_IDLE = 0,
+    PREFETCH_PENDING,
+    PREFETCH_FETCHING,
+    PREFETCH_DONE,
+    PREFETCH_HEAD,                          /* start of the stream, kept by the background thread */
+};
+
+/*
+ * A range fetched over a second connection, so that seeks into it complete
+ * without the inner protocol. Bytes below filled never change while the
+ * window is in use, they are read without the mutex.
+ */
+typedef struct PrefetchWindow {
+    int             state;
+    int64_t         start;
+    int             size;
+    int             filled;
+    int             readers;
+    int64_t         last_used;
+    uint8_t        *data;
+} PrefetchWindow;
+
+/*
+ * Bytes in [back_pos, write_pos) are kept: [back_pos, read_pos) for reading
+ * back, [read_pos, write_pos) not read yet. Both sides read and write the
+ * buffer in place without holding the mutex, it only guards the positions.
+ */
 typedef struct RingBuffer
 {
-    AVFifoBuffer *fifo;
+    uint8_t      *buffer;
+    int           capacity;
     int           read_back_capacity;
 
-    int           read_pos;
+    /* absolute, since the last reset */
+    int64_t       back_pos;
+    int64_t       read_pos;
+    int64_t       write_pos;
 } RingBuffer;
 
 typedef struct Context {
@@ -64,7 +102,6 @@ typedef struct Context {
     int             seek_completed;
     int64_t         seek_ret;
 
-    int             inner_io_error;
     int             io_error;
     int             io_eof_reached;
 
@@ -72,17 +109,52 @@ typedef struct Context {
     int64_t         logical_size;
     RingBuffer      ring;
 
+    /* background thread only */
+    IjkDiskCache   *cache;
+    int64_t         fill_pos;               /* stream offset of ring.write_pos */
+    int64_t         inner_pos;              /* where the inner protocol reads next */
+    int64_t         cache_read_bytes;
+
+    /* windows[0] is the head, guarded by mutex */
+    PrefetchWindow  windows[PREFETCH_WINDOWS_MAX + 1];
+    int             nb_windows;
+    int64_t         prefetch_clock;
+    int64_t         seek_history[3];
+    int             nb_seek_history;
+    int64_t         prefetch_read_bytes;
+    char           *inner_url;
+    AVDictionary   *inner_options;
+    URLContext     *prefetch_inner;         /* prefetch thread only */
+    pthread_cond_t  cond_wakeup_prefetch;
+    pthread_t       prefetch_thread;
+    int             prefetch_started;
+
     pthread_cond_t  cond_wakeup_main;
     pthread_cond_t  cond_wakeup_background;
     pthread_mutex_t mutex;
     pthread_t       async_buffer_thread;
 
+    /* watermarks, a side is only woken up when it can make progress */
+    int             main_wait_bytes;        /* reader sleeps until this much is buffered */
+    int             background_waiting;     /* writer sleeps until write_watermark is free */
+    int             write_watermark;
+    int64_t         main_wakeups;
+    int64_t         background_wakeups;
+
     int             abort_request;
     AVIOInterruptCB interrupt_callback;
 
     /* options */
     int64_t         forwards_capacity;
     int64_t         backwards_capacity;
+    int             chunk_size;
+    char           *cache_dir;
+    char           *cache_key;
+    int             cache_block_size;
+    int64_t         cache_max_bytes;
+    int             prefetch_windows;
+    int             prefetch_size;
+    char           *prefetch_hint;
     int64_t         app_ctx_intptr;
     AVApplicationContext *app_ctx;
 } Context;
@@ -90,60 +162,73 @@ typedef struct Context {
 static int ring_init(RingBuffer *ring, int64_t capacity, int64_t read_back_capacity)
 {
     memset(ring, 0, sizeof(RingBuffer));
-    ring->fifo = av_fifo_alloc((unsigned int)(capacity + read_back_capacity));
-    if (!ring->fifo)
+    ring->buffer = av_malloc(capacity + read_back_capacity);
+    if (!ring->buffer)
         return AVERROR(ENOMEM);
 
+    ring->capacity           = (int)(capacity + read_back_capacity);
     ring->read_back_capacity = (int)read_back_capacity;
     return 0;
 }
 
 static void ring_destroy(RingBuffer *ring)
 {
-    av_fifo_freep(&ring->fifo);
+    av_freep(&ring->buffer);
 }
 
 static void ring_reset(RingBuffer *ring)
 {
-    av_fifo_reset(ring->fifo);
-    ring->read_pos = 0;
+    ring->back_pos  = 0;
+    ring->read_pos  = 0;
+    ring->write_pos = 0;
 }
 
 static int ring_size(RingBuffer *ring)
 {
-    return av_fifo_size(ring->fifo) - ring->read_pos;
+    return (int)(ring->write_pos - ring->read_pos);
 }
 
 static int ring_space(RingBuffer *ring)
 {
-    return av_fifo_space(ring->fifo);
+    return ring->capacity - (int)(ring->write_pos - ring->back_pos);
+}
+
+/* contiguous bytes not read yet, consume them in place then ring_read_commit() */
+static int ring_read_span(RingBuffer *ring, uint8_t **data)
+{
+    int offset = (int)(ring->read_pos % ring->capacity);
+
+    *data = ring->buffer + offset;
+    return FFMIN(ring_size(ring), ring->capacity - offset);
 }
 
-static int ring_generic_read(RingBuffer *ring, void *dest, int buf_size, void (*func)(void*, void*, int))
+static void ring_read_commit(RingBuffer *ring, int size)
 {
-    int ret;
+    av_assert2(size <= ring_size(ring));
+    ring->read_pos += size;
 
-    av_assert2(buf_size <= ring_size(ring));
-    ret = av_fifo_generic_peek_at(ring->fifo, dest, ring->read_pos, buf_size, func);
-    ring->read_pos += buf_size;
+    if (ring->read_pos - ring->back_pos > ring->read_back_capacity)
+        ring->back_pos = ring->read_pos - ring->read_back_capacity;
+}
 
-    if (ring->read_pos > ring->read_back_capacity) {
-        av_fifo_drain(ring->fifo, ring->read_pos - ring->read_back_capacity);
-        ring->read_pos = ring->read_back_capacity;
-    }
+/* contiguous free bytes, fill them in place then ring_write_commit() */
+static int ring_write_span(RingBuffer *ring, uint8_t **data)
+{
+    int offset = (int)(ring->write_pos % ring->capacity);
 
-    return ret;
+    *data = ring->buffer + offset;
+    return FFMIN(ring_space(ring), ring->capacity - offset);
 }
 
-static int ring_generic_write(RingBuffer *ring, void *src, int size, int (*func)(void*, void*, int))
+static void ring_write_commit(RingBuffer *ring, int size)
 {
     av_assert2(size <= ring_space(ring));
-    return av_fifo_generic_write(ring->fifo, src, size, func);
+    ring->write_pos += size;
 }
 
 static int ring_size_of_read_back(RingBuffer *ring)
 {
-    return ring->read_pos;
+    return (int)(ring->read_pos - ring->back_pos);
 }
 
 static int ring_drain(RingBuffer *ring, int offset)
@@ -168,18 +253,6 @@ static int async_check_interrupt(void *arg)
     return c->abort_request;
 }
 
-static int wrapped_url_read(void *src, void *dst, int size)
-{
-    URLContext *h   = src;
-    Context    *c   = h->priv_data;
-    int         ret;
-
-    ret = ffurl_read(c->inner, dst, size);
-    c->inner_io_error = ret < 0 ? ret : 0;
-
-    return ret;
-}
-
 static void call_inject_statistic(URLContext *h)
 {
     Context *c = h->priv_data;
@@ -209,6 +282,310 @@ static void call_inject_async_fill_speed(URLContext *h, int is_full_speed, int64
     }
 }
 
+/* the window holding pos, or about to: a fetch in flight covers it */
+static PrefetchWindow *prefetch_find(Context *c, int64_t pos)
+{
+    PrefetchWindow *w;
+    int             i;
+
+    for (i = 0; i <= c->nb_windows; i++) {
+        w = &c->windows[i];
+        if (w->state == PREFETCH_IDLE || w->state == PREFETCH_PENDING)
+            continue;
+        if (pos >= w->start && pos < w->start + (w->state == PREFETCH_FETCHING ? w->size : w->filled))
+            return w;
+    }
+    return NULL;
+}
+
+/* mutex held */
+static void prefetch_request(Context *c, int64_t start)
+{
+    PrefetchWindow *w, *victim = NULL;
+    int             i, idle;
+
+    if (!c->nb_windows || start < 0 || start >= c->logical_size)
+        return;
+
+    for (i = 0; i <= c->nb_windows; i++) {
+        w = &c->windows[i];
+        if (w->state != PREFETCH_IDLE && start >= w->start && start < w->start + w->size)
+            return;
+    }
+
+    /* an idle window, or the least recently used one nobody is reading */
+    for (i = 1; i <= c->nb_windows; i++) {
+        w = &c->windows[i];
+        if (w->state == PREFETCH_FETCHING || w->readers)
+            continue;
+        idle = w->state == PREFETCH_IDLE;
+        if (!victim || idle > (victim->state == PREFETCH_IDLE) ||
+            (idle == (victim->state == PREFETCH_IDLE) && w->last_used < victim->last_used))
+            victim = w;
+    }
+    if (!victim)
+        return;
+
+    victim->state     = PREFETCH_PENDING;
+    victim->start     = start;
+    victim->size      = (int)FFMIN(c->prefetch_size, c->logical_size - start);
+    victim->filled    = 0;
+    victim->last_used = ++c->prefetch_clock;
+    pthread_cond_signal(&c->cond_wakeup_prefetch);
+}
+
+/* moov after mdat: fetch it while the demuxer still reads the head */
+static void prefetch_mp4_index(Context *c, const uint8_t *buf, int size)
+{
+    int64_t  off = 0, box_size;
+    uint32_t type;
+
+    if (size < 8 || AV_RL32(buf + 4) != MKTAG('f','t','y','p'))
+        return;
+
+    while (off + 8 <= size) {
+        box_size = AV_RB32(buf + off);
+        type     = AV_RL32(buf + off + 4);
+        if (box_size == 1) {
+            if (off + 16 > size)
+                return;
+            box_size = AV_RB64(buf + off + 8);
+        }
+        if (box_size < 8 || type == MKTAG('m','o','o','v'))
+            return;
+        if (type == MKTAG('m','d','a','t')) {
+            av_log(NULL, AV_LOG_DEBUG, "async: prefetch moov at %"PRId64"\n", off + box_size);
+            prefetch_request(c, off + box_size);
+            return;
+        }
+        off += box_size;
+    }
+}
+
+/* seeks stepping by a constant stride, e.g. skip buttons, predict the next one */
+static void prefetch_predict(Context *c, int64_t pos)
+{
+    int64_t d1, d2;
+
+    if (c->nb_seek_history == FF_ARRAY_ELEMS(c->seek_history)) {
+        memmove(c->seek_history, c->seek_history + 1, sizeof(c->seek_history) - sizeof(c->seek_history[0]));
+        c->nb_seek_history--;
+    }
+    c->seek_history[c->nb_seek_history++] = pos;
+    if (c->nb_seek_history < FF_ARRAY_ELEMS(c->seek_history))
+        return;
+
+    d1 = c->seek_history[1] - c->seek_history[0];
+    d2 = c->seek_history[2] - c->seek_history[1];
+    if (d1 && (d1 > 0) == (d2 > 0) && FFABS(d2 - d1) <= FFABS(d1) / 8)
+        prefetch_request(c, pos + d2);
+}
+
+/* async-prefetch-hint is set by the caller between reads, take it on the caller thread */
+static void prefetch_take_hints(URLContext *h)
+{
+    Context    *c = h->priv_data;
+    const char *p;
+    char       *end;
+    int64_t     pos;
+
+    if (!c->prefetch_hint)
+        return;
+
+    pthread_mutex_lock(&c->mutex);
+    for (p = c->prefetch_hint; *p; p = *end ? end + 1 : end) {
+        pos = strtoll(p, &end, 10);
+        if (end == p)
+            break;
+        /* a fast seek anyway */
+        if (pos >= c->logical_pos - ring_size_of_read_back(&c->ring) &&
+            pos < c->logical_pos + ring_size(&c->ring) + SHORT_SEEK_THRESHOLD)
+            continue;
+        prefetch_request(c, pos);
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    av_freep(&c->prefetch_hint);
+}
+
+/* background thread, from a window covering pos, waiting for one in flight */
+static int prefetch_read(URLContext *h, int64_t pos, uint8_t *data, int size)
+{
+    Context        *c = h->priv_data;
+    PrefetchWindow *w;
+    int             n = 0;
+
+    pthread_mutex_lock(&c->mutex);
+    while ((w = prefetch_find(c, pos))) {
+        if (pos < w->start + w->filled) {
+            n = (int)FFMIN(size, w->start + w->filled - pos);
+            w->readers++;
+            w->last_used = ++c->prefetch_clock;
+            /* keep streaming from the second connection */
+            if (w->state != PREFETCH_HEAD && pos + n > w->start + w->size / 2)
+                prefetch_request(c, w->start + w->size);
+            break;
+        }
+        if (c->seek_request || async_check_interrupt(h))
+            break;
+        c->background_waiting = 1;
+        pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
+        c->background_waiting = 0;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    if (n > 0) {
+        memcpy(data, w->data + (pos - w->start), n);
+        pthread_mutex_lock(&c->mutex);
+        w->readers--;
+        c->prefetch_read_bytes += n;
+        pthread_mutex_unlock(&c->mutex);
+    }
+    return n;
+}
+
+static void *async_prefetch_task(void *arg)
+{
+    URLContext      *h   = arg;
+    Context         *c   = h->priv_data;
+    AVIOInterruptCB  interrupt_callback = {.callback = async_check_interrupt, .opaque = h};
+    AVDictionary    *options;
+    PrefetchWindow  *w;
+    int64_t          pos = -1;
+    int              ret, filled, i;
+
+    while (1) {
+        pthread_mutex_lock(&c->mutex);
+        w = NULL;
+        while (!c->abort_request) {
+            for (i = 1; i <= c->nb_windows; i++) {
+                if (c->windows[i].state == PREFETCH_PENDING &&
+                    (!w || c->windows[i].last_used < w->last_used))
+                    w = &c->windows[i];
+            }
+            if (w)
+                break;
+            pthread_cond_wait(&c->cond_wakeup_prefetch, &c->mutex);
+        }
+        if (c->abort_request) {
+            pthread_mutex_unlock(&c->mutex);
+            break;
+        }
+        w->state = PREFETCH_FETCHING;
+        if (!w->data)
+            w->data = av_malloc(c->prefetch_size);
+        pthread_mutex_unlock(&c->mutex);
+
+        ret = w->data ? 0 : AVERROR(ENOMEM);
+        if (ret >= 0 && !c->prefetch_inner) {
+            options = NULL;
+            av_dict_copy(&options, c->inner_options, 0);
+            ret = ffurl_open_whitelist(&c->prefetch_inner, c->inner_url, AVIO_FLAG_READ, &interrupt_callback,
+                                       &options, h->protocol_whitelist, h->protocol_blacklist, h);
+            av_dict_free(&options);
+            pos = 0;
+        }
+        if (ret >= 0 && pos != w->start) {
+            pos = ffurl_seek(c->prefetch_inner, w->start, SEEK_SET);
+            ret = pos < 0 ? (int)pos : 0;
+        }
+
+        filled = 0;
+        while (ret >= 0 && filled < w->size) {
+            ret = ffurl_read(c->prefetch_inner, w->data + filled, w->size - filled);
+            if (ret <= 0)
+                break;
+            filled += ret;
+            pos    += ret;
+
+            pthread_mutex_lock(&c->mutex);
+            w->filled = filled;
+            if (c->background_waiting)
+                pthread_cond_signal(&c->cond_wakeup_background);
+            pthread_mutex_unlock(&c->mutex);
+        }
+        if (ret < 0 && ret != AVERROR_EOF && ret != AVERROR_EXIT) {
+            av_log(h, AV_LOG_WARNING, "prefetch at %"PRId64" failed: %s\n", w->start, av_err2str(ret));
+            ffurl_closep(&c->prefetch_inner);
+        }
+
+        pthread_mutex_lock(&c->mutex);
+        w->state = filled > 0 ? PREFETCH_DONE : PREFETCH_IDLE;
+        if (c->background_waiting)
+            pthread_cond_signal(&c->cond_wakeup_background);
+        pthread_mutex_unlock(&c->mutex);
+    }
+
+    ffurl_closep(&c->prefetch_inner);
+    return NULL;
+}
+
+/*
+ * From a prefetch window or the disk cache where they have the bytes,
+ * otherwise from the inner protocol.
+ */
+static int async_fill(URLContext *h, uint8_t *data, int size)
+{
+    Context        *c = h->priv_data;
+    PrefetchWindow *head = &c->windows[0];
+    int64_t         pos;
+    int             ret, n;
+
+    if (c->nb_windows) {
+        ret = prefetch_read(h, c->fill_pos, data, size);
+        if (ret > 0)
+            return ret;
+    }
+
+    if (c->cache) {
+        if (c->fill_pos >= c->logical_size)
+            return AVERROR_EOF;
+
+        ret = ijkdiskcache_read(c->cache, c->fill_pos, data, size);
+        if (ret > 0) {
+            c->cache_read_bytes += ret;
+            return ret;
+        }
+    }
+
+    /* left behind by cache or window hits, reading through is cheaper than reconnecting */
+    while (c->inner_pos < c->fill_pos && c->fill_pos - c->inner_pos <= SHORT_SEEK_THRESHOLD) {
+        ret = ffurl_read(c->inner, data, (int)FFMIN(size, c->fill_pos - c->inner_pos));
+        if (ret <= 0)
+            return ret;
+        c->inner_pos += ret;
+    }
+    if (c->inner_pos != c->fill_pos) {
+        pos = ffurl_seek(c->inner, c->fill_pos, SEEK_SET);
+        if (pos < 0)
+            return (int)pos;
+        c->inner_pos = pos;
+    }
+
+    ret = ffurl_read(c->inner, data, size);
+    if (ret > 0) {
+        if (c->nb_windows && c->fill_pos == 0) {
+            pthread_mutex_lock(&c->mutex);
+            prefetch_mp4_index(c, data, ret);
+            pthread_mutex_unlock(&c->mutex);
+        }
+        if (head->state == PREFETCH_HEAD && c->fill_pos == head->filled && head->filled < head->size) {
+            n = FFMIN(ret, head->size - head->filled);
+            memcpy(head->data + head->filled, data, n);
+            pthread_mutex_lock(&c->mutex);
+            head->filled += n;
+            pthread_mutex_unlock(&c->mutex);
+        }
+
+        c->inner_pos += ret;
+        if (c->cache && ijkdiskcache_write(c->cache, c->fill_pos, data, ret) < 0) {
+            av_log(h, AV_LOG_WARNING, "disk cache write failed, disabled\n");
+            ijkdiskcache_close(&c->cache);
+        }
+    }
+    return ret;
+}
+
 static void *async_buffer_task(void *arg)
 {
     URLContext   *h    = arg;
@@ -217,11 +594,13 @@ static void *async_buffer_task(void *arg)
     int           ret  = 0;
     int64_t       seek_ret;
     int           is_full_speed = 1;
+    int           i;
     int64_t       count_bytes = 0;
     int64_t       count_start_time_micro = av_gettime_relative();
 
     while (1) {
-        int fifo_space, to_copy;
+        int      fifo_space, to_copy;
+        uint8_t *data;
 
         pthread_mutex_lock(&c->mutex);
         if (async_check_interrupt(h)) {
@@ -233,7 +612,23 @@ static void *async_buffer_task(void *arg)
         }
 
         if (c->seek_request) {
-            seek_ret = ffurl_seek(c->inner, c->seek_pos, c->seek_whence);
+            if (c->seek_whence == SEEK_SET &&
+                (prefetch_find(c, c->seek_pos) || (c->cache && ijkdiskcache_has(c->cache, c->seek_pos)))) {
+                /* the inner seek is deferred until the cached range runs out */
+                seek_ret = c->seek_pos;
+            } else {
+                seek_ret = ffurl_seek(c->inner, c->seek_pos, c->seek_whence);
+                if (seek_ret >= 0)
+                    c->inner_pos = seek_ret;
+                /* the main connection fetches it now */
+                for (i = 1; i <= c->nb_windows; i++) {
+                    PrefetchWindow *w = &c->windows[i];
+                    if (w->state == PREFETCH_PENDING && seek_ret >= w->start && seek_ret < w->start + w->size)
+                        w->state = PREFETCH_IDLE;
+                }
+            }
+            if (seek_ret >= 0)
+                c->fill_pos = seek_ret;
             if (seek_ret < 0) {
                 c->io_eof_reached = 1;
                 c->io_error       = (int)seek_ret;
@@ -257,16 +652,22 @@ static void *async_buffer_task(void *arg)
 
         fifo_space = ring_space(ring);
         if (c->io_eof_reached || fifo_space <= 0) {
-            pthread_cond_signal(&c->cond_wakeup_main);
+            if (c->main_wait_bytes) {
+                c->main_wakeups++;
+                pthread_cond_signal(&c->cond_wakeup_main);
+            }
+            c->background_waiting = 1;
             pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
+            c->background_waiting = 0;
             pthread_mutex_unlock(&c->mutex);
             is_full_speed = 0;
             continue;
         }
+        to_copy = FFMIN(c->chunk_size, ring_write_span(ring, &data));
         pthread_mutex_unlock(&c->mutex);
 
-        to_copy = FFMIN(4096, fifo_space);
-        ret = ring_generic_write(ring, (void *)h, to_copy, (void *)wrapped_url_read);
+        /* only this thread writes, the span stays free until committed */
+        ret = async_fill(h, data, to_copy);
         if (ret > 0) {
             count_bytes += ret;
             if (count_bytes > FFMIN((1 * 1024 * 1024), c->forwards_capacity)) {
@@ -279,13 +680,19 @@ static void *async_buffer_task(void *arg)
         }
 
         pthread_mutex_lock(&c->mutex);
-        if (ret <= 0) {
+        if (ret > 0) {
+            ring_write_commit(ring, ret);
+            c->fill_pos += ret;
+        } else {
             c->io_eof_reached = 1;
-            if (c->inner_io_error < 0)
-                c->io_error = c->inner_io_error;
+            if (ret < 0)
+                c->io_error = ret;
         }
 
-        pthread_cond_signal(&c->cond_wakeup_main);
+        if (c->main_wait_bytes && (ret <= 0 || ring_size(ring) >= c->main_wait_bytes)) {
+            c->main_wakeups++;
+            pthread_cond_signal(&c->cond_wakeup_main);
+        }
         pthread_mutex_unlock(&c->mutex);
 
         call_inject_statistic(h);
@@ -294,6 +701,29 @@ static void *async_buffer_task(void *arg)
     return NULL;
 }
 
+/* join the prefetch thread and free the windows */
+static void async_stop_prefetch(URLContext *h)
+{
+    Context *c = h->priv_data;
+    int      i;
+
+    if (c->prefetch_started) {
+        pthread_mutex_lock(&c->mutex);
+        c->abort_request = 1;
+        pthread_cond_signal(&c->cond_wakeup_prefetch);
+        pthread_mutex_unlock(&c->mutex);
+
+        pthread_join(c->prefetch_thread, NULL);
+        pthread_cond_destroy(&c->cond_wakeup_prefetch);
+        c->prefetch_started = 0;
+        av_log(h, AV_LOG_INFO, "prefetch served %"PRId64" bytes\n", c->prefetch_read_bytes);
+    }
+
+    for (i = 0; i <= PREFETCH_WINDOWS_MAX; i++)
+        av_freep(&c->windows[i].data);
+    c->nb_windows = 0;
+}
+
 static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     Context         *c = h->priv_data;
@@ -310,6 +740,15 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
         c->app_ctx = (AVApplicationContext *)(intptr_t)c->app_ctx_intptr;
         av_dict_set_int(options, "ijkapplication", c->app_ctx_intptr, 0);
     }
+    /* for the prefetch connection */
+    c->inner_url = av_strdup(arg);
+    if (!c->inner_url) {
+        ret = AVERROR(ENOMEM);
+        goto url_fail;
+    }
+    if (options)
+        av_dict_copy(&c->inner_options, *options, 0);
+
     /* wrap interrupt callback */
     c->interrupt_callback = h->interrupt_callback;
     ret = ffurl_open_whitelist(&c->inner, arg, flags, &interrupt_callback, options, h->protocol_whitelist, h->protocol_blacklist, h);
@@ -321,6 +760,15 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
     c->logical_size = ffurl_size(c->inner);
     h->is_streamed  = c->inner->is_streamed;
 
+    c->write_watermark = (int)FFMIN(c->chunk_size, c->forwards_capacity / 2);
+
+    if (c->cache_dir && *c->cache_dir && c->logical_size > 0 && !h->is_streamed) {
+        ret = ijkdiskcache_open(&c->cache, c->cache_dir, c->cache_key && *c->cache_key ? c->cache_key : arg,
+                                c->logical_size, c->cache_block_size, c->cache_max_bytes);
+        if (ret < 0)
+            av_log(h, AV_LOG_WARNING, "disk cache in %s disabled: %s\n", c->cache_dir, av_err2str(ret));
+    }
+
     ret = pthread_mutex_init(&c->mutex, NULL);
     if (ret != 0) {
         av_log(h, AV_LOG_ERROR, "pthread_mutex_init failed : %s\n", av_err2str(ret));
@@ -339,6 +787,26 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
         goto cond_wakeup_background_fail;
     }
 
+    /* optional, playback goes on without it */
+    if (c->prefetch_windows > 0 && c->logical_size > 0 && !h->is_streamed) {
+        c->windows[0].data = av_malloc(c->prefetch_size);
+        if (c->windows[0].data && !pthread_cond_init(&c->cond_wakeup_prefetch, NULL)) {
+            c->windows[0].state = PREFETCH_HEAD;
+            c->windows[0].size  = (int)FFMIN(c->prefetch_size, c->logical_size);
+            c->nb_windows       = c->prefetch_windows;
+
+            ret = pthread_create(&c->prefetch_thread, NULL, async_prefetch_task, h);
+            if (ret) {
+                av_log(h, AV_LOG_WARNING, "prefetch disabled, pthread_create failed : %s\n", av_err2str(ret));
+                c->windows[0].state = PREFETCH_IDLE;
+                c->nb_windows       = 0;
+                pthread_cond_destroy(&c->cond_wakeup_prefetch);
+            } else {
+                c->prefetch_started = 1;
+            }
+        }
+    }
+
     ret = pthread_create(&c->async_buffer_thread, NULL, async_buffer_task, h);
     if (ret) {
         av_log(h, AV_LOG_ERROR, "pthread_create failed : %s\n", av_err2str(ret));
@@ -348,14 +816,18 @@ static int async_open(URLContext *h, const char *arg, int flags, AVDictionary **
     return 0;
 
 thread_fail:
+    async_stop_prefetch(h);
     pthread_cond_destroy(&c->cond_wakeup_background);
 cond_wakeup_background_fail:
     pthread_cond_destroy(&c->cond_wakeup_main);
 cond_wakeup_main_fail:
     pthread_mutex_destroy(&c->mutex);
 mutex_fail:
+    ijkdiskcache_close(&c->cache);
     ffurl_close(c->inner);
 url_fail:
+    av_freep(&c->inner_url);
+    av_dict_free(&c->inner_options);
     ring_destroy(&c->ring);
 fifo_fail:
     return ret;
@@ -374,18 +846,23 @@ static int async_close(URLContext *h)
     ret = pthread_join(c->async_buffer_thread, NULL);
     if (ret != 0)
         av_log(h, AV_LOG_ERROR, "pthread_join(): %s\n", av_err2str(ret));
+    async_stop_prefetch(h);
 
     pthread_cond_destroy(&c->cond_wakeup_background);
     pthread_cond_destroy(&c->cond_wakeup_main);
     pthread_mutex_destroy(&c->mutex);
+    if (c->cache)
+        av_log(h, AV_LOG_INFO, "disk cache served %"PRId64" bytes\n", c->cache_read_bytes);
+    ijkdiskcache_close(&c->cache);
     ffurl_close(c->inner);
+    av_freep(&c->inner_url);
+    av_dict_free(&c->inner_options);
     ring_destroy(&c->ring);
 
     return 0;
 }
 
-static int async_read_internal(URLContext *h, void *dest, int size, int read_complete,
-                               void (*func)(void*, void*, int))
+static int async_read_internal(URLContext *h, void *dest, int size, int read_complete)
 {
     Context      *c       = h->priv_data;
     RingBuffer   *ring    = &c->ring;
@@ -395,22 +872,27 @@ static int async_read_internal(URLContext *h, void *dest, int size, int read_com
     pthread_mutex_lock(&c->mutex);
 
     while (to_read > 0) {
-        int fifo_size, to_copy;
+        int      to_copy;
+        uint8_t *data;
         if (async_check_interrupt(h)) {
             ret = AVERROR_EXIT;
             break;
         }
-        fifo_size = ring_size(ring);
-        to_copy   = FFMIN(to_read, fifo_size);
+        to_copy = FFMIN(to_read, ring_read_span(ring, &data));
         if (to_copy > 0) {
-            ring_generic_read(ring, dest, to_copy, func);
-            if (!func)
+            /* the writer never touches unread bytes, copy without the lock */
+            if (dest) {
+                pthread_mutex_unlock(&c->mutex);
+                memcpy(dest, data, to_copy);
                 dest = (uint8_t *)dest + to_copy;
+                pthread_mutex_lock(&c->mutex);
+            }
+            ring_read_commit(ring, to_copy);
             c->logical_pos += to_copy;
             to_read        -= to_copy;
             ret             = size - to_read;
 
-            if (to_read <= 0 || !read_complete)
+            if (to_read <= 0 || (!read_complete && ring_size(ring) <= 0))
                 break;
         } else if (c->io_eof_reached) {
             if (ret <= 0) {
@@ -420,12 +902,21 @@ static int async_read_internal(URLContext *h, void *dest, int size, int read_com
                     ret = AVERROR_EOF;
             }
             break;
+        } else {
+            c->main_wait_bytes = read_complete ? (int)FFMIN(to_read, c->forwards_capacity) : 1;
+            if (c->background_waiting) {
+                c->background_wakeups++;
+                pthread_cond_signal(&c->cond_wakeup_background);
+            }
+            pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
+            c->main_wait_bytes = 0;
         }
-        pthread_cond_signal(&c->cond_wakeup_background);
-        pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
     }
 
-    pthread_cond_signal(&c->cond_wakeup_background);
+    if (c->background_waiting && ring_space(ring) >= c->write_watermark) {
+        c->background_wakeups++;
+        pthread_cond_signal(&c->cond_wakeup_background);
+    }
     pthread_mutex_unlock(&c->mutex);
 
     call_inject_statistic(h);
@@ -434,11 +925,8 @@ static int async_read_internal(URLContext *h, void *dest, int size, int read_com
 
 static int async_read(URLContext *h, unsigned char *buf, int size)
 {
-    return async_read_internal(h, buf, size, 0, NULL);
-}
-
-static void fifo_do_not_copy_func(void* dest, void* src, int size) {
-    // do not copy
+    prefetch_take_hints(h);
+    return async_read_internal(h, buf, size, 0);
 }
 
 static int64_t async_seek(URLContext *h, int64_t pos, int whence)
@@ -450,6 +938,8 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
     int fifo_size;
     int fifo_size_of_read_back;
 
+    prefetch_take_hints(h);
+
     if (whence == AVSEEK_SIZE) {
         av_log(h, AV_LOG_TRACE, "async_seek: AVSEEK_SIZE: %"PRId64"\n", (int64_t)c->logical_size);
         return c->logical_size;
@@ -480,10 +970,12 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
 
         if (pos_delta > 0) {
             // fast seek forwards
-            async_read_internal(h, NULL, pos_delta, 1, fifo_do_not_copy_func);
+            async_read_internal(h, NULL, pos_delta, 1);
         } else {
             // fast seek backwards
+            pthread_mutex_lock(&c->mutex);
             ring_drain(ring, pos_delta);
+            pthread_mutex_unlock(&c->mutex);
             call_inject_statistic(h);
             c->logical_pos = new_logical_pos;
         }
@@ -499,6 +991,8 @@ static int64_t async_seek(URLContext *h, int64_t pos, int whence)
 
     pthread_mutex_lock(&c->mutex);
 
+    prefetch_predict(c, new_logical_pos);
+
     c->seek_request   = 1;
     c->seek_pos       = new_logical_pos;
     c->seek_whence    = SEEK_SET;
@@ -534,6 +1028,22 @@ static const AVOption options[] = {
         OFFSET(forwards_capacity),  AV_OPT_TYPE_INT64, {.i64 = 128 * 1024}, 128 * 1024, 128 * 1024 * 1024, D },
     { "async-backwards-capacity",   "max bytes that may be seek backward without seeking in inner protocol",
         OFFSET(backwards_capacity), AV_OPT_TYPE_INT64, {.i64 = 128 * 1024}, 128 * 1024, 128 * 1024 * 1024, D },
+    { "async-chunk-size",           "max bytes read from the inner protocol at once",
+        OFFSET(chunk_size),         AV_OPT_TYPE_INT, {.i64 = CHUNK_SIZE_DEFAULT}, 4 * 1024, 4 * 1024 * 1024, D },
+    { "async-cache-dir",            "keep what is read in a block cache in this directory",
+        OFFSET(cache_dir),          AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, D },
+    { "async-cache-key",            "identify the asset in the disk cache, the url by default",
+        OFFSET(cache_key),          AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, D },
+    { "async-cache-block-size",     "disk cache block size",
+        OFFSET(cache_block_size),   AV_OPT_TYPE_INT, {.i64 = IJKDISKCACHE_BLOCK_SIZE_DEFAULT}, 4 * 1024, 16 * 1024 * 1024, D },
+    { "async-cache-max-bytes",      "disk cache budget, least recently used assets are evicted first",
+        OFFSET(cache_max_bytes),    AV_OPT_TYPE_INT64, {.i64 = IJKDISKCACHE_MAX_BYTES_DEFAULT}, 0, INT64_MAX, D },
+    { "async-prefetch-windows",     "ranges fetched ahead over a second connection, 0 to disable",
+        OFFSET(prefetch_windows),   AV_OPT_TYPE_INT, {.i64 = 3}, 0, PREFETCH_WINDOWS_MAX, D },
+    { "async-prefetch-size",        "bytes in each prefetch window",
+        OFFSET(prefetch_size),      AV_OPT_TYPE_INT, {.i64 = PREFETCH_SIZE_DEFAULT}, 64 * 1024, 16 * 1024 * 1024, D },
+    { "async-prefetch-hint",        "comma separated byte offsets likely to be read soon",
+        OFFSET(prefetch_hint),      AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, D },
     { "ijkapplication", "AVApplicationContext", OFFSET(app_ctx_intptr), AV_OPT_TYPE_INT64, { .i64 = 0 }, INT64_MIN, INT64_MAX, .flags = D },
     {NULL},
 };
@@ -562,6 +1072,7 @@ const URLProtocol ijkimp_ff_async_protocol = {
 
 #define TEST_SEEK_POS    (1536)
 #define TEST_STREAM_SIZE (2048)
+#define TEST_BENCH_SIZE  (256 * 1024 * 1024)
 
 typedef struct TestContext {
     AVClass        *class;
@@ -570,13 +1081,14 @@ typedef struct TestContext {
 
     /* options */
     int             opt_read_error;
+    int64_t         opt_stream_size;
 } TestContext;
 
 static int async_test_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     TestContext *c = h->priv_data;
     c->logical_pos  = 0;
-    c->logical_size = TEST_STREAM_SIZE;
+    c->logical_size = c->opt_stream_size;
     return 0;
 }
 
@@ -637,6 +1149,8 @@ static int64_t async_test_seek(URLContext *h, int64_t pos, int whence)
 static const AVOption async_test_options[] = {
     { "async-test-read-error",      "cause read fail",
         OFFSET(opt_read_error),     AV_OPT_TYPE_INT, { .i64 = 0 }, INT_MIN, INT_MAX, .flags = D },
+    { "async-test-stream-size",     "bytes in the stream",
+        OFFSET(opt_stream_size),    AV_OPT_TYPE_INT64, { .i64 = TEST_STREAM_SIZE }, 0, INT64_MAX, .flags = D },
     {NULL},
 };
 
@@ -668,7 +1182,10 @@ int main(void)
     int64_t       size;
     int64_t       pos;
     int64_t       read_len;
-    unsigned char buf[4096];
+    int64_t       start_time;
+    int64_t       elapsed;
+    Context      *c;
+    unsigned char buf[32768];
     AVDictionary *opts = NULL;
 
     ffurl_register_protocol(&ijkimp_ff_async_protocol);
@@ -759,6 +1276,27 @@ int main(void)
     ret = ffurl_read(h, buf, 1);
     printf("read: %d\n", ret);
 
+    /*
+     * benchmark sequential read
+     */
+    ffurl_close(h);
+    av_dict_free(&opts);
+    av_dict_set_int(&opts, "async-test-stream-size", TEST_BENCH_SIZE, 0);
+    av_dict_set_int(&opts, "async-forwards-capacity", 4 * 1024 * 1024, 0);
+    ret = ffurl_open(&h, "async:async-test:", AVIO_FLAG_READ, NULL, &opts);
+    printf("open: %d\n", ret);
+
+    start_time = av_gettime_relative();
+    read_len = 0;
+    while ((ret = ffurl_read(h, buf, sizeof(buf))) > 0)
+        read_len += ret;
+    elapsed = av_gettime_relative() - start_time;
+
+    c = h->priv_data;
+    printf("bench: %"PRId64" bytes in %"PRId64" ms, %.1f MB/s, wakeups main %"PRId64" background %"PRId64"\n",
+           read_len, elapsed / 1000, elapsed > 0 ? read_len / (elapsed / 1000000.0) / (1024 * 1024) : 0.0,
+           c->main_wakeups, c->background_wakeups);
+
 fail:
     av_dict_free(&opts);
     ffurl_close(h);
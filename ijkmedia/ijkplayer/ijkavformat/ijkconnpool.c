@@ -0,0 +1,272 @@
+/*
+ * ijkconnpool.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "ijkconnpool.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#define DNS_ENTRIES_MAX         32
+#define POOL_ENTRIES_MAX        8
+#define POOL_KEY_MAX            1040
+#define POOL_IDLE_TIMEOUT       (10 * 1000000LL)
+#define POOL_OPEN_TIMEOUT       (5 * 1000000LL)
+
+typedef struct DnsEntry {
+    char            host[1024];
+    IjkConnPoolAddr addrs[IJKCONNPOOL_ADDRS_MAX];
+    int             nb_addrs;
+    int64_t         expire_time;
+} DnsEntry;
+
+/* url is NULL while the connection is still being opened */
+typedef struct PoolEntry {
+    int         in_use;
+    char        key[POOL_KEY_MAX];
+    URLContext *url;
+    int64_t     open_time;
+} PoolEntry;
+
+typedef struct PrepareTask {
+    char          host[1024];
+    int           port;
+    int           ttl;
+    AVDictionary *options;
+    PoolEntry    *entry;
+} PrepareTask;
+
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DnsEntry        g_dns[DNS_ENTRIES_MAX];
+static PoolEntry       g_pool[POOL_ENTRIES_MAX];
+
+static int is_numeric_host(const char *host)
+{
+    struct in6_addr addr;
+
+    return inet_pton(AF_INET, host, &addr) == 1 || inet_pton(AF_INET6, host, &addr) == 1;
+}
+
+int ijkconnpool_resolve(const char *host, IjkConnPoolAddr *addrs, int max_addrs, int ttl)
+{
+    struct addrinfo  hints = {0};
+    struct addrinfo *ai    = NULL;
+    struct addrinfo *cur;
+    DnsEntry        *entry = NULL;
+    int64_t          now   = av_gettime_relative();
+    int              nb_addrs = 0;
+    int              ret;
+    int              i;
+
+    if (!host || !*host || strlen(host) >= sizeof(g_dns[0].host) || max_addrs <= 0)
+        return AVERROR(EINVAL);
+    if (is_numeric_host(host)) {
+        av_strlcpy(addrs[0], host, sizeof(addrs[0]));
+        return 1;
+    }
+
+    pthread_mutex_lock(&g_mutex);
+    for (i = 0; i < DNS_ENTRIES_MAX; i++) {
+        if (!strcmp(g_dns[i].host, host) && g_dns[i].expire_time > now) {
+            nb_addrs = FFMIN(g_dns[i].nb_addrs, max_addrs);
+            memcpy(addrs, g_dns[i].addrs, nb_addrs * sizeof(addrs[0]));
+            pthread_mutex_unlock(&g_mutex);
+            return nb_addrs;
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+
+    /* failures are not cached, the next open asks again */
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    ret = getaddrinfo(host, NULL, &hints, &ai);
+    if (ret) {
+        av_log(NULL, AV_LOG_WARNING, "ijkconnpool: resolve %s failed: %s\n", host, gai_strerror(ret));
+        return AVERROR(EIO);
+    }
+    /* the order getaddrinfo picked, as tcp.c tries them */
+    for (cur = ai; cur && nb_addrs < FFMIN(max_addrs, IJKCONNPOOL_ADDRS_MAX); cur = cur->ai_next) {
+        if (!getnameinfo(cur->ai_addr, cur->ai_addrlen, addrs[nb_addrs], sizeof(addrs[0]), NULL, 0, NI_NUMERICHOST))
+            nb_addrs++;
+    }
+    freeaddrinfo(ai);
+    if (!nb_addrs)
+        return AVERROR(EIO);
+
+    /* replace the same host, else an expired entry, else the one expiring first */
+    pthread_mutex_lock(&g_mutex);
+    for (i = 0; i < DNS_ENTRIES_MAX; i++) {
+        if (!strcmp(g_dns[i].host, host)) {
+            entry = &g_dns[i];
+            break;
+        }
+        if (!entry || g_dns[i].expire_time < entry->expire_time)
+            entry = &g_dns[i];
+    }
+    av_strlcpy(entry->host, host, sizeof(entry->host));
+    memcpy(entry->addrs, addrs, nb_addrs * sizeof(addrs[0]));
+    entry->nb_addrs    = nb_addrs;
+    entry->expire_time = now + ttl * 1000000LL;
+    pthread_mutex_unlock(&g_mutex);
+
+    av_log(NULL, AV_LOG_DEBUG, "ijkconnpool: %s -> %s, %d addresses\n", host, addrs[0], nb_addrs);
+    return nb_addrs;
+}
+
+static void pool_key(char *key, const char *host, int port)
+{
+    snprintf(key, POOL_KEY_MAX, "%s:%d", host, port);
+}
+
+/* caller holds g_mutex */
+static void pool_drop_stale(int64_t now)
+{
+    int i;
+
+    for (i = 0; i < POOL_ENTRIES_MAX; i++) {
+        if (g_pool[i].url && now - g_pool[i].open_time > POOL_IDLE_TIMEOUT) {
+            ffurl_closep(&g_pool[i].url);
+            g_pool[i].in_use = 0;
+        }
+    }
+}
+
+URLContext *ijkconnpool_take(const char *host, int port)
+{
+    URLContext *url = NULL;
+    char        key[POOL_KEY_MAX];
+    int         i;
+
+    pool_key(key, host, port);
+
+    pthread_mutex_lock(&g_mutex);
+    pool_drop_stale(av_gettime_relative());
+    for (i = 0; i < POOL_ENTRIES_MAX; i++) {
+        if (g_pool[i].url && !strcmp(g_pool[i].key, key)) {
+            url = g_pool[i].url;
+            g_pool[i].url    = NULL;
+            g_pool[i].in_use = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+
+    if (url)
+        av_log(NULL, AV_LOG_DEBUG, "ijkconnpool: reuse %s\n", key);
+    return url;
+}
+
+static void *prepare_thread(void *arg)
+{
+    PrepareTask *task = arg;
+    URLContext     *url  = NULL;
+    IjkConnPoolAddr addrs[IJKCONNPOOL_ADDRS_MAX];
+    AVDictionary   *options;
+    char            tcp_url[POOL_KEY_MAX + 16];
+    int             nb_addrs;
+    int             ret;
+    int             i;
+
+    ret = nb_addrs = ijkconnpool_resolve(task->host, addrs, IJKCONNPOOL_ADDRS_MAX, task->ttl);
+    for (i = 0; i < nb_addrs; i++) {
+        options = NULL;
+        av_dict_copy(&options, task->options, 0);
+        ff_url_join(tcp_url, sizeof(tcp_url), "tcp", NULL, addrs[i], task->port, NULL);
+        ret = ffurl_open_whitelist(&url, tcp_url, AVIO_FLAG_READ_WRITE, NULL, &options, NULL, NULL, NULL);
+        av_dict_free(&options);
+        if (!ret)
+            break;
+    }
+
+    pthread_mutex_lock(&g_mutex);
+    av_log(NULL, AV_LOG_DEBUG, "ijkconnpool: prepare %s: %d\n", task->entry->key, ret);
+    if (ret) {
+        task->entry->in_use = 0;
+    } else {
+        task->entry->url       = url;
+        task->entry->open_time = av_gettime_relative();
+    }
+    pthread_mutex_unlock(&g_mutex);
+
+    av_dict_free(&task->options);
+    av_free(task);
+    return NULL;
+}
+
+void ijkconnpool_prepare(const char *host, int port, AVDictionary *options, int ttl)
+{
+    PrepareTask *task  = NULL;
+    PoolEntry   *entry = NULL;
+    char         key[POOL_KEY_MAX];
+    pthread_t    thread;
+    int          i;
+
+    if (!host || !*host || port <= 0 || strlen(host) >= sizeof(task->host))
+        return;
+    pool_key(key, host, port);
+
+    pthread_mutex_lock(&g_mutex);
+    pool_drop_stale(av_gettime_relative());
+    for (i = 0; i < POOL_ENTRIES_MAX; i++) {
+        if (g_pool[i].in_use && !strcmp(g_pool[i].key, key))
+            goto end;
+        if (!g_pool[i].in_use && !entry)
+            entry = &g_pool[i];
+    }
+    if (!entry)
+        goto end;
+
+    task = av_mallocz(sizeof(PrepareTask));
+    if (!task)
+        goto end;
+    av_strlcpy(task->host, host, sizeof(task->host));
+    task->port  = port;
+    task->ttl   = ttl;
+    task->entry = entry;
+    av_dict_copy(&task->options, options, 0);
+    /* the spare may outlive the player that asked for it */
+    av_dict_set(&task->options, "ijkapplication", NULL, 0);
+    av_dict_set(&task->options, "ijkinject-segment-index", NULL, 0);
+    if (!av_dict_get(task->options, "timeout", NULL, 0))
+        av_dict_set_int(&task->options, "timeout", POOL_OPEN_TIMEOUT, 0);
+
+    entry->in_use = 1;
+    entry->url    = NULL;
+    av_strlcpy(entry->key, key, sizeof(entry->key));
+    if (pthread_create(&thread, NULL, prepare_thread, task)) {
+        entry->in_use = 0;
+        av_dict_free(&task->options);
+        av_freep(&task);
+        goto end;
+    }
+    pthread_detach(thread);
+
+end:
+    pthread_mutex_unlock(&g_mutex);
+}
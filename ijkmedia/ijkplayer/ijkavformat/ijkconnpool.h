@@ -0,0 +1,55 @@
+/*
+ * ijkconnpool.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#ifndef AVFORMAT_IJKCONNPOOL_H
+#define AVFORMAT_IJKCONNPOOL_H
+
+#include <netinet/in.h>
+#include "libavformat/url.h"
+
+#define IJKCONNPOOL_DNS_TTL_DEFAULT 60      /* seconds */
+#define IJKCONNPOOL_ADDRS_MAX       8
+
+typedef char IjkConnPoolAddr[INET6_ADDRSTRLEN];
+
+/*
+ * Process wide, shared by every player in the process:
+ *   dns cache   host -> numeric addresses, in getaddrinfo order,
+ *               entries expire after ttl seconds
+ *   warm pool   spare tcp connections to host:port opened ahead of the
+ *               next segment or reconnect, each handed out once and dropped
+ *               after being idle for a few seconds
+ * Thread safe.
+ */
+
+/*
+ * numeric addresses of host, from the cache when fresh, to be tried in order
+ * return the number of addresses, or < 0 on failure
+ */
+int         ijkconnpool_resolve(const char *host, IjkConnPoolAddr *addrs, int max_addrs, int ttl);
+
+/* a connected tcp: context to host:port, or NULL */
+URLContext *ijkconnpool_take(const char *host, int port);
+
+/* open a spare connection to host:port in the background, at most one per key */
+void        ijkconnpool_prepare(const char *host, int port, AVDictionary *options, int ttl);
+
+#endif
@@ -0,0 +1,425 @@
+/*
+ * ijkdiskcache.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "ijkdiskcache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "ijkplayer/ijkavutil/hash.h"
+
+#define INDEX_MAGIC             "ijkdiskcache 1"
+#define INDEX_SUFFIX            ".idx"
+#define DATA_SUFFIX             ".dat"
+#define INDEX_LINE_MAX          4096
+
+/* rewrite the index every so many new blocks, not only on close */
+#define PERSIST_INTERVAL_BLOCKS 64
+
+struct IjkDiskCache {
+    char    *dir;
+    char    *key;
+    char    *name;              /* <hash>, shared by both files */
+    char    *index_path;
+    char    *data_path;
+    int      fd;
+
+    int64_t  size;
+    int      block_size;
+    int      nb_blocks;
+    uint8_t *blocks;            /* 1 if the whole block is on disk */
+    int      nb_cached;
+    int      dirty_blocks;
+    int64_t  max_bytes;
+
+    /* bytes written back to back, blocks fully inside are complete */
+    int64_t  run_start;
+    int64_t  run_end;
+};
+
+typedef struct CacheEntry {
+    char    *name;
+    time_t   mtime;
+    int64_t  bytes;
+} CacheEntry;
+
+static void cache_reset(IjkDiskCache *cache)
+{
+    memset(cache->blocks, 0, cache->nb_blocks);
+    cache->nb_cached    = 0;
+    cache->dirty_blocks = 0;
+    if (ftruncate(cache->fd, 0) < 0)
+        av_log(NULL, AV_LOG_WARNING, "ijkdiskcache: truncate %s failed\n", cache->data_path);
+}
+
+static void cache_load_index(IjkDiskCache *cache)
+{
+    char     line[INDEX_LINE_MAX];
+    int64_t  size, start, end;
+    int      block_size, b;
+    FILE    *f;
+
+    f = fopen(cache->index_path, "r");
+    if (!f) {
+        cache_reset(cache);
+        return;
+    }
+
+    if (!fgets(line, sizeof(line), f) ||
+        sscanf(line, INDEX_MAGIC " %"SCNd64" %d", &size, &block_size) != 2 ||
+        size != cache->size || block_size != cache->block_size)
+        goto stale;
+
+    if (!fgets(line, sizeof(line), f))
+        goto stale;
+    line[strcspn(line, "\n")] = '\0';
+    if (strcmp(line, cache->key))
+        goto stale;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%"SCNd64" %"SCNd64, &start, &end) != 2 || start < 0 || end > cache->size)
+            goto stale;
+        for (b = (int)(start / block_size); b < cache->nb_blocks && (int64_t)b * block_size < end; b++) {
+            if (!cache->blocks[b]) {
+                cache->blocks[b] = 1;
+                cache->nb_cached++;
+            }
+        }
+    }
+
+    fclose(f);
+    return;
+stale:
+    av_log(NULL, AV_LOG_INFO, "ijkdiskcache: drop stale %s\n", cache->index_path);
+    fclose(f);
+    cache_reset(cache);
+}
+
+/*
+ * The index only lists blocks already synced to the data file, and is
+ * synced itself before it replaces the old one: after a crash the old or
+ * the new index is found, each telling the truth.
+ */
+static int cache_save_index(IjkDiskCache *cache)
+{
+    char    *tmp_path;
+    FILE    *f;
+    int      b = 0, start, ret = 0;
+
+    if (fsync(cache->fd) < 0) {
+        ret = AVERROR(errno);
+        av_log(NULL, AV_LOG_WARNING, "ijkdiskcache: sync %s failed: %s\n", cache->data_path, av_err2str(ret));
+        cache->dirty_blocks = 0;
+        return ret;
+    }
+
+    tmp_path = av_asprintf("%s.tmp", cache->index_path);
+    if (!tmp_path)
+        return AVERROR(ENOMEM);
+
+    f = fopen(tmp_path, "w");
+    if (!f) {
+        ret = AVERROR(errno);
+        goto end;
+    }
+
+    fprintf(f, INDEX_MAGIC " %"PRId64" %d\n%s\n", cache->size, cache->block_size, cache->key);
+    while (b < cache->nb_blocks) {
+        if (!cache->blocks[b]) {
+            b++;
+            continue;
+        }
+        start = b;
+        while (b < cache->nb_blocks && cache->blocks[b])
+            b++;
+        fprintf(f, "%"PRId64" %"PRId64"\n", (int64_t)start * cache->block_size,
+                FFMIN((int64_t)b * cache->block_size, cache->size));
+    }
+
+    if (fflush(f) != 0 || fsync(fileno(f)) < 0) {
+        ret = AVERROR(errno);
+        fclose(f);
+        unlink(tmp_path);
+    } else if (fclose(f) != 0 || rename(tmp_path, cache->index_path) < 0) {
+        ret = AVERROR(errno);
+        unlink(tmp_path);
+    }
+    cache->dirty_blocks = 0;
+end:
+    if (ret < 0)
+        av_log(NULL, AV_LOG_WARNING, "ijkdiskcache: write %s failed: %s\n", cache->index_path, av_err2str(ret));
+    av_free(tmp_path);
+    return ret;
+}
+
+static int cache_entry_cmp(const void *a, const void *b)
+{
+    const CacheEntry *ea = a;
+    const CacheEntry *eb = b;
+
+    return (ea->mtime > eb->mtime) - (ea->mtime < eb->mtime);
+}
+
+/* delete the least recently used assets but keep, until dir fits max_bytes */
+static void cache_evict(const char *dir, int64_t max_bytes, const char *keep)
+{
+    CacheEntry    *entries = NULL, *tmp;
+    int            nb_entries = 0, i;
+    int64_t        total = 0;
+    struct dirent *ent;
+    struct stat    st;
+    char          *path;
+    DIR           *d;
+
+    d = opendir(dir);
+    if (!d)
+        return;
+
+    while ((ent = readdir(d))) {
+        size_t len = strlen(ent->d_name);
+        CacheEntry entry = {0};
+
+        if (len <= strlen(INDEX_SUFFIX) || strcmp(ent->d_name + len - strlen(INDEX_SUFFIX), INDEX_SUFFIX))
+            continue;
+
+        entry.name = av_strndup(ent->d_name, len - strlen(INDEX_SUFFIX));
+        if (!entry.name)
+            break;
+
+        path = av_asprintf("%s/%s", dir, ent->d_name);
+        if (path && stat(path, &st) == 0)
+            entry.mtime = st.st_mtime;
+        av_free(path);
+
+        /* allocated size, the data file is sparse */
+        path = av_asprintf("%s/%s" DATA_SUFFIX, dir, entry.name);
+        if (path && stat(path, &st) == 0)
+            entry.bytes = (int64_t)st.st_blocks * 512;
+        av_free(path);
+
+        tmp = av_realloc_array(entries, nb_entries + 1, sizeof(*entries));
+        if (!tmp) {
+            av_free(entry.name);
+            break;
+        }
+        entries = tmp;
+        entries[nb_entries++] = entry;
+        total += entry.bytes;
+    }
+    closedir(d);
+
+    if (total > max_bytes) {
+        qsort(entries, nb_entries, sizeof(*entries), cache_entry_cmp);
+        for (i = 0; i < nb_entries && total > max_bytes; i++) {
+            if (keep && !strcmp(entries[i].name, keep))
+                continue;
+
+            av_log(NULL, AV_LOG_INFO, "ijkdiskcache: evict %s, %"PRId64" bytes\n", entries[i].name, entries[i].bytes);
+            path = av_asprintf("%s/%s" INDEX_SUFFIX, dir, entries[i].name);
+            if (path)
+                unlink(path);
+            av_free(path);
+            path = av_asprintf("%s/%s" DATA_SUFFIX, dir, entries[i].name);
+            if (path)
+                unlink(path);
+            av_free(path);
+            total -= entries[i].bytes;
+        }
+    }
+
+    for (i = 0; i < nb_entries; i++)
+        av_free(entries[i].name);
+    av_free(entries);
+}
+
+int ijkdiskcache_open(IjkDiskCache **pcache, const char *dir, const char *key,
+                      int64_t size, int block_size, int64_t max_bytes)
+{
+    IjkDiskCache *cache;
+    int           ret;
+
+    *pcache = NULL;
+    if (!dir || !*dir || !key || size <= 0 || block_size <= 0 || strchr(key, '\n'))
+        return AVERROR(EINVAL);
+    if ((size + block_size - 1) / block_size > INT_MAX)
+        return AVERROR(EINVAL);
+
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+        return AVERROR(errno);
+
+    cache = av_mallocz(sizeof(IjkDiskCache));
+    if (!cache)
+        return AVERROR(ENOMEM);
+    cache->fd         = -1;
+    cache->size       = size;
+    cache->block_size = block_size;
+    cache->nb_blocks  = (int)((size + block_size - 1) / block_size);
+    cache->max_bytes  = max_bytes;
+    cache->run_start  = -1;
+    cache->run_end    = -1;
+
+    cache->dir        = av_strdup(dir);
+    cache->key        = av_strdup(key);
+    cache->name       = av_asprintf("%016"PRIx64, ijk_hash_fnv1a64(key));
+    cache->blocks     = av_mallocz(cache->nb_blocks);
+    if (!cache->dir || !cache->key || !cache->name || !cache->blocks) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    cache->index_path = av_asprintf("%s/%s" INDEX_SUFFIX, dir, cache->name);
+    cache->data_path  = av_asprintf("%s/%s" DATA_SUFFIX, dir, cache->name);
+    if (!cache->index_path || !cache->data_path) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    cache->fd = open(cache->data_path, O_RDWR | O_CREAT, 0644);
+    if (cache->fd < 0) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+
+    cache_load_index(cache);
+    /* most recently used */
+    utime(cache->index_path, NULL);
+    cache_evict(dir, max_bytes, cache->name);
+
+    av_log(NULL, AV_LOG_INFO, "ijkdiskcache: %s, %d/%d blocks cached\n", cache->name, cache->nb_cached, cache->nb_blocks);
+    *pcache = cache;
+    return 0;
+fail:
+    ijkdiskcache_close(&cache);
+    return ret;
+}
+
+void ijkdiskcache_close(IjkDiskCache **pcache)
+{
+    IjkDiskCache *cache;
+
+    if (!pcache || !*pcache)
+        return;
+
+    cache = *pcache;
+    if (cache->fd >= 0) {
+        cache_save_index(cache);
+        close(cache->fd);
+        cache_evict(cache->dir, cache->max_bytes, NULL);
+    }
+
+    av_free(cache->dir);
+    av_free(cache->key);
+    av_free(cache->name);
+    av_free(cache->index_path);
+    av_free(cache->data_path);
+    av_free(cache->blocks);
+    av_freep(pcache);
+}
+
+int ijkdiskcache_has(IjkDiskCache *cache, int64_t pos)
+{
+    if (pos < 0 || pos >= cache->size)
+        return 0;
+    return cache->blocks[pos / cache->block_size];
+}
+
+int ijkdiskcache_read(IjkDiskCache *cache, int64_t pos, uint8_t *buf, int size)
+{
+    int64_t block_end;
+    ssize_t n;
+    int     b;
+
+    if (!ijkdiskcache_has(cache, pos))
+        return 0;
+
+    b         = (int)(pos / cache->block_size);
+    block_end = FFMIN((int64_t)(b + 1) * cache->block_size, cache->size);
+    size      = (int)FFMIN(size, block_end - pos);
+
+    do {
+        n = pread(cache->fd, buf, size, pos);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        /* lost or unreadable, fetch it again */
+        cache->blocks[b] = 0;
+        cache->nb_cached--;
+        cache->dirty_blocks++;
+        return 0;
+    }
+    return (int)n;
+}
+
+int ijkdiskcache_write(IjkDiskCache *cache, int64_t pos, const uint8_t *buf, int size)
+{
+    int64_t first, last, b;
+    int     written = 0;
+    ssize_t n;
+
+    if (pos < 0 || pos >= cache->size)
+        return 0;
+    /* the budget applies to this asset too */
+    if ((int64_t)cache->nb_cached * cache->block_size >= cache->max_bytes)
+        return 0;
+
+    size = (int)FFMIN(size, cache->size - pos);
+    while (written < size) {
+        n = pwrite(cache->fd, buf + written, size - written, pos + written);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            cache->run_end = -1;
+            return AVERROR(errno);
+        }
+        written += (int)n;
+    }
+
+    if (pos != cache->run_end)
+        cache->run_start = pos;
+    cache->run_end = pos + size;
+
+    /* blocks before pos / block_size were settled by earlier writes */
+    first = FFMAX((cache->run_start + cache->block_size - 1) / cache->block_size, pos / cache->block_size);
+    last  = cache->run_end == cache->size ? cache->nb_blocks : cache->run_end / cache->block_size;
+    for (b = first; b < last; b++) {
+        if (!cache->blocks[b]) {
+            cache->blocks[b] = 1;
+            cache->nb_cached++;
+            cache->dirty_blocks++;
+        }
+    }
+
+    if (cache->dirty_blocks >= PERSIST_INTERVAL_BLOCKS)
+        cache_save_index(cache);
+    return size;
+}
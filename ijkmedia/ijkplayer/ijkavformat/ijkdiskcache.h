@@ -0,0 +1,52 @@
+/*
+ * ijkdiskcache.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_IJKDISKCACHE_H
+#define AVFORMAT_IJKDISKCACHE_H
+
+#include <stdint.h>
+
+#define IJKDISKCACHE_BLOCK_SIZE_DEFAULT (128 * 1024)
+#define IJKDISKCACHE_MAX_BYTES_DEFAULT  (512 * 1024 * 1024LL)
+
+/*
+ * Block cache of one asset of known size, in a directory shared by assets:
+ *   <hash>.dat  sparse data file, block n at n * block_size
+ *   <hash>.idx  text index, "ijkdiskcache 1 <size> <block_size>", the key,
+ *               then one "<start> <end>" byte range of whole blocks per line
+ * Only complete blocks are served. Assets are evicted least recently used
+ * first when the directory grows past max_bytes.
+ * Not thread safe, use it from one thread at a time.
+ */
+typedef struct IjkDiskCache IjkDiskCache;
+
+int  ijkdiskcache_open(IjkDiskCache **pcache, const char *dir, const char *key,
+                       int64_t size, int block_size, int64_t max_bytes);
+/* persist the index and enforce the budget */
+void ijkdiskcache_close(IjkDiskCache **pcache);
+
+/* 1 if the block holding pos is cached */
+int  ijkdiskcache_has(IjkDiskCache *cache, int64_t pos);
+/* read up to the end of the block holding pos, 0 if it is not cached */
+int  ijkdiskcache_read(IjkDiskCache *cache, int64_t pos, uint8_t *buf, int size);
+/* blocks become cached once sequential writes have covered them whole */
+int  ijkdiskcache_write(IjkDiskCache *cache, int64_t pos, const uint8_t *buf, int size);
+
+#endif
@@ -21,13 +21,25 @@
 #include "libavformat/avformat.h"
 #include "libavformat/url.h"
 #include "libavutil/avstring.h"
+#include "libavutil/crc.h"
 #include "libavutil/opt.h"
+#include "libavutil/time.h"
 
 #include "ijkplayer/ijkavutil/opt.h"
 
 #include "ijkavformat.h"
 #include "libavutil/application.h"
 
+/* what the demuxer tells about a stream before any probing */
+typedef struct StreamKey {
+    enum AVMediaType codec_type;
+    enum AVCodecID   codec_id;
+    int              width;
+    int              height;
+    int              extradata_size;
+    uint32_t         extradata_crc;
+} StreamKey;
+
 typedef struct {
     AVClass         *class;
     AVFormatContext *inner;
@@ -36,10 +48,18 @@ typedef struct {
     int              discontinuity;
     int              error;
 
+    /* last full probe, reused by a reconnect to the same streams */
+    int              nb_probed;
+    StreamKey       *probed_keys;
+    AVCodecParameters **probed_params;
+
     /* options */
     AVDictionary   *open_opts;
     int64_t         app_ctx_intptr;
     AVApplicationContext *app_ctx;
+    int              fast_reconnect;
+    int              reconnect_delay_min;
+    int              reconnect_delay_max;
 } Context;
 
 static int ijkurlhook_call_inject(AVFormatContext *h)
@@ -71,6 +91,39 @@ fail:
     return ret;
 }
 
+/* the first retry is immediate, then min, 2 * min, ... up to max */
+static int reconnect_backoff(AVFormatContext *h)
+{
+    Context *c = h->priv_data;
+    int64_t  delay;
+    int64_t  wake_time;
+
+    if (c->io_control.retry_counter <= 1 || c->reconnect_delay_max <= 0)
+        return 0;
+
+    delay = (int64_t)c->reconnect_delay_min << FFMIN(c->io_control.retry_counter - 2, 20);
+    delay = FFMIN(delay, c->reconnect_delay_max);
+    av_log(h, AV_LOG_INFO, "livehook retry %d in %"PRId64" ms\n", c->io_control.retry_counter, delay);
+
+    wake_time = av_gettime_relative() + delay * 1000;
+    while (av_gettime_relative() < wake_time) {
+        if (ff_check_interrupt(&h->interrupt_callback))
+            return AVERROR_EXIT;
+        av_usleep(10 * 1000);
+    }
+    return 0;
+}
+
+/* injected first, so the app sees every retry before the wait */
+static int reconnect_inject(AVFormatContext *h)
+{
+    int ret = ijkurlhook_call_inject(h);
+
+    if (ret)
+        return ret;
+    return reconnect_backoff(h);
+}
+
 static int ijklivehook_probe(AVProbeData *probe)
 {
     if (av_strstart(probe->filename, "ijklivehook:", NULL))
@@ -84,6 +137,10 @@ static int ijklivehook_read_close(AVFormatContext *avf)
     Context *c = avf->priv_data;
 
     avformat_close_input(&c->inner);
+    while (c->nb_probed > 0)
+        avcodec_parameters_free(&c->probed_params[--c->nb_probed]);
+    av_freep(&c->probed_params);
+    av_freep(&c->probed_keys);
     return 0;
 }
 
@@ -120,11 +177,80 @@ static int copy_stream_props(AVStream *st, AVStream *source_st)
     return 0;
 }
 
+static void stream_key_init(StreamKey *key, AVStream *st)
+{
+    AVCodecParameters *par = st->codecpar;
+
+    memset(key, 0, sizeof(*key));
+    key->codec_type     = par->codec_type;
+    key->codec_id       = par->codec_id;
+    key->width          = par->width;
+    key->height         = par->height;
+    key->extradata_size = par->extradata_size;
+    if (par->extradata_size > 0)
+        key->extradata_crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, par->extradata, par->extradata_size);
+}
+
+static int probed_match(Context *c, AVFormatContext *new_avf)
+{
+    StreamKey key;
+    int       i;
+
+    if (c->nb_probed <= 0 || new_avf->nb_streams != c->nb_probed)
+        return 0;
+
+    for (i = 0; i < new_avf->nb_streams; i++) {
+        stream_key_init(&key, new_avf->streams[i]);
+        if (memcmp(&key, &c->probed_keys[i], sizeof(key)))
+            return 0;
+    }
+    return 1;
+}
+
+/* keys come from before probing, the params from after */
+static int probed_save(Context *c, StreamKey *keys, AVFormatContext *new_avf)
+{
+    AVCodecParameters **params;
+    int                 i;
+    int                 ret;
+
+    params = av_mallocz_array(new_avf->nb_streams, sizeof(*params));
+    if (!params)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < new_avf->nb_streams; i++) {
+        params[i] = avcodec_parameters_alloc();
+        if (!params[i]) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        ret = avcodec_parameters_copy(params[i], new_avf->streams[i]->codecpar);
+        if (ret < 0)
+            goto fail;
+    }
+
+    while (c->nb_probed > 0)
+        avcodec_parameters_free(&c->probed_params[--c->nb_probed]);
+    av_freep(&c->probed_params);
+    av_freep(&c->probed_keys);
+    c->probed_keys   = keys;
+    c->probed_params = params;
+    c->nb_probed     = new_avf->nb_streams;
+    return 0;
+fail:
+    for (i = 0; i < new_avf->nb_streams; i++)
+        avcodec_parameters_free(&params[i]);
+    av_free(params);
+    return ret;
+}
+
 static int open_inner(AVFormatContext *avf)
 {
     Context         *c          = avf->priv_data;
     AVDictionary    *tmp_opts   = NULL;
     AVFormatContext *new_avf    = NULL;
+    StreamKey       *keys       = NULL;
+    int              nb_keys    = 0;
+    int64_t          start_time = av_gettime_relative();
     int ret = -1;
     int i   = 0;
 
@@ -148,6 +274,29 @@ static int open_inner(AVFormatContext *avf)
     if (ret < 0)
         goto fail;
 
+    if (c->fast_reconnect && probed_match(c, new_avf)) {
+        /* same streams as before, skip find_stream_info and keep our streams */
+        for (i = 0; i < new_avf->nb_streams; i++) {
+            ret = avcodec_parameters_copy(new_avf->streams[i]->codecpar, c->probed_params[i]);
+            if (ret < 0)
+                goto fail;
+        }
+        av_log(avf, AV_LOG_INFO, "fast reconnect in %"PRId64" ms\n", (av_gettime_relative() - start_time) / 1000);
+        goto done;
+    }
+
+    /* streams found only while probing can not be matched before it */
+    if (c->fast_reconnect && !(new_avf->ctx_flags & AVFMTCTX_NOHEADER) && new_avf->nb_streams > 0) {
+        nb_keys = new_avf->nb_streams;
+        keys = av_mallocz_array(nb_keys, sizeof(*keys));
+        if (!keys) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        for (i = 0; i < new_avf->nb_streams; i++)
+            stream_key_init(&keys[i], new_avf->streams[i]);
+    }
+
     ret = avformat_find_stream_info(new_avf, NULL);
     if (ret < 0)
         goto fail;
@@ -164,11 +313,21 @@ static int open_inner(AVFormatContext *avf)
             goto fail;
     }
 
+    if (keys && nb_keys == new_avf->nb_streams) {
+        ret = probed_save(c, keys, new_avf);
+        if (ret < 0)
+            goto fail;
+        keys = NULL;
+    }
+    av_log(avf, AV_LOG_INFO, "open with probe in %"PRId64" ms\n", (av_gettime_relative() - start_time) / 1000);
+
+done:
     avformat_close_input(&c->inner);
     c->inner = new_avf;
     new_avf = NULL;
     ret = 0;
 fail:
+    av_free(keys);
     av_dict_free(&tmp_opts);
     avformat_close_input(&new_avf);
     return ret;
@@ -206,7 +365,7 @@ static int ijklivehook_read_header(AVFormatContext *avf, AVDictionary **options)
         }
 
         c->io_control.retry_counter++;
-        ret = ijkurlhook_call_inject(avf);
+        ret = reconnect_inject(avf);
         if (ret) {
             ret = AVERROR_EXIT;
             goto fail;
@@ -247,7 +406,7 @@ static int ijklivehook_read_packet(AVFormatContext *avf, AVPacket *pkt)
         }
 
         c->io_control.retry_counter++;
-        ret = ijkurlhook_call_inject(avf);
+        ret = reconnect_inject(avf);
         if (ret) {
             ret = AVERROR_EXIT;
             goto fail;
@@ -277,6 +436,12 @@ fail:
 
 static const AVOption options[] = {
     { "ijkapplication", "AVApplicationContext", OFFSET(app_ctx_intptr), AV_OPT_TYPE_INT64, { .i64 = 0 }, INT64_MIN, INT64_MAX, .flags = D },
+    { "ijklivehook-fast-reconnect", "reuse the probed stream info when a reconnect brings back the same streams",
+        OFFSET(fast_reconnect), AV_OPT_TYPE_INT, { .i64 = 1 }, 0, 1, .flags = D },
+    { "ijklivehook-reconnect-delay-min", "ms before the second retry, doubled on every further one",
+        OFFSET(reconnect_delay_min), AV_OPT_TYPE_INT, { .i64 = 100 }, 0, INT_MAX, .flags = D },
+    { "ijklivehook-reconnect-delay-max", "ms cap of the retry delay, 0 retries without delay",
+        OFFSET(reconnect_delay_max), AV_OPT_TYPE_INT, { .i64 = 5000 }, 0, INT_MAX, .flags = D },
     { NULL }
 };
 
@@ -0,0 +1,212 @@
+/*
+ * ijkmmap.c
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Local files mapped in memory: reads are copies out of the mapping and
+ * seeks only move the position. The kernel is asked to read ahead of the
+ * position, wherever it jumps to.
+ *
+ * The file must not shrink while it is open, a read past its new end
+ * faults. Files growing while open are only seen up to their size at open.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "libavformat/avio.h"
+#include "libavutil/avstring.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "ijkmmap.h"
+
+#define IJKMMAP_AVIO_BUFFER_SIZE (32 * 1024)
+
+typedef struct Context {
+    int             fd;
+    uint8_t        *data;
+    int64_t         size;
+    int64_t         pos;
+
+    /* position of the last read ahead hint, -1 for none */
+    int64_t         advised_pos;
+    int64_t         page_mask;
+    int             readahead;
+} Context;
+
+static void ijkmmap_advise(Context *c)
+{
+    int64_t  start;
+    int64_t  end;
+
+    if (c->readahead <= 0 || c->pos >= c->size)
+        return;
+    if (c->advised_pos >= 0 && c->pos >= c->advised_pos && c->pos < c->advised_pos + c->readahead / 2)
+        return;
+
+    start = c->pos & ~c->page_mask;
+    end   = FFMIN(c->pos + c->readahead, c->size);
+    if (madvise(c->data + start, (size_t)(end - start), MADV_WILLNEED))
+        av_log(NULL, AV_LOG_DEBUG, "ijkmmap: madvise: %s\n", strerror(errno));
+    c->advised_pos = c->pos;
+}
+
+static void ijkmmap_close(Context *c)
+{
+    if (c->data)
+        munmap(c->data, (size_t)c->size);
+    if (c->fd >= 0)
+        close(c->fd);
+    av_free(c);
+}
+
+static int ijkmmap_open(Context **pc, const char *path, int readahead)
+{
+    Context    *c;
+    struct stat st;
+    void       *data;
+    int         ret;
+
+    c = av_mallocz(sizeof(Context));
+    if (!c)
+        return AVERROR(ENOMEM);
+    c->readahead   = readahead;
+    c->advised_pos = -1;
+    c->page_mask   = sysconf(_SC_PAGESIZE) - 1;
+
+    c->fd = open(path, O_RDONLY);
+    if (c->fd < 0) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+    if (fstat(c->fd, &st) < 0) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        ret = AVERROR(EINVAL);
+        goto fail;
+    }
+
+    c->size = st.st_size;
+    if (c->size == 0) {
+        *pc = c;
+        return 0;
+    }
+    /* too big for the address space */
+    if ((uint64_t)c->size > SIZE_MAX) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    data = mmap(NULL, (size_t)c->size, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (data == MAP_FAILED) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+    c->data = data;
+
+    ijkmmap_advise(c);
+    *pc = c;
+    return 0;
+fail:
+    ijkmmap_close(c);
+    return ret;
+}
+
+static int ijkmmap_read(void *opaque, uint8_t *buf, int size)
+{
+    Context *c = opaque;
+
+    if (c->pos >= c->size)
+        return AVERROR_EOF;
+
+    size = (int)FFMIN(size, c->size - c->pos);
+    memcpy(buf, c->data + c->pos, size);
+    c->pos += size;
+
+    ijkmmap_advise(c);
+    return size;
+}
+
+static int64_t ijkmmap_seek(void *opaque, int64_t pos, int whence)
+{
+    Context *c = opaque;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return c->size;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += c->pos;
+        break;
+    case SEEK_END:
+        pos += c->size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    c->pos = pos;
+    ijkmmap_advise(c);
+    return pos;
+}
+
+int ijkmmap_avio_open(AVIOContext **pb, const char *url, int readahead)
+{
+    Context *c = NULL;
+    uint8_t *buffer;
+    int      ret;
+
+    *pb = NULL;
+    av_strstart(url, "file:", &url);
+    if (url[0] != '/')
+        return 0;
+
+    ret = ijkmmap_open(&c, url, readahead);
+    if (ret < 0)
+        return ret;
+
+    buffer = av_malloc(IJKMMAP_AVIO_BUFFER_SIZE);
+    if (!buffer) {
+        ijkmmap_close(c);
+        return AVERROR(ENOMEM);
+    }
+    *pb = avio_alloc_context(buffer, IJKMMAP_AVIO_BUFFER_SIZE, 0, c, ijkmmap_read, NULL, ijkmmap_seek);
+    if (!*pb) {
+        av_free(buffer);
+        ijkmmap_close(c);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+void ijkmmap_avio_closep(AVIOContext **pb)
+{
+    if (!pb || !*pb)
+        return;
+
+    ijkmmap_close((*pb)->opaque);
+    av_freep(&(*pb)->buffer);
+    av_freep(pb);
+}
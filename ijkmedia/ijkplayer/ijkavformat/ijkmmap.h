@@ -0,0 +1,37 @@
+/*
+ * ijkmmap.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_IJKMMAP_H
+#define AVFORMAT_IJKMMAP_H
+
+#include "libavformat/avio.h"
+
+#define IJKMMAP_READAHEAD_DEFAULT (2 * 1024 * 1024)
+
+/*
+ * AVIOContext reading a local file through a memory mapping, for
+ * avformat_open_input() with AVFMT_FLAG_CUSTOM_IO.
+ * readahead is how many bytes the kernel is asked to read ahead of the
+ * position. *pb is NULL if url is not an absolute path or a file: url.
+ */
+int  ijkmmap_avio_open(AVIOContext **pb, const char *url, int readahead);
+void ijkmmap_avio_closep(AVIOContext **pb);
+
+#endif
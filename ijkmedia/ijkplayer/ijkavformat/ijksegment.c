@@ -24,18 +24,283 @@
 #include "libavutil/avstring.h"
 #include "libavutil/log.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+#include "ijksegment.h"
 
 #include "libavutil/application.h"
 
+#define PRELOAD_DEPTH_MAX           4
+#define PRELOAD_BYTES_DEFAULT       (4 * 1024 * 1024)
+#define PRELOAD_ENTRIES_MAX         (PRELOAD_DEPTH_MAX * 2)
+#define PRELOAD_EXPIRE              (30 * 1000000LL)
+#define PRELOAD_CHUNK_SIZE          (32 * 1024)
+
+/*
+ * Segments opened and buffered ahead, keyed by url and shared by the
+ * process. The entry of the next segment is handed over with its
+ * connection and buffer when the concat demuxer opens that segment.
+ * The entry stays alive with the segment context, the interrupt callback
+ * of the connection points to it.
+ * Entries are opened with the player's application context, like the
+ * segment itself, so the player drops those nobody took when it closes
+ * its input, see ijksegment_preload_drop().
+ */
+typedef struct Preload {
+    char            url[4096];
+    URLContext     *inner;
+    uint8_t        *buffer;
+    int             capacity;
+    int             filled;
+    int             error;
+
+    int             abort;      /* dropped, interrupt the fetch */
+    int             stop;       /* handed over, stop after the current read */
+    AVIOInterruptCB interrupt_parent;
+
+    int             flags;
+    int64_t         app_ctx_intptr;
+    AVDictionary   *options;
+    char           *protocol_whitelist;
+    char           *protocol_blacklist;
+    int64_t         create_time;
+    pthread_t       thread;
+    struct Preload *next;
+} Preload;
+
+static pthread_mutex_t g_preload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Preload        *g_preloads;
+
 typedef struct Context {
     AVClass        *class;
     URLContext     *inner;
 
+    /* preloaded segment: buffer first, then the connection */
+    Preload        *preload;
+    int64_t         logical_pos;
+    int64_t         inner_pos;
+
     /* options */
     char           *http_hook;
     int64_t         app_ctx_intptr;
+    int             preload_depth;
+    int             preload_bytes;
 } Context;
 
+static int preload_check_interrupt(void *arg)
+{
+    Preload *p = arg;
+
+    if (p->abort)
+        return 1;
+    if (p->interrupt_parent.callback)
+        return ff_check_interrupt(&p->interrupt_parent);
+    return 0;
+}
+
+static void *preload_thread(void *arg)
+{
+    Preload        *p = arg;
+    AVIOInterruptCB interrupt_callback = {preload_check_interrupt, p};
+    int             ret;
+
+    ret = ffurl_open_whitelist(&p->inner,
+                               p->url,
+                               p->flags,
+                               &interrupt_callback,
+                               &p->options,
+                               p->protocol_whitelist,
+                               p->protocol_blacklist,
+                               NULL);
+    if (ret < 0) {
+        p->error = ret;
+        return NULL;
+    }
+
+    while (p->filled < p->capacity && !p->abort) {
+        pthread_mutex_lock(&g_preload_mutex);
+        ret = p->stop;
+        pthread_mutex_unlock(&g_preload_mutex);
+        if (ret)
+            break;
+
+        ret = ffurl_read(p->inner, p->buffer + p->filled, FFMIN(PRELOAD_CHUNK_SIZE, p->capacity - p->filled));
+        if (ret <= 0) {
+            p->error = ret ? ret : AVERROR_EOF;
+            break;
+        }
+        p->filled += ret;
+    }
+    return NULL;
+}
+
+static void preload_free(Preload **pp)
+{
+    Preload *p = *pp;
+
+    if (!p)
+        return;
+    ffurl_closep(&p->inner);
+    av_freep(&p->buffer);
+    av_dict_free(&p->options);
+    av_freep(&p->protocol_whitelist);
+    av_freep(&p->protocol_blacklist);
+    av_freep(pp);
+}
+
+/* interrupt, wait for and free entries unlinked from g_preloads */
+static void preload_drop_list(Preload *list)
+{
+    Preload *p;
+
+    while (list) {
+        p    = list;
+        list = p->next;
+        p->abort = 1;
+        pthread_join(p->thread, NULL);
+        preload_free(&p);
+    }
+}
+
+/*
+ * the entry of url, with the fetch stopped, or NULL
+ * an entry is opened with the hooks of its player, no other player may take it
+ */
+static Preload *preload_take(int64_t app_ctx_intptr, const char *url)
+{
+    Preload **pp;
+    Preload  *p = NULL;
+
+    pthread_mutex_lock(&g_preload_mutex);
+    for (pp = &g_preloads; *pp; pp = &(*pp)->next) {
+        if ((*pp)->app_ctx_intptr == app_ctx_intptr && !strcmp((*pp)->url, url)) {
+            p       = *pp;
+            *pp     = p->next;
+            p->next = NULL;
+            p->stop = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_preload_mutex);
+
+    if (p)
+        pthread_join(p->thread, NULL);
+    return p;
+}
+
+static void preload_start(URLContext *h, const char *url, int segment_index, int capacity, int flags, AVDictionary *options)
+{
+    Context  *c = h->priv_data;
+    Preload **pp;
+    Preload  *p;
+    Preload  *dropped = NULL;
+    Preload  *oldest;
+    int64_t   now = av_gettime_relative();
+    int       count = 0;
+
+    pthread_mutex_lock(&g_preload_mutex);
+    for (pp = &g_preloads; *pp;) {
+        p = *pp;
+        if (p->app_ctx_intptr == c->app_ctx_intptr && !strcmp(p->url, url)) {
+            pthread_mutex_unlock(&g_preload_mutex);
+            return;
+        }
+        /* nobody came for it */
+        if (now - p->create_time > PRELOAD_EXPIRE) {
+            *pp     = p->next;
+            p->next = dropped;
+            dropped = p;
+            continue;
+        }
+        count++;
+        pp = &p->next;
+    }
+    while (count >= PRELOAD_ENTRIES_MAX) {
+        oldest = g_preloads;
+        for (p = g_preloads; p; p = p->next) {
+            if (p->create_time < oldest->create_time)
+                oldest = p;
+        }
+        for (pp = &g_preloads; *pp != oldest; pp = &(*pp)->next);
+        *pp          = oldest->next;
+        oldest->next = dropped;
+        dropped      = oldest;
+        count--;
+    }
+
+    p = av_mallocz(sizeof(Preload));
+    if (!p)
+        goto end;
+    av_strlcpy(p->url, url, sizeof(p->url));
+    p->buffer   = av_malloc(capacity);
+    p->capacity = capacity;
+    p->flags    = flags;
+    p->create_time = now;
+    p->app_ctx_intptr = c->app_ctx_intptr;
+    av_dict_copy(&p->options, options, 0);
+    /* inject, retry and traffic statistics, as when the segment is opened */
+    av_dict_set_int(&p->options, "ijkapplication", c->app_ctx_intptr, 0);
+    av_dict_set_int(&p->options, "ijkinject-segment-index", segment_index, 0);
+    if (h->protocol_whitelist)
+        p->protocol_whitelist = av_strdup(h->protocol_whitelist);
+    if (h->protocol_blacklist)
+        p->protocol_blacklist = av_strdup(h->protocol_blacklist);
+    if (!p->buffer || pthread_create(&p->thread, NULL, preload_thread, p)) {
+        preload_free(&p);
+        goto end;
+    }
+    p->next    = g_preloads;
+    g_preloads = p;
+    av_log(h, AV_LOG_DEBUG, "preload %s\n", url);
+
+end:
+    pthread_mutex_unlock(&g_preload_mutex);
+    preload_drop_list(dropped);
+}
+
+/* ask the app for the urls of the next segments and start fetching them */
+static void preload_schedule(URLContext *h, AVApplicationContext *app_ctx, int segment_index, int flags, AVDictionary *options)
+{
+    Context       *c = h->priv_data;
+    AVAppIOControl io_control;
+    int            i;
+
+    if (!app_ctx || c->preload_depth <= 0)
+        return;
+
+    for (i = 1; i <= c->preload_depth; i++) {
+        memset(&io_control, 0, sizeof(io_control));
+        io_control.size = sizeof(io_control);
+        io_control.segment_index = segment_index + i;
+        snprintf(io_control.url, sizeof(io_control.url), "%d", segment_index + i);
+        if (av_application_on_io_control(app_ctx, AVAPP_CTRL_WILL_CONCAT_SEGMENT_OPEN, &io_control) || !io_control.url[0])
+            break;
+        preload_start(h, io_control.url, segment_index + i, c->preload_bytes / c->preload_depth, flags, options);
+    }
+}
+
+void ijksegment_preload_drop(AVApplicationContext *app_ctx)
+{
+    Preload **pp;
+    Preload  *p;
+    Preload  *dropped = NULL;
+
+    pthread_mutex_lock(&g_preload_mutex);
+    for (pp = &g_preloads; *pp;) {
+        p = *pp;
+        if (p->app_ctx_intptr != (int64_t)(intptr_t)app_ctx) {
+            pp = &p->next;
+            continue;
+        }
+        *pp     = p->next;
+        p->next = dropped;
+        dropped = p;
+    }
+    pthread_mutex_unlock(&g_preload_mutex);
+
+    preload_drop_list(dropped);
+}
+
 static int ijksegment_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     Context *c = h->priv_data;
@@ -64,6 +329,23 @@ static int ijksegment_open(URLContext *h, const char *arg, int flags, AVDictiona
         goto fail;
     }
 
+    c->preload = preload_take(c->app_ctx_intptr, io_control.url);
+    if (c->preload && c->preload->inner) {
+        c->preload->interrupt_parent = h->interrupt_callback;
+        c->inner     = c->preload->inner;
+        c->inner_pos = c->preload->filled;
+        c->preload->inner = NULL;
+        av_log(h, AV_LOG_INFO, "segment %d preloaded, %d bytes\n", segment_index, c->preload->filled);
+    } else {
+        preload_free(&c->preload);
+    }
+
+    if (options)
+        preload_schedule(h, app_ctx, segment_index, flags, *options);
+
+    if (c->inner)
+        return 0;
+
     av_dict_set_int(options, "ijkapplication", c->app_ctx_intptr, 0);
     av_dict_set_int(options, "ijkinject-segment-index", segment_index, 0);
 
@@ -86,22 +368,72 @@ fail:
 static int ijksegment_close(URLContext *h)
 {
     Context *c = h->priv_data;
+    int ret;
 
-    return ffurl_close(c->inner);
+    ret = ffurl_close(c->inner);
+    c->inner = NULL;
+    preload_free(&c->preload);
+    return ret;
 }
 
 static int ijksegment_read(URLContext *h, unsigned char *buf, int size)
 {
     Context *c = h->priv_data;
+    Preload *p = c->preload;
+    int64_t  seek_ret;
+    int      ret;
 
-    return ffurl_read(c->inner, buf, size);
+    if (!p)
+        return ffurl_read(c->inner, buf, size);
+
+    if (c->logical_pos < p->filled) {
+        size = (int)FFMIN(size, p->filled - c->logical_pos);
+        memcpy(buf, p->buffer + c->logical_pos, size);
+        c->logical_pos += size;
+        return size;
+    }
+    /* the preload ended the segment or failed there */
+    if (c->logical_pos == p->filled && c->inner_pos == p->filled && p->error < 0)
+        return p->error;
+
+    if (c->inner_pos != c->logical_pos) {
+        seek_ret = ffurl_seek(c->inner, c->logical_pos, SEEK_SET);
+        if (seek_ret < 0)
+            return (int)seek_ret;
+        c->inner_pos = seek_ret;
+    }
+    ret = ffurl_read(c->inner, buf, size);
+    if (ret > 0) {
+        c->logical_pos += ret;
+        c->inner_pos   += ret;
+    }
+    return ret;
 }
 
 static int64_t ijksegment_seek(URLContext *h, int64_t pos, int whence)
 {
     Context *c = h->priv_data;
+    int64_t  size;
+
+    if (!c->preload || whence == AVSEEK_SIZE)
+        return ffurl_seek(c->inner, pos, whence);
+
+    if (whence == SEEK_CUR) {
+        pos += c->logical_pos;
+    } else if (whence == SEEK_END) {
+        size = ffurl_seek(c->inner, 0, AVSEEK_SIZE);
+        if (size < 0)
+            return size;
+        pos += size;
+    } else if (whence != SEEK_SET) {
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
 
-    return ffurl_seek(c->inner, pos, whence);
+    /* the connection is repositioned by the next read past the buffer */
+    c->logical_pos = pos;
+    return pos;
 }
 
 #define OFFSET(x) offsetof(Context, x)
@@ -109,6 +441,10 @@ static int64_t ijksegment_seek(URLContext *h, int64_t pos, int whence)
 
 static const AVOption options[] = {
     { "ijkapplication", "AVApplicationContext", OFFSET(app_ctx_intptr), AV_OPT_TYPE_INT64, { .i64 = 0 }, INT64_MIN, INT64_MAX, .flags = D },
+    { "ijksegment-preload", "segments opened and buffered ahead of the one playing",
+        OFFSET(preload_depth), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, PRELOAD_DEPTH_MAX, .flags = D },
+    { "ijksegment-preload-bytes", "memory budget shared by the segments buffered ahead",
+        OFFSET(preload_bytes), AV_OPT_TYPE_INT, { .i64 = PRELOAD_BYTES_DEFAULT }, 64 * 1024, 64 * 1024 * 1024, .flags = D },
     { NULL }
 };
 
@@ -0,0 +1,32 @@
+/*
+ * ijksegment.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_IJKSEGMENT_H
+#define AVFORMAT_IJKSEGMENT_H
+
+#include "libavutil/application.h"
+
+/*
+ * Interrupt and free the preloaded segments nobody took, of the player
+ * owning app_ctx. Call it once the player has closed its input.
+ */
+void ijksegment_preload_drop(AVApplicationContext *app_ctx);
+
+#endif
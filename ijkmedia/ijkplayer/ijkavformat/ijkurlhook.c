@@ -24,8 +24,52 @@
 #include "libavutil/avstring.h"
 #include "libavutil/log.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
 
 #include "libavutil/application.h"
+#include "ijkconnpool.h"
+
+#include <arpa/inet.h>
+
+#define RANGE_CONNECTIONS_MAX       8
+#define RANGE_SLOTS_MAX             (RANGE_CONNECTIONS_MAX * 2)
+#define RANGE_SIZE_DEFAULT          (1024 * 1024)
+
+/*
+ * ijkhttphook parallel mode splits the forward window into byte ranges,
+ * fetched by one worker connection each and handed out to the reader in
+ * order. A slot goes IDLE -> FETCHING -> DONE -> IDLE once the reader has
+ * passed it; seeking away cancels FETCHING slots, the worker interrupts its
+ * request and gives the slot back.
+ */
+enum {
+    RANGE_IDLE = 0,
+    RANGE_FETCHING,
+    RANGE_DONE,
+    RANGE_CANCELLED,
+};
+
+typedef struct RangeSlot {
+    int             state;
+    int64_t         start;
+    int             size;
+    int             filled;
+    int             error;
+    uint8_t        *data;
+} RangeSlot;
+
+typedef struct RangeWorker {
+    URLContext     *h;
+    int             index;
+    RangeSlot      *slot;
+    pthread_t       thread;
+
+    /* throughput of this connection */
+    int             ranges;
+    int64_t         bytes;
+    int64_t         elapsed_micro;
+} RangeWorker;
 
 typedef struct Context {
     AVClass        *class;
@@ -39,6 +83,24 @@ typedef struct Context {
     const char     *scheme;
     const char     *inner_scheme;
 
+    /* parallel range fetching */
+    int             parallel;
+    int             range_abort;
+    int64_t         range_next;
+    URLContext     *range_first;
+    char            range_url[4096];
+    int             nb_slots;
+    RangeSlot       slots[RANGE_SLOTS_MAX];
+    int             nb_workers;
+    RangeWorker     workers[RANGE_CONNECTIONS_MAX];
+    pthread_mutex_t range_mutex;
+    pthread_cond_t  range_cond_main;
+    pthread_cond_t  range_cond_worker;
+    /* throughput of all connections together, reported by range_read() */
+    int64_t         speed_bytes;
+    int64_t         speed_start_time;
+    int             speed_throttled;    /* a worker went idle, the rate is a lower bound */
+
     /* options */
     int             inner_flags;
     AVDictionary   *inner_options;
@@ -47,6 +109,11 @@ typedef struct Context {
     int64_t         test_fail_point_next;
     int64_t         app_ctx_intptr;
     AVApplicationContext *app_ctx;
+    int             connections;
+    int             range_size;
+    int             dns_ttl;
+    int             pool;
+    int             pool_prepare;
 } Context;
 
 static int ijkurlhook_call_inject(URLContext *h)
@@ -87,7 +154,24 @@ fail:
     return ret;
 }
 
-static int ijkurlhook_reconnect(URLContext *h, AVDictionary *extra)
+static void ijkurlhook_attach(URLContext *h, URLContext *new_url)
+{
+    Context *c = h->priv_data;
+
+    ffurl_closep(&c->inner);
+
+    c->inner        = new_url;
+    h->is_streamed  = c->inner->is_streamed;
+    c->logical_pos  = ffurl_seek(c->inner, 0, SEEK_CUR);
+    if (c->inner->is_streamed)
+        c->logical_size = -1;
+    else
+        c->logical_size = ffurl_seek(c->inner, 0, AVSEEK_SIZE);
+
+    c->io_error = 0;
+}
+
+static int ijkurlhook_reconnect_url(URLContext *h, const char *url, AVDictionary *extra)
 {
     Context *c = h->priv_data;
     int ret = 0;
@@ -102,7 +186,7 @@ static int ijkurlhook_reconnect(URLContext *h, AVDictionary *extra)
         av_dict_copy(&inner_options, extra, 0);
 
     ret = ffurl_open_whitelist(&new_url,
-                               c->app_io_ctrl.url,
+                               url,
                                c->inner_flags,
                                &h->interrupt_callback,
                                &inner_options,
@@ -112,22 +196,19 @@ static int ijkurlhook_reconnect(URLContext *h, AVDictionary *extra)
     if (ret)
         goto fail;
 
-    ffurl_closep(&c->inner);
-
-    c->inner        = new_url;
-    h->is_streamed  = c->inner->is_streamed;
-    c->logical_pos  = ffurl_seek(c->inner, 0, SEEK_CUR);
-    if (c->inner->is_streamed)
-        c->logical_size = -1;
-    else
-        c->logical_size = ffurl_seek(c->inner, 0, AVSEEK_SIZE);
-
-    c->io_error = 0;
+    ijkurlhook_attach(h, new_url);
 fail:
     av_dict_free(&inner_options);
     return ret;
 }
 
+static int ijkurlhook_reconnect(URLContext *h, AVDictionary *extra)
+{
+    Context *c = h->priv_data;
+
+    return ijkurlhook_reconnect_url(h, c->app_io_ctrl.url, extra);
+}
+
 static int ijkurlhook_init(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     Context *c = h->priv_data;
@@ -156,6 +237,54 @@ static int ijkurlhook_init(URLContext *h, const char *arg, int flags, AVDictiona
     return ret;
 }
 
+/*
+ * a warm connection from the pool, else open one to each cached address
+ * in turn, else to the host name, as tcp.c would
+ */
+static int ijktcphook_reconnect(URLContext *h)
+{
+    Context        *c = h->priv_data;
+    URLContext     *new_url = NULL;
+    IjkConnPoolAddr addrs[IJKCONNPOOL_ADDRS_MAX];
+    char            proto[16];
+    char            host[1024];
+    char            path[1024];
+    char            url[sizeof(c->app_io_ctrl.url)];
+    int             nb_addrs = 0;
+    int             port = -1;
+    int             ret  = AVERROR(EIO);
+    int             i;
+
+    av_url_split(proto, sizeof(proto), NULL, 0, host, sizeof(host), &port, path, sizeof(path), c->app_io_ctrl.url);
+    if (port <= 0)
+        return ijkurlhook_reconnect(h, NULL);
+
+    if (c->pool)
+        new_url = ijkconnpool_take(host, port);
+    if (new_url) {
+        new_url->interrupt_callback = h->interrupt_callback;
+        ijkurlhook_attach(h, new_url);
+        ret = 0;
+    } else {
+        if (c->dns_ttl > 0)
+            nb_addrs = ijkconnpool_resolve(host, addrs, IJKCONNPOOL_ADDRS_MAX, c->dns_ttl);
+        for (i = 0; i < nb_addrs; i++) {
+            ff_url_join(url, sizeof(url), proto, NULL, addrs[i], port, "%s", path);
+            ret = ijkurlhook_reconnect_url(h, url, NULL);
+            if (!ret || ret == AVERROR_EXIT)
+                break;
+            av_log(h, AV_LOG_WARNING, "reconnect %s failed: %s\n", addrs[i], av_err2str(ret));
+        }
+        if (ret && ret != AVERROR_EXIT)
+            ret = ijkurlhook_reconnect(h, NULL);
+    }
+
+    /* the next segment or reconnect most likely goes to the same host */
+    if (!ret && c->pool_prepare)
+        ijkconnpool_prepare(host, port, c->inner_options, c->dns_ttl);
+    return ret;
+}
+
 static int ijktcphook_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     Context *c = h->priv_data;
@@ -168,7 +297,7 @@ static int ijktcphook_open(URLContext *h, const char *arg, int flags, AVDictiona
     if (ret)
         goto fail;
 
-    ret = ijkurlhook_reconnect(h, NULL);
+    ret = ijktcphook_reconnect(h);
     if (ret)
         goto fail;
 
@@ -176,10 +305,404 @@ fail:
     return ret;
 }
 
+static void call_inject_statistic(URLContext *h)
+{
+    Context *c = h->priv_data;
+    AVAppAsyncStatistic statistic = {0};
+    RangeSlot *slot;
+    int64_t    end;
+    int        i;
+
+    if (!c->app_ctx)
+        return;
+
+    statistic.size = sizeof(statistic);
+    pthread_mutex_lock(&c->range_mutex);
+    for (i = 0; i < c->nb_slots; i++) {
+        slot = &c->slots[i];
+        if (slot->state != RANGE_FETCHING && slot->state != RANGE_DONE)
+            continue;
+        end = slot->start + slot->filled;
+        if (end > c->logical_pos)
+            statistic.buf_forwards += end - FFMAX(slot->start, c->logical_pos);
+    }
+    pthread_mutex_unlock(&c->range_mutex);
+    statistic.buf_capacity = (int64_t)c->nb_slots * c->range_size;
+    av_application_on_async_statistic(c->app_ctx, &statistic);
+}
+
+/* the link as a whole: one event for the bytes of every connection */
+static void call_inject_range_speed(URLContext *h, int is_full_speed, int64_t bytes, int64_t elapsed_micro)
+{
+    Context *c = h->priv_data;
+    int64_t elapsed_milli = elapsed_micro / 1000;
+
+    if (c->app_ctx && bytes > 0 && elapsed_milli > 0) {
+        AVAppAsyncReadSpeed speed = {0};
+        speed.size = sizeof(speed);
+        speed.is_full_speed = is_full_speed;
+        speed.io_bytes      = bytes;
+        speed.elapsed_milli = elapsed_milli;
+        av_application_on_async_read_speed(c->app_ctx, &speed);
+    }
+}
+
+static int range_check_interrupt(void *arg)
+{
+    RangeWorker *w = arg;
+    Context     *c = w->h->priv_data;
+
+    if (c->range_abort || (w->slot && w->slot->state == RANGE_CANCELLED))
+        return 1;
+
+    return ff_check_interrupt(&w->h->interrupt_callback);
+}
+
+static int range_fetch(RangeWorker *w, RangeSlot *slot)
+{
+    URLContext     *h     = w->h;
+    Context        *c     = h->priv_data;
+    URLContext     *inner = NULL;
+    AVDictionary   *inner_options = NULL;
+    AVIOInterruptCB interrupt_callback = {range_check_interrupt, w};
+    char            url[sizeof(c->range_url)];
+    int             filled = 0;
+    int             ret    = 0;
+
+    pthread_mutex_lock(&c->range_mutex);
+    av_strlcpy(url, c->range_url, sizeof(url));
+    /* the connection opened to probe the size is already at the first range */
+    if (c->range_first && ffurl_seek(c->range_first, 0, SEEK_CUR) == slot->start) {
+        inner = c->range_first;
+        c->range_first = NULL;
+    }
+    pthread_mutex_unlock(&c->range_mutex);
+
+    /* opened with the callback of h, cancel it with its slot like the others */
+    if (inner)
+        inner->interrupt_callback = interrupt_callback;
+
+    if (!inner) {
+        av_dict_copy(&inner_options, c->inner_options, 0);
+        av_dict_set_int(&inner_options, "offset", slot->start, 0);
+        av_dict_set_int(&inner_options, "end_offset", slot->start + slot->size, 0);
+        ret = ffurl_open_whitelist(&inner,
+                                   url,
+                                   c->inner_flags,
+                                   &interrupt_callback,
+                                   &inner_options,
+                                   h->protocol_whitelist,
+                                   h->protocol_blacklist,
+                                   h);
+        av_dict_free(&inner_options);
+        if (ret < 0)
+            return ret;
+    }
+
+    while (filled < slot->size) {
+        ret = ffurl_read(inner, slot->data + filled, slot->size - filled);
+        if (ret == 0)
+            ret = AVERROR_EOF;
+        if (ret < 0)
+            break;
+
+        filled += ret;
+        pthread_mutex_lock(&c->range_mutex);
+        slot->filled    = filled;
+        c->speed_bytes += ret;
+        pthread_cond_signal(&c->range_cond_main);
+        pthread_mutex_unlock(&c->range_mutex);
+    }
+
+    ffurl_closep(&inner);
+    return filled < slot->size ? ret : 0;
+}
+
+static void *range_worker_thread(void *arg)
+{
+    RangeWorker *w = arg;
+    Context     *c = w->h->priv_data;
+    RangeSlot   *slot;
+    int64_t      start_time;
+    int64_t      elapsed;
+    int          i;
+    int          ret;
+
+    pthread_mutex_lock(&c->range_mutex);
+    while (!c->range_abort) {
+        slot = NULL;
+        if (c->range_next < c->logical_size) {
+            for (i = 0; i < c->nb_slots; i++) {
+                if (c->slots[i].state == RANGE_IDLE) {
+                    slot = &c->slots[i];
+                    break;
+                }
+            }
+        }
+        if (!slot) {
+            c->speed_throttled = 1;
+            pthread_cond_wait(&c->range_cond_worker, &c->range_mutex);
+            continue;
+        }
+
+        slot->state    = RANGE_FETCHING;
+        slot->start    = c->range_next;
+        slot->size     = (int)FFMIN(c->range_size, c->logical_size - c->range_next);
+        slot->filled   = 0;
+        slot->error    = 0;
+        c->range_next += slot->size;
+        w->slot        = slot;
+        pthread_mutex_unlock(&c->range_mutex);
+
+        start_time = av_gettime_relative();
+        ret = range_fetch(w, slot);
+        elapsed = av_gettime_relative() - start_time;
+        av_log(w->h, AV_LOG_DEBUG, "connection %d: %d bytes in %"PRId64" ms\n", w->index, slot->filled, elapsed / 1000);
+
+        pthread_mutex_lock(&c->range_mutex);
+        w->slot = NULL;
+        w->ranges++;
+        w->bytes         += slot->filled;
+        w->elapsed_micro += elapsed;
+        if (slot->state == RANGE_CANCELLED) {
+            slot->state = RANGE_IDLE;
+            pthread_cond_broadcast(&c->range_cond_worker);
+        } else {
+            slot->state = RANGE_DONE;
+            slot->error = ret;
+            pthread_cond_signal(&c->range_cond_main);
+        }
+    }
+    pthread_mutex_unlock(&c->range_mutex);
+
+    return NULL;
+}
+
+/* the slot the reader is in, or will be once the worker gets there */
+static RangeSlot *range_find(Context *c, int64_t pos)
+{
+    RangeSlot *slot;
+    int        i;
+
+    for (i = 0; i < c->nb_slots; i++) {
+        slot = &c->slots[i];
+        if (slot->state != RANGE_FETCHING && slot->state != RANGE_DONE)
+            continue;
+        if (pos >= slot->start && pos < slot->start + slot->size)
+            return slot;
+    }
+    return NULL;
+}
+
+static void range_release(Context *c, RangeSlot *slot)
+{
+    slot->state = slot->state == RANGE_FETCHING ? RANGE_CANCELLED : RANGE_IDLE;
+    pthread_cond_broadcast(&c->range_cond_worker);
+}
+
+/* drop every range and schedule from pos, also picks up a changed url */
+static void range_reset(URLContext *h, int64_t pos)
+{
+    Context *c = h->priv_data;
+    int      i;
+
+    pthread_mutex_lock(&c->range_mutex);
+    for (i = 0; i < c->nb_slots; i++) {
+        if (c->slots[i].state == RANGE_FETCHING || c->slots[i].state == RANGE_DONE)
+            range_release(c, &c->slots[i]);
+    }
+    c->range_next = pos;
+    c->speed_throttled = 1;
+    av_strlcpy(c->range_url, c->app_io_ctrl.url, sizeof(c->range_url));
+    ffurl_closep(&c->range_first);
+    pthread_mutex_unlock(&c->range_mutex);
+
+    c->logical_pos = pos;
+    c->io_error    = 0;
+}
+
+/* keep the window when pos is inside it, only the ranges behind pos go */
+static void range_seek(URLContext *h, int64_t pos)
+{
+    Context   *c = h->priv_data;
+    RangeSlot *slot;
+    int        i;
+
+    pthread_mutex_lock(&c->range_mutex);
+    slot = range_find(c, pos);
+    if (!slot || (slot->state == RANGE_DONE && slot->error < 0)) {
+        pthread_mutex_unlock(&c->range_mutex);
+        range_reset(h, pos);
+        return;
+    }
+    for (i = 0; i < c->nb_slots; i++) {
+        slot = &c->slots[i];
+        if ((slot->state == RANGE_FETCHING || slot->state == RANGE_DONE) && slot->start + slot->size <= pos)
+            range_release(c, slot);
+    }
+    pthread_mutex_unlock(&c->range_mutex);
+
+    c->logical_pos = pos;
+    c->io_error    = 0;
+}
+
+static int range_read(URLContext *h, unsigned char *buf, int size)
+{
+    Context   *c = h->priv_data;
+    RangeSlot *slot;
+    int64_t    now;
+    int64_t    speed_bytes = 0;
+    int64_t    speed_elapsed = 0;
+    int        speed_full = 0;
+    int        offset;
+    int        ret = 0;
+
+    pthread_mutex_lock(&c->range_mutex);
+    while (1) {
+        if (ff_check_interrupt(&h->interrupt_callback)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        if (c->logical_pos >= c->logical_size) {
+            ret = AVERROR_EOF;
+            break;
+        }
+
+        slot = range_find(c, c->logical_pos);
+        if (slot) {
+            offset = (int)(c->logical_pos - slot->start);
+            if (offset < slot->filled) {
+                /* the worker never touches filled bytes, copy without the lock */
+                ret = FFMIN(size, slot->filled - offset);
+                pthread_mutex_unlock(&c->range_mutex);
+                memcpy(buf, slot->data + offset, ret);
+                pthread_mutex_lock(&c->range_mutex);
+                if (offset + ret >= slot->size)
+                    range_release(c, slot);
+                break;
+            } else if (slot->state == RANGE_DONE) {
+                ret = slot->error < 0 ? slot->error : AVERROR(EIO);
+                break;
+            }
+        }
+        pthread_cond_wait(&c->range_cond_main, &c->range_mutex);
+    }
+    /* as often as ijkasync reports its single connection */
+    if (c->speed_bytes > FFMIN(1 * 1024 * 1024, (int64_t)c->nb_slots * c->range_size)) {
+        now                 = av_gettime_relative();
+        speed_bytes         = c->speed_bytes;
+        speed_elapsed       = now - c->speed_start_time;
+        speed_full          = !c->speed_throttled;
+        c->speed_bytes      = 0;
+        c->speed_start_time = now;
+        c->speed_throttled  = 0;
+    }
+    pthread_mutex_unlock(&c->range_mutex);
+
+    if (speed_bytes > 0)
+        call_inject_range_speed(h, speed_full, speed_bytes, speed_elapsed);
+    return ret;
+}
+
+static void range_stop(URLContext *h)
+{
+    Context     *c = h->priv_data;
+    RangeWorker *w;
+    int          i;
+
+    if (!c->parallel)
+        return;
+
+    pthread_mutex_lock(&c->range_mutex);
+    c->range_abort = 1;
+    pthread_cond_broadcast(&c->range_cond_worker);
+    pthread_mutex_unlock(&c->range_mutex);
+
+    for (i = 0; i < c->nb_workers; i++) {
+        w = &c->workers[i];
+        pthread_join(w->thread, NULL);
+        av_log(h, AV_LOG_INFO, "connection %d: %d ranges, %"PRId64" bytes, %"PRId64" KB/s\n",
+               i, w->ranges, w->bytes, w->elapsed_micro > 0 ? w->bytes * 1000 / 1024 * 1000 / w->elapsed_micro : 0);
+    }
+
+    ffurl_closep(&c->range_first);
+    av_freep(&c->slots[0].data);
+    pthread_cond_destroy(&c->range_cond_worker);
+    pthread_cond_destroy(&c->range_cond_main);
+    pthread_mutex_destroy(&c->range_mutex);
+    c->nb_workers = 0;
+    c->parallel   = 0;
+}
+
+/* takes over c->inner as the first range, falls back to serial reads on failure */
+static int range_start(URLContext *h)
+{
+    Context *c = h->priv_data;
+    uint8_t *data;
+    int      i;
+    int      ret;
+
+    c->nb_slots = FFMIN(c->connections * 2, RANGE_SLOTS_MAX);
+    data = av_malloc((size_t)c->nb_slots * c->range_size);
+    if (!data)
+        return AVERROR(ENOMEM);
+    for (i = 0; i < c->nb_slots; i++)
+        c->slots[i].data = data + (size_t)i * c->range_size;
+
+    ret = pthread_mutex_init(&c->range_mutex, NULL);
+    if (ret)
+        goto mutex_fail;
+    ret = pthread_cond_init(&c->range_cond_main, NULL);
+    if (ret)
+        goto cond_main_fail;
+    ret = pthread_cond_init(&c->range_cond_worker, NULL);
+    if (ret)
+        goto cond_worker_fail;
+
+    av_strlcpy(c->range_url, c->app_io_ctrl.url, sizeof(c->range_url));
+    c->range_next  = c->logical_pos;
+    c->range_first = c->inner;
+    c->inner       = NULL;
+    c->parallel    = 1;
+    c->speed_bytes      = 0;
+    c->speed_start_time = av_gettime_relative();
+    c->speed_throttled  = 0;
+
+    for (i = 0; i < c->connections; i++) {
+        c->workers[i].h     = h;
+        c->workers[i].index = i;
+        ret = pthread_create(&c->workers[i].thread, NULL, range_worker_thread, &c->workers[i]);
+        if (ret)
+            break;
+        c->nb_workers++;
+    }
+    if (c->nb_workers == 0) {
+        c->inner       = c->range_first;
+        c->range_first = NULL;
+        c->parallel    = 0;
+        goto thread_fail;
+    }
+
+    av_log(h, AV_LOG_INFO, "%d connections, %d bytes per range\n", c->nb_workers, c->range_size);
+    return 0;
+
+thread_fail:
+    pthread_cond_destroy(&c->range_cond_worker);
+cond_worker_fail:
+    pthread_cond_destroy(&c->range_cond_main);
+cond_main_fail:
+    pthread_mutex_destroy(&c->range_mutex);
+mutex_fail:
+    av_freep(&c->slots[0].data);
+    c->nb_slots = 0;
+    return AVERROR(ret);
+}
+
 static int ijkurlhook_close(URLContext *h)
 {
     Context *c = h->priv_data;
 
+    range_stop(h);
     av_dict_free(&c->inner_options);
     return ffurl_closep(&c->inner);
 }
@@ -198,7 +721,10 @@ static int ijkurlhook_read(URLContext *h, unsigned char *buf, int size)
         return AVERROR(EIO);
     }
 
-    ret = ffurl_read(c->inner, buf, size);
+    if (c->parallel)
+        ret = range_read(h, buf, size);
+    else
+        ret = ffurl_read(c->inner, buf, size);
     if (ret > 0)
         c->logical_pos += ret;
     else
@@ -211,6 +737,9 @@ static int ijkurlhook_write(URLContext *h, const unsigned char *buf, int size)
 {
     Context *c = h->priv_data;
 
+    if (!c->inner)
+        return AVERROR(ENOSYS);
+
     return ffurl_write(c->inner, buf, size);
 }
 
@@ -235,9 +764,15 @@ static int64_t ijkurlhook_seek(URLContext *h, int64_t pos, int whence)
 
 static int ijkhttphook_reconnect_at(URLContext *h, int64_t offset)
 {
+    Context      *c          = h->priv_data;
     int           ret        = 0;
     AVDictionary *extra_opts = NULL;
 
+    if (c->parallel) {
+        range_reset(h, offset);
+        return 0;
+    }
+
     av_dict_set_int(&extra_opts, "offset", offset, 0);
     ret = ijkurlhook_reconnect(h, extra_opts);
     av_dict_free(&extra_opts);
@@ -290,6 +825,11 @@ static int ijkhttphook_open(URLContext *h, const char *arg, int flags, AVDiction
             c->app_io_ctrl.retry_counter++;
     }
 
+    if (c->connections > 1 && !h->is_streamed && c->logical_size > 0) {
+        if (range_start(h))
+            av_log(h, AV_LOG_WARNING, "parallel range fetching disabled\n");
+    }
+
 fail:
     return ret;
 }
@@ -329,6 +869,8 @@ fail:
     if (ret <= 0) {
         c->io_error = ret;
     }
+    if (c->parallel)
+        call_inject_statistic(h);
     return ret;
 }
 
@@ -337,7 +879,7 @@ static int64_t ijkhttphook_reseek_at(URLContext *h, int64_t pos, int whence, int
     Context *c = h->priv_data;
     int ret = 0;
 
-    if (!force_reconnect)
+    if (!force_reconnect && !c->parallel)
         return ijkurlhook_seek(h, pos, whence);
 
     if (whence == SEEK_CUR)
@@ -349,6 +891,13 @@ static int64_t ijkhttphook_reseek_at(URLContext *h, int64_t pos, int whence, int
     if (pos < 0)
         return AVERROR(EINVAL);
 
+    if (c->parallel && !force_reconnect) {
+        if (pos > c->logical_size)
+            return AVERROR_EOF;
+        range_seek(h, pos);
+        return c->logical_pos;
+    }
+
     ret = ijkhttphook_reconnect_at(h, pos);
     if (ret) {
         c->io_error = ret;
@@ -418,6 +967,12 @@ static const AVOption ijktcphook_options[] = {
     { "ijktcphook-test-fail-point",     "test fail point, in bytes",
         OFFSET(test_fail_point),        AV_OPT_TYPE_INT,   {.i64 = 0}, 0,         INT_MAX, D },
     { "ijkapplication", "AVApplicationContext", OFFSET(app_ctx_intptr), AV_OPT_TYPE_INT64, { .i64 = 0 }, INT64_MIN, INT64_MAX, .flags = D },
+    { "ijktcphook-dns-ttl",             "seconds a resolved address is shared, 0 to resolve every open",
+        OFFSET(dns_ttl),                AV_OPT_TYPE_INT,   {.i64 = IJKCONNPOOL_DNS_TTL_DEFAULT}, 0, INT_MAX, D },
+    { "ijktcphook-pool",                "take warm connections from the process wide pool",
+        OFFSET(pool),                   AV_OPT_TYPE_INT,   {.i64 = 1}, 0,         1, D },
+    { "ijktcphook-pool-prepare",        "open a spare connection to the same host for the next open",
+        OFFSET(pool_prepare),           AV_OPT_TYPE_INT,   {.i64 = 0}, 0,         1, D },
 
     { NULL }
 };
@@ -428,6 +983,10 @@ static const AVOption ijkhttphook_options[] = {
     { "ijkhttphook-test-fail-point",    "test fail point, in bytes",
         OFFSET(test_fail_point),        AV_OPT_TYPE_INT,   {.i64 = 0}, 0,         INT_MAX, D },
     { "ijkapplication", "AVApplicationContext", OFFSET(app_ctx_intptr), AV_OPT_TYPE_INT64, { .i64 = 0 }, INT64_MIN, INT64_MAX, .flags = D },
+    { "ijkhttphook-connections",        "concurrent range requests, 1 reads over one connection",
+        OFFSET(connections),            AV_OPT_TYPE_INT,   {.i64 = 1}, 1,         RANGE_CONNECTIONS_MAX, D },
+    { "ijkhttphook-range-size",         "bytes per range request",
+        OFFSET(range_size),             AV_OPT_TYPE_INT,   {.i64 = RANGE_SIZE_DEFAULT}, 64 * 1024, 16 * 1024 * 1024, D },
 
     { NULL }
 };
@@ -469,3 +1028,192 @@ URLProtocol ijkimp_ff_ijkhttphook_protocol = {
     .priv_data_size      = sizeof(Context),
     .priv_data_class     = &ijkhttphook_context_class,
 };
+
+#if 0
+
+/*
+ * loopback stand-in for an http server with range support, byte n of the
+ * resource is (n & 0xFF) and every connection is throttled, so the parallel
+ * mode shows up in the cold start and throughput numbers
+ */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_RESOURCE_SIZE      (16 * 1024 * 1024)
+#define TEST_CONNECTION_RATE    (2 * 1024 * 1024)
+#define TEST_COLD_START_SIZE    (512 * 1024)
+#define TEST_SEEK_POS           (5 * 1024 * 1024 + 17)
+
+static void *test_server_connection(void *arg)
+{
+    int      fd    = (int)(intptr_t)arg;
+    int64_t  start = 0;
+    int64_t  end   = TEST_RESOURCE_SIZE - 1;
+    int64_t  pos;
+    char     request[4096];
+    char     header[512];
+    uint8_t  body[16 * 1024];
+    char    *range;
+    int      len = 0;
+    int      ret;
+    int      i;
+
+    while (len < sizeof(request) - 1) {
+        ret = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (ret <= 0)
+            goto end;
+        len += ret;
+        request[len] = 0;
+        if (strstr(request, "\r\n\r\n"))
+            break;
+    }
+
+    range = av_stristr(request, "\nRange: bytes=");
+    if (range)
+        sscanf(range + strlen("\nRange: bytes="), "%"SCNd64"-%"SCNd64, &start, &end);
+    end = FFMIN(end, TEST_RESOURCE_SIZE - 1);
+
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 206 Partial Content\r\n"
+             "Content-Length: %"PRId64"\r\n"
+             "Content-Range: bytes %"PRId64"-%"PRId64"/%d\r\n"
+             "Accept-Ranges: bytes\r\n"
+             "Connection: close\r\n\r\n",
+             end + 1 - start, start, end, TEST_RESOURCE_SIZE);
+    if (send(fd, header, strlen(header), MSG_NOSIGNAL) < 0)
+        goto end;
+
+    for (pos = start; pos <= end; pos += len) {
+        len = (int)FFMIN(sizeof(body), end + 1 - pos);
+        for (i = 0; i < len; i++)
+            body[i] = (pos + i) & 0xFF;
+        if (send(fd, body, len, MSG_NOSIGNAL) < 0)
+            break;
+        av_usleep(len * 1000000LL / TEST_CONNECTION_RATE);
+    }
+
+end:
+    close(fd);
+    return NULL;
+}
+
+static void *test_server(void *arg)
+{
+    int       listen_fd = (int)(intptr_t)arg;
+    int       fd;
+    pthread_t thread;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+        pthread_create(&thread, NULL, test_server_connection, (void *)(intptr_t)fd);
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static int test_check(unsigned char *buf, int size, int64_t pos)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        if (buf[i] != ((pos + i) & 0xFF)) {
+            printf("read-mismatch: actual %d, expecting %d, at %"PRId64"\n",
+                   (int)buf[i], (int)((pos + i) & 0xFF), pos + i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int test_read(URLContext *h, int64_t pos, int64_t size)
+{
+    unsigned char buf[32768];
+    int64_t       read_len = 0;
+    int           ret;
+
+    while (read_len < size) {
+        ret = ffurl_read(h, buf, (int)FFMIN(sizeof(buf), size - read_len));
+        if (ret <= 0) {
+            printf("read-error: %d at %"PRId64"\n", ret, pos + read_len);
+            return -1;
+        }
+        if (test_check(buf, ret, pos + read_len))
+            return -1;
+        read_len += ret;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    URLContext        *h = NULL;
+    AVDictionary      *opts = NULL;
+    struct sockaddr_in addr = {0};
+    socklen_t          addr_len = sizeof(addr);
+    pthread_t          server;
+    char               url[256];
+    int                connections[] = {1, 4};
+    int                listen_fd;
+    int                i;
+    int                ret;
+    int64_t            start_time;
+    int64_t            cold_start;
+    int64_t            elapsed;
+
+    ffurl_register_protocol(&ijkimp_ff_ijkhttphook_protocol);
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(listen_fd, 16) ||
+        getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len)) {
+        printf("listen failed\n");
+        return 1;
+    }
+    pthread_create(&server, NULL, test_server, (void *)(intptr_t)listen_fd);
+    snprintf(url, sizeof(url), "ijkhttphook:http://127.0.0.1:%d/test.bin", ntohs(addr.sin_port));
+
+    for (i = 0; i < FF_ARRAY_ELEMS(connections); i++) {
+        av_dict_set_int(&opts, "ijkhttphook-connections", connections[i], 0);
+
+        /*
+         * test ordered read, cold start is the time to the first bytes a demuxer probes
+         */
+        start_time = av_gettime_relative();
+        ret = ffurl_open(&h, url, AVIO_FLAG_READ, NULL, &opts);
+        printf("open: %d, size: %"PRId64"\n", ret, ffurl_size(h));
+        if (ret < 0 || test_read(h, 0, TEST_COLD_START_SIZE))
+            goto fail;
+        cold_start = av_gettime_relative() - start_time;
+        if (test_read(h, TEST_COLD_START_SIZE, TEST_RESOURCE_SIZE - TEST_COLD_START_SIZE))
+            goto fail;
+        elapsed = av_gettime_relative() - start_time;
+        printf("connections %d: cold start %"PRId64" ms, %d bytes in %"PRId64" ms, %.1f MB/s\n",
+               connections[i], cold_start / 1000, TEST_RESOURCE_SIZE, elapsed / 1000,
+               TEST_RESOURCE_SIZE / (elapsed / 1000000.0) / (1024 * 1024));
+
+        /*
+         * test seek forward, then back behind the window
+         */
+        printf("seek: %"PRId64"\n", ffurl_seek(h, TEST_SEEK_POS, SEEK_SET));
+        if (test_read(h, TEST_SEEK_POS, 1024 * 1024))
+            goto fail;
+        printf("seek: %"PRId64"\n", ffurl_seek(h, 100, SEEK_SET));
+        if (test_read(h, 100, 1024 * 1024))
+            goto fail;
+
+        ffurl_closep(&h);
+    }
+
+    printf("ok\n");
+    av_dict_free(&opts);
+    return 0;
+
+fail:
+    ffurl_closep(&h);
+    av_dict_free(&opts);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * hash.h
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFPLAY__IJKHASH_H
+#define FFPLAY__IJKHASH_H
+
+#include <stdint.h>
+
+/* 64-bit FNV-1a, names cache files on disk: never change the result */
+static inline uint64_t ijk_hash_fnv1a64(const char *str)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#endif
@@ -225,6 +225,29 @@ int ijkmp_set_stream_selected(IjkMediaPlayer *mp, int stream, int selected)
     return ret;
 }
 
+int ijkmp_start_record(IjkMediaPlayer *mp, const char *filename)
+{
+    assert(mp);
+
+    MPTRACE("%s(%s)\n", __func__, filename);
+    pthread_mutex_lock(&mp->mutex);
+    int ret = ffp_start_record(mp->ffplayer, filename);
+    pthread_mutex_unlock(&mp->mutex);
+    MPTRACE("%s(%s)=%d\n", __func__, filename, ret);
+    return ret;
+}
+
+void ijkmp_stop_record(IjkMediaPlayer *mp)
+{
+    assert(mp);
+
+    MPTRACE("%s()\n", __func__);
+    pthread_mutex_lock(&mp->mutex);
+    ffp_stop_record(mp->ffplayer);
+    pthread_mutex_unlock(&mp->mutex);
+    MPTRACE("%s()=void\n", __func__);
+}
+
 float ijkmp_get_property_float(IjkMediaPlayer *mp, int id, float default_value)
 {
     assert(mp);
@@ -176,6 +176,9 @@ void            ijkmp_set_playback_volume(IjkMediaPlayer *mp, float rate);
 
 int             ijkmp_set_stream_selected(IjkMediaPlayer *mp, int stream, int selected);
 
+int             ijkmp_start_record(IjkMediaPlayer *mp, const char *filename);
+void            ijkmp_stop_record(IjkMediaPlayer *mp);
+
 float           ijkmp_get_property_float(IjkMediaPlayer *mp, int id, float default_value);
 void            ijkmp_set_property_float(IjkMediaPlayer *mp, int id, float value);
 int64_t         ijkmp_get_property_int64(IjkMediaPlayer *mp, int id, int64_t default_value);
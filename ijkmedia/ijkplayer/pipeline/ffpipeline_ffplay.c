@@ -23,6 +23,7 @@
 #include "ffpipeline_ffplay.h"
 #include "ffpipenode_ffplay_vdec.h"
 #include "../ff_ffplay.h"
+#include "ijksdl/dummy/ijksdl_aout_dummy.h"
 
 static SDL_Class g_pipeline_class = {
     .name = "ffpipeline_ffplay",
@@ -44,7 +45,7 @@ static IJKFF_Pipenode *func_open_video_decoder(IJKFF_Pipeline *pipeline, FFPlaye
 
 static SDL_Aout *func_open_audio_output(IJKFF_Pipeline *pipeline, FFPlayer *ffp)
 {
-    return NULL;
+    return SDL_AoutDummy_Create();
 }
 
 IJKFF_Pipeline *ffpipeline_create_from_ffplay(FFPlayer *ffp)
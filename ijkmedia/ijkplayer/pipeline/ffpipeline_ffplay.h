@@ -25,7 +25,7 @@
 
 #include "../ff_ffpipeline.h"
 
-// There is no default aout for ffplay.
-// IJKFF_Pipeline *ffpipeline_create_from_ffplay(FFPlayer *ffp);
+// Software decoding and a dummy aout, for headless runs.
+IJKFF_Pipeline *ffpipeline_create_from_ffplay(FFPlayer *ffp);
 
 #endif
@@ -6,72 +6,319 @@
 
 #include "ring_buffer.h"
 
-int ring_buffer_init(pcm_ring_buffer *prb, int nitem)
+int ring_buffer_init(pcm_ring_buffer *prb, size_t size)
 {
-	prb->nitem = 0;
-	prb->item_array = (item_data *)malloc(sizeof(item_data) * nitem);
-	if (!prb->item_array)
+	size_t pot = 1;
+
+	memset(prb, 0, sizeof(pcm_ring_buffer));
+	while (pot < size)
+	{
+		pot <<= 1;
+	}
+
+	prb->buffer = (uint8_t *)malloc(pot);
+	if (!prb->buffer)
 	{
 		return RB_ENOMEM;
 	}
-	memset(prb->item_array, 0, sizeof(item_data) * nitem);
-	prb->r_pos = 0;
-	prb->w_pos = 0;
-	prb->nitem = nitem;
+	prb->size = pot;
+	prb->mask = pot - 1;
 
 	return 0;
 }
 
 void ring_buffer_deinit(pcm_ring_buffer *prb)
 {
-	if (prb->nitem)
+	free(prb->buffer);
+	memset(prb, 0, sizeof(pcm_ring_buffer));
+}
+
+static size_t ring_buffer_span_at(pcm_ring_buffer *prb, size_t pos, size_t length, ring_buffer_span *span)
+{
+	size_t offset = pos & prb->mask;
+	size_t first = prb->size - offset;
+
+	if (first > length)
 	{
-		int i;
-		for (i=0; i<prb->nitem; i++)
+		first = length;
+	}
+
+	span->data[0] = prb->buffer + offset;
+	span->length[0] = first;
+	span->data[1] = prb->buffer;
+	span->length[1] = length - first;
+
+	return length;
+}
+
+size_t ring_buffer_write_reserve(pcm_ring_buffer *prb, size_t length, ring_buffer_span *span)
+{
+	/* acquire: the consumer is done with the bytes before r_pos */
+	size_t r_pos = __atomic_load_n(&prb->r_pos, __ATOMIC_ACQUIRE);
+	size_t space = prb->size - (prb->w_pos - r_pos);
+
+	if (length > space)
+	{
+		length = space;
+	}
+
+	return ring_buffer_span_at(prb, prb->w_pos, length, span);
+}
+
+void ring_buffer_write_commit(pcm_ring_buffer *prb, size_t length)
+{
+	/* release: the bytes written are visible before the new w_pos */
+	__atomic_store_n(&prb->w_pos, prb->w_pos + length, __ATOMIC_RELEASE);
+}
+
+size_t ring_buffer_read_reserve(pcm_ring_buffer *prb, size_t length, ring_buffer_span *span)
+{
+	size_t w_pos = __atomic_load_n(&prb->w_pos, __ATOMIC_ACQUIRE);
+	size_t available = w_pos - prb->r_pos;
+
+	if (length > available)
+	{
+		length = available;
+	}
+
+	return ring_buffer_span_at(prb, prb->r_pos, length, span);
+}
+
+void ring_buffer_read_commit(pcm_ring_buffer *prb, size_t length)
+{
+	__atomic_store_n(&prb->r_pos, prb->r_pos + length, __ATOMIC_RELEASE);
+}
+
+int ring_buffer_push(pcm_ring_buffer *prb, const void *buffer, size_t length)
+{
+	ring_buffer_span span;
+
+	if (ring_buffer_write_reserve(prb, length, &span) < length)
+	{
+		return RB_EFULL;
+	}
+
+	memcpy(span.data[0], buffer, span.length[0]);
+	memcpy(span.data[1], (const uint8_t *)buffer + span.length[0], span.length[1]);
+	ring_buffer_write_commit(prb, length);
+
+	return 0;
+}
+
+int ring_buffer_peek(pcm_ring_buffer *prb, void *buffer, size_t length)
+{
+	ring_buffer_span span;
+
+	if (ring_buffer_read_reserve(prb, length, &span) < length)
+	{
+		return RB_EAGAIN;
+	}
+
+	memcpy(buffer, span.data[0], span.length[0]);
+	memcpy((uint8_t *)buffer + span.length[0], span.data[1], span.length[1]);
+
+	return 0;
+}
+
+int ring_buffer_pop(pcm_ring_buffer *prb, void *buffer, size_t length)
+{
+	int ret = ring_buffer_peek(prb, buffer, length);
+
+	if (ret == 0)
+	{
+		ring_buffer_read_commit(prb, length);
+	}
+
+	return ret;
+}
+
+#ifdef RING_BUFFER_TEST
+
+/*
+ * stress test and throughput benchmark, runs anywhere with pthreads:
+ *   cc -O2 -DRING_BUFFER_TEST ring_buffer.c -lpthread && ./a.out
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define TEST_RING_SIZE		4096
+#define TEST_STRESS_BYTES	(64ULL * 1024 * 1024)
+#define TEST_BENCH_BYTES	(1ULL * 1024 * 1024 * 1024)
+#define TEST_FRAME_BYTES	320
+
+typedef struct {
+	pcm_ring_buffer ring;
+	unsigned long long total;
+	int random_sizes;
+	int failed;
+} test_context;
+
+static unsigned int test_rand(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 16) & 0x7fff;
+}
+
+/* the byte stream is a counter, every byte can be checked */
+static void *test_producer(void *arg)
+{
+	test_context *c = arg;
+	unsigned long long written = 0;
+	unsigned int seed = 1;
+	ring_buffer_span span;
+	size_t i, j, n;
+
+	while (written < c->total)
+	{
+		n = c->random_sizes ? 1 + test_rand(&seed) % 1024 : TEST_FRAME_BYTES;
+		if (n > c->total - written)
 		{
-			if (prb->item_array[i].buffer)
-			{
-				free(prb->item_array[i].buffer);
+			n = c->total - written;
+		}
 
-				prb->item_array[i].buffer = NULL;
-				prb->item_array[i].length = 0;
+		n = ring_buffer_write_reserve(&c->ring, n, &span);
+		if (n == 0)
+		{
+			sched_yield();
+			continue;
+		}
+		for (i = 0; i < 2; i++)
+		{
+			for (j = 0; j < span.length[i]; j++)
+			{
+				span.data[i][j] = (uint8_t)written++;
 			}
 		}
+		ring_buffer_write_commit(&c->ring, n);
+	}
+
+	return NULL;
+}
 
-		free(prb->item_array);
+static void *test_consumer(void *arg)
+{
+	test_context *c = arg;
+	unsigned long long read = 0;
+	unsigned int seed = 2;
+	ring_buffer_span span;
+	size_t i, j, n;
 
-		prb->r_pos = 0;
-		prb->w_pos = 0;
-		prb->nitem = 0;
+	while (read < c->total)
+	{
+		n = c->random_sizes ? 1 + test_rand(&seed) % 1024 : TEST_FRAME_BYTES;
+		n = ring_buffer_read_reserve(&c->ring, n, &span);
+		if (n == 0)
+		{
+			sched_yield();
+			continue;
+		}
+		for (i = 0; i < 2; i++)
+		{
+			for (j = 0; j < span.length[i]; j++)
+			{
+				if (span.data[i][j] != (uint8_t)read++)
+				{
+					c->failed = 1;
+					return NULL;
+				}
+			}
+		}
+		ring_buffer_read_commit(&c->ring, n);
 	}
+
+	return NULL;
 }
 
-int ring_buffer_push(pcm_ring_buffer *prb, char *buffer, int length, USC_Time_t ts)
+/* copy in and out in capture sized frames */
+static void *bench_producer(void *arg)
 {
-	if (ring_buffer_full(prb))
+	test_context *c = arg;
+	uint8_t frame[TEST_FRAME_BYTES] = {0};
+	unsigned long long written = 0;
+
+	while (written < c->total)
 	{
-		return RB_EFULL;
+		if (ring_buffer_push(&c->ring, frame, sizeof(frame)) == 0)
+		{
+			written += sizeof(frame);
+		}
+		else
+		{
+			sched_yield();
+		}
 	}
 
-	item_data *item = &prb->item_array[prb->w_pos];
+	return NULL;
+}
+
+static void *bench_consumer(void *arg)
+{
+	test_context *c = arg;
+	uint8_t frame[TEST_FRAME_BYTES];
+	unsigned long long read = 0;
 
-	if(!item->buffer)
+	while (read < c->total)
 	{
-		item->buffer = (char*)malloc(length);
-		if (!item->buffer)
+		if (ring_buffer_pop(&c->ring, frame, sizeof(frame)) == 0)
 		{
-			return RB_ENOMEM;
+			read += sizeof(frame);
+		}
+		else
+		{
+			sched_yield();
 		}
-
-		item->length = length;
 	}
 
-	memcpy(item->buffer, buffer, length);
-	item->ts = ts;
+	return NULL;
+}
+
+static double test_run(test_context *c, void *(*producer)(void *), void *(*consumer)(void *))
+{
+	struct timespec start, end;
+	pthread_t p, q;
 
-	prb->w_pos = (prb->w_pos+1)%prb->nitem;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_create(&q, NULL, consumer, c);
+	pthread_create(&p, NULL, producer, c);
+	pthread_join(p, NULL);
+	pthread_join(q, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
 
-	return 0;
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
 }
 
+int main(void)
+{
+	test_context c;
+	double seconds;
+	int random_sizes;
+
+	for (random_sizes = 0; random_sizes <= 1; random_sizes++)
+	{
+		memset(&c, 0, sizeof(c));
+		ring_buffer_init(&c.ring, TEST_RING_SIZE);
+		c.total = TEST_STRESS_BYTES;
+		c.random_sizes = random_sizes;
+		seconds = test_run(&c, test_producer, test_consumer);
+		printf("stress %s: %s, %.2fs\n", random_sizes ? "random sizes" : "frames",
+		       c.failed ? "FAILED" : "ok", seconds);
+		ring_buffer_deinit(&c.ring);
+		if (c.failed)
+		{
+			return 1;
+		}
+	}
+
+	memset(&c, 0, sizeof(c));
+	ring_buffer_init(&c.ring, 64 * 1024);
+	c.total = TEST_BENCH_BYTES / TEST_FRAME_BYTES * TEST_FRAME_BYTES;
+	seconds = test_run(&c, bench_producer, bench_consumer);
+	printf("throughput: %.0f MB/s, %.1f M frames/s of %d bytes\n",
+	       c.total / seconds / (1024 * 1024), c.total / TEST_FRAME_BYTES / seconds / 1e6, TEST_FRAME_BYTES);
+	ring_buffer_deinit(&c.ring);
+
+	return 0;
+}
 
+#endif
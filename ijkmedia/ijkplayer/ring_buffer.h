@@ -1,68 +1,74 @@
-
-
 #ifndef MW_RING_BUFFER_H
 #define MW_RING_BUFFER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define RB_ERR_OK		0
+#define RB_EAGAIN		11
 #define RB_ENOMEM		12
 #define RB_EFULL		28
 
 typedef unsigned long long USC_Time_t;
 
+/*
+ * Lock-free byte ring for one producer and one consumer, e.g. the AudioUnit
+ * capture callback and the encoder thread. Storage is allocated once by
+ * ring_buffer_init(), nothing else allocates or blocks.
+ * r_pos and w_pos only grow and are each written by one side.
+ */
 typedef struct {
-	char *buffer;
-	int length;
-	USC_Time_t ts;
-} item_data;
+	uint8_t *buffer;
+	size_t size;		/* power of two */
+	size_t mask;
 
+	size_t r_pos;		/* consumer */
+	size_t w_pos;		/* producer */
+} pcm_ring_buffer;
 
+/* a reservation, wrapping around the end of the storage into data[1] */
 typedef struct {
-	int r_pos;
-	int w_pos;
-
-	int nitem;
-	item_data *item_array;
-}pcm_ring_buffer;
+	uint8_t *data[2];
+	size_t length[2];
+} ring_buffer_span;
 
 
-#define ring_buffer_empty(B) ((B)->r_pos == (B)->w_pos)
-#define ring_buffer_full(B) ( ((B)->w_pos+1)%(B)->nitem == (B)->r_pos)
-
-
-int ring_buffer_init(pcm_ring_buffer *prb, int nitem);
+int ring_buffer_init(pcm_ring_buffer *prb, size_t size);
 void ring_buffer_deinit(pcm_ring_buffer *prb);
 
-int ring_buffer_push(pcm_ring_buffer *prb, char *buffer, int length, USC_Time_t ts);
-
-static inline item_data * ring_buffer_peek(pcm_ring_buffer *prb)
+/* producer: reserve up to length bytes in place, then commit what was written */
+size_t ring_buffer_write_reserve(pcm_ring_buffer *prb, size_t length, ring_buffer_span *span);
+void ring_buffer_write_commit(pcm_ring_buffer *prb, size_t length);
+/* all or nothing, RB_EFULL if there is no room */
+int ring_buffer_push(pcm_ring_buffer *prb, const void *buffer, size_t length);
+
+/* consumer: reserve up to length bytes in place, then commit what was consumed */
+size_t ring_buffer_read_reserve(pcm_ring_buffer *prb, size_t length, ring_buffer_span *span);
+void ring_buffer_read_commit(pcm_ring_buffer *prb, size_t length);
+/* all or nothing, RB_EAGAIN if there is not enough data */
+int ring_buffer_peek(pcm_ring_buffer *prb, void *buffer, size_t length);
+int ring_buffer_pop(pcm_ring_buffer *prb, void *buffer, size_t length);
+
+/* bytes readable, exact for the consumer */
+static inline size_t ring_buffer_available(pcm_ring_buffer *prb)
 {
-	if (ring_buffer_empty(prb))
-	{
-		return NULL;
-	}
-
-	return (&prb->item_array[prb->r_pos]);
+	return __atomic_load_n(&prb->w_pos, __ATOMIC_ACQUIRE) - __atomic_load_n(&prb->r_pos, __ATOMIC_ACQUIRE);
 }
 
-static inline void ring_buffer_pop(pcm_ring_buffer *prb)
+/* bytes writable, exact for the producer */
+static inline size_t ring_buffer_space(pcm_ring_buffer *prb)
 {
-	prb->r_pos = (prb->r_pos+1)%prb->nitem;
+	return prb->size - ring_buffer_available(prb);
 }
 
+#define ring_buffer_empty(B) (ring_buffer_available(B) == 0)
+#define ring_buffer_full(B) (ring_buffer_space(B) == 0)
+
+/* only while neither side is running */
 static inline void ring_buffer_reset(pcm_ring_buffer *prb)
 {
 	prb->r_pos = 0;
 	prb->w_pos = 0;
 }
 
-static inline int ring_buffer_available(pcm_ring_buffer *prb)
-{
-	if (prb->w_pos>=prb->r_pos)
-	{
-		return prb->w_pos - prb->r_pos;
-	}
-
-	return prb->nitem + prb->w_pos - prb->r_pos;
-}
-
 #endif
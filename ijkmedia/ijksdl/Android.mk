@@ -50,6 +50,7 @@ LOCAL_SRC_FILES += gles2/fsh/yuv444p10le.fsh.c
 LOCAL_SRC_FILES += gles2/vsh/mvp.vsh.c
 
 LOCAL_SRC_FILES += dummy/ijksdl_vout_dummy.c
+LOCAL_SRC_FILES += dummy/ijksdl_aout_dummy.c
 
 LOCAL_SRC_FILES += ffmpeg/ijksdl_vout_overlay_ffmpeg.c
 LOCAL_SRC_FILES += ffmpeg/abi_all/image_convert.c
@@ -171,6 +171,9 @@ static int func_display_overlay_l(SDL_Vout *vout, SDL_VoutOverlay *overlay)
     }
     case SDL_FCC_RV24:
     case SDL_FCC_I420:
+    case SDL_FCC_I422:
+    case SDL_FCC_I420P10LE:
+    case SDL_FCC_I422P10LE:
     case SDL_FCC_I444P10LE: {
         // only GLES support
         if (opaque->egl)
@@ -0,0 +1,172 @@
+/*****************************************************************************
+ * ijksdl_aout_dummy.c
+ *****************************************************************************
+ *
+ *
+ * This file is part of ijkPlayer.
+ *
+ * ijkPlayer is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * ijkPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with ijkPlayer; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "ijksdl_aout_dummy.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "../ijksdl_inc_internal.h"
+#include "../ijksdl_thread.h"
+#include "../ijksdl_aout_internal.h"
+
+static SDL_Class g_dummy_class = {
+    .name = "DummyAout",
+};
+
+typedef struct SDL_Aout_Opaque {
+    SDL_cond *wakeup_cond;
+    SDL_mutex *wakeup_mutex;
+
+    SDL_AudioSpec spec;
+    uint8_t *buffer;
+
+    volatile bool pause_on;
+    volatile bool abort_request;
+
+    SDL_Thread *audio_tid;
+    SDL_Thread _audio_tid;
+} SDL_Aout_Opaque;
+
+/* the callback blocks on the decoded frame queue, no pacing is needed */
+static int aout_thread(void *arg)
+{
+    SDL_Aout *aout = arg;
+    SDL_Aout_Opaque *opaque = aout->opaque;
+    SDL_AudioCallback audio_cblk = opaque->spec.callback;
+    void *userdata = opaque->spec.userdata;
+
+    while (!opaque->abort_request) {
+        SDL_LockMutex(opaque->wakeup_mutex);
+        while (!opaque->abort_request && opaque->pause_on)
+            SDL_CondWaitTimeout(opaque->wakeup_cond, opaque->wakeup_mutex, 1000);
+        SDL_UnlockMutex(opaque->wakeup_mutex);
+
+        if (opaque->abort_request)
+            break;
+        audio_cblk(userdata, opaque->buffer, opaque->spec.size);
+    }
+
+    return 0;
+}
+
+static int aout_open_audio(SDL_Aout *aout, const SDL_AudioSpec *desired, SDL_AudioSpec *obtained)
+{
+    SDL_Aout_Opaque *opaque = aout->opaque;
+
+    opaque->spec = *desired;
+    SDL_CalculateAudioSpec(&opaque->spec);
+    if (obtained)
+        *obtained = opaque->spec;
+
+    opaque->buffer = malloc(opaque->spec.size);
+    if (!opaque->buffer) {
+        ALOGE("aout_open_audio: failed to allocate buffer");
+        return -1;
+    }
+
+    opaque->pause_on = 1;
+    opaque->abort_request = 0;
+    opaque->audio_tid = SDL_CreateThreadEx(&opaque->_audio_tid, aout_thread, aout, "ff_aout_dummy");
+    if (!opaque->audio_tid) {
+        ALOGE("aout_open_audio: failed to create audio thread");
+        free(opaque->buffer);
+        opaque->buffer = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void aout_pause_audio(SDL_Aout *aout, int pause_on)
+{
+    SDL_Aout_Opaque *opaque = aout->opaque;
+
+    SDL_LockMutex(opaque->wakeup_mutex);
+    opaque->pause_on = pause_on;
+    if (!pause_on)
+        SDL_CondSignal(opaque->wakeup_cond);
+    SDL_UnlockMutex(opaque->wakeup_mutex);
+}
+
+static void aout_flush_audio(SDL_Aout *aout)
+{
+    // nothing is buffered
+}
+
+static void aout_set_volume(SDL_Aout *aout, float left_volume, float right_volume)
+{
+    // nothing is played
+}
+
+static void aout_close_audio(SDL_Aout *aout)
+{
+    SDL_Aout_Opaque *opaque = aout->opaque;
+
+    SDL_LockMutex(opaque->wakeup_mutex);
+    opaque->abort_request = true;
+    SDL_CondSignal(opaque->wakeup_cond);
+    SDL_UnlockMutex(opaque->wakeup_mutex);
+
+    if (opaque->audio_tid)
+        SDL_WaitThread(opaque->audio_tid, NULL);
+
+    opaque->audio_tid = NULL;
+    free(opaque->buffer);
+    opaque->buffer = NULL;
+}
+
+static void aout_free_l(SDL_Aout *aout)
+{
+    if (!aout)
+        return;
+
+    SDL_Aout_Opaque *opaque = aout->opaque;
+    if (opaque) {
+        aout_close_audio(aout);
+
+        SDL_DestroyCond(opaque->wakeup_cond);
+        SDL_DestroyMutex(opaque->wakeup_mutex);
+    }
+
+    SDL_Aout_FreeInternal(aout);
+}
+
+SDL_Aout *SDL_AoutDummy_Create()
+{
+    SDL_Aout *aout = SDL_Aout_CreateInternal(sizeof(SDL_Aout_Opaque));
+    if (!aout)
+        return NULL;
+
+    SDL_Aout_Opaque *opaque = aout->opaque;
+    opaque->wakeup_cond  = SDL_CreateCond();
+    opaque->wakeup_mutex = SDL_CreateMutex();
+
+    aout->opaque_class = &g_dummy_class;
+    aout->free_l       = aout_free_l;
+    aout->open_audio   = aout_open_audio;
+    aout->pause_audio  = aout_pause_audio;
+    aout->flush_audio  = aout_flush_audio;
+    aout->set_volume   = aout_set_volume;
+    aout->close_audio  = aout_close_audio;
+
+    return aout;
+}
@@ -25,6 +25,7 @@
 
 #include "../ijksdl_vout.h"
 #include "../ijksdl_vout_internal.h"
+#include "../ffmpeg/ijksdl_vout_overlay_ffmpeg.h"
 
 typedef struct SDL_VoutSurface_Opaque {
     SDL_Vout *vout;
@@ -46,6 +47,15 @@ static void func_free_l(SDL_Vout *vout)
     SDL_Vout_FreeInternal(vout);
 }
 
+/* software overlays, so that frames still go through conversion */
+static SDL_VoutOverlay *func_create_overlay(int width, int height, int frame_format, SDL_Vout *vout)
+{
+    SDL_LockMutex(vout->mutex);
+    SDL_VoutOverlay *overlay = SDL_VoutFFmpeg_CreateOverlay(width, height, frame_format, vout);
+    SDL_UnlockMutex(vout->mutex);
+    return overlay;
+}
+
 static int func_display_overlay_l(SDL_Vout *vout, SDL_VoutOverlay *overlay)
 {
     return 0;
@@ -68,6 +78,7 @@ SDL_Vout *SDL_VoutDummy_Create()
     // SDL_Vout_Opaque *opaque = vout->opaque;
 
     vout->free_l = func_free_l;
+    vout->create_overlay = func_create_overlay;
     vout->display_overlay = func_display_overlay;
 
     return vout;
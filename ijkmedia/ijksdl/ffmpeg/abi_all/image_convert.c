@@ -21,11 +21,485 @@
  *****************************************************************************/
 
 #include "../ijksdl_image_convert.h"
+#include <string.h>
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "../../ijksdl_mutex.h"
+#include "../../ijksdl_thread.h"
 #if defined(__ANDROID__)
 #include "libyuv.h"
 #endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define IJK_IMAGE_CONVERT_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IJK_IMAGE_CONVERT_NEON 1
+#endif
 
-int ijk_image_convert(int width, int height,
+/*
+ * Built-in kernels, bit exact with each other whatever the instruction set:
+ *   YUV420P, NV12, NV21 -> RGB565, RGB24, 0BGR32 (BT.601 limited range)
+ *   NV12, NV21          -> YUV420P
+ *   YUV4xxP10LE         -> YUV4xxP
+ *
+ * Colour conversion works on 16 bit lanes with 6 fractional bits:
+ *   yy = ((y * 149) >> 1) - 1192          (y - 16) * 1.164 * 64
+ *   r  = (yy + 102 * v + 32) >> 6
+ *   g  = (yy - 25 * u - 52 * v + 32) >> 6
+ *   b  = (yy + 129 * u + 32) >> 6         u, v minus 128
+ * with saturating adds, as the simd kernels do, then clipped to 8 bits.
+ */
+#define YG      149
+#define YG_OFS  1192
+#define VR      102
+#define UG      25
+#define VG      52
+#define UB      129
+
+/* 16 pixels of a row to R, G, B, 255; u and v are 1 (planar) or 2 (interleaved) bytes apart per sample */
+typedef void (*YuvToRgbaRowFunc)(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *rgba, int width);
+typedef void (*SplitUVRowFunc)(const uint8_t *uv, uint8_t *u, uint8_t *v, int width);
+typedef void (*P10ToP8RowFunc)(const uint16_t *src, uint8_t *dst, int width);
+
+typedef struct ImageConvertKernels {
+    const char          *name;
+    YuvToRgbaRowFunc     yuv_to_rgba_row;
+    SplitUVRowFunc       split_uv_row;
+    P10ToP8RowFunc       p10_to_p8_row;
+} ImageConvertKernels;
+
+static inline int sat16(int v)
+{
+    return v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+}
+
+static inline uint8_t clip8(int v)
+{
+    return v > 255 ? 255 : (v < 0 ? 0 : v);
+}
+
+static inline void yuv_to_rgba_pixel(int y, int u, int v, uint8_t *rgba)
+{
+    int yy = ((y * YG) >> 1) - YG_OFS;
+
+    u -= 128;
+    v -= 128;
+    rgba[0] = clip8(sat16(sat16(yy + VR * v) + 32) >> 6);
+    rgba[1] = clip8(sat16(sat16(sat16(yy - UG * u) - VG * v) + 32) >> 6);
+    rgba[2] = clip8(sat16(sat16(yy + UB * u) + 32) >> 6);
+    rgba[3] = 255;
+}
+
+static void yuv_to_rgba_row_c(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *rgba, int width)
+{
+    for (int x = 0; x < width; x++)
+        yuv_to_rgba_pixel(y[x], u[(x >> 1) * uv_step], v[(x >> 1) * uv_step], rgba + x * 4);
+}
+
+static void split_uv_row_c(const uint8_t *uv, uint8_t *u, uint8_t *v, int width)
+{
+    for (int x = 0; x < width; x++) {
+        u[x] = uv[x * 2];
+        v[x] = uv[x * 2 + 1];
+    }
+}
+
+static void p10_to_p8_row_c(const uint16_t *src, uint8_t *dst, int width)
+{
+    for (int x = 0; x < width; x++)
+        dst[x] = clip8((src[x] + 2) >> 2);
+}
+
+static const ImageConvertKernels g_kernels_c = {
+    "c", yuv_to_rgba_row_c, split_uv_row_c, p10_to_p8_row_c,
+};
+
+#if IJK_IMAGE_CONVERT_X86
+#define X86_TARGET(isa) __attribute__((target(isa)))
+
+X86_TARGET("sse2")
+static inline void yuv_to_rgb8_sse2(__m128i y, __m128i u, __m128i v, __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i round = _mm_set1_epi16(32);
+    __m128i yy = _mm_sub_epi16(_mm_srli_epi16(_mm_mullo_epi16(y, _mm_set1_epi16(YG)), 1), _mm_set1_epi16(YG_OFS));
+
+    *r = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(v, _mm_set1_epi16(VR))), round), 6);
+    *g = _mm_srai_epi16(_mm_adds_epi16(_mm_subs_epi16(_mm_subs_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(UG))),
+                                                      _mm_mullo_epi16(v, _mm_set1_epi16(VG))), round), 6);
+    *b = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(u, _mm_set1_epi16(UB))), round), 6);
+}
+
+/* 8 chroma samples as 16 bit lanes, minus 128 */
+X86_TARGET("sse2")
+static inline void load_uv8_sse2(const uint8_t *u, const uint8_t *v, int uv_step, __m128i *uu, __m128i *vv)
+{
+    const __m128i bias = _mm_set1_epi16(128);
+
+    if (uv_step == 1) {
+        *uu = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)u), _mm_setzero_si128());
+        *vv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)v), _mm_setzero_si128());
+    } else {
+        __m128i c  = _mm_loadu_si128((const __m128i *)(u < v ? u : v));
+        __m128i lo = _mm_and_si128(c, _mm_set1_epi16(0xff));
+        __m128i hi = _mm_srli_epi16(c, 8);
+        *uu = u < v ? lo : hi;
+        *vv = u < v ? hi : lo;
+    }
+    *uu = _mm_sub_epi16(*uu, bias);
+    *vv = _mm_sub_epi16(*vv, bias);
+}
+
+X86_TARGET("sse2")
+static inline void store_rgba16_sse2(uint8_t *rgba, __m128i r, __m128i g, __m128i b)
+{
+    const __m128i a = _mm_set1_epi8((char)0xff);
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, a);
+    __m128i ba_hi = _mm_unpackhi_epi8(b, a);
+
+    _mm_storeu_si128((__m128i *)(rgba +  0), _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128((__m128i *)(rgba + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128((__m128i *)(rgba + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128((__m128i *)(rgba + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+}
+
+X86_TARGET("sse2")
+static void yuv_to_rgba_row_sse2(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *rgba, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i yv = _mm_loadu_si128((const __m128i *)(y + x));
+        __m128i uu, vv, r0, g0, b0, r1, g1, b1;
+
+        load_uv8_sse2(u + x / 2 * uv_step, v + x / 2 * uv_step, uv_step, &uu, &vv);
+        yuv_to_rgb8_sse2(_mm_unpacklo_epi8(yv, zero), _mm_unpacklo_epi16(uu, uu), _mm_unpacklo_epi16(vv, vv), &r0, &g0, &b0);
+        yuv_to_rgb8_sse2(_mm_unpackhi_epi8(yv, zero), _mm_unpackhi_epi16(uu, uu), _mm_unpackhi_epi16(vv, vv), &r1, &g1, &b1);
+        store_rgba16_sse2(rgba + x * 4, _mm_packus_epi16(r0, r1), _mm_packus_epi16(g0, g1), _mm_packus_epi16(b0, b1));
+    }
+    yuv_to_rgba_row_c(y + x, u + x / 2 * uv_step, v + x / 2 * uv_step, uv_step, rgba + x * 4, width - x);
+}
+
+X86_TARGET("sse2")
+static void split_uv_row_sse2(const uint8_t *uv, uint8_t *u, uint8_t *v, int width)
+{
+    const __m128i mask = _mm_set1_epi16(0xff);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i c0 = _mm_loadu_si128((const __m128i *)(uv + x * 2));
+        __m128i c1 = _mm_loadu_si128((const __m128i *)(uv + x * 2 + 16));
+
+        _mm_storeu_si128((__m128i *)(u + x), _mm_packus_epi16(_mm_and_si128(c0, mask), _mm_and_si128(c1, mask)));
+        _mm_storeu_si128((__m128i *)(v + x), _mm_packus_epi16(_mm_srli_epi16(c0, 8), _mm_srli_epi16(c1, 8)));
+    }
+    split_uv_row_c(uv + x * 2, u + x, v + x, width - x);
+}
+
+X86_TARGET("sse2")
+static void p10_to_p8_row_sse2(const uint16_t *src, uint8_t *dst, int width)
+{
+    const __m128i round = _mm_set1_epi16(2);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m128i s0 = _mm_srli_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i *)(src + x)), round), 2);
+        __m128i s1 = _mm_srli_epi16(_mm_adds_epu16(_mm_loadu_si128((const __m128i *)(src + x + 8)), round), 2);
+
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_packus_epi16(s0, s1));
+    }
+    p10_to_p8_row_c(src + x, dst + x, width - x);
+}
+
+static const ImageConvertKernels g_kernels_sse2 = {
+    "sse2", yuv_to_rgba_row_sse2, split_uv_row_sse2, p10_to_p8_row_sse2,
+};
+
+/* 16 pixels in one register of 16 bit lanes, then back to sse2 to interleave */
+X86_TARGET("avx2")
+static inline __m128i pack16_avx2(__m256i v)
+{
+    return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08));
+}
+
+X86_TARGET("avx2")
+static void yuv_to_rgba_row_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *rgba, int width)
+{
+    const __m256i round = _mm256_set1_epi16(32);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        __m256i yv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x)));
+        __m128i uu, vv;
+        __m256i u16, v16, yy, r, g, b;
+
+        load_uv8_sse2(u + x / 2 * uv_step, v + x / 2 * uv_step, uv_step, &uu, &vv);
+        u16 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(uu, uu)), _mm_unpackhi_epi16(uu, uu), 1);
+        v16 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(vv, vv)), _mm_unpackhi_epi16(vv, vv), 1);
+
+        yy = _mm256_sub_epi16(_mm256_srli_epi16(_mm256_mullo_epi16(yv, _mm256_set1_epi16(YG)), 1), _mm256_set1_epi16(YG_OFS));
+        r  = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(v16, _mm256_set1_epi16(VR))), round), 6);
+        g  = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_subs_epi16(_mm256_subs_epi16(yy, _mm256_mullo_epi16(u16, _mm256_set1_epi16(UG))),
+                                                                   _mm256_mullo_epi16(v16, _mm256_set1_epi16(VG))), round), 6);
+        b  = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(u16, _mm256_set1_epi16(UB))), round), 6);
+
+        store_rgba16_sse2(rgba + x * 4, pack16_avx2(r), pack16_avx2(g), pack16_avx2(b));
+    }
+    yuv_to_rgba_row_c(y + x, u + x / 2 * uv_step, v + x / 2 * uv_step, uv_step, rgba + x * 4, width - x);
+}
+
+/* splitting and narrowing are bound by memory, sse2 does */
+static const ImageConvertKernels g_kernels_avx2 = {
+    "avx2", yuv_to_rgba_row_avx2, split_uv_row_sse2, p10_to_p8_row_sse2,
+};
+#endif
+
+#if IJK_IMAGE_CONVERT_NEON
+static inline void yuv_to_rgb8_neon(uint8x8_t y, int16x8_t u, int16x8_t v, int16x8_t *r, int16x8_t *g, int16x8_t *b)
+{
+    const int16x8_t round = vdupq_n_s16(32);
+    int16x8_t yy = vsubq_s16(vreinterpretq_s16_u16(vshrq_n_u16(vmulq_n_u16(vmovl_u8(y), YG), 1)), vdupq_n_s16(YG_OFS));
+
+    *r = vshrq_n_s16(vqaddq_s16(vqaddq_s16(yy, vmulq_n_s16(v, VR)), round), 6);
+    *g = vshrq_n_s16(vqaddq_s16(vqsubq_s16(vqsubq_s16(yy, vmulq_n_s16(u, UG)), vmulq_n_s16(v, VG)), round), 6);
+    *b = vshrq_n_s16(vqaddq_s16(vqaddq_s16(yy, vmulq_n_s16(u, UB)), round), 6);
+}
+
+static void yuv_to_rgba_row_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, int uv_step, uint8_t *rgba, int width)
+{
+    const int16x8_t bias = vdupq_n_s16(128);
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t  yv = vld1q_u8(y + x);
+        uint8x16x4_t o;
+        int16x8x2_t uu, vv;
+        int16x8_t   u8, v8, r0, g0, b0, r1, g1, b1;
+
+        if (uv_step == 1) {
+            u8 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + x / 2)));
+            v8 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + x / 2)));
+        } else {
+            uint8x8x2_t c = vld2_u8((u < v ? u : v) + x);
+            u8 = vreinterpretq_s16_u16(vmovl_u8(u < v ? c.val[0] : c.val[1]));
+            v8 = vreinterpretq_s16_u16(vmovl_u8(u < v ? c.val[1] : c.val[0]));
+        }
+        uu = vzipq_s16(vsubq_s16(u8, bias), vsubq_s16(u8, bias));
+        vv = vzipq_s16(vsubq_s16(v8, bias), vsubq_s16(v8, bias));
+
+        yuv_to_rgb8_neon(vget_low_u8(yv),  uu.val[0], vv.val[0], &r0, &g0, &b0);
+        yuv_to_rgb8_neon(vget_high_u8(yv), uu.val[1], vv.val[1], &r1, &g1, &b1);
+
+        o.val[0] = vcombine_u8(vqmovun_s16(r0), vqmovun_s16(r1));
+        o.val[1] = vcombine_u8(vqmovun_s16(g0), vqmovun_s16(g1));
+        o.val[2] = vcombine_u8(vqmovun_s16(b0), vqmovun_s16(b1));
+        o.val[3] = vdupq_n_u8(255);
+        vst4q_u8(rgba + x * 4, o);
+    }
+    yuv_to_rgba_row_c(y + x, u + x / 2 * uv_step, v + x / 2 * uv_step, uv_step, rgba + x * 4, width - x);
+}
+
+static void split_uv_row_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x2_t c = vld2q_u8(uv + x * 2);
+
+        vst1q_u8(u + x, c.val[0]);
+        vst1q_u8(v + x, c.val[1]);
+    }
+    split_uv_row_c(uv + x * 2, u + x, v + x, width - x);
+}
+
+static void p10_to_p8_row_neon(const uint16_t *src, uint8_t *dst, int width)
+{
+    int x = 0;
+
+    for (; x + 16 <= width; x += 16)
+        vst1q_u8(dst + x, vcombine_u8(vqrshrn_n_u16(vld1q_u16(src + x), 2), vqrshrn_n_u16(vld1q_u16(src + x + 8), 2)));
+    p10_to_p8_row_c(src + x, dst + x, width - x);
+}
+
+static const ImageConvertKernels g_kernels_neon = {
+    "neon", yuv_to_rgba_row_neon, split_uv_row_neon, p10_to_p8_row_neon,
+};
+#endif
+
+static const ImageConvertKernels *image_convert_kernels(int cpu_flags)
+{
+#if IJK_IMAGE_CONVERT_X86
+    if (cpu_flags & AV_CPU_FLAG_AVX2)
+        return &g_kernels_avx2;
+    if (cpu_flags & AV_CPU_FLAG_SSE2)
+        return &g_kernels_sse2;
+#endif
+#if IJK_IMAGE_CONVERT_NEON
+    if (cpu_flags & AV_CPU_FLAG_NEON)
+        return &g_kernels_neon;
+#endif
+    return &g_kernels_c;
+}
+
+static void rgba_to_rgb24_row(const uint8_t *rgba, uint8_t *dst, int width)
+{
+    for (int x = 0; x < width; x++) {
+        dst[x * 3 + 0] = rgba[x * 4 + 0];
+        dst[x * 3 + 1] = rgba[x * 4 + 1];
+        dst[x * 3 + 2] = rgba[x * 4 + 2];
+    }
+}
+
+static void rgba_to_rgb565_row(const uint8_t *rgba, uint8_t *dst, int width)
+{
+    uint16_t *dst16 = (uint16_t *)dst;
+
+    for (int x = 0; x < width; x++)
+        dst16[x] = ((rgba[x * 4] >> 3) << 11) | ((rgba[x * 4 + 1] >> 2) << 5) | (rgba[x * 4 + 2] >> 3);
+}
+
+/* rows [slice_y, slice_y + slice_h) of the picture, slice_y even so that chroma rows split cleanly */
+static int convert_yuv_to_rgb(const ImageConvertKernels *k, int width, int slice_y, int slice_h,
+    enum AVPixelFormat dst_format, uint8_t **dst_data, int *dst_linesize,
+    enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize)
+{
+    void (*pack_row)(const uint8_t *rgba, uint8_t *dst, int width) = NULL;
+    uint8_t *rgba = NULL;
+    int      uv_step = 1;
+    int      u_offset = 0;
+    int      v_offset = 0;
+
+    switch (dst_format) {
+        case AV_PIX_FMT_0BGR32:     break;
+        case AV_PIX_FMT_RGB24:      pack_row = rgba_to_rgb24_row;  break;
+        case AV_PIX_FMT_RGB565:     pack_row = rgba_to_rgb565_row; break;
+        default:                    return -1;
+    }
+
+    if (src_format == AV_PIX_FMT_NV12 || src_format == AV_PIX_FMT_NV21) {
+        uv_step  = 2;
+        u_offset = src_format == AV_PIX_FMT_NV12 ? 0 : 1;
+        v_offset = 1 - u_offset;
+    }
+
+    if (pack_row) {
+        rgba = av_malloc(width * 4);
+        if (!rgba)
+            return -1;
+    }
+
+    for (int j = slice_y; j < slice_y + slice_h; j++) {
+        const uint8_t *y = src_data[0] + j * src_linesize[0];
+        const uint8_t *u = uv_step == 1 ? src_data[1] + (j >> 1) * src_linesize[1] : src_data[1] + (j >> 1) * src_linesize[1] + u_offset;
+        const uint8_t *v = uv_step == 1 ? src_data[2] + (j >> 1) * src_linesize[2] : src_data[1] + (j >> 1) * src_linesize[1] + v_offset;
+        uint8_t       *dst = dst_data[0] + j * dst_linesize[0];
+
+        if (pack_row) {
+            k->yuv_to_rgba_row(y, u, v, uv_step, rgba, width);
+            pack_row(rgba, dst, width);
+        } else {
+            k->yuv_to_rgba_row(y, u, v, uv_step, dst, width);
+        }
+    }
+
+    av_free(rgba);
+    return 0;
+}
+
+static int convert_nv_to_yuv420p(const ImageConvertKernels *k, int width, int slice_y, int slice_h,
+    uint8_t **dst_data, int *dst_linesize,
+    enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize)
+{
+    int chroma_width = (width + 1) >> 1;
+    int chroma_end   = (slice_y + slice_h + 1) >> 1;
+    int u_plane = src_format == AV_PIX_FMT_NV12 ? 1 : 2;
+
+    for (int j = slice_y; j < slice_y + slice_h; j++)
+        memcpy(dst_data[0] + j * dst_linesize[0], src_data[0] + j * src_linesize[0], width);
+    for (int j = slice_y >> 1; j < chroma_end; j++)
+        k->split_uv_row(src_data[1] + j * src_linesize[1],
+                        dst_data[u_plane] + j * dst_linesize[u_plane],
+                        dst_data[3 - u_plane] + j * dst_linesize[3 - u_plane],
+                        chroma_width);
+    return 0;
+}
+
+static int convert_p10_to_p8(const ImageConvertKernels *k, int width, int slice_y, int slice_h, int log2_chroma_w, int log2_chroma_h,
+    uint8_t **dst_data, int *dst_linesize, const uint8_t **src_data, const int *src_linesize)
+{
+    for (int plane = 0; plane < 3; plane++) {
+        int w     = plane ? -((-width) >> log2_chroma_w) : width;
+        int start = plane ? slice_y >> log2_chroma_h : slice_y;
+        int end   = plane ? -((-(slice_y + slice_h)) >> log2_chroma_h) : slice_y + slice_h;
+
+        for (int j = start; j < end; j++)
+            k->p10_to_p8_row((const uint16_t *)(src_data[plane] + j * src_linesize[plane]),
+                             dst_data[plane] + j * dst_linesize[plane], w);
+    }
+    return 0;
+}
+
+static int convert_builtin(const ImageConvertKernels *k, int width, int slice_y, int slice_h,
+    enum AVPixelFormat dst_format, uint8_t **dst_data, int *dst_linesize,
+    enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize)
+{
+    switch (src_format) {
+        /* limited range only, full range YUVJ420P is left to swscale */
+        case AV_PIX_FMT_YUV420P:
+            return convert_yuv_to_rgb(k, width, slice_y, slice_h, dst_format, dst_data, dst_linesize, src_format, src_data, src_linesize);
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_NV21:
+            if (dst_format == AV_PIX_FMT_YUV420P)
+                return convert_nv_to_yuv420p(k, width, slice_y, slice_h, dst_data, dst_linesize, src_format, src_data, src_linesize);
+            return convert_yuv_to_rgb(k, width, slice_y, slice_h, dst_format, dst_data, dst_linesize, src_format, src_data, src_linesize);
+        case AV_PIX_FMT_YUV420P10LE:
+            if (dst_format != AV_PIX_FMT_YUV420P)
+                return -1;
+            return convert_p10_to_p8(k, width, slice_y, slice_h, 1, 1, dst_data, dst_linesize, src_data, src_linesize);
+        case AV_PIX_FMT_YUV422P10LE:
+            if (dst_format != AV_PIX_FMT_YUV422P)
+                return -1;
+            return convert_p10_to_p8(k, width, slice_y, slice_h, 1, 0, dst_data, dst_linesize, src_data, src_linesize);
+        case AV_PIX_FMT_YUV444P10LE:
+            if (dst_format != AV_PIX_FMT_YUV444P)
+                return -1;
+            return convert_p10_to_p8(k, width, slice_y, slice_h, 0, 0, dst_data, dst_linesize, src_data, src_linesize);
+        default:
+            return -1;
+    }
+}
+
+/* whether convert_builtin handles the pair, so that slices are not dispatched for nothing */
+static int convert_builtin_supported(enum AVPixelFormat dst_format, enum AVPixelFormat src_format)
+{
+    int to_rgb = dst_format == AV_PIX_FMT_0BGR32 || dst_format == AV_PIX_FMT_RGB24 || dst_format == AV_PIX_FMT_RGB565;
+
+    switch (src_format) {
+        case AV_PIX_FMT_YUV420P:        return to_rgb;
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_NV21:           return to_rgb || dst_format == AV_PIX_FMT_YUV420P;
+        case AV_PIX_FMT_YUV420P10LE:    return dst_format == AV_PIX_FMT_YUV420P;
+        case AV_PIX_FMT_YUV422P10LE:    return dst_format == AV_PIX_FMT_YUV422P;
+        case AV_PIX_FMT_YUV444P10LE:    return dst_format == AV_PIX_FMT_YUV444P;
+        default:                        return 0;
+    }
+}
+
+static const ImageConvertKernels *image_convert_get_kernels(void)
+{
+    static const ImageConvertKernels *kernels;
+
+    /* the same on every call, racing callers store the same pointer */
+    if (!kernels)
+        kernels = image_convert_kernels(av_get_cpu_flags());
+    return kernels;
+}
+
+int ijk_image_convert_slice(int width, int height, int slice_y, int slice_h,
     enum AVPixelFormat dst_format, uint8_t **dst_data, int *dst_linesize,
     enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize)
 {
@@ -36,18 +510,18 @@ int ijk_image_convert(int width, int height,
             switch (dst_format) {
             case AV_PIX_FMT_RGB565:
                 return I420ToRGB565(
-                    src_data[0], src_linesize[0],
-                    src_data[1], src_linesize[1],
-                    src_data[2], src_linesize[2],
-                    dst_data[0], dst_linesize[0],
-                    width, height);
+                    src_data[0] + slice_y * src_linesize[0], src_linesize[0],
+                    src_data[1] + slice_y / 2 * src_linesize[1], src_linesize[1],
+                    src_data[2] + slice_y / 2 * src_linesize[2], src_linesize[2],
+                    dst_data[0] + slice_y * dst_linesize[0], dst_linesize[0],
+                    width, slice_h);
             case AV_PIX_FMT_0BGR32:
                 return I420ToABGR(
-                    src_data[0], src_linesize[0],
-                    src_data[1], src_linesize[1],
-                    src_data[2], src_linesize[2],
-                    dst_data[0], dst_linesize[0],
-                    width, height);
+                    src_data[0] + slice_y * src_linesize[0], src_linesize[0],
+                    src_data[1] + slice_y / 2 * src_linesize[1], src_linesize[1],
+                    src_data[2] + slice_y / 2 * src_linesize[2], src_linesize[2],
+                    dst_data[0] + slice_y * dst_linesize[0], dst_linesize[0],
+                    width, slice_h);
             default:
                 break;
             }
@@ -56,6 +530,526 @@ int ijk_image_convert(int width, int height,
             break;
     }
 #endif
-    return -1;
+
+    return convert_builtin(image_convert_get_kernels(), width, slice_y, slice_h,
+                           dst_format, dst_data, dst_linesize, src_format, src_data, src_linesize);
 }
 
+int ijk_image_convert(int width, int height,
+    enum AVPixelFormat dst_format, uint8_t **dst_data, int *dst_linesize,
+    enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize)
+{
+    return ijk_image_convert_slice(width, height, 0, height,
+                                   dst_format, dst_data, dst_linesize, src_format, src_data, src_linesize);
+}
+
+/*
+ * Persistent workers for ijk_image_convert_parallel. The caller converts
+ * slices too, then waits for the slices the workers took.
+ */
+typedef struct ImageConvertJob {
+    int                 width;
+    int                 height;
+    int                 slice_h;
+    enum AVPixelFormat  dst_format;
+    uint8_t           **dst_data;
+    int                *dst_linesize;
+    enum AVPixelFormat  src_format;
+    const uint8_t     **src_data;
+    const int          *src_linesize;
+} ImageConvertJob;
+
+struct IjkImageConvertPool {
+    SDL_mutex      *mutex;
+    SDL_cond       *work_cond;
+    SDL_cond       *done_cond;
+    int             abort_request;
+
+    SDL_Thread      threads[IJK_IMAGE_CONVERT_THREADS_MAX];
+    SDL_Thread     *thread_ids[IJK_IMAGE_CONVERT_THREADS_MAX];
+    int             nb_threads;
+
+    ImageConvertJob job;
+    int             nb_slices;
+    int             next_slice;
+    int             done_slices;
+    int             ret;
+};
+
+/* takes the next slice, runs it unlocked */
+static void image_convert_pool_run_slice_l(IjkImageConvertPool *pool)
+{
+    ImageConvertJob *job = &pool->job;
+    int slice_y = pool->next_slice++ * job->slice_h;
+    int slice_h = FFMIN(job->slice_h, job->height - slice_y);
+    int ret;
+
+    SDL_UnlockMutex(pool->mutex);
+    ret = ijk_image_convert_slice(job->width, job->height, slice_y, slice_h,
+                                  job->dst_format, job->dst_data, job->dst_linesize,
+                                  job->src_format, job->src_data, job->src_linesize);
+    SDL_LockMutex(pool->mutex);
+
+    if (ret)
+        pool->ret = ret;
+    if (++pool->done_slices == pool->nb_slices)
+        SDL_CondSignal(pool->done_cond);
+}
+
+static int image_convert_pool_worker(void *arg)
+{
+    IjkImageConvertPool *pool = arg;
+
+    SDL_LockMutex(pool->mutex);
+    while (!pool->abort_request) {
+        if (pool->next_slice < pool->nb_slices)
+            image_convert_pool_run_slice_l(pool);
+        else
+            SDL_CondWait(pool->work_cond, pool->mutex);
+    }
+    SDL_UnlockMutex(pool->mutex);
+    return 0;
+}
+
+IjkImageConvertPool *ijk_image_convert_pool_create(int threads)
+{
+    IjkImageConvertPool *pool;
+
+    if (threads <= 0)
+        threads = FFMIN(av_cpu_count(), 4);
+    threads = FFMIN(threads, IJK_IMAGE_CONVERT_THREADS_MAX + 1);
+    if (threads <= 1)
+        return NULL;
+
+    pool = av_mallocz(sizeof(IjkImageConvertPool));
+    if (!pool)
+        return NULL;
+
+    pool->mutex     = SDL_CreateMutex();
+    pool->work_cond = SDL_CreateCond();
+    pool->done_cond = SDL_CreateCond();
+    if (!pool->mutex || !pool->work_cond || !pool->done_cond)
+        goto fail;
+
+    /* the caller is one of the threads */
+    for (int i = 0; i < threads - 1; i++) {
+        pool->thread_ids[i] = SDL_CreateThreadEx(&pool->threads[i], image_convert_pool_worker, pool, "ff_vconvert");
+        if (!pool->thread_ids[i])
+            break;
+        pool->nb_threads++;
+    }
+    if (!pool->nb_threads)
+        goto fail;
+
+    return pool;
+fail:
+    ijk_image_convert_pool_destroy(&pool);
+    return NULL;
+}
+
+void ijk_image_convert_pool_destroy(IjkImageConvertPool **ppool)
+{
+    IjkImageConvertPool *pool;
+
+    if (!ppool || !*ppool)
+        return;
+    pool = *ppool;
+
+    if (pool->mutex) {
+        SDL_LockMutex(pool->mutex);
+        pool->abort_request = 1;
+        SDL_CondBroadcast(pool->work_cond);
+        SDL_UnlockMutex(pool->mutex);
+    }
+    for (int i = 0; i < pool->nb_threads; i++)
+        SDL_WaitThread(pool->thread_ids[i], NULL);
+
+    SDL_DestroyCondP(&pool->done_cond);
+    SDL_DestroyCondP(&pool->work_cond);
+    SDL_DestroyMutexP(&pool->mutex);
+    av_freep(ppool);
+}
+
+int ijk_image_convert_parallel(IjkImageConvertPool *pool, int width, int height,
+    enum AVPixelFormat dst_format, uint8_t **dst_data, int *dst_linesize,
+    enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize)
+{
+    ImageConvertJob *job;
+    int slice_h;
+    int ret;
+
+    if (!pool || !convert_builtin_supported(dst_format, src_format))
+        return ijk_image_convert(width, height, dst_format, dst_data, dst_linesize, src_format, src_data, src_linesize);
+
+    /* even rows, so that no slice starts in the middle of a chroma row */
+    slice_h = FFALIGN((height + pool->nb_threads) / (pool->nb_threads + 1), 2);
+    if (slice_h >= height)
+        return ijk_image_convert(width, height, dst_format, dst_data, dst_linesize, src_format, src_data, src_linesize);
+
+    SDL_LockMutex(pool->mutex);
+    job = &pool->job;
+    job->width          = width;
+    job->height         = height;
+    job->slice_h        = slice_h;
+    job->dst_format     = dst_format;
+    job->dst_data       = dst_data;
+    job->dst_linesize   = dst_linesize;
+    job->src_format     = src_format;
+    job->src_data       = src_data;
+    job->src_linesize   = src_linesize;
+    pool->nb_slices     = (height + slice_h - 1) / slice_h;
+    pool->next_slice    = 0;
+    pool->done_slices   = 0;
+    pool->ret           = 0;
+    SDL_CondBroadcast(pool->work_cond);
+
+    while (pool->next_slice < pool->nb_slices)
+        image_convert_pool_run_slice_l(pool);
+    while (pool->done_slices < pool->nb_slices)
+        SDL_CondWait(pool->done_cond, pool->mutex);
+
+    ret = pool->ret;
+    pool->nb_slices = 0;
+    SDL_UnlockMutex(pool->mutex);
+    return ret;
+}
+
+#ifdef IJK_IMAGE_CONVERT_TEST
+
+/*
+ * every kernel set bit exact against the c one, the c one close to swscale,
+ * then a benchmark at 1080p:
+ *   cc -O2 -DIJK_IMAGE_CONVERT_TEST image_convert.c ../../ijksdl_mutex.c ../../ijksdl_thread.c \
+ *      -lswscale -lavutil -lpthread && ./a.out
+ * build with -DIJK_IMAGE_CONVERT_TEST_NO_SWSCALE to skip the comparison with swscale.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "libavutil/imgutils.h"
+#ifndef IJK_IMAGE_CONVERT_TEST_NO_SWSCALE
+#include "libswscale/swscale.h"
+#endif
+
+#define TEST_BENCH_WIDTH    1920
+#define TEST_BENCH_HEIGHT   1080
+#define TEST_BENCH_FRAMES   100
+#define TEST_SLICE_WIDTH    3840
+#define TEST_SLICE_HEIGHT   2160
+#define TEST_SLICE_FRAMES   30
+
+typedef struct TestConversion {
+    enum AVPixelFormat src_format;
+    enum AVPixelFormat dst_format;
+    int                tolerance;   /* against swscale, per byte or per 565 field */
+} TestConversion;
+
+static const TestConversion g_test_conversions[] = {
+    { AV_PIX_FMT_YUV420P,       AV_PIX_FMT_0BGR32,  2 },
+    { AV_PIX_FMT_YUV420P,       AV_PIX_FMT_RGB24,   2 },
+    { AV_PIX_FMT_YUV420P,       AV_PIX_FMT_RGB565,  1 },
+    { AV_PIX_FMT_NV12,          AV_PIX_FMT_0BGR32,  2 },
+    { AV_PIX_FMT_NV21,          AV_PIX_FMT_RGB24,   2 },
+    { AV_PIX_FMT_NV12,          AV_PIX_FMT_YUV420P, 0 },
+    { AV_PIX_FMT_NV21,          AV_PIX_FMT_YUV420P, 0 },
+    /* swscale dithers down to 8 bits */
+    { AV_PIX_FMT_YUV420P10LE,   AV_PIX_FMT_YUV420P, 1 },
+    { AV_PIX_FMT_YUV422P10LE,   AV_PIX_FMT_YUV422P, 1 },
+    { AV_PIX_FMT_YUV444P10LE,   AV_PIX_FMT_YUV444P, 1 },
+};
+
+typedef struct TestImage {
+    uint8_t *data[4];
+    int      linesize[4];
+    int      size;
+} TestImage;
+
+static unsigned int test_rand(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+static int test_image_alloc(TestImage *img, enum AVPixelFormat format, int width, int height)
+{
+    memset(img, 0, sizeof(*img));
+    img->size = av_image_alloc(img->data, img->linesize, width, height, format, 16);
+    return img->size;
+}
+
+/* full range noise, 10 bit samples kept in range */
+static void test_image_fill(TestImage *img, enum AVPixelFormat format, unsigned int *seed)
+{
+    int high_depth = format == AV_PIX_FMT_YUV420P10LE || format == AV_PIX_FMT_YUV422P10LE || format == AV_PIX_FMT_YUV444P10LE;
+
+    if (high_depth) {
+        for (int i = 0; i < img->size / 2; i++)
+            ((uint16_t *)img->data[0])[i] = test_rand(seed) & 0x3ff;
+    } else {
+        for (int i = 0; i < img->size; i++)
+            img->data[0][i] = test_rand(seed);
+    }
+}
+
+/* largest difference over the visible part of the planes */
+static int test_image_diff(const TestImage *a, const TestImage *b, enum AVPixelFormat format, int width, int height)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int max_diff = 0;
+
+    for (int plane = 0; plane < 4 && a->data[plane]; plane++) {
+        int h     = plane == 1 || plane == 2 ? -((-height) >> desc->log2_chroma_h) : height;
+        int bytes = av_image_get_linesize(format, width, plane);
+
+        for (int j = 0; j < h; j++) {
+            const uint8_t *pa = a->data[plane] + j * a->linesize[plane];
+            const uint8_t *pb = b->data[plane] + j * b->linesize[plane];
+
+            if (format == AV_PIX_FMT_RGB565) {
+                for (int x = 0; x < width; x++) {
+                    int ca = ((const uint16_t *)pa)[x];
+                    int cb = ((const uint16_t *)pb)[x];
+                    int d0 = abs((ca >> 11) - (cb >> 11));
+                    int d1 = abs(((ca >> 5) & 0x3f) - ((cb >> 5) & 0x3f));
+                    int d2 = abs((ca & 0x1f) - (cb & 0x1f));
+                    max_diff = FFMAX(max_diff, FFMAX3(d0, d1, d2));
+                }
+            } else {
+                for (int x = 0; x < bytes; x++) {
+                    /* the padding byte of 0BGR32 is left to the converter */
+                    if (format == AV_PIX_FMT_0BGR32 && x % 4 == 3)
+                        continue;
+                    max_diff = FFMAX(max_diff, abs(pa[x] - pb[x]));
+                }
+            }
+        }
+    }
+    return max_diff;
+}
+
+static const ImageConvertKernels *g_test_kernels[] = {
+    &g_kernels_c,
+#if IJK_IMAGE_CONVERT_X86
+    &g_kernels_sse2,
+    &g_kernels_avx2,
+#endif
+#if IJK_IMAGE_CONVERT_NEON
+    &g_kernels_neon,
+#endif
+};
+
+static int test_kernels_usable(const ImageConvertKernels *k)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+#if IJK_IMAGE_CONVERT_X86
+    if (k == &g_kernels_avx2)
+        return cpu_flags & AV_CPU_FLAG_AVX2;
+    if (k == &g_kernels_sse2)
+        return cpu_flags & AV_CPU_FLAG_SSE2;
+#endif
+#if IJK_IMAGE_CONVERT_NEON
+    if (k == &g_kernels_neon)
+        return cpu_flags & AV_CPU_FLAG_NEON;
+#endif
+    return 1;
+}
+
+static int test_convert(const ImageConvertKernels *k, const TestConversion *t, int width, int height,
+    const TestImage *src, TestImage *dst)
+{
+    return convert_builtin(k, width, 0, height, t->dst_format, dst->data, dst->linesize,
+                           t->src_format, (const uint8_t **)src->data, src->linesize);
+}
+
+static int test_one(const TestConversion *t, int width, int height, unsigned int *seed)
+{
+    TestImage src, ref, out;
+    int failed = 0;
+
+    if (test_image_alloc(&src, t->src_format, width, height) < 0 ||
+        test_image_alloc(&ref, t->dst_format, width, height) < 0 ||
+        test_image_alloc(&out, t->dst_format, width, height) < 0)
+        return 1;
+    test_image_fill(&src, t->src_format, seed);
+
+    if (test_convert(&g_kernels_c, t, width, height, &src, &ref)) {
+        failed = 1;
+        goto end;
+    }
+
+    for (int i = 1; i < sizeof(g_test_kernels) / sizeof(g_test_kernels[0]); i++) {
+        const ImageConvertKernels *k = g_test_kernels[i];
+        int diff;
+
+        if (!test_kernels_usable(k))
+            continue;
+        memset(out.data[0], 0, out.size);
+        test_convert(k, t, width, height, &src, &out);
+        diff = test_image_diff(&ref, &out, t->dst_format, width, height);
+        if (diff) {
+            printf("%s -> %s %dx%d: %s differs from c by %d\n", av_get_pix_fmt_name(t->src_format),
+                   av_get_pix_fmt_name(t->dst_format), width, height, k->name, diff);
+            failed = 1;
+        }
+    }
+
+#ifndef IJK_IMAGE_CONVERT_TEST_NO_SWSCALE
+    {
+        struct SwsContext *sws = sws_getContext(width, height, t->src_format, width, height, t->dst_format,
+                                                SWS_BILINEAR, NULL, NULL, NULL);
+        int diff;
+
+        if (!sws) {
+            failed = 1;
+            goto end;
+        }
+        memset(out.data[0], 0, out.size);
+        sws_scale(sws, (const uint8_t * const *)src.data, src.linesize, 0, height, out.data, out.linesize);
+        sws_freeContext(sws);
+        diff = test_image_diff(&ref, &out, t->dst_format, width, height);
+        if (diff > t->tolerance) {
+            printf("%s -> %s %dx%d: differs from swscale by %d, more than %d\n", av_get_pix_fmt_name(t->src_format),
+                   av_get_pix_fmt_name(t->dst_format), width, height, diff, t->tolerance);
+            failed = 1;
+        }
+    }
+#endif
+
+end:
+    av_freep(&src.data[0]);
+    av_freep(&ref.data[0]);
+    av_freep(&out.data[0]);
+    return failed;
+}
+
+static void test_bench(const TestConversion *t)
+{
+    TestImage src, dst;
+    unsigned int seed = 3;
+
+    if (test_image_alloc(&src, t->src_format, TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT) < 0 ||
+        test_image_alloc(&dst, t->dst_format, TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT) < 0)
+        return;
+    test_image_fill(&src, t->src_format, &seed);
+
+    printf("%-14s -> %-8s", av_get_pix_fmt_name(t->src_format), av_get_pix_fmt_name(t->dst_format));
+    for (int i = 0; i < sizeof(g_test_kernels) / sizeof(g_test_kernels[0]); i++) {
+        const ImageConvertKernels *k = g_test_kernels[i];
+        struct timespec start, end;
+        double seconds;
+
+        if (!test_kernels_usable(k))
+            continue;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int n = 0; n < TEST_BENCH_FRAMES; n++)
+            test_convert(k, t, TEST_BENCH_WIDTH, TEST_BENCH_HEIGHT, &src, &dst);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("  %s %7.1f MP/s", k->name, TEST_BENCH_WIDTH * TEST_BENCH_HEIGHT * (double)TEST_BENCH_FRAMES / seconds / 1e6);
+    }
+    printf("\n");
+
+    av_freep(&src.data[0]);
+    av_freep(&dst.data[0]);
+}
+
+/* the pool must give the same bytes as one pass */
+static int test_parallel(IjkImageConvertPool *pool, const TestConversion *t, int width, int height, unsigned int *seed)
+{
+    TestImage src, ref, out;
+    int failed = 0;
+
+    if (test_image_alloc(&src, t->src_format, width, height) < 0 ||
+        test_image_alloc(&ref, t->dst_format, width, height) < 0 ||
+        test_image_alloc(&out, t->dst_format, width, height) < 0)
+        return 1;
+    test_image_fill(&src, t->src_format, seed);
+
+    ijk_image_convert(width, height, t->dst_format, ref.data, ref.linesize,
+                      t->src_format, (const uint8_t **)src.data, src.linesize);
+    memset(out.data[0], 0, out.size);
+    if (ijk_image_convert_parallel(pool, width, height, t->dst_format, out.data, out.linesize,
+                                   t->src_format, (const uint8_t **)src.data, src.linesize) ||
+        test_image_diff(&ref, &out, t->dst_format, width, height)) {
+        printf("%s -> %s %dx%d: slices differ from one pass\n", av_get_pix_fmt_name(t->src_format),
+               av_get_pix_fmt_name(t->dst_format), width, height);
+        failed = 1;
+    }
+
+    av_freep(&src.data[0]);
+    av_freep(&ref.data[0]);
+    av_freep(&out.data[0]);
+    return failed;
+}
+
+static double test_bench_slices(IjkImageConvertPool *pool, const TestConversion *t, const TestImage *src, TestImage *dst)
+{
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int n = 0; n < TEST_SLICE_FRAMES; n++)
+        ijk_image_convert_parallel(pool, TEST_SLICE_WIDTH, TEST_SLICE_HEIGHT, t->dst_format, dst->data, dst->linesize,
+                                   t->src_format, (const uint8_t **)src->data, src->linesize);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9) / TEST_SLICE_FRAMES;
+}
+
+int main(void)
+{
+    static const int sizes[][2] = { { 16, 2 }, { 17, 3 }, { 33, 7 }, { 1, 1 }, { 640, 360 }, { 1279, 719 } };
+    IjkImageConvertPool *pool;
+    unsigned int seed = 1;
+    int failed = 0;
+
+    for (int i = 0; i < sizeof(g_test_conversions) / sizeof(g_test_conversions[0]); i++) {
+        const TestConversion *t = &g_test_conversions[i];
+
+        for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            failed |= test_one(t, sizes[s][0], sizes[s][1], &seed);
+        for (int n = 0; n < 20; n++)
+            failed |= test_one(t, 1 + test_rand(&seed) % 200, 1 + test_rand(&seed) % 50, &seed);
+        printf("%-14s -> %-8s %s\n", av_get_pix_fmt_name(t->src_format), av_get_pix_fmt_name(t->dst_format),
+               failed ? "FAILED" : "ok");
+    }
+    if (failed)
+        return 1;
+
+    pool = ijk_image_convert_pool_create(4);
+    if (!pool)
+        return 1;
+    for (int i = 0; i < sizeof(g_test_conversions) / sizeof(g_test_conversions[0]); i++) {
+        for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            failed |= test_parallel(pool, &g_test_conversions[i], sizes[s][0], sizes[s][1], &seed);
+        failed |= test_parallel(pool, &g_test_conversions[i], TEST_SLICE_WIDTH, TEST_SLICE_HEIGHT + 1, &seed);
+    }
+    printf("slices %s\n", failed ? "FAILED" : "ok");
+    if (failed) {
+        ijk_image_convert_pool_destroy(&pool);
+        return 1;
+    }
+
+    for (int i = 0; i < sizeof(g_test_conversions) / sizeof(g_test_conversions[0]); i++)
+        test_bench(&g_test_conversions[i]);
+
+    /* 4k per frame, one pass against 4 threads */
+    for (int i = 0; i < sizeof(g_test_conversions) / sizeof(g_test_conversions[0]); i++) {
+        const TestConversion *t = &g_test_conversions[i];
+        TestImage src, dst;
+
+        if (test_image_alloc(&src, t->src_format, TEST_SLICE_WIDTH, TEST_SLICE_HEIGHT) < 0 ||
+            test_image_alloc(&dst, t->dst_format, TEST_SLICE_WIDTH, TEST_SLICE_HEIGHT) < 0)
+            break;
+        test_image_fill(&src, t->src_format, &seed);
+        printf("%-14s -> %-8s 4k  1 thread %6.2f ms  4 threads %6.2f ms\n",
+               av_get_pix_fmt_name(t->src_format), av_get_pix_fmt_name(t->dst_format),
+               test_bench_slices(NULL, t, &src, &dst) * 1e3, test_bench_slices(pool, t, &src, &dst) * 1e3);
+        av_freep(&src.data[0]);
+        av_freep(&dst.data[0]);
+    }
+
+    ijk_image_convert_pool_destroy(&pool);
+    return 0;
+}
+
+#endif
@@ -31,4 +31,22 @@ int ijk_image_convert(int width, int height,
     enum AVPixelFormat dst_format, uint8_t **dst_data, int *dst_linesize,
     enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize);
 
+/* rows [slice_y, slice_y + slice_h) only, slice_y even; slices of one picture may run concurrently */
+int ijk_image_convert_slice(int width, int height, int slice_y, int slice_h,
+    enum AVPixelFormat dst_format, uint8_t **dst_data, int *dst_linesize,
+    enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize);
+
+#define IJK_IMAGE_CONVERT_THREADS_MAX 15
+
+typedef struct IjkImageConvertPool IjkImageConvertPool;
+
+/* threads counts the caller, <= 0 for one per core up to 4; NULL if that leaves no worker */
+IjkImageConvertPool *ijk_image_convert_pool_create(int threads);
+void ijk_image_convert_pool_destroy(IjkImageConvertPool **ppool);
+
+/* ijk_image_convert in horizontal slices shared with the pool's workers, one caller at a time */
+int ijk_image_convert_parallel(IjkImageConvertPool *pool, int width, int height,
+    enum AVPixelFormat dst_format, uint8_t **dst_data, int *dst_linesize,
+    enum AVPixelFormat src_format, const uint8_t **src_data, const int *src_linesize);
+
 #endif
@@ -49,6 +49,9 @@ struct SDL_VoutOverlay_Opaque {
 
     struct SwsContext *img_convert_ctx;
     int sws_flags;
+
+    /* owned by the vout, NULL to convert on the caller alone */
+    IjkImageConvertPool *convert_pool;
 };
 
 /* Always assume a linesize alignment of 1 here */
@@ -156,6 +159,43 @@ static int func_unlock(SDL_VoutOverlay *overlay)
     return SDL_UnlockMutex(opaque->mutex);
 }
 
+/* the pixel format an overlay holds */
+static enum AVPixelFormat overlay_pixel_format(Uint32 overlay_format)
+{
+    switch (overlay_format) {
+        case SDL_FCC_YV12:
+        case SDL_FCC_I420:          return AV_PIX_FMT_YUV420P;
+        case SDL_FCC_I422:          return AV_PIX_FMT_YUV422P;
+        case SDL_FCC_NV12:          return AV_PIX_FMT_NV12;
+        case SDL_FCC_I420P10LE:     return AV_PIX_FMT_YUV420P10LE;
+        case SDL_FCC_I422P10LE:     return AV_PIX_FMT_YUV422P10LE;
+        case SDL_FCC_I444P10LE:     return AV_PIX_FMT_YUV444P10LE;
+        case SDL_FCC_RV32:          return AV_PIX_FMT_0BGR32;
+        case SDL_FCC_RV24:          return AV_PIX_FMT_RGB24;
+        case SDL_FCC_RV16:          return AV_PIX_FMT_RGB565;
+        default:                    return AV_PIX_FMT_NONE;
+    }
+}
+
+/* yuv frames the overlay can wrap as they are, the renderer converts them */
+static int overlay_can_link(Uint32 overlay_format, int frame_format)
+{
+    switch (overlay_format) {
+        case SDL_FCC_YV12:
+        case SDL_FCC_I420:
+            return frame_format == AV_PIX_FMT_YUV420P || frame_format == AV_PIX_FMT_YUVJ420P;
+        case SDL_FCC_I422:
+            return frame_format == AV_PIX_FMT_YUV422P || frame_format == AV_PIX_FMT_YUVJ422P;
+        case SDL_FCC_NV12:
+        case SDL_FCC_I420P10LE:
+        case SDL_FCC_I422P10LE:
+        case SDL_FCC_I444P10LE:
+            return frame_format == overlay_pixel_format(overlay_format);
+        default:
+            return 0;
+    }
+}
+
 static int func_fill_frame(SDL_VoutOverlay *overlay, const AVFrame *frame)
 {
     assert(overlay);
@@ -164,49 +204,15 @@ static int func_fill_frame(SDL_VoutOverlay *overlay, const AVFrame *frame)
 
     av_frame_unref(opaque->linked_frame);
 
-    int need_swap_uv = 0;
-    int use_linked_frame = 0;
-    enum AVPixelFormat dst_format = AV_PIX_FMT_NONE;
-    switch (overlay->format) {
-        case SDL_FCC_YV12:
-            need_swap_uv = 1;
-            // no break;
-        case SDL_FCC_I420:
-            if (frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUVJ420P) {
-                // ALOGE("direct draw frame");
-                use_linked_frame = 1;
-                dst_format = frame->format;
-            } else {
-                // ALOGE("copy draw frame");
-                dst_format = AV_PIX_FMT_YUV420P;
-            }
-            break;
-        case SDL_FCC_I444P10LE:
-            if (frame->format == AV_PIX_FMT_YUV444P10LE) {
-                // ALOGE("direct draw frame");
-                use_linked_frame = 1;
-                dst_format = frame->format;
-            } else {
-                // ALOGE("copy draw frame");
-                dst_format = AV_PIX_FMT_YUV444P10LE;
-            }
-            break;
-        case SDL_FCC_RV32:
-            dst_format = AV_PIX_FMT_0BGR32;
-            break;
-        case SDL_FCC_RV24:
-            dst_format = AV_PIX_FMT_RGB24;
-            break;
-        case SDL_FCC_RV16:
-            dst_format = AV_PIX_FMT_RGB565;
-            break;
-        default:
-            ALOGE("SDL_VoutFFmpeg_ConvertPicture: unexpected overlay format %s(%d)",
-                  (char*)&overlay->format, overlay->format);
-            return -1;
+    int need_swap_uv = overlay->format == SDL_FCC_YV12;
+    int use_linked_frame = overlay_can_link(overlay->format, frame->format);
+    enum AVPixelFormat dst_format = use_linked_frame ? frame->format : overlay_pixel_format(overlay->format);
+    if (dst_format == AV_PIX_FMT_NONE) {
+        ALOGE("SDL_VoutFFmpeg_ConvertPicture: unexpected overlay format %s(%d)",
+              (char*)&overlay->format, overlay->format);
+        return -1;
     }
 
-
     // setup frame
     if (use_linked_frame) {
         // linked frame
@@ -251,9 +257,9 @@ static int func_fill_frame(SDL_VoutOverlay *overlay, const AVFrame *frame)
      */
     if (use_linked_frame) {
         // do nothing
-    } else if (ijk_image_convert(frame->width, frame->height,
-                                 dst_format, swscale_dst_pic.data, swscale_dst_pic.linesize,
-                                 frame->format, (const uint8_t**) frame->data, frame->linesize)) {
+    } else if (ijk_image_convert_parallel(opaque->convert_pool, frame->width, frame->height,
+                                          dst_format, swscale_dst_pic.data, swscale_dst_pic.linesize,
+                                          frame->format, (const uint8_t**) frame->data, frame->linesize)) {
         opaque->img_convert_ctx = sws_getCachedContext(opaque->img_convert_ctx,
                                                        frame->width, frame->height, frame->format, frame->width, frame->height,
                                                        dst_format, opaque->sws_flags, NULL, NULL, NULL);
@@ -289,6 +295,21 @@ SDL_VoutOverlay *SDL_VoutFFmpeg_CreateOverlay(int width, int height, int frame_f
                 case AV_PIX_FMT_YUV444P10LE:
                     overlay_format = SDL_FCC_I444P10LE;
                     break;
+                case AV_PIX_FMT_YUV422P10LE:
+                    overlay_format = SDL_FCC_I422P10LE;
+                    break;
+                case AV_PIX_FMT_YUV420P10LE:
+                    overlay_format = SDL_FCC_I420P10LE;
+                    break;
+                case AV_PIX_FMT_YUV422P:
+                case AV_PIX_FMT_YUVJ422P:
+                    overlay_format = SDL_FCC_I422;
+                    break;
+#if defined(__APPLE__)
+                case AV_PIX_FMT_NV12:
+                    overlay_format = SDL_FCC_NV12;
+                    break;
+#endif
                 case AV_PIX_FMT_YUV420P:
                 case AV_PIX_FMT_YUVJ420P:
                 default:
@@ -315,6 +336,7 @@ SDL_VoutOverlay *SDL_VoutFFmpeg_CreateOverlay(int width, int height, int frame_f
     SDL_VoutOverlay_Opaque *opaque = overlay->opaque;
     opaque->mutex         = SDL_CreateMutex();
     opaque->sws_flags     = SWS_BILINEAR;
+    opaque->convert_pool  = SDL_VoutGetConvertPool_l(display, width, height);
 
     overlay->opaque_class = &g_vout_overlay_ffmpeg_class;
     overlay->format       = overlay_format;
@@ -327,13 +349,13 @@ SDL_VoutOverlay *SDL_VoutFFmpeg_CreateOverlay(int width, int height, int frame_f
     overlay->unlock             = func_unlock;
     overlay->func_fill_frame    = func_fill_frame;
 
-    enum AVPixelFormat ff_format = AV_PIX_FMT_NONE;
+    enum AVPixelFormat ff_format = overlay_pixel_format(overlay_format);
     int buf_width = width;
     int buf_height = height;
     switch (overlay_format) {
     case SDL_FCC_I420:
-    case SDL_FCC_YV12: {
-        ff_format = AV_PIX_FMT_YUV420P;
+    case SDL_FCC_YV12:
+    case SDL_FCC_I422: {
         // FIXME: need runtime config
 #if defined(__ANDROID__)
         // 16 bytes align pitch for arm-neon image-convert
@@ -349,8 +371,14 @@ SDL_VoutOverlay *SDL_VoutFFmpeg_CreateOverlay(int width, int height, int frame_f
         opaque->planes = 3;
         break;
     }
+    case SDL_FCC_NV12: {
+        buf_width = IJKALIGN(width, 16);
+        opaque->planes = 2;
+        break;
+    }
+    case SDL_FCC_I420P10LE:
+    case SDL_FCC_I422P10LE:
     case SDL_FCC_I444P10LE: {
-        ff_format = AV_PIX_FMT_YUV444P10LE;
         // FIXME: need runtime config
 #if defined(__ANDROID__)
         // 16 bytes align pitch for arm-neon image-convert
@@ -367,13 +395,11 @@ SDL_VoutOverlay *SDL_VoutFFmpeg_CreateOverlay(int width, int height, int frame_f
         break;
     }
     case SDL_FCC_RV16: {
-        ff_format = AV_PIX_FMT_RGB565;
         buf_width = IJKALIGN(width, 8); // 2 bytes per pixel
         opaque->planes = 1;
         break;
     }
     case SDL_FCC_RV24: {
-        ff_format = AV_PIX_FMT_RGB24;
 #if defined(__ANDROID__)
         // 16 bytes align pitch for arm-neon image-convert
         buf_width = IJKALIGN(width, 16); // 1 bytes per pixel for Y-plane
@@ -386,7 +412,6 @@ SDL_VoutOverlay *SDL_VoutFFmpeg_CreateOverlay(int width, int height, int frame_f
         break;
     }
     case SDL_FCC_RV32: {
-        ff_format = AV_PIX_FMT_0BGR32;
         buf_width = IJKALIGN(width, 4); // 4 bytes per pixel
         opaque->planes = 1;
         break;
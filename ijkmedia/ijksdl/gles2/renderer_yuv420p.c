@@ -62,12 +62,16 @@ static GLboolean yuv420p_uploadTexture(IJK_GLES2_Renderer *renderer, SDL_VoutOve
 
           int     planes[3]    = { 0, 1, 2 };
     const GLsizei widths[3]    = { overlay->pitches[0], overlay->pitches[1], overlay->pitches[2] };
-    const GLsizei heights[3]   = { overlay->h,          overlay->h / 2,      overlay->h / 2 };
+          GLsizei heights[3]   = { overlay->h,          overlay->h / 2,      overlay->h / 2 };
     const GLubyte *pixels[3]   = { overlay->pixels[0],  overlay->pixels[1],  overlay->pixels[2] };
 
     switch (overlay->format) {
         case SDL_FCC_I420:
             break;
+        case SDL_FCC_I422:
+            heights[1] = overlay->h;
+            heights[2] = overlay->h;
+            break;
         case SDL_FCC_YV12:
             planes[1] = 2;
             planes[2] = 1;
@@ -70,6 +70,7 @@ static GLboolean yuv420sp_uploadTexture(IJK_GLES2_Renderer *renderer, SDL_VoutOv
 
     switch (overlay->format) {
         case SDL_FCC__VTB:
+        case SDL_FCC_NV12:
             break;
         default:
             ALOGE("[yuv420sp] unexpected format %x\n", overlay->format);
@@ -62,10 +62,16 @@ static GLboolean yuv444p10le_uploadTexture(IJK_GLES2_Renderer *renderer, SDL_Vou
 
           int     planes[3]    = { 0, 1, 2 };
     const GLsizei widths[3]    = { overlay->pitches[0] / 2, overlay->pitches[1] / 2, overlay->pitches[2] / 2 };
-    const GLsizei heights[3]   = { overlay->h,              overlay->h,              overlay->h };
+          GLsizei heights[3]   = { overlay->h,              overlay->h,              overlay->h };
     const GLubyte *pixels[3]   = { overlay->pixels[0],      overlay->pixels[1],      overlay->pixels[2] };
 
+    /* the shader samples normalized coordinates, only chroma heights differ */
     switch (overlay->format) {
+        case SDL_FCC_I420P10LE:
+            heights[1] = overlay->h / 2;
+            heights[2] = overlay->h / 2;
+            break;
+        case SDL_FCC_I422P10LE:
         case SDL_FCC_I444P10LE:
             break;
         default:
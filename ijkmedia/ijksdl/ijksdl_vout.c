@@ -34,6 +34,8 @@ void SDL_VoutFree(SDL_Vout *vout)
     if (!vout)
         return;
 
+    ijk_image_convert_pool_destroy(&vout->convert_pool);
+
     if (vout->free_l) {
         vout->free_l(vout);
     } else {
@@ -67,6 +69,44 @@ int SDL_VoutSetOverlayFormat(SDL_Vout *vout, Uint32 overlay_format)
     return 0;
 }
 
+/*
+ * Overlays keep the pool they were created with, so once it is started it
+ * lives as long as the vout and its thread count can't change any more.
+ */
+int SDL_VoutSetConvertThreads(SDL_Vout *vout, int threads, int slice_threshold)
+{
+    int ret = 0;
+
+    if (!vout)
+        return -1;
+
+    SDL_LockMutex(vout->mutex);
+    if (vout->convert_pool && threads != vout->convert_threads) {
+        ret = -1;
+    } else {
+        vout->convert_threads     = threads;
+    }
+    vout->convert_slice_threshold = slice_threshold;
+    SDL_UnlockMutex(vout->mutex);
+    return ret;
+}
+
+/*
+ * The workers are started by the first frame large enough to need them.
+ * Called from create_overlay, which holds vout->mutex already.
+ */
+IjkImageConvertPool *SDL_VoutGetConvertPool_l(SDL_Vout *vout, int width, int height)
+{
+    if (!vout || vout->convert_slice_threshold <= 0 || vout->convert_threads == 1)
+        return NULL;
+    if ((int64_t)width * height < vout->convert_slice_threshold)
+        return NULL;
+
+    if (!vout->convert_pool)
+        vout->convert_pool = ijk_image_convert_pool_create(vout->convert_threads);
+    return vout->convert_pool;
+}
+
 SDL_VoutOverlay *SDL_Vout_CreateOverlay(int width, int height, int frame_format, SDL_Vout *vout)
 {
     if (vout && vout->create_overlay)
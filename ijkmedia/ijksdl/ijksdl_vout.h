@@ -29,6 +29,7 @@
 #include "ijksdl_mutex.h"
 #include "ijksdl_video.h"
 #include "ffmpeg/ijksdl_inc_ffmpeg.h"
+#include "ffmpeg/ijksdl_image_convert.h"
 
 typedef struct SDL_VoutOverlay_Opaque SDL_VoutOverlay_Opaque;
 typedef struct SDL_VoutOverlay SDL_VoutOverlay;
@@ -68,12 +69,19 @@ struct SDL_Vout {
     int (*display_overlay)(SDL_Vout *vout, SDL_VoutOverlay *overlay);
 
     Uint32 overlay_format;
+
+    /* frames of at least convert_slice_threshold pixels are converted on convert_pool */
+    int convert_threads;
+    int convert_slice_threshold;
+    IjkImageConvertPool *convert_pool;
 };
 
 void SDL_VoutFree(SDL_Vout *vout);
 void SDL_VoutFreeP(SDL_Vout **pvout);
 int  SDL_VoutDisplayYUVOverlay(SDL_Vout *vout, SDL_VoutOverlay *overlay);
 int  SDL_VoutSetOverlayFormat(SDL_Vout *vout, Uint32 overlay_format);
+int  SDL_VoutSetConvertThreads(SDL_Vout *vout, int threads, int slice_threshold);
+IjkImageConvertPool *SDL_VoutGetConvertPool_l(SDL_Vout *vout, int width, int height);
 
 SDL_VoutOverlay *SDL_Vout_CreateOverlay(int width, int height, int frame_format, SDL_Vout *vout);
 int     SDL_VoutLockYUVOverlay(SDL_VoutOverlay *overlay);
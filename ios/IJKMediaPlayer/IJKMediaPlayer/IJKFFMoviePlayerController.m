@@ -1088,6 +1088,22 @@ inline static void fillMetaInternal(NSMutableDictionary *meta, IjkMediaMeta *raw
             _seeking = NO;
             break;
         }
+        case FFP_MSG_CACHED_PACKETS_DROPPED: {
+            [[NSNotificationCenter defaultCenter]
+             postNotificationName:IJKMPMoviePlayerCachedPacketsDroppedNotification
+             object:self
+             userInfo:@{IJKMPMoviePlayerCachedPacketsDroppedDurationKey: @(avmsg->arg1),
+                        IJKMPMoviePlayerCachedPacketsDroppedCountKey: @(avmsg->arg2)}];
+            break;
+        }
+        case FFP_MSG_INTERCOM_ERROR: {
+            NSLog(@"FFP_MSG_INTERCOM_ERROR: %d\n", avmsg->arg1);
+            [[NSNotificationCenter defaultCenter]
+             postNotificationName:IJKMPMoviePlayerIntercomErrorNotification
+             object:self
+             userInfo:@{IJKMPMoviePlayerIntercomErrorKey: @(avmsg->arg1)}];
+            break;
+        }
         case FFP_MSG_VIDEO_DECODER_OPEN: {
             _isVideoToolboxOpen = avmsg->arg1;
             NSLog(@"FFP_MSG_VIDEO_DECODER_OPEN: %@\n", _isVideoToolboxOpen ? @"true" : @"false");
@@ -1637,9 +1653,9 @@ void screenshot_callback_(char *filepath, void *ffp) {
     
     //    [self stopHudTimer];
     //ijkmp_pause(_mediaPlayer);
-    ijkmp_set_option(_mediaPlayer, IJKMP_OPT_CATEGORY_PLAYER, "local_record_start", "1");
     NSString *fileName = [NSString stringWithFormat:@"%@/%ld.mp4", recorderRootPath, (long)[[NSDate date] timeIntervalSince1970]*1000];
-    ijkmp_set_option(_mediaPlayer, IJKMP_OPT_CATEGORY_PLAYER, "local_record_filename", [fileName UTF8String]);
+    if (ijkmp_start_record(_mediaPlayer, [fileName UTF8String]) < 0)
+        return nil;
 //    mwmp_start_recorder(_mediaPlayer, [recorderRootPath UTF8String]);
     return fileName;
 }
@@ -1647,7 +1663,7 @@ void screenshot_callback_(char *filepath, void *ffp) {
 - (void)stopRec{
     if(!_mediaPlayer)
         return;
-    ijkmp_set_option(_mediaPlayer, IJKMP_OPT_CATEGORY_PLAYER, "local_record_start", "0");
+    ijkmp_stop_record(_mediaPlayer);
 //    mwmp_stop_recorder(_mediaPlayer);
 }
 
@@ -162,6 +162,14 @@ IJK_EXTERN NSString *const IJKMPMoviePlayerDidSeekCompleteNotification;
 IJK_EXTERN NSString *const IJKMPMoviePlayerDidSeekCompleteTargetKey;
 IJK_EXTERN NSString *const IJKMPMoviePlayerDidSeekCompleteErrorKey;
 
+IJK_EXTERN NSString *const IJKMPMoviePlayerCachedPacketsDroppedNotification;
+IJK_EXTERN NSString *const IJKMPMoviePlayerCachedPacketsDroppedDurationKey;
+IJK_EXTERN NSString *const IJKMPMoviePlayerCachedPacketsDroppedCountKey;
+
+// intercom stopped on an error, capture is stopped
+IJK_EXTERN NSString *const IJKMPMoviePlayerIntercomErrorNotification;
+IJK_EXTERN NSString *const IJKMPMoviePlayerIntercomErrorKey;
+
 @end
 
 #pragma mark IJKMediaUrlOpenDelegate
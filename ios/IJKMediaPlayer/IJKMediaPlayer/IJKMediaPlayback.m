@@ -43,6 +43,13 @@ NSString *const IJKMPMoviePlayerDidSeekCompleteNotification = @"IJKMPMoviePlayer
 NSString *const IJKMPMoviePlayerDidSeekCompleteTargetKey = @"IJKMPMoviePlayerDidSeekCompleteTargetKey";
 NSString *const IJKMPMoviePlayerDidSeekCompleteErrorKey = @"IJKMPMoviePlayerDidSeekCompleteErrorKey";
 
+NSString *const IJKMPMoviePlayerCachedPacketsDroppedNotification = @"IJKMPMoviePlayerCachedPacketsDroppedNotification";
+NSString *const IJKMPMoviePlayerCachedPacketsDroppedDurationKey = @"IJKMPMoviePlayerCachedPacketsDroppedDurationKey";
+NSString *const IJKMPMoviePlayerCachedPacketsDroppedCountKey = @"IJKMPMoviePlayerCachedPacketsDroppedCountKey";
+
+NSString *const IJKMPMoviePlayerIntercomErrorNotification = @"IJKMPMoviePlayerIntercomErrorNotification";
+NSString *const IJKMPMoviePlayerIntercomErrorKey = @"IJKMPMoviePlayerIntercomErrorKey";
+
 @implementation IJKMediaUrlOpenData {
     NSString *_url;
     BOOL _handled;